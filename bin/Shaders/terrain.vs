@@ -17,14 +17,92 @@ out vec3 CameraPos;
 
 uniform mat4 modelMat;
 
+//*****************
+// Height Map Data
+//*****************
+// With heightMap.enabled the vertex attributes are not
+// used. Each mesh is drawn with base vertex mesh*edge*edge,
+// so gl_VertexID gives the mesh and the vert inside it,
+// and the vert is rebuilt from the R16 height texture.
+struct HeightMap {
+    int enabled;
+    int sobel; // Sobel normals, else central differences
+    int edge; // Verts per mesh edge
+    int subdiv; // Meshes per terrain edge
+    float spacing; // Distance between verts
+    float heightMult;
+    float midpoint;
+    sampler2D heights;
+};
+uniform HeightMap heightMap;
+
+float FetchHeight(ivec2 p)
+{
+	ivec2 size=textureSize(heightMap.heights,0);
+	p=clamp(p,ivec2(0),size-1);
+	return texelFetch(heightMap.heights,p,0).r*65535.0f;
+}
+
+void HeightMapVertex(out vec3 pos,out vec2 tex,out vec3 norm)
+{
+	int meshVerts=heightMap.edge*heightMap.edge;
+	int mesh=gl_VertexID/meshVerts;
+	int local=gl_VertexID-mesh*meshVerts;
+
+	// Grid position in the whole terrain (x=column, y=row)
+	ivec2 p=ivec2(local%heightMap.edge,local/heightMap.edge);
+	p+=(heightMap.edge-1)*ivec2(mesh%heightMap.subdiv,mesh/heightMap.subdiv);
+
+	ivec2 size=textureSize(heightMap.heights,0);
+	float shift=heightMap.spacing*float(size.x-1)/2.0f;
+
+	pos=vec3(float(p.x)*heightMap.spacing-shift,
+	         heightMap.heightMult*(FetchHeight(p)-heightMap.midpoint),
+	         float(p.y)*heightMap.spacing-shift);
+	tex=vec2(p);
+
+	// Same differences as HeightNormals, one sided at the edges
+	ivec2 lo=max(p-1,ivec2(0));
+	ivec2 hi=min(p+1,size-1);
+
+	float dx,dz;
+	if (heightMap.sobel!=0)
+	{
+		dx=( FetchHeight(ivec2(hi.x,lo.y))-FetchHeight(ivec2(lo.x,lo.y))
+		   +2.0f*(FetchHeight(ivec2(hi.x,p.y))-FetchHeight(ivec2(lo.x,p.y)))
+		   + FetchHeight(ivec2(hi.x,hi.y))-FetchHeight(ivec2(lo.x,hi.y)) )/4.0f;
+		dz=( FetchHeight(ivec2(lo.x,hi.y))-FetchHeight(ivec2(lo.x,lo.y))
+		   +2.0f*(FetchHeight(ivec2(p.x,hi.y))-FetchHeight(ivec2(p.x,lo.y)))
+		   + FetchHeight(ivec2(hi.x,hi.y))-FetchHeight(ivec2(hi.x,lo.y)) )/4.0f;
+	}
+	else
+	{
+		dx=FetchHeight(ivec2(hi.x,p.y))-FetchHeight(ivec2(lo.x,p.y));
+		dz=FetchHeight(ivec2(p.x,hi.y))-FetchHeight(ivec2(p.x,lo.y));
+	}
+
+	float gx=(hi.x>lo.x) ? heightMap.heightMult*dx/(heightMap.spacing*float(hi.x-lo.x)) : 0.0f;
+	float gz=(hi.y>lo.y) ? heightMap.heightMult*dz/(heightMap.spacing*float(hi.y-lo.y)) : 0.0f;
+
+	norm=normalize(vec3(-gx,1.0f,-gz));
+}
+
 void main()
 {
-	gl_Position=projMat * viewMat * modelMat * vec4(position, 1.0f);
-	
+	vec3 pos=position;
+	vec2 tex=texture;
+	vec3 norm=normal;
+
+	if (heightMap.enabled!=0)
+	{
+		HeightMapVertex(pos,tex,norm);
+	}
+
+	gl_Position=projMat * viewMat * modelMat * vec4(pos, 1.0f);
+
 	// Variables passed to the frangment shader
-	Position=vec3(modelMat * vec4(position, 1.0f));
-	Normal=normal;
-	TexCoord=vec2(texture.x,1.0f-texture.y);
+	Position=vec3(modelMat * vec4(pos, 1.0f));
+	Normal=norm;
+	TexCoord=vec2(tex.x,1.0f-tex.y);
 	CameraPos=camPos;
 }
-
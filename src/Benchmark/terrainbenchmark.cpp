@@ -0,0 +1,207 @@
+#include "terrainbenchmark.h"
+#include <sys/resource.h>
+#include <fstream>
+#include <omp.h>
+
+//************************************
+//       Benchmark Defaults
+//************************************
+TerrainBenchmark::TerrainBenchmark()
+{
+    sizes = ParseList("257,513,1025,2049,4097,8193");
+
+    // 1,2,4... up to the available threads
+    int maxThreads=omp_get_max_threads();
+    for (int t=1; t<maxThreads; t*=2)
+    {
+        threads.push_back(t);
+    }
+    threads.push_back(maxThreads);
+
+    reps=3;
+    nsmooth=8;
+    erodeIters=10;
+    subdiv=2;
+    seed=1234;
+};
+
+//************************************
+//         Parse Input Flags
+//************************************
+bool TerrainBenchmark::Init(int argc,char *argv[])
+{
+    for (int i=1; i<argc; ++i)
+    {
+        std::string flag(argv[i]);
+        if (i+1>=argc)
+        {
+            std::cerr << "Missing value for " << flag << std::endl;
+            return false;
+        }
+
+        std::string val(argv[++i]);
+
+        if      (flag.compare("-s")==0) {sizes=ParseList(val);}
+        else if (flag.compare("-t")==0) {threads=ParseList(val);}
+        else if (flag.compare("-r")==0) {reps=std::max(1,atoi(val.c_str()));}
+        else if (flag.compare("-n")==0) {nsmooth=std::max(0,atoi(val.c_str()));}
+        else if (flag.compare("-e")==0) {erodeIters=std::max(0,atoi(val.c_str()));}
+        else if (flag.compare("-o")==0) {outFile=val;}
+        else
+        {
+            std::cerr << "Unknown flag " << flag << std::endl;
+            return false;
+        }
+    }
+
+    for (int i=0; i<(int)sizes.size(); ++i)
+    {
+        int n=sizes[i]-1;
+        if (n<4 || (n & (n-1))!=0)
+        {
+            std::cerr << "Terrain size must be 2^n+1: " << sizes[i] << std::endl;
+            return false;
+        }
+    }
+
+    return !sizes.empty() && !threads.empty();
+};
+
+//************************************
+//      Run All Benchmark Cases
+//************************************
+int TerrainBenchmark::Run()
+{
+    std::ofstream file;
+    if (!outFile.empty())
+    {
+        file.open(outFile.c_str());
+        if (!file.is_open())
+        {
+            std::cerr << "Unable to open " << outFile << std::endl;
+            return 1;
+        }
+    }
+
+    // The engine logs to std::cout, send that to stderr so stdout only holds CSV
+    std::streambuf *stdoutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+    std::ostream out(outFile.empty() ? stdoutBuf : file.rdbuf());
+    out << "size,threads,verts,stage,seconds,mverts_per_s,peak_rss_mb" << std::endl;
+
+    for (int s=0; s<(int)sizes.size(); ++s)
+    {
+        for (int t=0; t<(int)threads.size(); ++t)
+        {
+            std::cerr << "Running size " << sizes[s] << " threads " << threads[t] << std::endl;
+            RunCase(sizes[s],threads[t],out);
+        }
+    }
+
+    std::cout.rdbuf(stdoutBuf);
+    return 0;
+};
+
+//************************************
+//      Run a Single Benchmark Case
+//************************************
+/*
+Stages are timed one by one, in the same order
+GenerateTerrain/SetupVerts run them.
+*/
+void TerrainBenchmark::RunCase(int size,int nthreads,std::ostream &out)
+{
+    const int NSTAGE=6;
+    const char *names[NSTAGE] = {"generate","smooth","erode","indices","verts","normals"};
+    double best[NSTAGE];
+    for (int k=0; k<NSTAGE; ++k)
+    {
+        best[k]=1.0e30;
+    }
+
+    omp_set_num_threads(nthreads);
+
+    TerrainGeneration terrain;
+    terrain.SetupTerrainCreationParameters(size,0,glm::ivec3(500,150,150),seed);
+    terrain.subdiv=subdiv;
+
+    ErosionSettings erosion;
+    erosion.iterations=erodeIters;
+
+    HeightSmoother smoother;
+
+    for (int r=0; r<reps; ++r)
+    {
+        double ts[NSTAGE+1];
+
+        // Every rep builds from scratch, not from the graph's tile cache
+        terrain.graph.ClearCache();
+
+        ts[0]=omp_get_wtime();
+        terrain.GenerateTerrainData(size);
+
+        ts[1]=omp_get_wtime();
+        smoother.Smooth(terrain.HeightData,terrain.smoothKernel,nsmooth);
+
+        ts[2]=omp_get_wtime();
+        terrain.eroder.Erode(terrain.HeightData,erosion,seed);
+
+        ts[3]=omp_get_wtime();
+        terrain.SetupSubMeshes();
+
+        ts[4]=omp_get_wtime();
+        terrain.RecalculateMaxMinHeights();
+        terrain.RecalculateVerticies();
+
+        ts[5]=omp_get_wtime();
+        terrain.RecalculateNormals();
+
+        ts[6]=omp_get_wtime();
+
+        for (int k=0; k<NSTAGE; ++k)
+        {
+            best[k]=std::min(best[k],ts[k+1]-ts[k]);
+        }
+    }
+
+    double nverts=(double)size*(double)size;
+    double peak=PeakMemoryMB();
+
+    for (int k=0; k<NSTAGE; ++k)
+    {
+        double work = (k==2) ? nverts*erodeIters : nverts;
+        double rate = best[k]>0.0 ? work/best[k]/1.0e6 : 0.0;
+        out << size << "," << nthreads << "," << (long long int)nverts << "," << names[k] << ","
+            << best[k] << "," << rate << "," << peak << std::endl;
+    }
+};
+
+//************************************
+//        Parse a Comma List
+//************************************
+std::vector<int> TerrainBenchmark::ParseList(const std::string &list)
+{
+    std::vector<int> vals;
+    std::stringstream ss(list);
+    std::string item;
+
+    while (std::getline(ss,item,','))
+    {
+        int val=atoi(item.c_str());
+        if (val>0)
+        {
+            vals.push_back(val);
+        }
+    }
+
+    return vals;
+};
+
+//************************************
+//      Peak Resident Memory (MB)
+//************************************
+double TerrainBenchmark::PeakMemoryMB()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return usage.ru_maxrss/1024.0; // ru_maxrss is in kB on linux
+};
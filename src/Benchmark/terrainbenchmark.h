@@ -0,0 +1,67 @@
+#ifndef TERRAINBENCHMARK_H
+#define TERRAINBENCHMARK_H
+
+#include "../Headers/headerscpp.h"
+#include "../Engine/DevTools/TerrainGenerator/terrainGenerator.h"
+#include <iostream>
+
+//      *************************************************************     //
+//                          Terrain Benchmark Class
+//               Times the CPU stages of the terrain pipeline
+//      *************************************************************     //
+/*
+    Runs the terrain pipeline without a window or
+    GL context and writes one CSV line per stage:
+
+        size,threads,verts,stage,seconds,mverts_per_s,peak_rss_mb
+
+    Stages are generate (diamond-square), smooth,
+    erode (hydraulic/thermal erosion), indices
+    (sub-mesh split), verts (max/min + positions)
+    and normals. Every case is run reps times and
+    the fastest run is reported. The erode rate
+    counts every iteration over every vert.
+    peak_rss_mb is the process peak so far, so
+    sizes are run smallest first.
+
+    Flags:
+        -s 257,513,...  terrain sizes (2^n+1)
+        -t 1,2,4,...    thread counts
+        -r N            repetitions per case
+        -n N            smoothing cycles
+        -e N            erosion iterations (0 skips)
+        -o file         write the CSV to file
+*/
+class TerrainBenchmark
+{
+    //--------------------------
+    //     Run Parameters
+    //--------------------------
+    std::vector<int> sizes;
+    std::vector<int> threads;
+    int reps;
+    int nsmooth;
+    int erodeIters;
+    int subdiv;
+    unsigned int seed;
+    std::string outFile;
+
+    //------------------------------
+    //Private Member Class Functions
+    //------------------------------
+    static std::vector<int> ParseList(const std::string &list);
+    static double PeakMemoryMB();
+
+    void RunCase(int size,int nthreads,std::ostream &out);
+
+public:
+    TerrainBenchmark();
+
+    // Read the flags, returns false on bad input
+    bool Init(int argc,char *argv[]);
+
+    // Run every size/thread combination
+    int Run();
+};
+
+#endif
@@ -1,219 +1,638 @@
 #include "terrainGenerator.h"
 #include <omp.h>
 #include <math.h>
+#include <limits>
 
 //******************************************//
 //             Allocate Data                //
 //******************************************//
 /*
-Allocate height data.
+Allocate a size x size height field.
 */
-void TerrainGeneration::AllocateData(int size)
+bool TerrainGeneration::AllocateData(HeightField16 &field,int size)
 {
-    int h = size;
-    int w = size;
+    if (!field.Allocate(size,size))
+    {
+        Console::cPrint("Failed to allocate Height Data!");
+        return false;
+    }
 
-    long long int memSize = h*w*sizeof(int);
+    long long int memSize = field.MemSize();
     Console::cPrint(tools::appendStrings("Required Memory for Height Data: ",memSize/(float)(1024*1024),"MB"));
+    field.Fill(0);
+    return true;
+};
+
+//******************************************//
+//          Generate Height Data            //
+//******************************************//
+/*
+Build the height data in place, on the calling
+thread (see BuildHeightData).
+*/
+void TerrainGeneration::GenerateTerrainData(int terrainSize)
+{
+    // Replaces whatever a background build would have delivered
+    job.Cancel();
+    sizeScale/=shownStride;
+    shownStride=1;
+
+    // Live erosion state belongs to the old terrain
+    eroder.Cleanup();
+
+    BuildSettings set=GetBuildSettings(terrainSize);
+    buildSeed=set.seed;
+    lastSeed=set.seed;
+    this->terrainSize=terrainSize;
+    ChangeHeightScale(1.0f);
+
+    ConfigureGraph(set,NULL);
+    BuildHeightData(HeightData,set,graph,NULL);
+};
 
-    if(!HeightData.empty())
+//******************************************//
+//         Snapshot the Build Settings      //
+//******************************************//
+/*
+A seed of 0 asks for a fresh random terrain, unless
+only the settings behind the heights (blur, erosion,
+output) changed since the last build: then that
+build's seed is kept, so the heights and their
+cached tiles stay and only the later nodes are built
+again. Building again with nothing changed gives a
+new terrain.
+*/
+TerrainGeneration::BuildSettings TerrainGeneration::GetBuildSettings(int size)
+{
+    BuildSettings set;
+    set.size=size;
+    set.NSmooth=NSmooth;
+    set.heightVariation=heightVariation;
+    set.generator=generator;
+    set.noise=NoiseSettings();
+    set.kernel=smoothKernel;
+    set.erosion=erosion;
+    set.output=graphOutput;
+    set.stages = 2 + (erosion.iterations>0 ? 1 : 0) + (graphOutput>NODE_EROSION ? 1 : 0);
+
+    uint64_t heights,rest;
+    SettingsKeys(set,heights,rest);
+
+    const bool downstreamOnly = buildSeed!=0 && heights==heightsKey && rest!=restKey;
+    set.clockSeed = (seed==0 && !downstreamOnly);
+    if (seed!=0)
     {
-        for (int i=0; i<(int)HeightData.size(); ++i)
-        {
-            HeightData[i].clear();
-        }
-        HeightData.clear();
+        set.seed=seed;
+    }
+    else
+    {
+        set.seed = set.clockSeed ? CounterRandom::ClockSeed() : buildSeed;
     }
 
-    HeightData.resize(h);
+    heightsKey=heights;
+    restKey=rest;
+    return set;
+};
+
+// Hashes of the settings the heights are built from (the seed aside) and of all others
+void TerrainGeneration::SettingsKeys(const BuildSettings &set,uint64_t &heights,uint64_t &rest)
+{
+    uint64_t h=HeightGraph::HashBytes(&set.size,sizeof(set.size));
+    auto add=[&h](const void *data,size_t bytes) {h=HeightGraph::HashBytes(data,bytes,h);};
+
+    int type=set.noise.type;
+    add(&set.heightVariation[0],3*sizeof(int));
+    add(&set.generator,sizeof(set.generator));
+    add(&type,sizeof(type));
+    add(&set.noise.wavelength,sizeof(float));
+    add(&set.noise.octaves,sizeof(int));
+    add(&set.noise.lacunarity,sizeof(float));
+    add(&set.noise.gain,sizeof(float));
+    add(&set.noise.warp,sizeof(float));
+    heights=h;
+
+    const ErosionSettings &e=set.erosion;
+    int kernel=set.kernel;
+    h=HeightGraph::HashBytes(&set.NSmooth,sizeof(set.NSmooth));
+    add(&kernel,sizeof(kernel));
+    add(&set.output,sizeof(set.output));
+    add(&e.iterations,sizeof(int));
+    add(&e.rain,sizeof(float));
+    add(&e.evaporation,sizeof(float));
+    add(&e.flow,sizeof(float));
+    add(&e.capacity,sizeof(float));
+    add(&e.minSlope,sizeof(float));
+    add(&e.erosion,sizeof(float));
+    add(&e.deposition,sizeof(float));
+    add(&e.maxErosion,sizeof(float));
+    add(&e.talus,sizeof(float));
+    add(&e.thermal,sizeof(float));
+    rest=h;
+};
+
+//******************************************//
+//         Coarse Copy for a Preview        //
+//******************************************//
+static void PublishCoarse(const HeightField16 &field,int stride,HeightBuildJob *job)
+{
+    const int n=(field.Width()-1)/stride+1;
+    HeightField16 coarse(n,n);
 
-    for (int i=0; i<h; ++i)
+    #pragma omp parallel for schedule(static)
+    for (int i=0; i<n; ++i)
     {
-        HeightData[i].resize(w);
+        const uint16_t *src=field.Row(i*stride);
+        uint16_t *dst=coarse.Row(i);
+        for (int j=0; j<n; ++j)
+        {
+            dst[j]=src[j*stride];
+        }
     }
+
+    job->PublishPreview(coarse,stride);
 };
 
 //******************************************//
-//          Generate Height Data            //
+//          Configure the Graph             //
 //******************************************//
 /*
-Generate the height data based on the mid-point formula.
+Set the fixed nodes from set. Nodes whose
+parameters did not change keep their hashes, and
+so their cached tiles. Call only while no build
+runs, the worker reads the graph.
+
+The cache keeps about one world per node and one
+more, so undoing the last tweak finds its tiles.
+A fresh clock seed makes every cached tile useless,
+so they are dropped.
 */
-void TerrainGeneration::GenerateTerrainData(int terrainSize)
+void TerrainGeneration::ConfigureGraph(const BuildSettings &set,HeightBuildJob *job)
 {
+    graph.SetWorld(set.size,set.size);
+    if (set.clockSeed)
+    {
+        graph.ClearCache();
+    }
 
-    int h = terrainSize;
-    int w = h;
+    const size_t world=(size_t)set.size*set.size*sizeof(uint16_t);
+    graph.SetBudget(std::min(world*(graph.GetNodes()+1),(size_t)256*1024*1024));
 
-    AllocateData(terrainSize);
+    if (set.generator>0)
+    {
+        HeightGraph::Params heights;
+        heights.seed=set.seed;
+        heights.noise=set.noise;
+        graph.SetNode(NODE_HEIGHTS,HeightGraph::OP_NOISE,heights);
+    }
+    else
+    {
+        // The key holds everything the midpoint displacement reads
+        uint64_t key=HeightGraph::HashBytes(&set.size,sizeof(set.size));
+        key=HeightGraph::HashBytes(&set.heightVariation[0],3*sizeof(int),key);
+        key=HeightGraph::HashBytes(&set.seed,sizeof(set.seed),key);
 
-    //Choose 4 random pixel colors to initialize
-    RandomInteger RandC(4,clock());
+        graph.SetSource(NODE_HEIGHTS,[set,job](HeightField16 &field)
+        {
+            return MidpointHeights(field,set,job);
+        },key);
+    }
 
-    //HeightData[  0  ][  0  ] = RandC.GenRandInt(50,100);
-    //HeightData[  0  ][ w-1 ] = RandC.GenRandInt(50,100);
-    //HeightData[ h-1 ][  0  ] = RandC.GenRandInt(50,100);
-    //HeightData[ h-1 ][ w-1 ] = RandC.GenRandInt(50,100);
+    HeightGraph::Params blur;
+    blur.kernel=set.kernel;
+    blur.passes=set.NSmooth;
+    graph.SetNode(NODE_BLUR,HeightGraph::OP_BLUR,blur,NODE_HEIGHTS);
 
-    // Max is 1000, Min is 0
-    HeightData[  0  ][  0  ] = heightVariation.x;
-    HeightData[  0  ][ w-1 ] = heightVariation.x;
-    HeightData[ h-1 ][  0  ] = heightVariation.x;
-    HeightData[ h-1 ][ w-1 ] = heightVariation.x;
+    HeightGraph::Params erode;
+    erode.seed=set.seed;
+    erode.erosion=set.erosion;
+    graph.SetNode(NODE_EROSION,HeightGraph::OP_EROSION,erode,NODE_BLUR);
+};
 
-    //std::cout << "Beginning Fra\n";
-    Console::cPrint("Computing Height Data...");
-    //std::cout << "[" << HeightData[0][0] << "," << HeightData[0][w-1] << "]" << std::endl;
-    //std::cout << "[" << HeightData[h-1][0] << "," << HeightData[h-1][w-1] << "]" << std::endl;
-    std::vector<Box> Boxes;
+//******************************************//
+//            Build Height Data             //
+//******************************************//
+/*
+Evaluate the graph output for the whole terrain
+into field. This only reads set and the graph, so
+the same code runs in place or on a worker thread
+beside the editor. The stages are the graph
+nodes:
+
+    1) Heights, either midpoint displacement or
+       a noise generator
+    2) Blur passes
+    3) Erosion (only with erosion iterations)
+    4) Nodes added behind these
+
+Stages whose tiles are all cached are skipped.
+
+With a job the stage messages go through
+job->Report, which prints them and keeps them as
+the build status, the build stops between steps
+once cancelled (returning false), and coarse
+previews (257 and 1025 verts wide, when at least
+4x smaller than the terrain) are published as soon
+as their verts are final: on the midpoint level
+that completes their grid, or for the noise by
+evaluating it on the coarse grid first. Previews
+show the heights before blur and erosion.
+*/
+bool TerrainGeneration::BuildHeightData(HeightField16 &field,const BuildSettings &set,HeightGraph &graph,HeightBuildJob *job)
+{
+    const int h = set.size;
+    const HeightRect all(0,h,0,h);
 
-    Box box1(0,0,0,w-1,h-1,0,h-1,w-1);
-    Boxes.push_back(box1);
+    if (!AllocateData(field,h))
+    {
+        return false;
+    }
 
-    bool chkfin=false;
-    int cycle=0;
-    //RandomInt RI(pow(2,16),100+cycle);
+    Console::cPrint(tools::appendStrings("Terrain Seed: ",set.seed));
 
-    //****************************************************************
-    //Calculate Initial Height map via midpoint displacement algorithm
-    //****************************************************************
-    while (!chkfin)
+    //**************************************************
+    //  Noise previews, unless the heights are cached
+    //**************************************************
+    if (job && set.generator>0 && !graph.IsCached(NODE_HEIGHTS,all))
     {
-        ++cycle;
-        Console::cPrint(tools::appendStrings(" Cycle: ",cycle));
-        int N = Boxes.size();
-        //RandomInt RI(N,100+cycle);
+        HeightNoise noise;
+        noise.Setup(set.noise,set.seed);
 
-        int hvlow=heightVariation.y;
-        int hvhigh=heightVariation.z;
-
-        RandomInteger RI(6*N,clock());
-        for (int k = 0; k<(int)N; ++k)
+        const int edges[2] = {257,1025};
+        for (int k=0; k<2; ++k)
         {
-            //std::cout << "   Box: " << k << std::endl;
-            int RandomMPeak = RI.GenRandInt(-hvlow/cycle,hvhigh/cycle);
-            int RandomEPeak = RI.GenRandInt(-hvlow/cycle,hvhigh/cycle);
-            //int RandomPeak = 0;
-            Boxes[k].SetMiddle(HeightData,RandomMPeak);
-            Boxes[k].SetEdge(HeightData,RandomEPeak);
+            int stride=(h-1)/(edges[k]-1);
+            if (stride<4 || (h-1)%(edges[k]-1)!=0)
+            {
+                continue;
+            }
+
+            HeightField16 coarse((h-1)/stride+1,(h-1)/stride+1);
+            noise.Fill(coarse,0,0,stride);
+            if (!job->Report(1,set.stages,"",0.0f))
+            {
+                return false;
+            }
+            job->PublishPreview(coarse,stride);
         }
+    }
 
-        //Boxes[0].PrintBoxIdx();
-        std::vector<Box> cpBoxes = Boxes;
-        //cpBoxes[0].PrintBoxIdx();
-        Boxes.clear();
+    //******************************
+    //  Report Node by Node
+    //******************************
+    int running=-1;
+    double ts=0.0;
 
-        for  (int l = 0; l<(int)cpBoxes.size(); ++l)
+    auto progress=[&](int node,float fraction) -> bool
+    {
+        if (fraction<=0.0f)
         {
-            chkfin = cpBoxes[l].ProduceNewIdx(Boxes);
-            //std::cout << "chkfin: " << chkfin << std::endl;
+            const int stage = node<=NODE_EROSION ? node+1 : set.stages;
+            std::string message;
+            switch (node)
+            {
+                case NODE_HEIGHTS: message="Computing Height Data..."; break;
+                case NODE_BLUR: message="Running Height Map Blur Cycles..."; break;
+                case NODE_EROSION: message="Running Erosion..."; break;
+                default: message=tools::appendStrings("Running Graph Node ",node,"..."); break;
+            }
+
+            running=node;
+            ts=omp_get_wtime();
+
+            if (job)
+            {
+                return job->Report(stage,set.stages,message,0.0f);
+            }
+            Console::cPrint(message);
+            return true;
         }
 
-        //std::cout << "NUMBOXES: " << Boxes.size() << std::endl;
-    }
+        // Done is reported by the node and again by the graph
+        if (fraction>=1.0f && running==node)
+        {
+            running=-1;
+            if (node==NODE_BLUR)
+            {
+                Console::cPrint(tools::appendStrings("   Cycles: ",set.NSmooth," Time: ",(omp_get_wtime()-ts)*1000.0,"ms"));
+            }
+            else if (node==NODE_EROSION)
+            {
+                Console::cPrint(tools::appendStrings("   Iterations: ",set.erosion.iterations," Time: ",(omp_get_wtime()-ts)*1000.0,"ms"));
+            }
+        }
+
+        return job ? job->Report(fraction) : true;
+    };
 
-    for (int k = 0; k<(int)Boxes.size(); ++k)
+    const long long built=graph.GetBuiltTiles();
+    if (!graph.Evaluate(set.output,all,field,progress,job ? job->CancelFlag() : NULL))
     {
-        Boxes[k].SetMiddle(HeightData,0);
-        Boxes[k].SetEdge(HeightData,0);
+        return false;
     }
 
-    /*for (int i=0;i<terrainSize;++i)
+    Console::cPrint(tools::appendStrings("   Graph tiles built: ",graph.GetBuiltTiles()-built));
+    return true;
+};
+
+//******************************************//
+//         Midpoint Displacement            //
+//******************************************//
+/*
+Source of NODE_HEIGHTS for generator 0, fills the
+whole field.
+
+Midpoint displacement refines the grid level by
+level. On each level the box edge length (step)
+halves, and the positions of the new points follow
+directly from the level, so no lists of boxes are
+needed. All points of a step only depend on points
+set by earlier steps, which makes every row of a
+step independent and lets it run in parallel.
+*/
+bool TerrainGeneration::MidpointHeights(HeightField16 &field,const BuildSettings &set,HeightBuildJob *job)
+{
+    const int h = field.Height();
+    const int w = field.Width();
+
+    // Preview strides, coarsest first
+    std::vector<int> strides;
+    if (job)
     {
-        std::cout << "[";
-        for (int j=0;j<terrainSize;++j)
+        const int edges[2] = {257,1025};
+        for (int k=0; k<2; ++k)
         {
-            std::cout << HeightData[i][j] << ",";
+            int stride=(h-1)/(edges[k]-1);
+            if (stride>=4 && (h-1)%(edges[k]-1)==0)
+            {
+                strides.push_back(stride);
+            }
         }
-        std::cout << "]" << std::endl;
-    }*/
+    }
+    size_t nextPreview=0;
 
-    //******************************
-    //Blur image For Smoothness
-    //******************************
-    Console::cPrint("Running Height Map Blur Cycles...");
-    //std::cout << "Running Height Map Blur Cycles..." << "\n";
-    for (int l=0; l<NSmooth; ++l)
+    CounterRandom rng(set.seed);
+
+    // Max is 1000, Min is 0
+    field(  0  ,  0  ) = set.heightVariation.x;
+    field(  0  , w-1 ) = set.heightVariation.x;
+    field( h-1 ,  0  ) = set.heightVariation.x;
+    field( h-1 , w-1 ) = set.heightVariation.x;
+
+    int cycle=0;
+
+    //****************************************************************
+    //Calculate Initial Height map via midpoint displacement algorithm
+    //****************************************************************
+    for (int step=w-1; step>1; step/=2)
     {
-        std::vector< std::vector<int> > TempData = HeightData;
-        //std::cout << "   Cycle: " << l << "\n";
-        Console::cPrint(tools::appendStrings("   Cycle: ",l));
+        ++cycle;
 
-        #pragma omp parallel for
-        for (int j = 0; j<h; ++j)
+        // Levels above this one hold 1/step^2 of the points
+        const std::string message=tools::appendStrings(" Cycle: ",cycle);
+        if (job)
         {
-            for (int i = 0; i<w; ++i)
+            if (!job->Report(1,set.stages,message,1.0f/((float)step*step)))
             {
-                int NewVal = AverageHeights(i,j,TempData,terrainSize);
-
-                HeightData[i][j] = NewVal;
+                return false;
             }
         }
-        #pragma omp barrier
+        else
+        {
+            Console::cPrint(message);
+        }
+
+        // The last level only interpolates
+        int hvlow=0;
+        int hvhigh=0;
+        if (step>2)
+        {
+            hvlow=set.heightVariation.y/cycle;
+            hvhigh=set.heightVariation.z/cycle;
+        }
+
+        SquareStep(field,step,cycle,rng,hvlow,hvhigh);
+        DiamondStep(field,step,cycle,rng,hvlow,hvhigh);
+
+        // The grid of spacing step/2 is final now
+        if (nextPreview<strides.size() && step/2==strides[nextPreview])
+        {
+            PublishCoarse(field,strides[nextPreview++],job);
+        }
     }
+
+    return true;
 };
 
 //******************************************//
-//          Average the heights            //
+//          Background Generation           //
 //******************************************//
 /*
-Average the heights, this helps smooth the terrain
-after generation.
+Build the creation parameters on a worker thread,
+cancelling a build still running. The terrain on
+screen stays until UpdateGeneration() swaps in a
+preview or the result.
 */
-int TerrainGeneration::AverageHeights(int i,int j, std::vector< std::vector<int> > &data,int size)
+void TerrainGeneration::StartGeneration()
 {
-    int h = size;
-    int w = h;
+    // Live erosion would write into heights about to be replaced
+    StopErosion();
+
+    // The worker reads the graph, the old build stops before it changes
+    job.Cancel();
 
-    int im1 = i-1;
-    int ip1 = i+1;
-    int jm1 = j-1;
-    int jp1 = j+1;
+    Console::cPrint("Generating Terrain Data:");
+    Console::cPrint(tools::appendStrings("Terain Size: ",createSize),true);
 
-    //Periodic Conditions
-    if (im1 < 0)
+    BuildSettings set=GetBuildSettings(createSize);
+    buildSeed=set.seed;
+    ConfigureGraph(set,&job);
+
+    job.Start([this,set](HeightBuildJob &j,HeightField16 &field)
     {
-        im1=w-1;
-    }
+        return BuildHeightData(field,set,graph,&j);
+    });
+};
 
-    if (ip1 > w-1)
+/*
+Call once a frame. A preview is drawn with its verts
+stride times further apart, so it covers the same
+ground as the finished terrain. The swapped out
+heights become the back buffer of the next build.
+*/
+bool TerrainGeneration::UpdateGeneration()
+{
+    int stride=1;
+    bool result=job.TakeResult(HeightData);
+    if (!result && !job.TakePreview(HeightData,stride))
     {
-        ip1=0;
+        return false;
     }
 
-    if (jm1 < 0)
+    eroder.Cleanup();
+    sizeScale=sizeScale/shownStride*stride;
+    shownStride=stride;
+    terrainSize=HeightData.Width();
+    ChangeHeightScale(1.0f);
+
+    if (result)
+    {
+        lastSeed=buildSeed;
+        Console::cPrint("Setting up Verts:");
+    }
+    else
     {
-        jm1=h-1;
+        Console::cPrint(tools::appendStrings("Preview: ",terrainSize,"x",terrainSize," verts"));
     }
 
-    if (jp1 > h-1)
+    SetupVerts();
+    SetTerrainOnGPU();
+    return true;
+};
+
+void TerrainGeneration::CancelGeneration()
+{
+    if (job.IsRunning())
     {
-        jp1=0;
+        Console::cPrint("Terrain generation cancelled");
     }
+    job.Cancel();
+};
+
+//******************************************//
+//          Setup the Noise Generator       //
+//******************************************//
+/*
+The creation parameters keep their meaning: the
+initial height is the height of noise value 0, the
+drop and rise how far the noise reaches below and
+above it.
+*/
+HeightNoise::Settings TerrainGeneration::NoiseSettings()
+{
+    HeightNoise::Settings set=noiseSettings;
+    set.type=(HeightNoise::Type)(std::max(generator,1)-1);
+    set.base=heightVariation.x;
+    set.drop=heightVariation.y;
+    set.rise=heightVariation.z;
+    set.maxHeight=1000.0f;
+    return set;
+};
+
+void TerrainGeneration::SetupNoise()
+{
+    noise.Setup(NoiseSettings(),lastSeed);
+};
 
-    std::vector<int> NPix;
+//******************************************//
+//       Clamp Height to Valid Range        //
+//******************************************//
+/*
+Every displaced height is kept in 0..1000, the range
+Box::SetMiddle and Box::SetEdge clamped to before the
+steps were done level by level. Below 0 a height
+would also wrap around in 16 bits.
+*/
+static inline uint16_t ClampHeight(int val)
+{
+    return (uint16_t)(val < 0 ? 0 : (val > 1000 ? 1000 : val));
+};
 
-    NPix.resize(8);
+//******************************************//
+//          Diamond-Square: Square          //
+//******************************************//
+/*
+Set the center of every box of edge length step to the
+average of its four corners minus a random peak.
 
-    NPix[0] = data[im1][jm1];
-    NPix[1] = data[i][jm1];
-    NPix[2] = data[ip1][jm1];
-    NPix[3] = data[im1][j];
-    NPix[4] = data[ip1][j];
-    NPix[5] = data[im1][jp1];
-    NPix[6] = data[i][jp1];
-    NPix[7] = data[ip1][jp1];
+Random peaks are drawn from stream (2*cycle) with the
+box index as the counter.
+*/
+void TerrainGeneration::SquareStep(HeightField16 &field,int step,int cycle,const CounterRandom &rng,int hvlow,int hvhigh)
+{
+    int half = step/2;
+    int nBox = (field.Width()-1)/step;
 
-    //Calculate Average
-    int SUM = 0;
-    for (int k=0; k<8; ++k)
+    #pragma omp parallel
     {
-        SUM += NPix[k];
+        std::vector<int> peaks(nBox,0);
+
+        #pragma omp for schedule(static)
+        for (int bi=0; bi<nBox; ++bi)
+        {
+            if (hvlow!=0 || hvhigh!=0)
+            {
+                rng.FillInts(2*cycle,(uint64_t)bi*nBox,nBox,-hvlow,hvhigh,&peaks[0]);
+            }
+
+            const uint16_t *top = field.Row(bi*step);
+            const uint16_t *bot = field.Row(bi*step+step);
+            uint16_t *mid = field.Row(bi*step+half);
+
+            for (int bj=0; bj<nBox; ++bj)
+            {
+                int j = bj*step;
+                int avg = (top[j]+top[j+step]+bot[j]+bot[j+step])/4;
+                mid[j+half] = ClampHeight(avg-peaks[bj]);
+            }
+        }
     }
+};
+
+//******************************************//
+//          Diamond-Square: Diamond         //
+//******************************************//
+/*
+Set the middle of every box edge to the average of its
+(up to four) diamond neighbours minus a random peak. The
+neighbours are box corners and the box centers set by the
+square step of the same level.
+
+Random peaks are drawn from stream (2*cycle+1) with the
+edge index as the counter.
+*/
+void TerrainGeneration::DiamondStep(HeightField16 &field,int step,int cycle,const CounterRandom &rng,int hvlow,int hvhigh)
+{
+    int half = step/2;
+    int nBox = (field.Width()-1)/step;
+    int nRow = (field.Width()-1)/half;
+    int last = field.Width()-1;
+
+    #pragma omp parallel
+    {
+        std::vector<int> peaks(nBox+1,0);
+
+        #pragma omp for schedule(static)
+        for (int k=0; k<=nRow; ++k)
+        {
+            // Even rows hold horizontal edges, odd rows vertical ones
+            int jstart = (k%2==0) ? half : 0;
+            int nEdge = (k%2==0) ? nBox : nBox+1;
+
+            if (hvlow!=0 || hvhigh!=0)
+            {
+                rng.FillInts(2*cycle+1,(uint64_t)k*(nBox+1),nEdge,-hvlow,hvhigh,&peaks[0]);
+            }
 
-    int AVG = SUM/8;
+            int i = k*half;
+            uint16_t *row = field.Row(i);
+            const uint16_t *up = i>0 ? field.Row(i-half) : NULL;
+            const uint16_t *down = i<last ? field.Row(i+half) : NULL;
 
-    return AVG;
+            for (int e=0; e<nEdge; ++e)
+            {
+                int j = jstart+e*step;
+                int sum = 0;
+                int cnt = 0;
+
+                if (up) {sum+=up[j]; ++cnt;}
+                if (down) {sum+=down[j]; ++cnt;}
+                if (j>0) {sum+=row[j-half]; ++cnt;}
+                if (j<last) {sum+=row[j+half]; ++cnt;}
+
+                row[j] = ClampHeight(sum/cnt-peaks[e]);
+            }
+        }
+    }
 };
 
 //*********************************************
@@ -223,26 +642,52 @@ int TerrainGeneration::AverageHeights(int i,int j, std::vector< std::vector<int>
 Setup the verticies/tex coords based on size and
 data stored in height data.
 */
-void TerrainGeneration::SetupVerts()
+void TerrainGeneration::SetupVerts(bool rangeKnown)
 {
-    int h = terrainSize;
-    int w = terrainSize;
-    int sd = pow(4,subdiv);
-
-    Console::cPrint("Allocating Verts Memory...");
-    verts.resize(w*h);
+    Console::cPrint("Calculating Indicies...");
+    SetupSubMeshes();
 
-    Console::cPrint("Determining Max/Min Heights...");
-    RecalculateMaxMinHeights();
+    if (!rangeKnown)
+    {
+        Console::cPrint("Determining Max/Min Heights...");
+        RecalculateMaxMinHeights();
+    }
 
     Console::cPrint("Calculating Verts...");
     RecalculateVerticies();
+
+    Console::cPrint("Building Pick Pyramid...");
+    picker.SetMapping(sizeScale,heightMult,vertMidpoint);
+    picker.Build(HeightData);
     //HeightData.clear(); // Done with height data
 
+    // A new terrain starts a new sculpt history
+    history.Reset(HeightData.Width(),HeightData.Height());
+
+    // Same mapping for drawing from a height texture
+    SetHeightMap(&HeightData,sizeScale,heightMult,vertMidpoint,normals.GetQuality()==HeightNormals::NORMALS_SOBEL);
+
     Console::cPrint("Calculating Normals...");
     RecalculateNormals();
 
-    Console::cPrint("Calculating Indicies...");
+    Console::cPrint(" Terrain Successfully Setup!",true);
+};
+
+//*********************************************
+//        Setup the Sub-Meshes and Indices
+//*********************************************
+/*
+Split the terrain into pow(4,subdiv) meshes, allocate
+their verts, build the triangle indices shared by all
+meshes and compute the mesh center positions. The
+verts themselves are filled in by UpdateVerticies and
+UpdateNormals.
+*/
+void TerrainGeneration::SetupSubMeshes()
+{
+    int h = terrainSize;
+    int w = terrainSize;
+    int sd = pow(4,subdiv);
 
     if (!AccessIdxs().empty())
     {
@@ -261,24 +706,44 @@ void TerrainGeneration::SetupVerts()
 
     SetupMeshSubInfo(sqrt(sd),N,sizeScale);
 
-    long long int memreq=(N-1)*(N-1)*6;
-    Console::cPrint(tools::appendStrings(" Idx. Mem. Req.: ",(sd*memreq)/(1024*1024),"MB"));
+    // Every mesh has the same layout, so the indices are built once and shared
+    long long int memreq=(long long int)(N-1)*(N-1)*6;
+    Console::cPrint(tools::appendStrings(" Idx. Mem. Req.: ",(memreq*sizeof(GLuint))/(1024*1024),"MB"));
 
-    AccessIdxs().resize(sd);
-    for (int i=0; i<sd; ++i)
+    AccessIdxs().resize(memreq);
+
+    #pragma omp parallel for firstprivate(N)
+    for (int i=0; i<(N-1); ++i)
     {
-        AccessIdxs()[i].resize(memreq);
+        long long int it=(long long int)i*(N-1)*6;
+        for (int j=0; j<(N-1); ++j)
+        {
+            int idx1 = j+(i)*N;
+            int idx2 = (j+(i)*N)+1;
+            int idx3 = j+(i+1)*N;
+            int idx4 = (j+1)+(i+1)*N;
+
+            AccessIdxs()[it+0]=idx1;
+            AccessIdxs()[it+1]=idx3;
+            AccessIdxs()[it+2]=idx2;
+
+            AccessIdxs()[it+3]=idx2;
+            AccessIdxs()[it+4]=idx3;
+            AccessIdxs()[it+5]=idx4;
+
+            it+=6;
+        }
     }
 
+    // Mesh verts are kept between rebuilds of the same size
     Console::cPrint(" Allocating Mesh Verts Memory...");
     AccessMeshVerts().resize(sd);
+    #pragma omp parallel for
     for (int i=0; i<sd; ++i)
     {
-        AccessMeshVerts()[i].resize(N*N);
+        AccessMeshVerts()[i].resize((size_t)N*N);
     }
 
-    Console::cPrint(" Indexing Mesh Verts...");
-
     #pragma omp parallel for firstprivate(sd,N)
     for (int m=0; m<(int)sqrt(sd); ++m)
     {
@@ -287,46 +752,6 @@ void TerrainGeneration::SetupVerts()
             int sdIdx=n+m*(int)sqrt(sd);
             //std::cout << "SubDivisions: m: " << m << " n: " << n << " IDX: " << sdIdx << std::endl;
 
-            long int it=0;
-            // Index the verts for each new mesh
-            for (int i=0; i<(N-1); ++i)
-            {
-                for (int j=0; j<(N-1); ++j)
-                {
-                    int idx1 = j+(i)*N;
-                    int idx2 = (j+(i)*N)+1;
-                    int idx3 = j+(i+1)*N;
-                    int idx4 = (j+1)+(i+1)*N;
-
-                    //std::cout << " QUAD: {" << idx1 << "," << idx3 << "," << idx2 << "}"
-                    //                << ",{" << idx2 << "," << idx3 << "," << idx4 << "}\n";
-
-                    AccessIdxs()[sdIdx][it+0]=idx1;
-                    AccessIdxs()[sdIdx][it+1]=idx3;
-                    AccessIdxs()[sdIdx][it+2]=idx2;
-
-                    AccessIdxs()[sdIdx][it+3]=idx2;
-                    AccessIdxs()[sdIdx][it+4]=idx3;
-                    AccessIdxs()[sdIdx][it+5]=idx4;
-
-                    it+=6;
-                }
-            }
-
-            // Store the verts based on the index
-            for (int i=0; i<N; ++i)
-            {
-                for (int j=0; j<N; ++j)
-                {
-                    int Nidx=j+(i)*N;
-                    int ic=i+(N-1)*m;
-                    int jc=j+(N-1)*n;
-                    int idx1=jc+ic*h;
-                    //std::cout << " VERT: {" << idx1 << ""<< Nidx << "}\n";
-                    AccessMeshVerts()[sdIdx][Nidx]=verts[idx1];
-                }
-            }
-
             // Compute the center of each new mesh
             double fw=(w-1)*sizeScale; // full width of terrain
             double dx=fw/(double)sqrt(sd); // Width of a single mesh
@@ -345,142 +770,81 @@ void TerrainGeneration::SetupVerts()
     double fw=(w-1)*sizeScale; // full width of terrain
     double dx=fw/(double)sqrt(sd); // Width of a single mesh
     meshwidth = dx/2.0;
-
-    //verts.clear(); // Done with normal verts
-    Console::cPrint(" Terrain Successfully Setup!",true);
 };
 
 //*********************************************
 //            Recalculate Normals
 //*********************************************
 /*
-Recalculate the normals based on new vertex positions.
+Recalculate the normals from the height data.
 
-Begins by calculating vectors from each center
-vertex to each nearest neighbor, then calculating
-the cross product of each of these vectors. Averaging
-these vectors gives a "smoothed" normal based on the
-slope.
+The grid is regular, so the normals come straight
+from the height gradients (see HeightNormals). The
+quality mode is set with SetNormalQuality.
 */
 void TerrainGeneration::RecalculateNormals()
 {
-    int h = terrainSize;
-    int w = terrainSize;
+    UpdateNormals(HeightRect(0,terrainSize,0,terrainSize));
+};
 
-    //std::cout << "Beginning Normals...\n";
-    //Console::cPrint(" Calculating Normals...");
+//*********************************************
+//        Update Normals in a Region
+//*********************************************
+/*
+Writes the normals of rect r straight into every
+sub-mesh overlapping it. Edge verts shared by two
+meshes are computed for both.
+*/
+void TerrainGeneration::UpdateNormals(const HeightRect &r)
+{
+    int Nm = GetMeshSubDiv();
+    int N = GetMeshEdge();
 
-    #pragma omp parallel for shared(h,w)
-    for (int i=0; i<h; ++i)
+    if (Nm<=0 || N<=1 || (int)AccessMeshVerts().size()<Nm*Nm)
     {
-        for (int j=0; j<w; ++j)
-        {
-            //std::cout << "BEGINNING NORMAL (" << i << "," << j << ")\n";
-            int im1=i-1;
-            int jm1=j-1;
-            int ip1=i+1;
-            int jp1=j+1;
-
-            glm::vec3 dP1;
-            if (!(im1<0))
-            {
-                dP1 = verts[j+im1*w].position - verts[j+i*w].position;
-            }
-
-            glm::vec3 dP2;
-            if (!(im1<0) && !(jm1<0))
-            {
-                dP2 = verts[jm1+im1*w].position - verts[j+i*w].position;
-            }
+        return;
+    }
 
-            glm::vec3 dP3;
-            if (!(jm1<0))
-            {
-                dP3 = verts[jm1+i*w].position - verts[j+i*w].position;
-            }
+    normals.SetScale(sizeScale,heightMult);
 
-            glm::vec3 dP4;
-            if (!(jm1<0) && !(ip1>=h))
-            {
-                dP4 = verts[jm1+ip1*w].position - verts[j+i*w].position;
-            }
+    for (int m=0; m<Nm; ++m)
+    {
+        for (int n=0; n<Nm; ++n)
+        {
+            HeightRect mesh = MeshRect(m,n);
+            HeightRect o = mesh.Intersect(r);
 
-            glm::vec3 dP5;
-            if (!(ip1>=h))
+            if (o.Empty())
             {
-                dP5 = verts[j+ip1*w].position - verts[j+i*w].position;
+                continue;
             }
 
-            glm::vec3 dP6;
-            if (!(jp1>=w) && !(ip1>=h))
-            {
-                dP6 = verts[jp1+ip1*w].position - verts[j+i*w].position;
-            }
+            Vertex *mVerts = &AccessMeshVerts()[n+m*Nm][0];
+            normals.Compute(HeightData,mVerts,N,mesh.i0,mesh.j0,o.i0,o.i1,o.j0,o.j1);
+        }
+    }
+};
 
-            glm::vec3 dP7;
-            if (!(jp1>=w))
-            {
-                dP7 = verts[jp1+i*w].position - verts[j+i*w].position;
-            }
-
-            glm::vec3 dP8;
-            if (!(jp1>=w) && !(im1<0))
-            {
-                dP8 = verts[jp1+im1*w].position - verts[j+i*w].position;
-            }
-
-            glm::vec3 cP1 = -glm::normalize(glm::cross(dP3,dP1));
-            glm::vec3 cP2 = -glm::normalize(glm::cross(dP4,dP2));
-            glm::vec3 cP3 = -glm::normalize(glm::cross(dP5,dP3));
-            glm::vec3 cP4 = -glm::normalize(glm::cross(dP6,dP4));
-            glm::vec3 cP5 = -glm::normalize(glm::cross(dP7,dP5));
-            glm::vec3 cP6 = -glm::normalize(glm::cross(dP8,dP6));
-            glm::vec3 cP7 = -glm::normalize(glm::cross(dP1,dP7));
-            glm::vec3 cP8 = -glm::normalize(glm::cross(dP2,dP8));
-
-            if (i-1 < 0)
-            {
-                cP1=glm::vec3(0.0f);
-                cP2=glm::vec3(0.0f);
-                cP6=glm::vec3(0.0f);
-                cP7=glm::vec3(0.0f);
-                cP8=glm::vec3(0.0f);
-            }
-
-            if (j-1 < 0)
-            {
-                cP1=glm::vec3(0.0f);
-                cP2=glm::vec3(0.0f);
-                cP3=glm::vec3(0.0f);
-                cP4=glm::vec3(0.0f);
-                cP8=glm::vec3(0.0f);
-            }
-
-            if (j+1 >= w)
-            {
-                cP4=glm::vec3(0.0f);
-                cP5=glm::vec3(0.0f);
-                cP6=glm::vec3(0.0f);
-                cP7=glm::vec3(0.0f);
-                cP8=glm::vec3(0.0f);
-            }
-
-            if (i+1 >= h)
-            {
-                cP2=glm::vec3(0.0f);
-                cP3=glm::vec3(0.0f);
-                cP4=glm::vec3(0.0f);
-                cP5=glm::vec3(0.0f);
-                cP6=glm::vec3(0.0f);
-            }
-
-            glm::vec3 Normal=glm::normalize(cP1+cP2+cP3+cP4+cP5+cP6+cP7+cP8);
+//*********************************************
+//           Sub-Mesh Grid Rect
+//*********************************************
+/*
+Meshes share their edge verts, so mesh (m,n) covers
+rows and columns [(N-1)*m,(N-1)*m+N).
+*/
+HeightRect TerrainGeneration::MeshRect(int m,int n)
+{
+    int N = GetMeshEdge();
+    return HeightRect((N-1)*m,(N-1)*m+N,(N-1)*n,(N-1)*n+N);
+};
 
-            verts[j+i*w].normal=Normal;
-            //std::cout << "NORMAL (" << i << "," << j << "): [" << verts[j+i*w].normal.x << ","<< verts[j+i*w].normal.y << "," <<  verts[j+i*w].normal.z << "]" << std::endl;
-        }
-    }
-    #pragma omp barrier
+//*********************************************
+//         World Position of a Vert
+//*********************************************
+glm::vec3 TerrainGeneration::VertPosition(int i,int j)
+{
+    float shift=(float)sizeScale*(terrainSize-1)/2.0f;
+    return glm::vec3(j*sizeScale-shift,heightMult*((float)HeightData(i,j)-vertMidpoint),i*sizeScale-shift);
 };
 
 //*********************************************
@@ -494,32 +858,79 @@ void TerrainGeneration::RecalculateVerticies()
     int h = terrainSize;
     int w = terrainSize;
 
-    // Calculate the shift of the mesh (Used to shift 0,0 to center)
-    float shift=(float)sizeScale*(h-1)/2.0f;
+    vertMidpoint=(lowShift+GetRelHeight().x)/2.0f;
+
+    AccessRelHeight().x=heightMult*(GetRelHeight().x-vertMidpoint);
 
-    float midpoint=(lowShift+GetRelHeight().x)/2.0f;
+    UpdateVerticies(HeightRect(0,h,0,w));
+};
 
-    AccessRelHeight().x=heightMult*(GetRelHeight().x-midpoint);
+//*********************************************
+//        Update Verticies in a Region
+//*********************************************
+/*
+Rebuild the verts of rows [r.i0,r.i1) and columns
+[r.j0,r.j1) from the height data, written straight
+into every sub-mesh overlapping the rect. The height
+midpoint from the last full RecalculateVerticies is
+kept, so the rest of the terrain does not move.
+*/
+void TerrainGeneration::UpdateVerticies(const HeightRect &r)
+{
+    int h = terrainSize;
+    int Nm = GetMeshSubDiv();
+    int N = GetMeshEdge();
 
+    if (Nm<=0 || N<=1 || (int)AccessMeshVerts().size()<Nm*Nm)
+    {
+        return;
+    }
+
+    // Calculate the shift of the mesh (Used to shift 0,0 to center)
+    float shift=(float)sizeScale*(h-1)/2.0f;
+
+    float midpoint = vertMidpoint;
     float sScale = sizeScale;
     float hMult = heightMult;
 
-    #pragma omp parallel for firstprivate(h,w,sScale,shift,midpoint,hMult)
-    for (int i=0; i<h; ++i)
+    for (int m=0; m<Nm; ++m)
     {
-        for (int j=0; j<w; ++j)
+        for (int n=0; n<Nm; ++n)
         {
-            float Height = HeightData[i][j];
+            HeightRect mesh = MeshRect(m,n);
+            HeightRect o = mesh.Intersect(r);
+
+            if (o.Empty())
+            {
+                continue;
+            }
+
+            Vertex *mVerts = &AccessMeshVerts()[n+m*Nm][0];
+            int i0=o.i0, i1=o.i1;
+            int j0=o.j0, j1=o.j1;
+            int mi0=mesh.i0, mj0=mesh.j0;
+
+            #pragma omp parallel for firstprivate(N,j0,j1,mi0,mj0,sScale,shift,midpoint,hMult) if(o.Rows()*o.Cols()>16384)
+            for (int i=i0; i<i1; ++i)
+            {
+                const uint16_t *hRow = HeightData.Row(i);
+                Vertex *vRow = mVerts + (size_t)(i-mi0)*N; // vRow[j-mj0] is vert (i,j)
+
+                for (int j=j0; j<j1; ++j)
+                {
+                    float Height = hRow[j];
+                    Vertex &v = vRow[j-mj0];
 
-            verts[j+i*w].position.x = j*sScale-shift;
-            verts[j+i*w].position.y = (float)hMult*(Height-midpoint);
-            verts[j+i*w].position.z = i*sScale-shift;
+                    v.position.x = j*sScale-shift;
+                    v.position.y = (float)hMult*(Height-midpoint);
+                    v.position.z = i*sScale-shift;
 
-            verts[j+i*w].texture.x = (float)j;
-            verts[j+i*w].texture.y = (float)i;
+                    v.texture.x = (float)j;
+                    v.texture.y = (float)i;
+                }
+            }
         }
     }
-    #pragma omp barrier
 };
 
 //*********************************************
@@ -530,30 +941,32 @@ Calculate the maximum and minimum heights
 */
 void TerrainGeneration::RecalculateMaxMinHeights()
 {
-    int h = terrainSize;
-    int w = terrainSize;
-
-    AccessRelHeight().x=0.0f;
-    lowShift=1.0E30;
-
-    for (int i=0; i<h; ++i)
-    {
-        for (int j=0; j<w; ++j)
-        {
-            float Height = HeightData[i][j];
+    uint16_t low,high;
+    HeightData.MinMax(low,high);
+    SetHeightRange(low,high);
+};
 
-            if (Height>GetRelHeight().x)
-            {
-                AccessRelHeight().x=Height;
-                highShift=Height;
-            }
+void TerrainGeneration::SetHeightRange(uint16_t low,uint16_t high)
+{
+    AccessRelHeight().x=high;
+    highShift=high;
+    lowShift=low;
+};
 
-            if (Height<lowShift)
-            {
-                lowShift=Height;
-            }
-        }
-    }
+//*********************************************
+//            Change the Height Scale
+//*********************************************
+/*
+Built terrains hold heights in editor units (scale
+1), imported heightmaps keep their finer samples.
+heightMult follows the scale, so the terrain keeps
+its height in the world and the multiplier shown in
+the editor stays the same.
+*/
+void TerrainGeneration::ChangeHeightScale(float scale)
+{
+    heightMult*=GetHeightScale()/scale;
+    SetHeightScale(scale);
 };
 
 //*********************************************
@@ -563,12 +976,14 @@ void TerrainGeneration::RecalculateMaxMinHeights()
 Setup Terrain Creation Parameters
 1) terrainSize
 2) heightVariation
+3) seed
 */
-void TerrainGeneration::SetupTerrainCreationParameters(int terrainSize,int NSmooth,glm::ivec3 heightVariation)
+void TerrainGeneration::SetupTerrainCreationParameters(int terrainSize,int NSmooth,glm::ivec3 heightVariation,unsigned int seed)
 {
-    this->terrainSize=terrainSize;
+    this->createSize=terrainSize;
     this->NSmooth=NSmooth;
     this->heightVariation=heightVariation;
+    this->seed=seed;
 };
 
 //*********************************************
@@ -576,12 +991,12 @@ void TerrainGeneration::SetupTerrainCreationParameters(int terrainSize,int NSmoo
 //*********************************************
 /*
 Setup Terrain Parameters
-1) heightMult
+1) heightMult (per editor height unit)
 2) relativeHeight
 */
 void TerrainGeneration::SetupTerrainModifyParameters(float heightMult,glm::vec3 relheight)
 {
-    this->heightMult=heightMult;
+    this->heightMult=heightMult/GetHeightScale();
     AccessRelHeight() = glm::vec4(GetRelHeight().x,relheight.x,relheight.y,relheight.z);
 };
 
@@ -593,98 +1008,32 @@ Set Relative Height Data on GPU.
 */
 void TerrainGeneration::modifyElevation(int func,float eff,InputStruct &input,RTSCamera &camera)
 {
-    double x,y;
-    input.ReturnMousePos(x,y); // Get mouse screen position
-
     generalTimer.start_point(); // Start the timer *TESTING*
 
-    double sphererad = sqrt(meshwidth*meshwidth+meshwidth*meshwidth); // Radius of the sphere
-
-    // Initialize variables to be set
-    int mesh=-1;
-    int poly=-1;
-    glm::vec3 baryPos(1.0E7);
-    glm::vec3 avgPos;
-    bool found=false;
+    PickResult pick = PickTerrain(camera);
 
-    // Search all meshes for click
-    for(int m=0; m<int(AccessIdxs().size()); ++m)
+    // Queue the brush, applied once per frame by ApplyBrushStrokes
+    if (pick.hit)
     {
-        if (!found)
-        {
-            // Declare thread variables for private use
-            //glm::vec3 dir = camera.cameraDir;
-            glm::vec3 pos = camera.cameraPos;
-            glm::vec3 ray = camera.Cursor3DRay;
+        // Brush center is the center of the hit triangle
+        int i = pick.i;
+        int j = pick.j;
 
-            glm::vec3 spherecent = glm::vec3(AccessPositions()[m].x,0.0f,AccessPositions()[m].y);
-
-            // Determine if click occurs within mesh sphere
-            if (glmtools::DetermineSphereIntersection(pos,ray,spherecent,sphererad))
-            {
-                // If click occurs within mesh sphere, search mesh for clicked triangle
-                #pragma omp parallel for default(shared) firstprivate(m,pos,ray)
-                for(int i=0; i<int(AccessIdxs()[m].size())/3; ++i)
-                {
-                    int idx1 = AccessIdxs()[m][i*3];
-                    int idx2 = AccessIdxs()[m][i*3+1];
-                    int idx3 = AccessIdxs()[m][i*3+2];
-
-                    glm::vec3 n1 = AccessMeshVerts()[m][idx1].normal;
-                    glm::vec3 n2 = AccessMeshVerts()[m][idx2].normal;
-                    glm::vec3 n3 = AccessMeshVerts()[m][idx3].normal;
-
-                    glm::vec3 na = glm::normalize(n1+n2+n3);
-
-                    // Determine if the polygon is facing the ray
-                    if (glm::dot(-glm::normalize(ray),na) > 0)
-                    {
-                        glm::vec3 v1 = AccessMeshVerts()[m][idx1].position;
-                        glm::vec3 v2 = AccessMeshVerts()[m][idx2].position;
-                        glm::vec3 v3 = AccessMeshVerts()[m][idx3].position;
-
-                        glm::vec3 baryPostmp;
-
-                        // Determine if searched triangle intersects click ray
-                        if (glmtools::DetermineTriangleIntersection(pos,ray,v1,v2,v3,baryPostmp))
-                        {
-                            #pragma omp critical
-                            {
-                                if (baryPostmp.z < baryPos.z)
-                                {
-                                    baryPos=baryPostmp;
-                                    mesh=m;
-                                    poly=i;
-
-                                    avgPos=v1+v2+v3;
-                                    avgPos*=0.3333333;
-                                    found=true;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    // Modify the height data
-    if (found)
-    {
-        switch(func)
+        glm::vec3 avgPos;
+        if (pick.tri==0)
         {
-            case 0: {ModifyHeightData(avgPos,0,eff);break;}
-            case 1: {ModifyHeightData(avgPos,1,eff);break;}
-            case 2: {LevelHeightData(avgPos,eff);break;}
+            avgPos = VertPosition(i,j) + VertPosition(i+1,j) + VertPosition(i,j+1);
+        } else {
+            avgPos = VertPosition(i,j+1) + VertPosition(i+1,j) + VertPosition(i+1,j+1);
         }
+        avgPos*=0.3333333;
 
-        // Recalculate the data based on height changes
-        RecalculateData();
+        strokeQueue.push_back(BrushSample(avgPos,func,eff));
         //****************
         // TESTING THINGSsds
         //****************
-        Console::cPrint(tools::appendStrings("Intersect Mesh(",mesh,") Polygon(",poly,")"));
-        Console::cPrint(tools::appendStrings("Bary Position [",baryPos.x,",",baryPos.y,",",baryPos.z,"]"));
+        Console::cPrint(tools::appendStrings("Intersect Cell(",i,",",j,") Triangle(",pick.tri,")"));
+        Console::cPrint(tools::appendStrings("Hit Position [",pick.position.x,",",pick.position.y,",",pick.position.z,"]"));
     } else {
         Console::cPrint("No intersection detected!");
     }
@@ -694,110 +1043,878 @@ void TerrainGeneration::modifyElevation(int func,float eff,InputStruct &input,RT
     Console::cPrint(generalTimer.get_generic_print_string("modifyElevation "));
 };
 
+//*********************************************
+//          Pick the Terrain Under Cursor
+//*********************************************
+/*
+Intersect the camera cursor ray with the terrain
+using the min/max pyramid. Cheap enough to call
+every frame (hover).
+*/
+PickResult TerrainGeneration::PickTerrain(RTSCamera &camera)
+{
+    return picker.Pick(HeightData,camera.cameraPos,camera.Cursor3DRay);
+};
+
+//*********************************************
+//           Apply Queued Brush Strokes
+//*********************************************
+/*
+Apply every brush sample queued since the last call
+(normally one frame). Consecutive raise/lower samples
+are merged into a single height update, then the
+dirty region is recomputed and uploaded once.
+
+A frame without samples ends the stroke, which is
+then pushed as one undo step. Sculpting stops live
+erosion, whose state would overwrite the strokes.
+*/
+void TerrainGeneration::ApplyBrushStrokes()
+{
+    if (strokeQueue.empty())
+    {
+        if (!IsEroding())
+        {
+            history.EndEdit(HeightData);
+        }
+        return;
+    }
+
+    if (IsEroding())
+    {
+        StopErosion();
+    }
+
+    std::vector<BrushSample> run;
+    for (int k=0; k<(int)strokeQueue.size(); ++k)
+    {
+        const BrushSample &sample = strokeQueue[k];
+
+        if (sample.func==2)
+        {
+            ModifyHeightData(run);
+            run.clear();
+
+            LevelHeightData(sample.point,sample.eff);
+        } else {
+            run.push_back(sample);
+        }
+    }
+    ModifyHeightData(run);
+
+    strokeQueue.clear();
+
+    UpdateDirtyRegion();
+};
+
 //*********************************************
 //            Modify Height Data
 //*********************************************
 /*
+Raise (func=1) or lower (func=0) the terrain around
+each sample by the brush falloff. The changes of all
+samples are summed first and applied once, so a
+height is rounded and range checked a single time
+per batch.
 
+Only the bounding rects of the brushes are visited.
 */
-void TerrainGeneration::ModifyHeightData(glm::vec3 point,int updown,float eff)
+void TerrainGeneration::ModifyHeightData(const std::vector<BrushSample> &samples)
 {
-    int h = terrainSize;
-    int w = terrainSize;
+    if (samples.empty())
+    {
+        return;
+    }
 
-    float hmult=5.0f;
+    const float radius=50.0f;
+    const float hmult=5.0f*GetHeightScale(); // 5 editor height units
 
-    float lShift=lowShift;
-    float hShift=highShift;
+    // Rect covered by the whole batch
+    HeightRect U;
+    for (int k=0; k<(int)samples.size(); ++k)
+    {
+        U.Add(BrushRect(samples[k].point,radius));
+    }
 
-    #pragma omp parallel for firstprivate(h,w,point,hmult,eff,lShift,hShift)
-    for (int i=0; i<h; ++i)
+    if (U.Empty())
     {
-        for (int j=0; j<w; ++j)
+        return;
+    }
+
+    const int uw = U.Cols();
+    brushAccum.assign((size_t)U.Rows()*uw,0.0f);
+
+    float shift=(float)sizeScale*(terrainSize-1)/2.0f;
+    float sScale=sizeScale;
+    float hMult=heightMult;
+    float midpoint=vertMidpoint;
+
+    // Sum the height change of every sample
+    for (int k=0; k<(int)samples.size(); ++k)
+    {
+        const glm::vec3 p = samples[k].point;
+        const float sign = (samples[k].func==1) ? 1.0f : -1.0f;
+
+        brushFalloff.Setup(radius,samples[k].eff,hmult);
+        const BrushFalloff &falloff = brushFalloff;
+
+        HeightRect r = BrushRect(p,radius);
+
+        #pragma omp parallel for if(r.Rows()*r.Cols()>16384)
+        for (int i=r.i0; i<r.i1; ++i)
         {
-            float R = glm::length(verts[j+i*w].position-point);
-            if (R < 50.0)
+            const uint16_t *hRow = HeightData.Row(i);
+            float *aRow = brushAccum.data()+(size_t)(i-U.i0)*uw;
+
+            float dz = i*sScale-shift-p.z;
+
+            for (int j=r.j0; j<r.j1; ++j)
             {
-                float nM = hmult/(pow(R/4.0,eff)+1.0);
-                float nY = 0.0;
+                float dx = j*sScale-shift-p.x;
+                float dy = hMult*(hRow[j]-midpoint)-p.y;
 
-                switch (updown)
+                float R = sqrtf(dx*dx+dy*dy+dz*dz);
+                if (R < radius)
                 {
-                    case 0: {nY = HeightData[i][j] - nM;break;}
-                    case 1: {nY = HeightData[i][j] + nM;break;}
+                    aRow[j-U.j0] += sign*falloff(R);
                 }
-                //std::cout << "*TEST* Length: " << R << " nM: " << nM << " nY: " << nY << " nYo: " << HeightData[i][j] << std::endl;
+            }
+        }
+    }
+
+    // Apply the summed change
+    history.Touch(HeightData,U);
 
-                if (!(std::round(nY)>hShift) && !(std::round(nY)<lShift))
+    float lShift=lowShift;
+    float hShift=highShift;
+
+    #pragma omp parallel for if(U.Rows()*uw>16384)
+    for (int i=U.i0; i<U.i1; ++i)
+    {
+        uint16_t *hRow = HeightData.Row(i);
+        const float *aRow = brushAccum.data()+(size_t)(i-U.i0)*uw;
+
+        for (int j=U.j0; j<U.j1; ++j)
+        {
+            if (aRow[j-U.j0]!=0.0f)
+            {
+                float nY = std::round(hRow[j]+aRow[j-U.j0]);
+                if (!(nY>hShift) && !(nY<lShift))
                 {
-                    //std::cout << "*TEST* Length: " << R << " nM: " << nM << " nY: " << nY << " nYcorr: " << std::round(nY) << " nYo: " << HeightData[i][j] << "\n";
-                    HeightData[i][j] = std::round(nY);
+                    hRow[j] = (uint16_t)nY;
                 }
             }
         }
-        //std::cout << " "<< std::endl;
     }
-    //std::cout << "|-------------------------------|"<< std::endl;
-    #pragma omp barrier
+
+    dirty.Add(U);
 };
 
 //*********************************************
-//            Modify Height Data
+//            Level Height Data
 //*********************************************
 /*
-
+Pull every height within 100 units of point 5% of
+the way toward the average height in that radius.
+The average is a parallel reduction over the
+brush rect.
 */
 void TerrainGeneration::LevelHeightData(glm::vec3 point,float eff)
+{
+    const float radius=100.0f;
+
+    HeightRect r = BrushRect(point,radius);
+    if (r.Empty())
+    {
+        return;
+    }
+
+    float shift=(float)sizeScale*(terrainSize-1)/2.0f;
+    float sScale=sizeScale;
+    float hMult=heightMult;
+    float midpoint=vertMidpoint;
+    bool parallel = r.Rows()*r.Cols()>16384;
+
+    long long int sum=0;
+    long long int cnt=0;
+
+    #pragma omp parallel for reduction(+:sum,cnt) if(parallel)
+    for (int i=r.i0; i<r.i1; ++i)
+    {
+        const uint16_t *hRow = HeightData.Row(i);
+        float dz = i*sScale-shift-point.z;
+
+        for (int j=r.j0; j<r.j1; ++j)
+        {
+            float dx = j*sScale-shift-point.x;
+            float dy = hMult*(hRow[j]-midpoint)-point.y;
+
+            if (dx*dx+dy*dy+dz*dz < radius*radius)
+            {
+                sum += hRow[j];
+                ++cnt;
+            }
+        }
+    }
+
+    if (cnt==0)
+    {
+        return;
+    }
+
+    int avgHeight = std::round(sum/(float)cnt);
+
+    history.Touch(HeightData,r);
+
+    #pragma omp parallel for if(parallel)
+    for (int i=r.i0; i<r.i1; ++i)
+    {
+        uint16_t *hRow = HeightData.Row(i);
+        float dz = i*sScale-shift-point.z;
+
+        for (int j=r.j0; j<r.j1; ++j)
+        {
+            float dx = j*sScale-shift-point.x;
+            float dy = hMult*(hRow[j]-midpoint)-point.y;
+
+            if (dx*dx+dy*dy+dz*dz < radius*radius)
+            {
+                int cY = hRow[j];
+                float scale=(avgHeight-cY)*0.05;
+                hRow[j] = std::round(cY+scale);
+            }
+        }
+    }
+
+    dirty.Add(r);
+};
+
+//*********************************************
+//          Bounding Rect of a Brush
+//*********************************************
+/*
+Returns the rect of verts whose x,z position lies
+within radius of point, clipped to the terrain.
+*/
+HeightRect TerrainGeneration::BrushRect(glm::vec3 point,float radius)
 {
     int h = terrainSize;
     int w = terrainSize;
 
-    //float hmult=5.0f;
+    float shift=(float)sizeScale*(h-1)/2.0f;
+
+    int ic = (int)floor((point.z+shift)/sizeScale);
+    int jc = (int)floor((point.x+shift)/sizeScale);
+    int rc = (int)ceil(radius/sizeScale)+1;
+
+    return HeightRect(ic-rc,ic+rc+1,jc-rc,jc+rc+1).Clipped(h,w);
+};
+
+//*********************************************
+//            Sculpt Undo and Redo
+//*********************************************
+/*
+Write the tiles of the previous (next) step back
+into the height data. Only those tiles are marked
+dirty, so the update costs the same as a stroke
+over the same area.
+*/
+void TerrainGeneration::Undo()
+{
+    strokeQueue.clear();
+    StopErosion();
+
+    HeightRect r = history.Undo(HeightData);
+    if (r.Empty())
+    {
+        Console::cPrint("Nothing to undo");
+        return;
+    }
 
-    //float lShift=lowShift;
-    //float hShift=highShift;
+    dirty.Add(r);
+    UpdateDirtyRegion();
+};
 
-    std::vector< std::pair<int,int> > idx;
-    std::vector< double > dists;
-    std::pair< int,int > avgh;
+void TerrainGeneration::Redo()
+{
+    strokeQueue.clear();
+    StopErosion();
 
-    avgh.first=0.0;
-    avgh.second=0;
+    HeightRect r = history.Redo(HeightData);
+    if (r.Empty())
+    {
+        Console::cPrint("Nothing to redo");
+        return;
+    }
 
-    //#pragma omp parallel for firstprivate(h,w,point,hmult,eff)
-    for (int i=0; i<h; ++i)
+    dirty.Add(r);
+    UpdateDirtyRegion();
+};
+
+//*********************************************
+//              Live Erosion
+//*********************************************
+/*
+The eroder keeps its water and sediment between
+steps, so a run can be watched and stopped at any
+point. Writing the whole terrain back and updating
+it through the dirty region path costs more than a
+step, so it is done every erosionUpload steps and
+when the run stops.
+*/
+void TerrainGeneration::StartErosion()
+{
+    if (HeightData.Empty() || AccessMeshVerts().empty())
     {
-        for (int j=0; j<w; ++j)
+        return;
+    }
+
+    history.EndEdit(HeightData);
+    erosionPending=0;
+    if (eroder.Load(HeightData,lastSeed,GetHeightScale()))
+    {
+        Console::cPrint(tools::appendStrings("Erosion Started (",eroder.MemSize()/(1024*1024),"MB)"));
+    }
+};
+
+void TerrainGeneration::StepErosion(int iterations)
+{
+    if (!IsEroding())
+    {
+        return;
+    }
+
+    eroder.Run(iterations,erosion);
+
+    if (++erosionPending>=erosionUpload)
+    {
+        ShowErosion();
+    }
+};
+
+// Write the eroded heights back as one edit of the whole terrain
+void TerrainGeneration::ShowErosion()
+{
+    if (erosionPending==0)
+    {
+        return;
+    }
+    erosionPending=0;
+
+    HeightRect all(0,HeightData.Height(),0,HeightData.Width());
+    history.Touch(HeightData,all);
+    eroder.Store(HeightData);
+
+    dirty.Add(all);
+    UpdateDirtyRegion();
+};
+
+void TerrainGeneration::StopErosion()
+{
+    if (!IsEroding())
+    {
+        return;
+    }
+
+    ShowErosion();
+
+    Console::cPrint(tools::appendStrings("Erosion Stopped after ",eroder.GetStep()," iterations"));
+    eroder.Cleanup();
+    history.EndEdit(HeightData);
+};
+
+//*********************************************
+//        Update the Dirty Height Region
+//*********************************************
+/*
+Recompute everything that depends on the heights
+changed since the last update:
+
+    verts    the dirty rect
+    normals  the dirty rect plus a 1 vert halo
+    meshes   the chunk verts covering the halo rect
+             are pushed into the existing GPU buffers
+
+The dirty rect is cleared afterwards.
+*/
+void TerrainGeneration::UpdateDirtyRegion()
+{
+    int h = terrainSize;
+    int w = terrainSize;
+
+    HeightRect r = dirty.Clipped(h,w);
+    dirty.Clear();
+
+    if (r.Empty() || AccessMeshVerts().empty())
+    {
+        return;
+    }
+
+    UpdateVerticies(r);
+    picker.Update(HeightData,r);
+
+    HeightRect halo = r.Padded(1).Clipped(h,w);
+    UpdateNormals(halo);
+
+    UpdateSubMeshes(halo);
+    UpdateHeightMapOnGPU(r);
+};
+
+//*********************************************
+//     Update the Sub-Meshes in a Region
+//*********************************************
+/*
+Upload the rows of rect r of every sub-mesh that
+overlaps it (neighbouring meshes share their edge
+verts) with glBufferSubData. Rows spanning the whole
+mesh are contiguous and go up in one call.
+*/
+void TerrainGeneration::UpdateSubMeshes(const HeightRect &r)
+{
+    int Nm = GetMeshSubDiv(); // Meshes per side
+    int N = GetMeshEdge(); // Verts per mesh side
+
+    if (Nm<=0 || N<=1 || (int)AccessMeshVerts().size()<Nm*Nm)
+    {
+        return;
+    }
+
+    // Meshes that can overlap the rect
+    int m0 = std::max((r.i0-1)/(N-1),0);
+    int m1 = std::min((r.i1-1)/(N-1),Nm-1);
+    int n0 = std::max((r.j0-1)/(N-1),0);
+    int n1 = std::min((r.j1-1)/(N-1),Nm-1);
+
+    for (int m=m0; m<=m1; ++m)
+    {
+        for (int n=n0; n<=n1; ++n)
         {
-            glm::vec3 v1=verts[j+i*w].position;
-            float R = glm::length(v1-point);
-            if (R < 100.0)
+            HeightRect mesh = MeshRect(m,n);
+            HeightRect o = mesh.Intersect(r);
+
+            if (o.Empty())
             {
-                avgh.first+=HeightData[i][j]; // Add heights
-                ++avgh.second; // Count heights
+                continue;
+            }
 
-                std::pair<int,int> wkidx; // Build element
-                wkidx.first=i; // Element index
-                wkidx.second=j; // Element index
+            int sdIdx=n+m*Nm;
+
+            if (o.j0==mesh.j0 && o.j1==mesh.j1)
+            {
+                UpdateMeshOnGPU(sdIdx,(o.i0-mesh.i0)*N,o.Rows()*N);
+                continue;
+            }
 
-                idx.push_back(wkidx); // Save pair
+            for (int ic=o.i0; ic<o.i1; ++ic)
+            {
+                int i=ic-mesh.i0;
+                int first=(o.j0-mesh.j0)+i*N;
 
-                dists.push_back(R);
+                UpdateMeshOnGPU(sdIdx,first,o.Cols());
             }
         }
-        //std::cout << " "<< std::endl;
+    }
+};
+
+//*********************************************
+//       Save the Terrain as a Tile Store
+//*********************************************
+/*
+Tiles are tileSize cells wide, or the whole terrain
+when it is smaller. The world keeps the vert spacing
+and height mapping of the editor terrain, so the
+streamed world lines up with it.
+*/
+bool TerrainGeneration::SaveTiledWorld(std::string filename,int tileSize)
+{
+    if (HeightData.Empty())
+    {
+        return false;
+    }
+
+    tileSize = std::min(tileSize,HeightData.Width()-1);
+
+    TerrainTileStore store;
+    bool ok = store.WriteField(filename,HeightData,tileSize,sizeScale,heightMult,vertMidpoint);
+
+    Console::cPrint(tools::appendStrings(ok ? "Saved Tile Store: " : "Could not save Tile Store: ",filename));
+    return ok;
+};
+
+//*********************************************
+//          Setup a Noise World
+//*********************************************
+/*
+The height range is the one the noise is clamped
+to, the real one is only known once every tile is
+built.
+*/
+TileStoreHeader TerrainGeneration::SetupNoiseWorld(int tilesX,int tilesY,int tileSize)
+{
+    if (lastSeed==0)
+    {
+        lastSeed = (seed!=0) ? seed : CounterRandom::ClockSeed();
+    }
+    SetupNoise();
+
+    TileStoreHeader hdr;
+    hdr.tileSize=std::max(tileSize,1);
+    hdr.apron=1;
+    hdr.tilesX=std::max(tilesX,1);
+    hdr.tilesY=std::max(tilesY,1);
+    hdr.spacing=sizeScale/shownStride; // Spacing of the full terrain, not of a preview
+    hdr.heightMult=heightMult*GetHeightScale(); // Noise heights are in editor units
+    hdr.midpoint=heightVariation.x;
+    hdr.minHeight=0;
+    hdr.maxHeight=(uint16_t)std::min(std::max(noise.GetSettings().maxHeight,0.0f),65535.0f);
+    return hdr;
+};
+
+//*********************************************
+//     Save a Noise World as a Tile Store
+//*********************************************
+/*
+Every tile (apron included) is filled from world
+coordinates, so tiles built on different threads
+meet exactly. At the world border the apron repeats
+the edge vert, as in TerrainTileStore::WriteField.
+*/
+bool TerrainGeneration::SaveNoiseWorld(std::string filename,int tilesX,int tilesY,int tileSize)
+{
+    if (tilesX<1 || tilesY<1 || tileSize<1)
+    {
+        return false;
+    }
+
+    TileStoreHeader hdr = SetupNoiseWorld(tilesX,tilesY,tileSize);
+
+    TerrainTileStore store;
+    if (!store.Create(filename,hdr))
+    {
+        Console::cPrint(tools::appendStrings("Could not create Tile Store: ",filename));
+        return false;
+    }
+
+    const int E = store.TileEdge();
+    const int a = hdr.apron;
+
+    double ts=omp_get_wtime();
+    uint16_t low=std::numeric_limits<uint16_t>::max();
+    uint16_t high=0;
+    bool ok=true;
+
+    #pragma omp parallel for schedule(dynamic) reduction(min:low) reduction(max:high) reduction(&&:ok)
+    for (int t=0; t<tilesX*tilesY; ++t)
+    {
+        const int tx=t%tilesX;
+        const int ty=t/tilesX;
+
+        HeightField16 tile(E,E);
+        noise.FillTile(tile,(long long)tx*tileSize-a,(long long)ty*tileSize-a);
+        TerrainTileStore::RepeatApron(hdr,tx,ty,tile);
+
+        uint16_t lo,hi;
+        tile.MinMax(lo,hi);
+        low=std::min(low,lo);
+        high=std::max(high,hi);
+
+        ok = store.WriteTile(tx,ty,tile) && ok;
+    }
+
+    store.SetHeightRange(low,high);
+    ok = store.Flush() && ok;
+
+    Console::cPrint(tools::appendStrings(ok ? "Saved Noise World: " : "Could not save Noise World: ",filename));
+    Console::cPrint(tools::appendStrings(" ",store.WorldWidth(),"x",store.WorldHeight()," verts in ",omp_get_wtime()-ts,"s"));
+    return ok;
+};
+
+//*********************************************
+//         Load an Exported Terrain
+//*********************************************
+/*
+Maps the .ter file and copies the heights and mesh
+verts straight out of it. The verts are only rebuilt
+when the file has none. Only square terrains split
+into 2^k x 2^k meshes (as generated) can be edited.
+*/
+bool TerrainGeneration::LoadTerrain(std::string filename)
+{
+    std::stringstream ss;
+    ss << "../Data/Terrain/" << filename << ".ter";
+
+    double ts=glfwGetTime();
+
+    TerrainLoader file;
+    if (!file.Open(ss.str()))
+    {
+        Console::cPrint(tools::appendStrings("Could not load ",ss.str()));
+        return false;
+    }
+
+    const TerrainFileHeader &header = file.Header();
+
+    int sd=0;
+    while ((1<<sd)<header.Nsub)
+    {
+        ++sd;
+    }
+
+    if (header.width!=header.height || (1<<sd)!=header.Nsub || (header.width-1)%header.Nsub!=0
+     || header.Elen!=(header.width-1)/header.Nsub+1 || header.chunkCount!=header.Nsub*header.Nsub)
+    {
+        Console::cPrint(tools::appendStrings(ss.str()," has a mesh layout the editor cannot use"));
+        return false;
+    }
+
+    // The loaded terrain replaces any build in progress
+    CancelGeneration();
+    shownStride=1;
+
+    terrainSize=header.width;
+    createSize=terrainSize;
+    subdiv=sd;
+    sizeScale=header.spacing;
+    heightMult=header.heightMult;
+
+    if (!file.CopyHeights(HeightData))
+    {
+        Console::cPrint("Failed to allocate Height Data!");
+        return false;
+    }
+    dirty.Clear();
+    strokeQueue.clear();
+    eroder.Cleanup();
+    history.Reset(HeightData.Width(),HeightData.Height());
+
+    SetupSubMeshes();
+    RecalculateMaxMinHeights();
+    vertMidpoint=header.midpoint;
+
+    // Also restores the texture heights over the ones set above
+    if (!LoadTerrainFile(file))
+    {
+        Console::cPrint("Calculating Verts...");
+        UpdateVerticies(HeightRect(0,terrainSize,0,terrainSize));
+        RecalculateNormals();
     }
 
-    int avgHeight = std::round(avgh.first/(float)avgh.second);
-    for (auto&& el : idx)
+    picker.SetMapping(sizeScale,heightMult,vertMidpoint);
+    picker.Build(HeightData);
+    SetHeightMap(&HeightData,sizeScale,heightMult,vertMidpoint,normals.GetQuality()==HeightNormals::NORMALS_SOBEL);
+
+    Console::cPrint(tools::appendStrings("Loaded ",ss.str()," in ",glfwGetTime()-ts,"s"));
+    return true;
+};
+
+//*********************************************
+//         Save the Terrain in the Background
+//*********************************************
+/*
+The snapshot shares every height tile not edited
+since the last snapshot, so the frame that asks for
+a save only copies what changed.
+*/
+bool TerrainGeneration::SaveTerrain(std::string filename)
+{
+    // A preview is not the terrain
+    if (HeightData.Empty() || IsGenerating() || shownStride!=1)
     {
-        //std::cout << "Working!!\n";
-        int cY = HeightData[el.first][el.second];
-        float scale=(avgHeight-cY)*0.05;
+        Console::cPrint("No terrain to save!");
+        return false;
+    }
+
+    std::stringstream ss;
+    ss << "../Data/Terrain/" << filename << ".ter";
+
+    double ts=glfwGetTime();
+
+    TerrainSaver::Snapshot snap;
+    snap.filename=ss.str();
+    snap.header=FileHeader();
+    snap.width=HeightData.Width();
+    snap.height=HeightData.Height();
+    history.Snapshot(HeightData,snap.tiles);
+    snap.tileSize=history.GetTileSize();
+    snap.tilesX=history.GetTilesX();
+
+    savedTiles=snap.tiles;
+    savedHeader=snap.header;
+    lastAutosave=glfwGetTime();
+
+    saver.Save(snap);
 
-        HeightData[el.first][el.second]=std::round(cY+scale);
+    Console::cPrint(tools::appendStrings("Saving ",ss.str(),", snapshot in ",glfwGetTime()-ts,"s"));
+    return true;
+};
+
+// The fields FileHeader() fills in, which the editor can change between saves
+static bool SameSettings(const TerrainFileHeader &a,const TerrainFileHeader &b)
+{
+    bool same = a.Nsub==b.Nsub && a.Elen==b.Elen && a.spacing==b.spacing
+             && a.heightMult==b.heightMult && a.midpoint==b.midpoint && a.heightScale==b.heightScale && a.shine==b.shine
+             && strncmp(a.shader,b.shader,sizeof(a.shader))==0;
+
+    for (int i=0; i<4 && same; ++i)
+    {
+        same = a.relativeHeight[i]==b.relativeHeight[i]
+            && strncmp(a.textures[i],b.textures[i],sizeof(a.textures[i]))==0;
+    }
+    for (int i=0; i<3 && same; ++i)
+    {
+        same = a.Ka[i]==b.Ka[i] && a.Kd[i]==b.Kd[i] && a.Ks[i]==b.Ks[i];
+    }
+
+    return same;
+};
+
+void TerrainGeneration::UpdateAutosave()
+{
+    if (autosaveInterval<=0.0 || glfwGetTime()-lastAutosave<autosaveInterval)
+    {
+        return;
     }
+    lastAutosave=glfwGetTime();
 
-    //std::cout << "|-------------------------------|"<< std::endl;
-    //#pragma omp barrier
+    if (HeightData.Empty() || IsGenerating() || shownStride!=1 || saver.IsBusy())
+    {
+        return;
+    }
+
+    // Unchanged tiles are the very same buffers as in the last save
+    std::vector<HeightHistory::TileData> tiles;
+    history.Snapshot(HeightData,tiles);
+    TerrainFileHeader header=FileHeader();
+
+    if (tiles==savedTiles && SameSettings(header,savedHeader))
+    {
+        return;
+    }
+
+    SaveTerrain(autosaveName);
+};
+
+//*********************************************
+//         Import and Export Heightmaps
+//*********************************************
+/*
+The image is read one row at a time and resampled
+into a new height field, so only the terrain itself
+has to fit in memory. The height range comes out of
+the same pass. The old terrain stays until the
+import succeeded.
+
+Heightmap samples span 0..65535 and built heights
+0..1000 (see ClampHeight). Imported samples are
+kept as they are, with a height scale of 65.535
+samples per editor unit, so no precision of the
+heightmap is lost. Exports stretch built heights to
+the full range and write imported ones unchanged,
+exporting and importing again gives back the same
+heights.
+*/
+static const float HeightmapScale=65535.0f/1000.0f;
+
+bool TerrainGeneration::ImportHeightmap(std::string filename,int size,int rawWidth,int rawHeight)
+{
+    std::string path="../Data/Terrain/"+filename;
+    double ts=glfwGetTime();
+
+    HeightmapFile file;
+    if (!file.Open(path,rawWidth,rawHeight))
+    {
+        Console::cPrint(tools::appendStrings("Could not read heightmap ",path));
+        return false;
+    }
+
+    // 2^n+1 verts along each edge
+    if (size<=0)
+    {
+        size=std::max(file.Width(),file.Height());
+    }
+    int edge=2;
+    while (edge+1<size)
+    {
+        edge*=2;
+    }
+    size=edge+1;
+
+    Console::cPrint(tools::appendStrings("Importing ",file.Width(),"x",file.Height()," heightmap"));
+    Console::cPrint(tools::appendStrings(" Resampled to ",size,"x",size," verts"));
+
+    // The imported terrain replaces any build in progress
+    CancelGeneration();
+
+    HeightField16 field;
+    if (!field.Allocate(size,size))
+    {
+        Console::cPrint("Failed to allocate Height Data!");
+        return false;
+    }
+
+    auto rows=[&file](uint16_t *row) {return file.ReadRow(row);};
+
+    uint16_t low,high;
+    if (!HeightResampler::Resample(file.Width(),file.Height(),rows,field,low,high))
+    {
+        Console::cPrint(tools::appendStrings("Heightmap ",path," ended early or is broken"));
+        return false;
+    }
+
+    HeightData.Swap(field);
+    sizeScale/=shownStride;
+    shownStride=1;
+    terrainSize=size;
+    createSize=size;
+    while ((1<<subdiv)>size-1)
+    {
+        --subdiv;
+    }
+
+    dirty.Clear();
+    strokeQueue.clear();
+    eroder.Cleanup();
+    ChangeHeightScale(HeightmapScale);
+
+    SetHeightRange(low,high);
+    SetupVerts(true);
+
+    Console::cPrint(tools::appendStrings("Imported ",path," in ",glfwGetTime()-ts,"s"));
+    return true;
+};
+
+bool TerrainGeneration::ExportHeightmap(std::string filename)
+{
+    // A preview is not the terrain
+    if (HeightData.Empty() || shownStride!=1)
+    {
+        Console::cPrint("No terrain to export!");
+        return false;
+    }
+
+    std::string path="../Data/Terrain/"+filename;
+    double ts=glfwGetTime();
+
+    std::vector<uint16_t> line(HeightData.Width());
+    const float stretch=HeightmapScale/GetHeightScale();
+    auto rows=[this,&line,stretch](int i) -> const uint16_t*
+    {
+        const uint16_t *src=HeightData.Row(i);
+        for (size_t j=0; j<line.size(); ++j)
+        {
+            line[j]=(uint16_t)std::min(std::round(src[j]*stretch),65535.0f);
+        }
+        return &line[0];
+    };
+
+    bool written=HeightmapFile::Write(path,HeightData.Width(),HeightData.Height(),rows);
+    if (written)
+    {
+        Console::cPrint(tools::appendStrings("Exported ",path," in ",glfwGetTime()-ts,"s"));
+    }
+    else
+    {
+        Console::cPrint(tools::appendStrings("Failed to export ",path));
+    }
+    return written;
 };
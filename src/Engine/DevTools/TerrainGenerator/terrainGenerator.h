@@ -4,12 +4,25 @@
 #include "../../../Headers/headerscpp.h"
 #include "../../../Headers/headersogl.h"
 #include "../../Handlers/TerrainHandler/terrainhandler.h"
+#include "../../Handlers/TerrainHandler/terraintilestore.h"
 #include "../worldbuildertools/randlib.h"
-#include "../worldbuildertools/boxclass.h"
+#include "../worldbuildertools/heightsmoother.h"
+#include "../worldbuildertools/heightnormals.h"
+#include "../worldbuildertools/sculptbrush.h"
+#include "../worldbuildertools/heightpicker.h"
+#include "../worldbuildertools/heighthistory.h"
+#include "../worldbuildertools/heighteroder.h"
+#include "../worldbuildertools/heightnoise.h"
+#include "../worldbuildertools/heightbuildjob.h"
+#include "../worldbuildertools/heightgraph.h"
+#include "../worldbuildertools/terrainsaver.h"
+#include "../worldbuildertools/heightresampler.h"
+#include "../../Loaders/heightmapfile.h"
 #include "../../Handlers/ModelHandler/base_classes.h"
 #include "../../Tools/rtscamera.h"
 #include "../../Tools/console.h"
 #include "../../Tools/micro_timer.h"
+#include "../../Tools/heightfield.hpp"
 #include "../../Tools/ToolBoxs/terraincreationtoolbox.h"
 #include "../../Tools/ToolBoxs/terrainmodificationtoolbox.h"
 #include "../../Tools/ToolBoxs/materialmodificationtoolbox.h"
@@ -29,6 +42,8 @@
 */
 class TerrainGeneration : public TerrainHandler
 {
+    // Headless stage timing (src/Benchmark)
+    friend class TerrainBenchmark;
 
     //******************************
     //	Terrain Data
@@ -36,23 +51,96 @@ class TerrainGeneration : public TerrainHandler
     //************
     // Saved Data
     //************
-    std::vector< std::vector<int> > HeightData;
+    HeightField16 HeightData; // Row-major, aligned height storage
 
     int terrainSize; // Size of the terrain
+    int createSize; // Size the next generation builds
     int NSmooth; // Number of smoothing cycles to run
     int subdiv; // Number of meshes to subdivide into
-    float heightMult; // Height multiplier
+    float heightMult; // Height multiplier of one height sample (see ChangeHeightScale)
 
     glm::ivec3 heightVariation;
 
+    unsigned int seed; // Generation seed (0=pick a new one each time)
+    unsigned int lastSeed; // Seed used by the last generation
+
+    int generator; // 0=midpoint displacement, 1=fBm, 2=ridged, 3=domain warped noise
+    HeightNoise noise; // Tile independent noise generator
+    HeightNoise::Settings noiseSettings; // Shape of the noise (heights come from heightVariation)
+
+    HeightSmoother::Kernel smoothKernel; // Kernel used by the blur passes
+
+    HeightEroder eroder; // Hydraulic/thermal erosion, loaded while live erosion runs
+    int erosionUpload; // Live erosion steps between showing the heights
+    int erosionPending; // Steps run since the heights were last written back
+    ErosionSettings erosion; // Settings of the erosion stage and of live erosion
+
+    HeightNormals normals; // Vertex normals from the height data
+
+    HeightRect dirty; // Heights changed since the last update
+
+    HeightPicker picker; // Min/max pyramid for ray picking
+
+    std::vector<BrushSample> strokeQueue; // Brush samples of the current frame
+    BrushFalloff brushFalloff; // Raise/lower falloff table
+    std::vector<float> brushAccum; // Summed height change of a batch
+
+    HeightHistory history; // Sculpt undo/redo, one step per stroke
+
+    //*************************
+    //    Background Saving
+    //*************************
+    TerrainSaver saver; // Packs and writes saves on a worker thread
+    std::vector<HeightHistory::TileData> savedTiles; // Height tiles of the last save
+    TerrainFileHeader savedHeader; // Look of the last save
+
+    double autosaveInterval; // Seconds between autosaves (0=off)
+    double lastAutosave;
+    std::string autosaveName;
+
+    //*************************
+    // Background Generation
+    //*************************
+    // Everything a height build reads, copied so it can run beside the editor
+    struct BuildSettings
+    {
+        int size;
+        int NSmooth;
+        glm::ivec3 heightVariation;
+        unsigned int seed; // Never 0, picked when the build starts
+        bool clockSeed; // A fresh seed came from the clock, no cached tile can be used
+        int generator;
+        HeightNoise::Settings noise;
+        HeightSmoother::Kernel kernel;
+        ErosionSettings erosion;
+        int output; // Graph node delivering the terrain
+        int stages; // Stages the build reports
+    };
+
+    /*
+    Generation runs through a height graph, so a
+    tweak of the blur or erosion only rebuilds the
+    tiles downstream of it. Its first nodes are
+    fixed (see the NODE_ ids), more can be added
+    behind them through AccessGraph().
+    */
+    HeightGraph graph;
+    int graphOutput;
+
+    HeightBuildJob job; // Declared after what its task uses, so it stops first
+    unsigned int buildSeed; // Seed of the running build
+    uint64_t heightsKey,restKey; // Settings of the last build, see GetBuildSettings
+    int shownStride; // Grid step of the preview on screen (1=full terrain)
+
     //************
     // Built Data
     //************
-    std::vector< Vertex > verts;
+    // Verts are written straight into the sub-meshes (AccessMeshVerts)
 
     //std::vector< glm::vec2 > positions; // mesh positions
 
     float lowShift;
+    float vertMidpoint; // Height shift applied to the verts
     float highShift;
 
     float sizeScale; // Distance between verts
@@ -71,7 +159,7 @@ public:
         SetDefaults();
     };
 
-    ~TerrainGeneration () {};
+    ~TerrainGeneration () {CancelGeneration();};
 
     //*********************************************
     //         Generates Terrain on CPU
@@ -79,8 +167,8 @@ public:
     void GenerateTerrain()
     {
         Console::cPrint("Generating Terrain Data:");
-        Console::cPrint(tools::appendStrings("Terain Size: ",this->terrainSize),true);
-        GenerateTerrainData(this->terrainSize);
+        Console::cPrint(tools::appendStrings("Terain Size: ",this->createSize),true);
+        GenerateTerrainData(this->createSize);
 
         Console::cPrint("Setting up Verts:");
         //std::cout << "Setting up Verts...\n";
@@ -106,7 +194,27 @@ public:
         SetupMaterials(Ka,Kd,Ks,shininess); //Inherited Function
 
         std::cout << "Setting up Parameters...\n";
-        SetupTerrainCreationParameters(5,2,glm::ivec3(500,150,150));
+        SetupTerrainCreationParameters(5,2,glm::ivec3(500,150,150),0);
+        terrainSize=createSize;
+        lastSeed=0;
+        buildSeed=0;
+        heightsKey=0;
+        restKey=0;
+        shownStride=1;
+
+        // Fixed chain heights -> blur -> erosion, configured by every build
+        graph.Clear();
+        graph.AddSource(HeightGraph::Source(),0);
+        graph.AddNode(HeightGraph::OP_BLUR,HeightGraph::Params(),NODE_HEIGHTS);
+        graph.AddNode(HeightGraph::OP_EROSION,HeightGraph::Params(),NODE_BLUR);
+        graphOutput=NODE_EROSION;
+        erosionUpload=4;
+        erosionPending=0;
+        autosaveInterval=300.0;
+        lastAutosave=0.0;
+        autosaveName="autosave";
+        generator=0;
+        smoothKernel=HeightSmoother::SMOOTH_BOX;
         SetupTerrainModifyParameters(0.3f,glm::vec3(0.1f,0.8f,0.05f));
 
         subdiv=2;
@@ -117,17 +225,18 @@ public:
     //************************
     /*
     terrainSize: the width and height in number of verticies of the terrain (int)
-    heightMult: The height multiplier of the terrain. (float)
+    heightMult: The height multiplier of the terrain, per editor height unit. (float)
     HeightVariation: (glm::ivec3)
             .x=number between 0 and 1000, corner starting heights.
             .y=Inital random drop of heights (shrinks by generation)
             .z=Inital random increases of heights (shrinks by generation)
+    seed: Seed of the random generator, 0 picks a new seed for every generation
     relheight: (glm::vec3)
             .x=switching height of lowland to midland textures
             .y=switching height of midland to highland textures
             .z=Percent of switching
     */
-    void SetupTerrainCreationParameters(int terrainSize,int NSmooth,glm::ivec3 heightVariation);
+    void SetupTerrainCreationParameters(int terrainSize,int NSmooth,glm::ivec3 heightVariation,unsigned int seed);
     void SetupTerrainModifyParameters(float heightMult,glm::vec3 relheight);
 
     //**************************
@@ -152,7 +261,7 @@ public:
     //**********************
     TerrainCreationData GetCreationData()
     {
-        TerrainCreationData data(terrainSize,NSmooth,subdiv,heightVariation);
+        TerrainCreationData data(createSize,NSmooth,subdiv,heightVariation,seed,generator);
         return data;
     };
 
@@ -164,8 +273,10 @@ public:
         int rtnSize;
         int rtnSmooth;
         glm::ivec3 rtnHV;
-        data.ReturnData(rtnSize,rtnSmooth,subdiv,rtnHV);
-        SetupTerrainCreationParameters(rtnSize,rtnSmooth,rtnHV);
+        unsigned int rtnSeed;
+        data.ReturnData(rtnSize,rtnSmooth,subdiv,rtnHV,rtnSeed,generator);
+        generator=std::min(std::max(generator,0),3);
+        SetupTerrainCreationParameters(rtnSize,rtnSmooth,rtnHV,rtnSeed);
     };
 
     //**************************
@@ -174,7 +285,7 @@ public:
     TerrainModificationData GetModificationData()
     {
         glm::vec3 relHeight(GetRelHeight().y,GetRelHeight().z,GetRelHeight().w);
-        TerrainModificationData data(heightMult,relHeight);
+        TerrainModificationData data(heightMult*GetHeightScale(),relHeight);
         return data;
     };
 
@@ -241,15 +352,153 @@ public:
         modifyElevation(2,1.0f,input,camera);
     };
 
-    void modifyElevation(int func,float eff,InputStruct &input,RTSCamera &camera);
+    void modifyElevation(int func,float eff,InputStruct &input,RTSCamera &camera);
+
+    // Terrain hit under the cursor (cheap, usable for hover)
+    PickResult PickTerrain(RTSCamera &camera);
+
+    // Apply the brush samples queued this frame
+    void ApplyBrushStrokes();
+
+    // Step the sculpt history back or forward
+    void Undo();
+    void Redo();
+
+    // Bytes of height tiles the undo history may hold
+    void SetUndoBudget(size_t bytes) {history.SetBudget(bytes);};
+
+    // Select the kernel used by the blur passes
+    void SetSmoothKernel(HeightSmoother::Kernel kernel) {smoothKernel=kernel;};
+
+    // Select central (fast) or Sobel (smooth) normals
+    void SetNormalQuality(HeightNormals::Quality quality) {normals.SetQuality(quality);};
+
+    // Seed used to build the current terrain
+    unsigned int GetLastSeed() {return lastSeed;};
+
+    // Height generator, 0=midpoint displacement, 1=fBm, 2=ridged, 3=domain warped noise
+    void SetGenerator(int generator) {this->generator=std::min(std::max(generator,0),3);};
+    int GetGenerator() {return generator;};
+
+    // Wavelength, octaves etc. of the noise generators
+    void SetNoiseSettings(const HeightNoise::Settings &settings) {noiseSettings=settings;};
+
+    /*
+    Write a tilesX x tilesY tile world built straight
+    from the noise generator (fBm when the midpoint
+    generator is selected) for streaming. Tiles are
+    generated in parallel, one at a time each, so
+    the world never has to fit in memory.
+    */
+    bool SaveNoiseWorld(std::string filename,int tilesX,int tilesY,int tileSize=128);
+
+    /*
+    Set up the noise of the same world and return its
+    header, for TerrainTileStreamer::OpenNoise, which
+    builds the tiles as the camera reaches them.
+    */
+    TileStoreHeader SetupNoiseWorld(int tilesX,int tilesY,int tileSize=128);
+    const HeightNoise& GetNoise() const {return noise;};
+
+    /*
+    Generate the terrain on a worker thread (see
+    BuildHeightData), cancelling a generation still
+    running. UpdateGeneration() must be called once
+    a frame: it swaps in coarse previews and then the
+    finished terrain, and returns true when it did.
+    */
+    void StartGeneration();
+    bool UpdateGeneration();
+    void CancelGeneration();
+    bool IsGenerating() {return job.IsRunning();};
+    HeightBuildJob::Status GetGenerationStatus() {return job.GetStatus();};
+
+    // Nodes of the generation graph set from the creation parameters
+    enum
+    {
+        NODE_HEIGHTS=0, // Midpoint displacement or noise
+        NODE_BLUR=1,
+        NODE_EROSION=2
+    };
+
+    /*
+    The generation graph, for nodes added behind the
+    fixed ones. A running generation is cancelled
+    first, as it reads the graph.
+    */
+    HeightGraph& AccessGraph() {CancelGeneration(); return graph;};
+
+    // Node whose heights become the terrain (NODE_EROSION by default)
+    void SetGraphOutput(int node) {graphOutput=std::min(std::max(node,0),graph.GetNodes()-1);};
+
+    // Erosion run after the blur passes (iterations=0 skips the stage)
+    void SetErosion(const ErosionSettings &settings) {erosion=settings;};
+    ErosionSettings GetErosion() {return erosion;};
+
+    // Live erosion in the editor, the whole run is one undo step
+    void StartErosion();
+    void StepErosion(int iterations);
+    void StopErosion();
+    bool IsEroding() {return eroder.IsLoaded();};
+
+    // Write the height data as a tile store for streaming (TerrainTileStreamer)
+    bool SaveTiledWorld(std::string filename,int tileSize=128);
+
+    // Load a terrain written by ExportTerrain or SaveTerrain (../Data/Terrain/filename.ter)
+    bool LoadTerrain(std::string filename);
+
+    /*
+    Save the heights and look of the terrain to
+    ../Data/Terrain/filename.ter. Only a snapshot is
+    taken here (see TerrainSaver), packing and
+    writing run on a worker thread while editing
+    goes on. Returns false if there is no finished
+    terrain to save.
+    */
+    bool SaveTerrain(std::string filename);
+
+    // Save to ../Data/Terrain/filename.ter every seconds (0=off)
+    void SetAutosave(double seconds,std::string filename="autosave") {autosaveInterval=std::max(seconds,0.0); autosaveName=filename;};
+    double GetAutosaveInterval() {return autosaveInterval;};
+
+    // Call once a frame, autosaves when the interval is up and the terrain changed since the last save
+    void UpdateAutosave();
+
+    bool IsSaving() {return saver.IsBusy();};
+    void WaitForSave() {saver.Wait();};
+
+    /*
+    Import a 16 bit heightmap (../Data/Terrain/filename,
+    .png or .raw, see HeightmapFile) as the terrain.
+    Rows are streamed through HeightResampler straight
+    into the height data, size verts along each edge
+    rounded up to 2^n+1 (0 for the smallest that holds
+    the image). rawWidth/rawHeight give the size of
+    .raw files (0 for a square). Samples keep their
+    16 bit precision, the height multiplier is scaled
+    so 0..65535 stands as tall as heights 0..1000 of
+    a built terrain (8 bit 0..255 likewise).
+    */
+    bool ImportHeightmap(std::string filename,int size=0,int rawWidth=0,int rawHeight=0);
+
+    // Write the heights as a 16 bit heightmap (../Data/Terrain/filename, .png or .raw), built heights 0..1000 stretched to 0..65535, imported samples unchanged
+    bool ExportHeightmap(std::string filename);
 
 private:
     //**************************
     //Terrain Building Functions
     //**************************
-    void AllocateData (int size);
+    static bool AllocateData (HeightField16 &field,int size);
     void GenerateTerrainData(int size);
-    int AverageHeights(int i,int j, std::vector<std::vector<int>> &data,int size);
+    BuildSettings GetBuildSettings(int size);
+    static void SettingsKeys(const BuildSettings &set,uint64_t &heights,uint64_t &rest);
+    void ConfigureGraph(const BuildSettings &set,HeightBuildJob *job);
+    static bool BuildHeightData(HeightField16 &field,const BuildSettings &set,HeightGraph &graph,HeightBuildJob *job);
+    static bool MidpointHeights(HeightField16 &field,const BuildSettings &set,HeightBuildJob *job);
+    HeightNoise::Settings NoiseSettings();
+    void SetupNoise();
+    static void SquareStep(HeightField16 &field,int step,int cycle,const CounterRandom &rng,int hvlow,int hvhigh);
+    static void DiamondStep(HeightField16 &field,int step,int cycle,const CounterRandom &rng,int hvlow,int hvhigh);
 
     // Setup a Regular Mesh
     void setupMeshRegular();
@@ -260,19 +509,52 @@ private:
     // Calculate the max and low heights
     void RecalculateMaxMinHeights();
 
+    // Take low and high as the height range
+    void SetHeightRange(uint16_t low,uint16_t high);
+
+    // Height samples per editor unit, keeping the terrain's world height
+    void ChangeHeightScale(float scale);
+
     // Recalculate Normals
     void RecalculateNormals();
 
+    // Recompute the normals of a region only
+    void UpdateNormals(const HeightRect &r);
+
     // Recalculate Verticies
     void RecalculateVerticies();
 
-    // Setup Verties
-    void SetupVerts();
+    // Rebuild the verts of a region only
+    void UpdateVerticies(const HeightRect &r);
 
-    // Modify the height data
-    void ModifyHeightData(glm::vec3 point,int updown,float eff);
+    // Setup Verties, rangeKnown when SetHeightRange was already called for the heights
+    void SetupVerts(bool rangeKnown=false);
+
+    // Allocate the sub-meshes and build their indices
+    void SetupSubMeshes();
+
+    // Grid rect covered by sub-mesh (m,n)
+    HeightRect MeshRect(int m,int n);
+
+    // World position of grid vert (i,j)
+    glm::vec3 VertPosition(int i,int j);
+
+    // Modify the height data (raise/lower batch)
+    void ModifyHeightData(const std::vector<BrushSample> &samples);
 
     // Level the height data
     void LevelHeightData(glm::vec3 point,float eff);
+
+    // Rect of verts within radius of point
+    HeightRect BrushRect(glm::vec3 point,float radius);
+
+    // Recompute verts/normals/meshes of the dirty region
+    void UpdateDirtyRegion();
+
+    // Push a region of the sub-mesh verts to the GPU
+    void UpdateSubMeshes(const HeightRect &r);
+
+    // Store pending live erosion steps into the terrain
+    void ShowErosion();
 };
 #endif
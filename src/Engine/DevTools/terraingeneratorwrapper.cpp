@@ -43,6 +43,13 @@ void TerrainGeneratorWrapper::Init (GrafixEngine *game) {
     MaterialModificationData mmtoolboxdata=terrainGen.GetMaterialModificationData();
     mmtoolbox.Init(0.0f,0.0f,&game->props,game->audioengine,mmtoolboxdata);
 
+    //***********************
+    //  Load Terrain Toolbox
+    //***********************
+    // Initialize the Load terrain toolbox
+    ldtoolbox.Init("Load",0.0f,0.0f,&game->props,game->audioengine);
+    ldtoolbox.SetHint(".png/.raw: 16 bit, 0-65535 as tall as 0-1000");
+
     //***********************
     //  Save Terrain Toolbox
     //***********************
@@ -51,6 +58,7 @@ void TerrainGeneratorWrapper::Init (GrafixEngine *game) {
 
     // Initialize the Save terrain toolbox
     ettoolbox.Init("Export",0.0f,0.0f,&game->props,game->audioengine);
+    ettoolbox.SetHint(".png/.raw: built heights 0-1000 become 0-65535");
 
     //**************************
     //Terrain Sculpting Toolbox
@@ -68,10 +76,16 @@ void TerrainGeneratorWrapper::Init (GrafixEngine *game) {
     smbi[0].options.push_back("Load");
     smbi[0].options.push_back("Save");
     smbi[0].options.push_back("Export");
+    smbi[0].options.push_back("Export Adaptive");
 
     smbi[1].title="View";
     smbi[1].options.push_back("Wireframe Mode");
     smbi[1].options.push_back("Number Mesh");
+    smbi[1].options.push_back("Level of Detail");
+    smbi[1].options.push_back("LOD Bias +");
+    smbi[1].options.push_back("LOD Bias -");
+    smbi[1].options.push_back("Height Map Rendering");
+    smbi[1].options.push_back("Tile Streaming");
 
     smbi[2].title="Generate";
     smbi[2].options.push_back("Terrain");
@@ -85,6 +99,7 @@ void TerrainGeneratorWrapper::Init (GrafixEngine *game) {
     smbi[3].options.push_back("Terrain");
     smbi[3].options.push_back("Material");
     smbi[3].options.push_back("Sculpting");
+    smbi[3].options.push_back("Erosion");
 
     mbar.Init(smbi,game->props);
     smbi.clear();
@@ -126,7 +141,34 @@ void TerrainGeneratorWrapper::UpdateEvents(InputStruct &input)
         //*******************************
         if (selID.option==0)
         {
-            selID.reset();
+            int ldtbCall=ldtoolbox.UpdateEvents(input);
+            if(ldtbCall==0)
+            {
+                //*****************************
+                //    LOAD TERRAIN FUNCTIONS
+                //*****************************
+                // Names with a .png or .raw extension are heightmaps to import
+                std::string fn=ldtoolbox.GetFileName();
+                bool loaded = HeightmapFile::FormatOf(fn)!=HeightmapFile::HEIGHTMAP_NONE ? terrainGen.ImportHeightmap(fn)
+                                                                                        : terrainGen.LoadTerrain(fn);
+                if (loaded)
+                {
+                    terrainGen.SetTerrainOnGPU();
+
+                    // The file may have brought its own shader
+                    if (terrainGen.GetGPUShdr())
+                    {
+                        camera.RegisterShaderWithCameraDataUBO(terrainGen.AccessShader());
+                        skylight.RegisterShader(terrainGen.AccessShader());
+                    }
+                }
+                selID.reset();
+            }
+
+            if(ldtbCall==1)
+            {
+                selID.reset();
+            }
         }
 
         //*******************************
@@ -140,8 +182,9 @@ void TerrainGeneratorWrapper::UpdateEvents(InputStruct &input)
                 //*****************************
                 //    SAVE TERRAIN FUNCTIONS
                 //*****************************
-                std::string fn=sttoolbox.GetFileName();
-
+                // Written on a worker thread, editing goes on meanwhile
+                terrainGen.SaveTerrain(sttoolbox.GetFileName());
+
                 selID.reset();
             }
 
@@ -154,7 +197,8 @@ void TerrainGeneratorWrapper::UpdateEvents(InputStruct &input)
         //*******************************
         //        Export Terrain
         //*******************************
-        if (selID.option==2)
+        // Full grid meshes, or adaptive ones within the export error
+        if (selID.option==2 || selID.option==3)
         {
             int ettbCall=ettoolbox.UpdateEvents(input);
             if(ettbCall==0)
@@ -162,7 +206,16 @@ void TerrainGeneratorWrapper::UpdateEvents(InputStruct &input)
                 //*****************************
                 //    SAVE TERRAIN FUNCTIONS
                 //*****************************
-                terrainGen.ExportTerrain(ettoolbox.GetFileName());
+                // Names with a .png or .raw extension export the heights only
+                std::string fn=ettoolbox.GetFileName();
+                if (HeightmapFile::FormatOf(fn)!=HeightmapFile::HEIGHTMAP_NONE)
+                {
+                    terrainGen.ExportHeightmap(fn);
+                }
+                else
+                {
+                    terrainGen.ExportTerrain(fn,selID.option==3);
+                }
                 selID.reset();
             }
 
@@ -211,6 +264,93 @@ void TerrainGeneratorWrapper::UpdateEvents(InputStruct &input)
 
             selID.reset();
         }
+
+        //*******************************
+        //    Toggle Level of Detail
+        //*******************************
+        if (selID.option==2)
+        {
+            terrainGen.SetLODEnabled(!terrainGen.GetLODEnabled());
+            if (terrainGen.GetGPUData())
+            {
+                terrainGen.SetTerrainOnGPU();
+            }
+
+            selID.reset();
+        }
+
+        //*******************************
+        //       Change the LOD Bias
+        //*******************************
+        if (selID.option==3)
+        {
+            terrainGen.SetLODBias(terrainGen.GetLODBias()+0.5f);
+            selID.reset();
+        }
+
+        if (selID.option==4)
+        {
+            terrainGen.SetLODBias(terrainGen.GetLODBias()-0.5f);
+            selID.reset();
+        }
+
+        //*******************************
+        //  Toggle Height Map Rendering
+        //*******************************
+        if (selID.option==5)
+        {
+            terrainGen.SetHeightMapEnabled(!terrainGen.GetHeightMapEnabled());
+            if (terrainGen.GetGPUData())
+            {
+                terrainGen.SetTerrainOnGPU();
+            }
+
+            selID.reset();
+        }
+
+        //*******************************
+        //     Toggle Tile Streaming
+        //*******************************
+        /*
+        With a noise generator selected a 64x64 tile
+        world is streamed straight from the noise, each
+        tile built by the streamer's worker as the camera
+        reaches it. Else the current terrain (if any) is
+        written out as the tile store first, otherwise
+        the store already on disk is streamed.
+        */
+        if (selID.option==6)
+        {
+            if (streamer.IsActive())
+            {
+                streamer.Close();
+            }
+            else
+            {
+                std::string fn="../Data/Terrain/world.tiles";
+                bool opened;
+                if (terrainGen.GetGenerator()>0)
+                {
+                    TileStoreHeader world = terrainGen.SetupNoiseWorld(64,64);
+                    opened = streamer.OpenNoise(terrainGen.GetNoise(),world);
+                }
+                else
+                {
+                    if (terrainGen.GetGPUData())
+                    {
+                        terrainGen.SaveTiledWorld(fn);
+                    }
+                    opened = streamer.Open(fn);
+                }
+
+                if (opened)
+                {
+                    streamer.Start();
+                }
+            }
+
+            selID.reset();
+        }
     }
 
     //******************************
@@ -229,10 +369,10 @@ void TerrainGeneratorWrapper::UpdateEvents(InputStruct &input)
                 //*****************************
                 // TERRAIN CREATION FUNCTIONS
                 //*****************************
+                // Built in the background, a running generation is cancelled
                 TerrainCreationData tcdata=tctoolbox.FetchTerrainCreationData();
                 terrainGen.SaveCreationData(tcdata);
-                terrainGen.GenerateTerrain();
-                terrainGen.SetTerrainOnGPU();
+                terrainGen.StartGeneration();
             }
 
             if(tctbCall==1)
@@ -383,8 +523,53 @@ void TerrainGeneratorWrapper::UpdateEvents(InputStruct &input)
                 selID.reset();
             }
         }
+
+        //*******************************
+        //     Toggle Live Erosion
+        //*******************************
+        if (selID.option==3)
+        {
+            if (terrainGen.IsEroding())
+            {
+                terrainGen.StopErosion();
+            }
+            else
+            {
+                terrainGen.StartErosion();
+            }
+
+            selID.reset();
+        }
+    }
+
+    // A block of erosion iterations a frame while live erosion is on
+    terrainGen.StepErosion(4);
+
+    //******************************
+    //   Sculpt Undo (Ctrl+Z/Y)
+    //******************************
+    // Not while a file name is being typed
+    if (!(selID.isset && selID.menu==0))
+    {
+        bool ctrl = input.GetKey(GLFW_KEY_LEFT_CONTROL) || input.GetKey(GLFW_KEY_RIGHT_CONTROL);
+
+        if (kh.CheckKeyState(ctrl && input.GetKey(GLFW_KEY_Z),GLFW_KEY_Z))
+        {
+            terrainGen.Undo();
+        }
+
+        if (kh.CheckKeyState(ctrl && input.GetKey(GLFW_KEY_Y),GLFW_KEY_Y))
+        {
+            terrainGen.Redo();
+        }
     }
 
+    // Apply this frame's sculpting in one pass
+    terrainGen.ApplyBrushStrokes();
+
+    // Queue and upload the streamed tiles around the camera
+    streamer.Update(camera.GetvPolPos());
+
     // Update the camera
     camera.UpdateCamera(input);
 };
@@ -409,7 +594,7 @@ void TerrainGeneratorWrapper::ToolBoxDraw()
             // Load Menu
             if(selID.option==0)
             {
-
+                ldtoolbox.DrawToolBox();
             }
 
             // Save Menu
@@ -418,8 +603,8 @@ void TerrainGeneratorWrapper::ToolBoxDraw()
                 sttoolbox.DrawToolBox();
             }
 
-            // Save Menu
-            if(selID.option==2)
+            // Export Menu
+            if(selID.option==2 || selID.option==3)
             {
                 ettoolbox.DrawToolBox();
             }
@@ -480,6 +665,12 @@ void TerrainGeneratorWrapper::UpdateData()
     }
 
     dt=glfwGetTime();
+
+    // Swap in previews and the finished terrain of a background generation
+    terrainGen.UpdateGeneration();
+
+    // Periodic background save of a changed terrain
+    terrainGen.UpdateAutosave();
 };
 
 //******************************************//
@@ -497,7 +688,14 @@ void TerrainGeneratorWrapper::Draw()
     if (wireframe)
         glPolygonMode(GL_FRONT_AND_BACK,GL_LINE);
 
-    terrainGen.DrawCall();
+    if (streamer.IsActive())
+    {
+        terrainGen.DrawCall(streamer,camera);
+    }
+    else
+    {
+        terrainGen.DrawCall(camera);
+    }
 
     glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
     glDisable(GL_DEPTH_TEST);
@@ -536,6 +734,31 @@ void TerrainGeneratorWrapper::Draw()
     std::stringstream ss3;
     ss3 << "Number of Verts: " << terrainGen.GetNumberVerts();
     text.RenderTextRightJustified(ss3.str(),0.98,0.85,0.9f,glm::vec3(1.0f));
+
+    std::stringstream ss4;
+    ss4 << "Drawn Triangles: " << terrainGen.GetDrawnTriangles();
+    if (terrainGen.GetLODEnabled())
+        ss4 << " (LOD Bias: " << terrainGen.GetLODBias() << ")";
+    text.RenderTextRightJustified(ss4.str(),0.98,0.8,0.9f,glm::vec3(1.0f));
+
+    std::stringstream ss5;
+    if (streamer.IsActive())
+    {
+        ss5 << "Streamed Tiles: " << streamer.GetVisibleTiles() << "/" << streamer.GetResidentTiles() << " (Pending: " << streamer.GetPendingTiles() << ", " << streamer.GetGPUMemory()/(1024*1024) << "MB)";
+    }
+    else
+    {
+        ss5 << "Visible Meshes: " << terrainGen.GetVisibleMeshes() << " (Culled: " << terrainGen.GetCulledMeshes() << ")";
+    }
+    text.RenderTextRightJustified(ss5.str(),0.98,0.75,0.9f,glm::vec3(1.0f));
+
+    HeightBuildJob::Status gen=terrainGen.GetGenerationStatus();
+    if (gen.running)
+    {
+        std::stringstream ss6;
+        ss6 << "Generating (" << gen.stage << "/" << gen.stages << "): " << gen.message << " " << (int)(gen.fraction*100.0f) << "%";
+        text.RenderTextRightJustified(ss6.str(),0.98,0.7,0.9f,glm::vec3(1.0f));
+    }
 };
 
 //******************************************//
@@ -550,13 +773,17 @@ void TerrainGeneratorWrapper::Cleanup()
     camera.Cleanup();
     skylight.Cleanup();
     text.Cleanup();
+    streamer.Close();
+    terrainGen.CancelGeneration();
+    terrainGen.WaitForSave();
     terrainGen.Cleanup();
 
     // Cleanup toolboxes
     tctoolbox.Cleanup();
     tmtoolbox.Cleanup();
     mmtoolbox.Cleanup();
-    sttoolbox.Cleanup();
+    ldtoolbox.Cleanup();
+    sttoolbox.Cleanup();
     ettoolbox.Cleanup();
     tstoolbox.Cleanup();
 
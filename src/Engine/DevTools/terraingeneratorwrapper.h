@@ -14,6 +14,7 @@
 #include "../Tools/ToolBoxs/terrainsculptingtoolbox.h"
 #include "../Tools/ToolBoxs/savetoolbox.h"
 #include "TerrainGenerator/terrainGenerator.h"
+#include "../Handlers/TerrainHandler/terraintilestreamer.h"
 
 //******************************************//
 //    Terrain Generator Wrapper Class       //
@@ -57,6 +58,9 @@ class TerrainGeneratorWrapper
     // Terrain Scupting Toolbox
     TerrainSculptingToolbox tstoolbox;
 
+    // Load Terrain Toolbox
+    SaveToolbox ldtoolbox;
+
     // Save Terrain Toolbox
     SaveToolbox sttoolbox;
 
@@ -66,6 +70,9 @@ class TerrainGeneratorWrapper
     // Terrain Generator Class
     TerrainGeneration terrainGen;
 
+    // Streamed tile world, drawn instead of the terrain when active
+    TerrainTileStreamer streamer;
+
     // Class Wrappers
     RTSCamera camera;
 
@@ -76,6 +83,9 @@ class TerrainGeneratorWrapper
     BarSelection selID;
     MenuBar mbar;
 
+    // Press and release of the undo/redo keys
+    keyhandler kh;
+
 public:
     TerrainGeneratorWrapper() {};
     ~TerrainGeneratorWrapper () {};
@@ -0,0 +1,148 @@
+#include "heightbuildjob.h"
+#include "../../Tools/console.h"
+#include <algorithm>
+
+HeightBuildJob::HeightBuildJob()
+{
+    cancel=false;
+    previewStride=1;
+    previewReady=false;
+    resultReady=false;
+}
+
+//******************************************//
+//          Start and Stop a Build          //
+//******************************************//
+void HeightBuildJob::Start(Task task)
+{
+    Cancel();
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        status=Status();
+        status.running=true;
+    }
+
+    worker=std::thread(&HeightBuildJob::Run,this,task);
+};
+
+void HeightBuildJob::Cancel()
+{
+    cancel=true;
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+    cancel=false;
+
+    std::lock_guard<std::mutex> guard(lock);
+    status.running=false;
+    previewReady=false;
+    resultReady=false;
+};
+
+void HeightBuildJob::Run(Task task)
+{
+    bool ok=task(*this,back);
+
+    std::lock_guard<std::mutex> guard(lock);
+    status.running=false;
+    resultReady = ok && !cancel;
+};
+
+//******************************************//
+//        Poll from the Main Thread         //
+//******************************************//
+bool HeightBuildJob::IsRunning()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return status.running;
+};
+
+HeightBuildJob::Status HeightBuildJob::GetStatus()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return status;
+};
+
+bool HeightBuildJob::TakePreview(HeightField16 &field,int &stride)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!previewReady)
+    {
+        return false;
+    }
+
+    field.Swap(preview);
+    stride=previewStride;
+    previewReady=false;
+    return true;
+};
+
+/*
+The worker is done with the back buffer once the
+result is flagged, it is joined before the swap
+so the next Start() finds it idle.
+*/
+bool HeightBuildJob::TakeResult(HeightField16 &field)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!resultReady)
+        {
+            return false;
+        }
+        resultReady=false;
+        previewReady=false;
+    }
+
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+
+    field.Swap(back);
+    return true;
+};
+
+//******************************************//
+//       Report from the Worker Thread      //
+//******************************************//
+bool HeightBuildJob::Report(int stage,int stages,const std::string &message,float fraction)
+{
+    if (!message.empty())
+    {
+        Console::cPrint(message);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    status.stage=stage;
+    status.stages=stages;
+    if (!message.empty())
+    {
+        status.message=message;
+    }
+    status.fraction=std::min(std::max(fraction,0.0f),1.0f);
+
+    return !cancel;
+};
+
+bool HeightBuildJob::Report(float fraction)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    status.fraction=std::min(std::max(fraction,0.0f),1.0f);
+    return !cancel;
+};
+
+void HeightBuildJob::PublishPreview(HeightField16 &coarse,int stride)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (cancel)
+    {
+        return;
+    }
+
+    preview.Swap(coarse);
+    previewStride=stride;
+    previewReady=true;
+};
@@ -0,0 +1,102 @@
+#ifndef HEIGHTBUILDJOB_C
+#define HEIGHTBUILDJOB_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Tools/heightfield.hpp"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+//******************************************//
+//          Height Build Job Class          //
+//******************************************//
+/*
+    Runs a height field build on a worker thread
+    so the editor keeps drawing while it runs.
+
+    The task writes into the job's back buffer. It
+    reports its stages through Report(), which also
+    prints the stage message to the Console, and
+    may publish coarse previews on the way. The
+    main thread polls once a frame: TakePreview()
+    and TakeResult() swap the newest preview or the
+    finished field with the editor's height data,
+    so neither side ever sees a half built field,
+    and the old heights become the back buffer of
+    the next build.
+
+    Starting a new build cancels the running one.
+    Tasks check Report()/Cancelled() between their
+    steps and return false when asked to stop.
+*/
+class HeightBuildJob
+{
+public:
+    // Builds into field, returns false if cancelled or failed
+    typedef std::function<bool(HeightBuildJob &job,HeightField16 &field)> Task;
+
+    struct Status
+    {
+        bool running;
+        int stage; // 1..stages
+        int stages;
+        std::string message; // Last stage message
+        float fraction; // Done of the current stage, 0..1
+
+        Status() : running(false), stage(0), stages(0), fraction(0.0f) {};
+    };
+
+private:
+    std::thread worker;
+    std::mutex lock;
+    std::atomic<bool> cancel;
+
+    HeightField16 back; // Written by the task only while it runs
+
+    HeightField16 preview;
+    int previewStride;
+    bool previewReady;
+    bool resultReady;
+
+    Status status;
+
+    void Run(Task task);
+
+public:
+    HeightBuildJob();
+    ~HeightBuildJob() {Cancel();};
+
+    //*************************
+    //       Main Thread
+    //*************************
+    // Cancel any running build and start task
+    void Start(Task task);
+
+    // Stop the running build and wait for the worker, nothing is published after
+    void Cancel();
+
+    bool IsRunning();
+    Status GetStatus();
+
+    // Swap in the newest preview, stride being world verts per preview vert
+    bool TakePreview(HeightField16 &field,int &stride);
+
+    // Swap in the finished field
+    bool TakeResult(HeightField16 &field);
+
+    //*************************
+    //      Worker Thread
+    //*************************
+    bool Cancelled() const {return cancel;};
+    const std::atomic<bool>* CancelFlag() const {return &cancel;};
+
+    // Enter a stage (message printed if not empty) or move within it, false when cancelled
+    bool Report(int stage,int stages,const std::string &message,float fraction);
+    bool Report(float fraction);
+
+    // Publish coarse, taking its contents, stride being world verts per preview vert
+    void PublishPreview(HeightField16 &coarse,int stride);
+};
+
+#endif
@@ -0,0 +1,411 @@
+#include "heighteroder.h"
+#include <algorithm>
+#include <math.h>
+
+HeightEroder::HeightEroder()
+{
+    cur=0;
+    width=0;
+    height=0;
+    step=0;
+    scale=1.0f;
+    tileSize=128;
+    stepsPerExchange=4;
+}
+
+void HeightEroder::Scratch::Resize(size_t n)
+{
+    if (b.size()>=n)
+    {
+        return;
+    }
+
+    b.resize(n); b2.resize(n);
+    w.resize(n); w2.resize(n);
+    s.resize(n); s2.resize(n);
+    c.resize(n);
+    for (int k=0; k<4; ++k)
+    {
+        f[k].resize(n);
+    }
+};
+
+//******************************************//
+//          Load and Store the State        //
+//******************************************//
+bool HeightEroder::Load(const HeightField16 &field,unsigned int seed,float scale)
+{
+    if (field.Empty() || !(scale>0.0f))
+    {
+        return false;
+    }
+
+    width=field.Width();
+    height=field.Height();
+    cur=0;
+    step=0;
+    this->scale=scale;
+    rng.SetSeed(seed);
+
+    const size_t n=(size_t)width*height;
+    for (int l=0; l<2; ++l)
+    {
+        layers[l].ground.resize(n);
+        layers[l].water.resize(n);
+        layers[l].sediment.resize(n);
+    }
+
+    Layer &L = layers[cur];
+    const float inv = 1.0f/scale;
+
+    #pragma omp parallel for schedule(static)
+    for (int i=0; i<height; ++i)
+    {
+        const uint16_t *row = field.Row(i);
+        const size_t o = (size_t)i*width;
+
+        for (int j=0; j<width; ++j)
+        {
+            L.ground[o+j]=row[j]*inv;
+            L.water[o+j]=0.0f;
+            L.sediment[o+j]=0.0f;
+        }
+    }
+
+    return true;
+};
+
+void HeightEroder::Store(HeightField16 &field) const
+{
+    if (!IsLoaded() || field.Width()!=width || field.Height()!=height)
+    {
+        return;
+    }
+
+    const Layer &L = layers[cur];
+
+    #pragma omp parallel for schedule(static)
+    for (int i=0; i<height; ++i)
+    {
+        uint16_t *row = field.Row(i);
+        const size_t o = (size_t)i*width;
+
+        for (int j=0; j<width; ++j)
+        {
+            float v = std::round((L.ground[o+j]+L.sediment[o+j])*scale);
+            row[j] = (uint16_t)std::min(std::max(v,0.0f),65535.0f);
+        }
+    }
+};
+
+void HeightEroder::Cleanup()
+{
+    for (int l=0; l<2; ++l)
+    {
+        std::vector<float>().swap(layers[l].ground);
+        std::vector<float>().swap(layers[l].water);
+        std::vector<float>().swap(layers[l].sediment);
+    }
+
+    width=0;
+    height=0;
+    step=0;
+};
+
+void HeightEroder::Erode(HeightField16 &field,const ErosionSettings &set,unsigned int seed)
+{
+    if (set.iterations<=0 || !Load(field,seed))
+    {
+        return;
+    }
+
+    Run(set.iterations,set);
+    Store(field);
+    Cleanup();
+};
+
+//******************************************//
+//              Run Iterations              //
+//******************************************//
+/*
+Each block of stepsPerExchange iterations reads the
+current layer and writes the other, so tiles never
+see a neighbour half way through a block.
+*/
+bool HeightEroder::Run(int iterations,const ErosionSettings &set,const std::atomic<bool> *stop)
+{
+    if (!IsLoaded())
+    {
+        return false;
+    }
+
+    const int tilesX=(width+tileSize-1)/tileSize;
+    const int tilesY=(height+tileSize-1)/tileSize;
+
+    int done=0;
+    while (done<iterations)
+    {
+        const int steps=std::min(stepsPerExchange,iterations-done);
+
+        #pragma omp parallel
+        {
+            Scratch sc;
+
+            #pragma omp for schedule(dynamic)
+            for (int t=0; t<tilesX*tilesY; ++t)
+            {
+                if (stop && *stop)
+                {
+                    continue;
+                }
+                RunTile(t/tilesX,t%tilesX,steps,set,sc);
+            }
+        }
+
+        // A stopped block is not switched to
+        if (stop && *stop)
+        {
+            return false;
+        }
+
+        cur=1-cur;
+        step+=steps;
+        done+=steps;
+    }
+
+    return true;
+};
+
+HeightEroder::Area HeightEroder::Shrink(const Area &a,int ri0,int rj0) const
+{
+    Area r=a;
+    if (ri0+a.i0>0) ++r.i0;
+    if (ri0+a.i1<height) --r.i1;
+    if (rj0+a.j0>0) ++r.j0;
+    if (rj0+a.j1<width) --r.j1;
+    return r;
+};
+
+//******************************************//
+//         Run a Tile with its Halo         //
+//******************************************//
+/*
+Call op(j,up,down,left,right) for the cells [j0,j1)
+of a row, the flags telling which neighbours lie
+inside the field. Only the first and last column of
+the field need the checks, every other cell goes
+through a loop with constant flags that vectorizes.
+*/
+template <class Op>
+static inline void ForCells(int j0,int j1,int rj0,int width,bool up,bool down,Op op)
+{
+    if (j0<j1 && rj0+j0==0)
+    {
+        op(j0,up,down,false,true);
+        ++j0;
+    }
+
+    if (j0<j1 && rj0+j1==width)
+    {
+        --j1;
+        op(j1,up,down,true,false);
+    }
+
+    if (up && down)
+    {
+        #pragma omp simd
+        for (int j=j0; j<j1; ++j)
+        {
+            op(j,true,true,true,true);
+        }
+    } else {
+        for (int j=j0; j<j1; ++j)
+        {
+            op(j,up,down,true,true);
+        }
+    }
+};
+
+// Height a cell gains (d>0) or loses (d<0) to a neighbour d above it
+static inline float Excess(float d,float talus)
+{
+    return std::max(d-talus,0.0f)-std::max(-d-talus,0.0f);
+};
+
+void HeightEroder::RunTile(int ti,int tj,int steps,const ErosionSettings &set,Scratch &sc)
+{
+    const int halo=3*steps;
+
+    const int ti0=ti*tileSize;
+    const int ti1=std::min(ti0+tileSize,height);
+    const int tj0=tj*tileSize;
+    const int tj1=std::min(tj0+tileSize,width);
+
+    const int ri0=std::max(ti0-halo,0);
+    const int ri1=std::min(ti1+halo,height);
+    const int rj0=std::max(tj0-halo,0);
+    const int rj1=std::min(tj1+halo,width);
+
+    const int R=ri1-ri0;
+    const int C=rj1-rj0;
+
+    sc.Resize((size_t)R*C);
+
+    float *b=&sc.b[0], *b2=&sc.b2[0];
+    float *w=&sc.w[0], *w2=&sc.w2[0];
+    float *s=&sc.s[0], *s2=&sc.s2[0];
+    float *c=&sc.c[0];
+    float *fu=&sc.f[0][0], *fd=&sc.f[1][0], *fl=&sc.f[2][0], *fr=&sc.f[3][0];
+
+    //********************
+    //  Copy In the Halo
+    //********************
+    const Layer &src = layers[cur];
+    for (int i=0; i<R; ++i)
+    {
+        const size_t o=(size_t)(ri0+i)*width+rj0;
+        memcpy(b+(size_t)i*C,&src.ground[o],C*sizeof(float));
+        memcpy(w+(size_t)i*C,&src.water[o],C*sizeof(float));
+        memcpy(s+(size_t)i*C,&src.sediment[o],C*sizeof(float));
+    }
+
+    const float keep=1.0f-set.evaporation;
+    const float slide=0.25f*set.thermal;
+    const float flowScale=0.5f*set.flow;
+
+    Area a={0,R,0,C};
+    for (int k=0; k<steps; ++k)
+    {
+        const uint32_t it=(uint32_t)(step+k);
+
+        //********************
+        //        Rain
+        //********************
+        for (int i=a.i0; i<a.i1; ++i)
+        {
+            float *wRow=w+(size_t)i*C;
+            const uint64_t first=(uint64_t)(ri0+i)*width+rj0+a.j0;
+
+            // Drawn into w2, free until the flow step
+            rng.FillReals(it,first,a.j1-a.j0,0.5f*set.rain,1.5f*set.rain,w2);
+            for (int j=a.j0; j<a.j1; ++j)
+            {
+                wRow[j]+=w2[j-a.j0];
+            }
+        }
+
+        //********************
+        //  Outflow per Cell
+        //********************
+        const Area a1=Shrink(a,ri0,rj0);
+        for (int i=a1.i0; i<a1.i1; ++i)
+        {
+            const size_t row=(size_t)i*C;
+
+            ForCells(a1.j0,a1.j1,rj0,width,ri0+i>0,ri0+i<height-1,[&](int j,bool up,bool down,bool left,bool right)
+            {
+                const size_t l=row+j;
+                const float lvl=b[l]+w[l];
+
+                float du = up    ? std::max(lvl-(b[l-C]+w[l-C]),0.0f) : 0.0f;
+                float dd = down  ? std::max(lvl-(b[l+C]+w[l+C]),0.0f) : 0.0f;
+                float dl = left  ? std::max(lvl-(b[l-1]+w[l-1]),0.0f) : 0.0f;
+                float dr = right ? std::max(lvl-(b[l+1]+w[l+1]),0.0f) : 0.0f;
+
+                // Never more than the water the cell holds
+                float total=(du+dd+dl+dr)*flowScale;
+                float scale = total>w[l] ? flowScale*w[l]/total : flowScale;
+
+                fu[l]=du*scale;
+                fd[l]=dd*scale;
+                fl[l]=dl*scale;
+                fr[l]=dr*scale;
+                c[l] = w[l]>0.0f ? s[l]/w[l] : 0.0f;
+            });
+        }
+
+        //**************************
+        // Transport and Erosion
+        //**************************
+        const Area a2=Shrink(a1,ri0,rj0);
+        for (int i=a2.i0; i<a2.i1; ++i)
+        {
+            const size_t row=(size_t)i*C;
+
+            ForCells(a2.j0,a2.j1,rj0,width,ri0+i>0,ri0+i<height-1,[&](int j,bool up,bool down,bool left,bool right)
+            {
+                const size_t l=row+j;
+                const float out=fu[l]+fd[l]+fl[l]+fr[l];
+
+                // Missing neighbours count as level ground with no flow
+                float in=0.0f, sedIn=0.0f;
+                if (up)    {in+=fd[l-C]; sedIn+=fd[l-C]*c[l-C];}
+                if (down)  {in+=fu[l+C]; sedIn+=fu[l+C]*c[l+C];}
+                if (left)  {in+=fr[l-1]; sedIn+=fr[l-1]*c[l-1];}
+                if (right) {in+=fl[l+1]; sedIn+=fl[l+1]*c[l+1];}
+
+                float bu = up    ? b[l-C] : b[l];
+                float bd = down  ? b[l+C] : b[l];
+                float bl = left  ? b[l-1] : b[l];
+                float br = right ? b[l+1] : b[l];
+
+                float water=w[l]-out+in;
+                float sed=s[l]-out*c[l]+sedIn;
+
+                float gx=0.5f*(br-bl);
+                float gz=0.5f*(bd-bu);
+                float slope=std::max(sqrtf(gx*gx+gz*gz),set.minSlope);
+                float cap=set.capacity*0.5f*(out+in)*slope;
+
+                // Drop the excess sediment or pick up ground up to the capacity
+                float change = sed>cap ? set.deposition*(sed-cap) : -std::min(set.erosion*(cap-sed),set.maxErosion);
+
+                b2[l]=b[l]+change;
+                w2[l]=water*keep;
+                s2[l]=sed-change;
+            });
+        }
+
+        //********************
+        //  Thermal Erosion
+        //********************
+        const Area a3=Shrink(a2,ri0,rj0);
+        for (int i=a3.i0; i<a3.i1; ++i)
+        {
+            const size_t row=(size_t)i*C;
+
+            ForCells(a3.j0,a3.j1,rj0,width,ri0+i>0,ri0+i<height-1,[&](int j,bool up,bool down,bool left,bool right)
+            {
+                const size_t l=row+j;
+                const float h=b2[l];
+
+                // Excess over the talus slope, gained from higher and lost to lower neighbours
+                float du = up    ? b2[l-C]-h : 0.0f;
+                float dd = down  ? b2[l+C]-h : 0.0f;
+                float dl = left  ? b2[l-1]-h : 0.0f;
+                float dr = right ? b2[l+1]-h : 0.0f;
+
+                float move = Excess(du,set.talus)+Excess(dd,set.talus)+Excess(dl,set.talus)+Excess(dr,set.talus);
+                b[l]=h+slide*move;
+            });
+        }
+
+        std::swap(w,w2);
+        std::swap(s,s2);
+        a=a3;
+    }
+
+    //********************
+    //  Write the Tile
+    //********************
+    Layer &dst = layers[1-cur];
+    for (int i=ti0; i<ti1; ++i)
+    {
+        const size_t o=(size_t)i*width+tj0;
+        const size_t l=(size_t)(i-ri0)*C+(tj0-rj0);
+
+        memcpy(&dst.ground[o],b+l,(tj1-tj0)*sizeof(float));
+        memcpy(&dst.water[o],w+l,(tj1-tj0)*sizeof(float));
+        memcpy(&dst.sediment[o],s+l,(tj1-tj0)*sizeof(float));
+    }
+};
@@ -0,0 +1,166 @@
+#ifndef HEIGHTERODER_C
+#define HEIGHTERODER_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Tools/heightfield.hpp"
+#include "randlib.h"
+#include <atomic>
+
+//******************************************//
+//           Erosion Settings Struct        //
+//******************************************//
+/*
+    All amounts are in height units per iteration,
+    slopes in height units per grid cell.
+*/
+struct ErosionSettings
+{
+    int iterations; // Iterations run by Erode() (0=no erosion stage)
+
+    float rain; // Mean water added to every cell
+    float evaporation; // Fraction of the water lost
+    float flow; // Fraction of a water level difference that flows
+
+    float capacity; // Sediment carried per unit of water flow and slope
+    float minSlope; // Slope used on flat ground, so water still carries some
+    float erosion; // Fraction of the missing capacity picked up
+    float deposition; // Fraction of the excess sediment dropped
+    float maxErosion; // Most ground removed from a cell
+
+    float talus; // Steepest slope thermal erosion leaves standing
+    float thermal; // Fraction of the excess slope that slides (<=1)
+
+    ErosionSettings()
+    {
+        iterations=0;
+        rain=0.05f;
+        evaporation=0.02f;
+        flow=0.5f;
+        capacity=2.0f;
+        minSlope=0.05f;
+        erosion=0.3f;
+        deposition=0.3f;
+        maxErosion=0.5f;
+        talus=4.0f;
+        thermal=0.2f;
+    };
+};
+
+//******************************************//
+//            Height Eroder Class           //
+//******************************************//
+/*
+    Grid based hydraulic and thermal erosion of a
+    HeightField16. Every cell holds its ground
+    height, water and suspended sediment (floats,
+    so changes well below one height unit add up).
+    An iteration runs:
+
+        rain        random amount per cell, drawn
+                    from (seed, iteration, cell)
+        flow        water moves to the lower of the
+                    4 neighbours in proportion to the
+                    water level difference, carrying
+                    its share of the sediment
+        erosion     the flow picks up ground up to
+                    its capacity (flow x slope), or
+                    drops the sediment above it
+        evaporation
+        thermal     slopes above the talus slope
+                    slide down to the neighbours
+
+    Every step is written as a gather: a cell only
+    reads the previous values of cells at most 1
+    away, so one iteration depends on cells up to 3
+    away.
+
+    The field is cut into tiles. A thread copies a
+    tile plus a halo of 3 x stepsPerExchange cells
+    into its own scratch buffers, runs that many
+    iterations there (the valid area shrinking by
+    up to 3 cells a step) and writes the tile back
+    into the second global buffer. The halos are
+    exchanged through the global buffers after
+    every block of iterations. Each cell is worked
+    out by the same operations on the same inputs
+    whichever tile or thread does it, so results
+    only depend on the seed and the settings.
+
+    Water cannot leave the field.
+*/
+class HeightEroder
+{
+    struct Layer
+    {
+        std::vector<float> ground;
+        std::vector<float> water;
+        std::vector<float> sediment;
+    };
+
+    // Per thread scratch of one tile plus halo
+    struct Scratch
+    {
+        std::vector<float> b,b2,w,w2,s,s2,c;
+        std::vector<float> f[4]; // Outflow to up, down, left, right
+        void Resize(size_t n);
+    };
+
+    // Cells [i0,i1)x[j0,j1) of the scratch that hold valid values
+    struct Area
+    {
+        int i0,i1,j0,j1;
+    };
+
+    Layer layers[2];
+    int cur; // Layer holding the current state
+    int width,height;
+    long long int step; // Iterations run since Load()
+    float scale; // Height samples per unit of ground
+
+    int tileSize;
+    int stepsPerExchange;
+
+    CounterRandom rng;
+
+    void RunTile(int ti,int tj,int steps,const ErosionSettings &set,Scratch &sc);
+
+    // Shrink a by 1 on every side that is not on the field border
+    Area Shrink(const Area &a,int ri0,int rj0) const;
+
+public:
+    HeightEroder();
+    ~HeightEroder() {};
+
+    /*
+    Take the heights of field as ground, with no water
+    or sediment. Heights are divided by scale, so the
+    settings act the same on fields with finer height
+    samples.
+    */
+    bool Load(const HeightField16 &field,unsigned int seed,float scale=1.0f);
+
+    /*
+    Run iterations on the loaded state. Once *stop is
+    set the remaining tiles are skipped, the state is
+    left at the last whole block and false returned.
+    */
+    bool Run(int iterations,const ErosionSettings &set,const std::atomic<bool> *stop=NULL);
+
+    // Write ground plus suspended sediment back, scaled, rounded and clamped
+    void Store(HeightField16 &field) const;
+
+    // Load, run settings.iterations, store and free
+    void Erode(HeightField16 &field,const ErosionSettings &set,unsigned int seed);
+
+    bool IsLoaded() const {return width>0;};
+    long long int GetStep() const {return step;};
+    size_t MemSize() const {return (size_t)width*height*6*sizeof(float);};
+
+    // Tile edge and iterations between halo exchanges
+    void SetTiling(int tile,int steps) {tileSize=std::max(tile,8); stepsPerExchange=std::max(steps,1);};
+
+    // Release the state buffers
+    void Cleanup();
+};
+
+#endif
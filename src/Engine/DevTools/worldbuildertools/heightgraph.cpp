@@ -0,0 +1,809 @@
+#include "heightgraph.h"
+#include <algorithm>
+#include <math.h>
+#include <omp.h>
+
+HeightGraph::HeightGraph()
+{
+    width=0;
+    height=0;
+    tileSize=256;
+    tilesX=0;
+    tilesY=0;
+    budget=(size_t)64*1024*1024;
+    used=0;
+    useClock=0;
+    builtTiles=0;
+}
+
+//******************************************//
+//             Build the Graph              //
+//******************************************//
+int HeightGraph::Inputs(Op op)
+{
+    switch (op)
+    {
+        case OP_SOURCE:
+        case OP_NOISE:
+            return 0;
+        case OP_BLEND:
+            return 2;
+        default:
+            return 1;
+    }
+};
+
+bool HeightGraph::Valid(Op op,int node,int a,int b) const
+{
+    const int n=Inputs(op);
+    if (n>0 && (a<0 || a>=node))
+    {
+        return false;
+    }
+    if (n>1 && (b<0 || b>=node))
+    {
+        return false;
+    }
+    return true;
+};
+
+int HeightGraph::AddNode(Op op,const Params &params,int a,int b)
+{
+    if (op==OP_SOURCE || !Valid(op,(int)nodes.size(),a,b))
+    {
+        return -1;
+    }
+
+    Node nd;
+    nd.op=op;
+    nd.params=params;
+    nd.input[0]=Inputs(op)>0 ? a : -1;
+    nd.input[1]=Inputs(op)>1 ? b : -1;
+    nodes.push_back(nd);
+    return (int)nodes.size()-1;
+};
+
+int HeightGraph::AddSource(Source source,uint64_t key)
+{
+    Node nd;
+    nd.op=OP_SOURCE;
+    nd.params.sourceKey=key;
+    nd.source=source;
+    nd.input[0]=-1;
+    nd.input[1]=-1;
+    nodes.push_back(nd);
+    return (int)nodes.size()-1;
+};
+
+bool HeightGraph::SetNode(int node,Op op,const Params &params,int a,int b)
+{
+    if (node<0 || node>=(int)nodes.size() || op==OP_SOURCE || !Valid(op,node,a,b))
+    {
+        return false;
+    }
+
+    Node &nd=nodes[node];
+    nd.op=op;
+    nd.params=params;
+    nd.source=Source();
+    nd.input[0]=Inputs(op)>0 ? a : -1;
+    nd.input[1]=Inputs(op)>1 ? b : -1;
+    return true;
+};
+
+bool HeightGraph::SetSource(int node,Source source,uint64_t key)
+{
+    if (node<0 || node>=(int)nodes.size())
+    {
+        return false;
+    }
+
+    Node &nd=nodes[node];
+    nd.op=OP_SOURCE;
+    nd.params.sourceKey=key;
+    nd.source=source;
+    nd.input[0]=-1;
+    nd.input[1]=-1;
+    return true;
+};
+
+void HeightGraph::Clear()
+{
+    nodes.clear();
+    ClearCache();
+};
+
+//******************************************//
+//              Operator Traits             //
+//******************************************//
+bool HeightGraph::Identity(int node) const
+{
+    const Node &nd=nodes[node];
+    switch (nd.op)
+    {
+        case OP_BLUR:
+            return nd.params.passes<=0;
+        case OP_TERRACE:
+            return nd.params.sharpness<=0.0f;
+        case OP_EROSION:
+            return nd.params.erosion.iterations<=0;
+        default:
+            return false;
+    }
+};
+
+bool HeightGraph::Global(int node) const
+{
+    const Op op=nodes[node].op;
+    return op==OP_SOURCE || (op==OP_EROSION && !Identity(node));
+};
+
+int HeightGraph::Halo(int node) const
+{
+    // One 3x3 pass reaches one vert further
+    return nodes[node].op==OP_BLUR ? std::max(nodes[node].params.passes,0) : 0;
+};
+
+//******************************************//
+//               Node Hashes                //
+//******************************************//
+uint64_t HeightGraph::HashBytes(const void *data,size_t bytes,uint64_t hash)
+{
+    const unsigned char *p=(const unsigned char*)data;
+    for (size_t k=0; k<bytes; ++k)
+    {
+        hash^=p[k];
+        hash*=1099511628211ULL;
+    }
+    return hash;
+};
+
+/*
+Only the parameters the operator reads go in, so
+changing any other one keeps the cached tiles.
+*/
+uint64_t HeightGraph::NodeHash(int node,const std::vector<uint64_t> &hashes) const
+{
+    const Node &nd=nodes[node];
+    if (Identity(node))
+    {
+        return hashes[nd.input[0]];
+    }
+
+    const Params &p=nd.params;
+    uint64_t h=14695981039346656037ULL;
+    auto add=[&h](const void *data,size_t bytes) {h=HashBytes(data,bytes,h);};
+
+    int op=nd.op;
+    add(&op,sizeof(op));
+    add(&width,sizeof(width));
+    add(&height,sizeof(height));
+
+    switch (nd.op)
+    {
+        case OP_SOURCE:
+            add(&p.sourceKey,sizeof(p.sourceKey));
+            break;
+
+        case OP_NOISE:
+        {
+            int type=p.noise.type;
+            add(&p.seed,sizeof(p.seed));
+            add(&type,sizeof(type));
+            add(&p.noise.wavelength,sizeof(float));
+            add(&p.noise.octaves,sizeof(int));
+            add(&p.noise.lacunarity,sizeof(float));
+            add(&p.noise.gain,sizeof(float));
+            add(&p.noise.warp,sizeof(float));
+            add(&p.noise.base,sizeof(float));
+            add(&p.noise.drop,sizeof(float));
+            add(&p.noise.rise,sizeof(float));
+            add(&p.noise.maxHeight,sizeof(float));
+            break;
+        }
+
+        case OP_BLUR:
+        {
+            int kernel=p.kernel;
+            add(&kernel,sizeof(kernel));
+            add(&p.passes,sizeof(p.passes));
+            break;
+        }
+
+        case OP_TERRACE:
+            add(&p.step,sizeof(p.step));
+            add(&p.sharpness,sizeof(p.sharpness));
+            break;
+
+        case OP_CLAMP:
+            add(&p.low,sizeof(p.low));
+            add(&p.high,sizeof(p.high));
+            break;
+
+        case OP_EROSION:
+        {
+            const ErosionSettings &e=p.erosion;
+            const float vals[10] = {e.rain,e.evaporation,e.flow,e.capacity,e.minSlope,
+                                    e.erosion,e.deposition,e.maxErosion,e.talus,e.thermal};
+            add(&p.seed,sizeof(p.seed));
+            add(&e.iterations,sizeof(e.iterations));
+            add(vals,sizeof(vals));
+            break;
+        }
+
+        case OP_BLEND:
+        {
+            int blend=p.blend;
+            add(&blend,sizeof(blend));
+            if (p.blend==BLEND_MIX)
+            {
+                add(&p.weight,sizeof(p.weight));
+            }
+            break;
+        }
+    }
+
+    for (int k=0; k<Inputs(nd.op); ++k)
+    {
+        add(&hashes[nd.input[k]],sizeof(uint64_t));
+    }
+
+    return h;
+};
+
+void HeightGraph::Hashes(int node,std::vector<uint64_t> &hashes) const
+{
+    hashes.resize(node+1);
+    for (int n=0; n<=node; ++n)
+    {
+        hashes[n]=NodeHash(n,hashes);
+    }
+};
+
+//******************************************//
+//             World and Tiles              //
+//******************************************//
+void HeightGraph::SetWorld(int width,int height)
+{
+    if (width==this->width && height==this->height)
+    {
+        return;
+    }
+
+    this->width=std::max(width,0);
+    this->height=std::max(height,0);
+    tilesX=(this->width+tileSize-1)/tileSize;
+    tilesY=(this->height+tileSize-1)/tileSize;
+    ClearCache();
+};
+
+void HeightGraph::SetTileSize(int size)
+{
+    size=std::max(size,16);
+    if (size==tileSize)
+    {
+        return;
+    }
+
+    tileSize=size;
+    tilesX=(width+tileSize-1)/tileSize;
+    tilesY=(height+tileSize-1)/tileSize;
+    ClearCache();
+};
+
+HeightRect HeightGraph::TileRect(int tile) const
+{
+    int ty = tile/tilesX;
+    int tx = tile%tilesX;
+    return HeightRect(ty*tileSize,std::min((ty+1)*tileSize,height),
+                      tx*tileSize,std::min((tx+1)*tileSize,width));
+};
+
+// Split [a,b) into pieces inside [0,n), wrapping around
+static void WrapRange(int a,int b,int n,std::vector< std::pair<int,int> > &pieces)
+{
+    pieces.clear();
+    for (int pos=a; pos<b;)
+    {
+        int w=((pos%n)+n)%n;
+        int len=std::min(b-pos,n-w);
+        pieces.push_back(std::make_pair(w,w+len));
+        pos+=len;
+    }
+};
+
+void HeightGraph::MarkTiles(const HeightRect &rect,bool wrap,std::vector<char> &marks) const
+{
+    std::vector< std::pair<int,int> > rows,cols;
+    if (wrap)
+    {
+        WrapRange(rect.i0,rect.i1,height,rows);
+        WrapRange(rect.j0,rect.j1,width,cols);
+    }
+    else
+    {
+        HeightRect r=rect.Clipped(height,width);
+        if (r.Empty())
+        {
+            return;
+        }
+        rows.push_back(std::make_pair(r.i0,r.i1));
+        cols.push_back(std::make_pair(r.j0,r.j1));
+    }
+
+    for (size_t a=0; a<rows.size(); ++a)
+    {
+        for (size_t b=0; b<cols.size(); ++b)
+        {
+            for (int ty=rows[a].first/tileSize; ty<=(rows[a].second-1)/tileSize; ++ty)
+            {
+                for (int tx=cols[b].first/tileSize; tx<=(cols[b].second-1)/tileSize; ++tx)
+                {
+                    marks[ty*tilesX+tx]=1;
+                }
+            }
+        }
+    }
+};
+
+/*
+Row by row, in runs that stay within one tile. Every
+tile the rect touches must be held.
+*/
+void HeightGraph::Gather(const std::vector<TileData> &tiles,const HeightRect &rect,bool wrap,HeightField16 &field) const
+{
+    if (field.Width()!=rect.Cols() || field.Height()!=rect.Rows())
+    {
+        field.Allocate(rect.Cols(),rect.Rows());
+    }
+
+    for (int i=rect.i0; i<rect.i1; ++i)
+    {
+        const int wi = wrap ? ((i%height)+height)%height : i;
+        const int ty = wi/tileSize;
+        uint16_t *dst = field.Row(i-rect.i0);
+
+        for (int pos=rect.j0; pos<rect.j1;)
+        {
+            const int wj = wrap ? ((pos%width)+width)%width : pos;
+            const int t = ty*tilesX+wj/tileSize;
+            const HeightRect tr = TileRect(t);
+            const int len = std::min(rect.j1-pos,tr.j1-wj);
+
+            memcpy(dst+(pos-rect.j0),&(*tiles[t])[(size_t)(wi-tr.i0)*tr.Cols()+(wj-tr.j0)],len*sizeof(uint16_t));
+            pos+=len;
+        }
+    }
+};
+
+// Rect from (world coordinates) of field, whose first vert is world vert (fj0,fi0)
+HeightGraph::TileData HeightGraph::CopyTile(const HeightField16 &field,const HeightRect &from,int fi0,int fj0) const
+{
+    const int cols=from.Cols();
+    std::shared_ptr< std::vector<uint16_t> > data = std::make_shared< std::vector<uint16_t> >((size_t)from.Rows()*cols);
+    for (int i=from.i0; i<from.i1; ++i)
+    {
+        memcpy(&(*data)[(size_t)(i-from.i0)*cols],field.Row(i-fi0)+(from.j0-fj0),cols*sizeof(uint16_t));
+    }
+    return data;
+};
+
+//******************************************//
+//               Tile Cache                 //
+//******************************************//
+static inline uint64_t CacheKey(uint64_t hash,int tile)
+{
+    uint64_t z = hash ^ ((uint64_t)(tile+1)*0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+};
+
+HeightGraph::TileData HeightGraph::Lookup(uint64_t hash,int tile)
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    auto it=cache.find(CacheKey(hash,tile));
+    if (it==cache.end())
+    {
+        return TileData();
+    }
+
+    it->second.lastUse=++useClock;
+    return it->second.data;
+};
+
+void HeightGraph::Insert(uint64_t hash,int tile,const TileData &data)
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    CacheEntry &e=cache[CacheKey(hash,tile)];
+    if (e.data)
+    {
+        used-=e.data->size()*sizeof(uint16_t);
+    }
+
+    e.data=data;
+    e.lastUse=++useClock;
+    used+=data->size()*sizeof(uint16_t);
+};
+
+void HeightGraph::Trim()
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    if (used<=budget)
+    {
+        return;
+    }
+
+    std::vector< std::pair<uint64_t,uint64_t> > order; // (last use, key)
+    order.reserve(cache.size());
+    for (auto it=cache.begin(); it!=cache.end(); ++it)
+    {
+        order.push_back(std::make_pair(it->second.lastUse,it->first));
+    }
+    std::sort(order.begin(),order.end());
+
+    for (size_t k=0; k<order.size() && used>budget; ++k)
+    {
+        auto it=cache.find(order[k].second);
+        used-=it->second.data->size()*sizeof(uint16_t);
+        cache.erase(it);
+    }
+};
+
+void HeightGraph::ClearCache()
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    cache.clear();
+    used=0;
+    builtTiles=0;
+};
+
+bool HeightGraph::IsCached(int node,const HeightRect &rect)
+{
+    if (node<0 || node>=(int)nodes.size() || tilesX*tilesY==0)
+    {
+        return false;
+    }
+
+    std::vector<uint64_t> hashes;
+    Hashes(node,hashes);
+
+    std::vector<char> marks(tilesX*tilesY,0);
+    MarkTiles(rect,false,marks);
+
+    for (int t=0; t<(int)marks.size(); ++t)
+    {
+        if (marks[t] && !Lookup(hashes[node],t))
+        {
+            return false;
+        }
+    }
+    return true;
+};
+
+//******************************************//
+//            Build Local Tiles             //
+//******************************************//
+HeightGraph::TileData HeightGraph::BuildTile(int node,int tile,const TileSets &held,HeightSmoother &smoother) const
+{
+    const Node &nd=nodes[node];
+    const Params &p=nd.params;
+    const HeightRect tr=TileRect(tile);
+
+    HeightField16 a,b;
+
+    switch (nd.op)
+    {
+        case OP_NOISE:
+        {
+            HeightNoise noise;
+            noise.Setup(p.noise,p.seed);
+            a.Allocate(tr.Cols(),tr.Rows());
+            noise.FillTile(a,tr.j0,tr.i0);
+            break;
+        }
+
+        case OP_BLUR:
+        {
+            // The halo wraps around like the full field blur, its own edges go to waste
+            const HeightRect in=tr.Padded(Halo(node));
+            Gather(held[nd.input[0]],in,true,a);
+            smoother.Smooth(a,p.kernel,p.passes);
+            return CopyTile(a,tr,in.i0,in.j0);
+        }
+
+        case OP_TERRACE:
+        {
+            const float step=std::max(p.step,1.0f);
+            const float power=1.0f+9.0f*std::min(p.sharpness,1.0f);
+
+            Gather(held[nd.input[0]],tr,false,a);
+            for (int i=0; i<a.Height(); ++i)
+            {
+                uint16_t *row=a.Row(i);
+                for (int j=0; j<a.Width(); ++j)
+                {
+                    // Ramp within a step, bent so it stays flat longer
+                    float base=floorf(row[j]/step)*step;
+                    float f=(row[j]-base)/step;
+                    float v=std::round(base+step*powf(f,power));
+                    row[j]=(uint16_t)std::min(std::max(v,0.0f),65535.0f);
+                }
+            }
+            break;
+        }
+
+        case OP_CLAMP:
+        {
+            Gather(held[nd.input[0]],tr,false,a);
+            for (int i=0; i<a.Height(); ++i)
+            {
+                uint16_t *row=a.Row(i);
+                for (int j=0; j<a.Width(); ++j)
+                {
+                    row[j]=std::min(std::max(row[j],p.low),p.high);
+                }
+            }
+            break;
+        }
+
+        case OP_BLEND:
+        {
+            Gather(held[nd.input[0]],tr,false,a);
+            Gather(held[nd.input[1]],tr,false,b);
+            const float w=p.weight;
+
+            for (int i=0; i<a.Height(); ++i)
+            {
+                uint16_t *ra=a.Row(i);
+                const uint16_t *rb=b.Row(i);
+                for (int j=0; j<a.Width(); ++j)
+                {
+                    if (p.blend==BLEND_MIN)
+                    {
+                        ra[j]=std::min(ra[j],rb[j]);
+                    }
+                    else if (p.blend==BLEND_MAX)
+                    {
+                        ra[j]=std::max(ra[j],rb[j]);
+                    }
+                    else
+                    {
+                        float v=std::round(ra[j]+(rb[j]-(float)ra[j])*w);
+                        ra[j]=(uint16_t)std::min(std::max(v,0.0f),65535.0f);
+                    }
+                }
+            }
+            break;
+        }
+
+        default:
+            Gather(held[nd.input[0]],tr,false,a);
+            break;
+    }
+
+    return CopyTile(a,tr,tr.i0,tr.j0);
+};
+
+//******************************************//
+//            Build Global Nodes            //
+//******************************************//
+/*
+The whole world is built at once and all of its
+tiles are cached, needed or not.
+*/
+bool HeightGraph::BuildWorld(int node,TileSets &held,const std::vector<uint64_t> &hashes,Progress &progress,const std::atomic<bool> *stop)
+{
+    const Node &nd=nodes[node];
+    HeightField16 world;
+
+    if (nd.op==OP_SOURCE)
+    {
+        if (!nd.source || !world.Allocate(width,height) || !nd.source(world))
+        {
+            return false;
+        }
+
+        if (world.Width()!=width || world.Height()!=height)
+        {
+            return false;
+        }
+    }
+    else if (nd.op==OP_EROSION)
+    {
+        const ErosionSettings &set=nd.params.erosion;
+        Gather(held[nd.input[0]],HeightRect(0,height,0,width),false,world);
+
+        // Blocks of one halo exchange, so a stop does not wait for the whole run
+        HeightEroder eroder;
+        eroder.Load(world,nd.params.seed);
+        const int block=4;
+        for (int done=0; done<set.iterations; done+=block)
+        {
+            if (!eroder.Run(std::min(block,set.iterations-done),set,stop))
+            {
+                return false;
+            }
+            if (progress && !progress(node,(float)std::min(done+block,set.iterations)/set.iterations))
+            {
+                return false;
+            }
+        }
+        eroder.Store(world);
+    }
+
+    const int nt=tilesX*tilesY;
+    held[node].resize(nt);
+
+    #pragma omp parallel for schedule(static)
+    for (int t=0; t<nt; ++t)
+    {
+        held[node][t]=CopyTile(world,TileRect(t),0,0);
+        Insert(hashes[node],t,held[node][t]);
+    }
+
+    builtTiles+=nt;
+    return true;
+};
+
+//******************************************//
+//               Evaluate a Node            //
+//******************************************//
+bool HeightGraph::Evaluate(int node,const HeightRect &rect,HeightField16 &out,Progress progress,const std::atomic<bool> *stop)
+{
+    if (node<0 || node>=(int)nodes.size() || tilesX*tilesY==0)
+    {
+        return false;
+    }
+
+    const HeightRect r=rect.Clipped(height,width);
+    if (r.Empty())
+    {
+        return false;
+    }
+
+    const int nt=tilesX*tilesY;
+
+    std::vector<uint64_t> hashes;
+    Hashes(node,hashes);
+
+    // Tiles each node has to deliver (empty for nodes not involved)
+    std::vector< std::vector<char> > need(node+1);
+    TileSets held(node+1);
+
+    need[node].assign(nt,0);
+    MarkTiles(r,false,need[node]);
+
+    //*******************************
+    //  Tiles Wanted, Output First
+    //*******************************
+    // Consumers have higher ids, so a node's needs are complete when it is reached
+    for (int n=node; n>=0; --n)
+    {
+        if (need[n].empty())
+        {
+            continue;
+        }
+
+        held[n].resize(nt);
+        std::vector<int> missing;
+        for (int t=0; t<nt; ++t)
+        {
+            if (need[n][t] && !(held[n][t]=Lookup(hashes[n],t)))
+            {
+                missing.push_back(t);
+            }
+        }
+
+        const Node &nd=nodes[n];
+        for (int k=0; k<Inputs(nd.op) && !missing.empty(); ++k)
+        {
+            std::vector<char> &in=need[nd.input[k]];
+            if (in.empty())
+            {
+                in.assign(nt,0);
+            }
+
+            if (Global(n))
+            {
+                std::fill(in.begin(),in.end(),1);
+                continue;
+            }
+
+            for (size_t m=0; m<missing.size(); ++m)
+            {
+                MarkTiles(TileRect(missing[m]).Padded(Halo(n)),nd.op==OP_BLUR,in);
+            }
+        }
+    }
+
+    //*******************************
+    //   Build, Inputs First
+    //*******************************
+    for (int n=0; n<=node; ++n)
+    {
+        if (need[n].empty())
+        {
+            continue;
+        }
+
+        // Identity nodes share their input's tiles, which may have just been built
+        std::vector<int> missing;
+        for (int t=0; t<nt; ++t)
+        {
+            if (need[n][t] && !held[n][t])
+            {
+                if (Identity(n))
+                {
+                    held[n][t]=held[nodes[n].input[0]][t];
+                }
+                else
+                {
+                    missing.push_back(t);
+                }
+            }
+        }
+
+        if (missing.empty())
+        {
+            continue;
+        }
+
+        if (progress && !progress(n,0.0f))
+        {
+            return false;
+        }
+
+        if (Global(n))
+        {
+            if (!BuildWorld(n,held,hashes,progress,stop))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            std::atomic<int> done(0);
+            std::atomic<bool> halt(false);
+
+            #pragma omp parallel
+            {
+                HeightSmoother smoother;
+
+                #pragma omp for schedule(dynamic)
+                for (int m=0; m<(int)missing.size(); ++m)
+                {
+                    if (halt || (stop && *stop))
+                    {
+                        continue;
+                    }
+
+                    const int t=missing[m];
+                    held[n][t]=BuildTile(n,t,held,smoother);
+                    Insert(hashes[n],t,held[n][t]);
+
+                    int d=++done;
+                    if (progress && omp_get_thread_num()==0 && !progress(n,(float)d/missing.size()))
+                    {
+                        halt=true;
+                    }
+                }
+            }
+
+            builtTiles+=done;
+            if (halt || (stop && *stop))
+            {
+                return false;
+            }
+        }
+
+        if (progress && !progress(n,1.0f))
+        {
+            return false;
+        }
+    }
+
+    Gather(held[node],r,false,out);
+    Trim();
+    return true;
+};
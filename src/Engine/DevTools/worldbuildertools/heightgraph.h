@@ -0,0 +1,234 @@
+#ifndef HEIGHTGRAPH_C
+#define HEIGHTGRAPH_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Tools/heightfield.hpp"
+#include "heightsmoother.h"
+#include "heighteroder.h"
+#include "heightnoise.h"
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+
+//******************************************//
+//            Height Graph Class            //
+//******************************************//
+/*
+    Height field operators wired into a DAG and
+    evaluated lazily, tile by tile.
+
+    A node's inputs always have lower ids, so the
+    graph cannot hold a cycle and the id order is
+    a valid evaluation order.
+
+    Every node has a hash of its operator, the
+    parameters the operator reads and the hashes of
+    its inputs. Built tiles are cached under (node
+    hash, tile), so changing a node only changes the
+    hashes of the nodes downstream of it, and only
+    their tiles are built again. Going back to an
+    earlier setting finds its tiles still cached.
+    Nodes that change nothing (0 blur passes, 0
+    erosion iterations) take the hash of their input
+    and share its tiles.
+
+    Evaluate() works out the tiles each node has to
+    deliver: the requested rect at the output, the
+    tiles plus operator halo further up, skipping
+    whatever is cached. Then the nodes are built in
+    id order, the missing tiles of a node in
+    parallel. Local operators read their input tiles
+    plus halo and match the same operator run over
+    the whole world exactly; the blur wraps around
+    the world edges like HeightSmoother does.
+
+    Operators:
+        OP_SOURCE   whole world from a function
+                    (midpoint displacement)
+        OP_NOISE    HeightNoise from world coords
+        OP_BLUR     HeightSmoother passes
+        OP_TERRACE  heights into flat steps
+        OP_CLAMP    heights into [low,high]
+        OP_EROSION  HeightEroder, the whole world
+                    at once (water travels far)
+        OP_BLEND    mix, min or max of two inputs
+
+    The cache holds up to budget bytes of tiles,
+    the least recently used go first.
+*/
+class HeightGraph
+{
+public:
+    enum Op
+    {
+        OP_SOURCE=0,
+        OP_NOISE=1,
+        OP_BLUR=2,
+        OP_TERRACE=3,
+        OP_CLAMP=4,
+        OP_EROSION=5,
+        OP_BLEND=6
+    };
+
+    enum BlendMode
+    {
+        BLEND_MIX=0, // a+(b-a)*weight
+        BLEND_MIN=1,
+        BLEND_MAX=2
+    };
+
+    // Fills the whole world, false to stop
+    typedef std::function<bool(HeightField16 &field)> Source;
+
+    // Told when a node starts building (fraction 0) and how far it got, false to stop
+    typedef std::function<bool(int node,float fraction)> Progress;
+
+    // Parameters of every operator, each one reads its own
+    struct Params
+    {
+        unsigned int seed; // NOISE, EROSION
+        uint64_t sourceKey; // SOURCE: changes whenever the source would build something else
+
+        HeightNoise::Settings noise; // NOISE
+
+        HeightSmoother::Kernel kernel; // BLUR
+        int passes; // BLUR
+
+        float step; // TERRACE: height of one step
+        float sharpness; // TERRACE: 0 leaves the ramps, 1 nearly flat steps
+
+        uint16_t low,high; // CLAMP
+
+        ErosionSettings erosion; // EROSION
+
+        BlendMode blend; // BLEND
+        float weight; // BLEND_MIX
+
+        Params()
+        {
+            seed=1;
+            sourceKey=0;
+            kernel=HeightSmoother::SMOOTH_BOX;
+            passes=0;
+            step=50.0f;
+            sharpness=0.5f;
+            low=0;
+            high=1000;
+            blend=BLEND_MIX;
+            weight=0.5f;
+        };
+    };
+
+private:
+    typedef std::shared_ptr<const std::vector<uint16_t> > TileData;
+    typedef std::vector< std::vector<TileData> > TileSets;
+
+    struct Node
+    {
+        Op op;
+        Params params;
+        Source source;
+        int input[2]; // -1 when unused
+    };
+
+    struct CacheEntry
+    {
+        TileData data;
+        uint64_t lastUse;
+    };
+
+    std::vector<Node> nodes;
+
+    int width,height;
+    int tileSize;
+    int tilesX,tilesY;
+
+    std::unordered_map<uint64_t,CacheEntry> cache;
+    std::mutex cacheLock;
+    size_t budget;
+    size_t used; // Bytes of the cached tiles
+    uint64_t useClock;
+    long long builtTiles; // Tiles built since the last ClearCache
+
+    // Inputs exist and come before node
+    bool Valid(Op op,int node,int a,int b) const;
+    static int Inputs(Op op);
+
+    // Reads its input tiles plus Halo(), or the whole world when Global()
+    bool Global(int node) const;
+    int Halo(int node) const;
+    bool Identity(int node) const;
+
+    uint64_t NodeHash(int node,const std::vector<uint64_t> &hashes) const;
+    void Hashes(int node,std::vector<uint64_t> &hashes) const;
+
+    HeightRect TileRect(int tile) const;
+    TileData Lookup(uint64_t hash,int tile);
+    void Insert(uint64_t hash,int tile,const TileData &data);
+    void Trim();
+
+    // Tiles touched by rect, wrapped around the world edges if wrap
+    void MarkTiles(const HeightRect &rect,bool wrap,std::vector<char> &marks) const;
+
+    // Copy rect of a node's held tiles into field, wrapped around the world edges if wrap
+    void Gather(const std::vector<TileData> &tiles,const HeightRect &rect,bool wrap,HeightField16 &field) const;
+
+    TileData CopyTile(const HeightField16 &field,const HeightRect &from,int fi0,int fj0) const;
+
+    TileData BuildTile(int node,int tile,const TileSets &held,HeightSmoother &smoother) const;
+    bool BuildWorld(int node,TileSets &held,const std::vector<uint64_t> &hashes,Progress &progress,const std::atomic<bool> *stop);
+
+public:
+    HeightGraph();
+    ~HeightGraph() {};
+
+    //*************************
+    //      Build the Graph
+    //*************************
+    // Add an operator node, inputs must be existing nodes (-1 if unused). Returns its id or -1
+    int AddNode(Op op,const Params &params,int a=-1,int b=-1);
+    int AddSource(Source source,uint64_t key);
+
+    // Change a node, its inputs must have lower ids
+    bool SetNode(int node,Op op,const Params &params,int a=-1,int b=-1);
+    bool SetSource(int node,Source source,uint64_t key);
+
+    int GetNodes() const {return (int)nodes.size();};
+    Op GetOp(int node) const {return nodes[node].op;};
+    const Params& GetParams(int node) const {return nodes[node].params;};
+
+    // Remove all nodes and cached tiles
+    void Clear();
+
+    //*************************
+    //     World and Tiles
+    //*************************
+    // World size in verts, the cache is emptied when it changes
+    void SetWorld(int width,int height);
+    void SetTileSize(int size);
+    void SetBudget(size_t bytes) {budget=bytes; Trim();};
+
+    //*************************
+    //        Evaluate
+    //*************************
+    /*
+    Fill out (resized to rect) with rect of node,
+    building only the tiles not cached. Returns false
+    if stopped (through progress or *stop).
+    */
+    bool Evaluate(int node,const HeightRect &rect,HeightField16 &out,Progress progress=Progress(),const std::atomic<bool> *stop=NULL);
+
+    // Every tile of rect of node is cached
+    bool IsCached(int node,const HeightRect &rect);
+
+    void ClearCache();
+    size_t GetMemory() const {return used;};
+    long long GetBuiltTiles() const {return builtTiles;};
+
+    // 64 bit FNV-1a, for source keys
+    static uint64_t HashBytes(const void *data,size_t bytes,uint64_t hash=14695981039346656037ULL);
+};
+
+#endif
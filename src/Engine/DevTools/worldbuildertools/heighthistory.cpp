@@ -0,0 +1,351 @@
+#include "heighthistory.h"
+#include <algorithm>
+#include <unordered_set>
+
+HeightHistory::HeightHistory()
+{
+    tileSize=64;
+    budget=(size_t)256*1024*1024;
+    maxSteps=128;
+    width=0;
+    height=0;
+    Reset(0,0);
+}
+
+//******************************************//
+//             Reset the History            //
+//******************************************//
+void HeightHistory::Reset(int w,int h)
+{
+    width=std::max(w,0);
+    height=std::max(h,0);
+    tilesX=(width+tileSize-1)/tileSize;
+    tilesY=(height+tileSize-1)/tileSize;
+
+    undo.clear();
+    redo.clear();
+    open.clear();
+
+    openIndex.assign((size_t)tilesX*tilesY,-1);
+    current.assign((size_t)tilesX*tilesY,TileData());
+    used=0;
+};
+
+//******************************************//
+//                Tile Access               //
+//******************************************//
+HeightRect HeightHistory::TileRect(int tile) const
+{
+    int ty = tile/tilesX;
+    int tx = tile%tilesX;
+    return HeightRect(ty*tileSize,std::min((ty+1)*tileSize,height),
+                      tx*tileSize,std::min((tx+1)*tileSize,width));
+};
+
+HeightHistory::TileData HeightHistory::CopyTile(const HeightField16 &field,int tile) const
+{
+    HeightRect r = TileRect(tile);
+    const int cols = r.Cols();
+
+    std::shared_ptr< std::vector<uint16_t> > data = std::make_shared< std::vector<uint16_t> >((size_t)r.Rows()*cols);
+    for (int i=r.i0; i<r.i1; ++i)
+    {
+        memcpy(&(*data)[(size_t)(i-r.i0)*cols],field.Row(i)+r.j0,cols*sizeof(uint16_t));
+    }
+
+    return data;
+};
+
+void HeightHistory::WriteTile(HeightField16 &field,int tile,const TileData &data) const
+{
+    HeightRect r = TileRect(tile);
+    const int cols = r.Cols();
+
+    for (int i=r.i0; i<r.i1; ++i)
+    {
+        memcpy(field.Row(i)+r.j0,&(*data)[(size_t)(i-r.i0)*cols],cols*sizeof(uint16_t));
+    }
+};
+
+//******************************************//
+//           Record a Height Edit           //
+//******************************************//
+/*
+The first time the open edit touches a tile its
+contents are captured. If the buffer from the last
+edit of that tile is still current it is shared
+instead of copied.
+*/
+void HeightHistory::Touch(const HeightField16 &field,const HeightRect &rect)
+{
+    if (field.Width()!=width || field.Height()!=height)
+    {
+        Reset(field.Width(),field.Height());
+    }
+
+    HeightRect r = rect.Clipped(height,width);
+    if (r.Empty())
+    {
+        return;
+    }
+
+    for (int ty=r.i0/tileSize; ty<=(r.i1-1)/tileSize; ++ty)
+    {
+        for (int tx=r.j0/tileSize; tx<=(r.j1-1)/tileSize; ++tx)
+        {
+            int tile = ty*tilesX+tx;
+            if (openIndex[tile]>=0)
+            {
+                continue;
+            }
+
+            TileEdit edit;
+            edit.tile=tile;
+            edit.before = current[tile] ? current[tile] : CopyTile(field,tile);
+
+            openIndex[tile]=(int)open.size();
+            open.push_back(edit);
+        }
+    }
+};
+
+/*
+Capture the new contents of every touched tile.
+Tiles that ended up unchanged are left out, an
+edit that changed nothing is not pushed. A new
+edit clears the redo steps.
+*/
+void HeightHistory::EndEdit(const HeightField16 &field)
+{
+    if (open.empty())
+    {
+        return;
+    }
+
+    const int n = (int)open.size();
+
+    #pragma omp parallel for if(n>16)
+    for (int k=0; k<n; ++k)
+    {
+        open[k].after = CopyTile(field,open[k].tile);
+    }
+
+    Edit edit;
+    edit.reserve(n);
+    for (int k=0; k<n; ++k)
+    {
+        TileEdit &t = open[k];
+        openIndex[t.tile]=-1;
+
+        if (*t.before==*t.after)
+        {
+            current[t.tile]=t.before;
+            continue;
+        }
+
+        current[t.tile]=t.after;
+        edit.push_back(t);
+    }
+    open.clear();
+
+    if (edit.empty())
+    {
+        return;
+    }
+
+    std::sort(edit.begin(),edit.end(),[](const TileEdit &a,const TileEdit &b) {return a.tile<b.tile;});
+
+    undo.push_back(edit);
+    redo.clear();
+    Enforce();
+};
+
+//******************************************//
+//               Undo and Redo              //
+//******************************************//
+HeightRect HeightHistory::Apply(HeightField16 &field,const Edit &edit,bool after)
+{
+    const int n = (int)edit.size();
+
+    // Tiles are disjoint, so they can be written in parallel
+    #pragma omp parallel for if(n>16)
+    for (int k=0; k<n; ++k)
+    {
+        WriteTile(field,edit[k].tile,after ? edit[k].after : edit[k].before);
+    }
+
+    HeightRect r;
+    for (int k=0; k<n; ++k)
+    {
+        current[edit[k].tile] = after ? edit[k].after : edit[k].before;
+        r.Add(TileRect(edit[k].tile));
+    }
+
+    return r;
+};
+
+HeightRect HeightHistory::Undo(HeightField16 &field)
+{
+    // A stroke still being recorded is finished first, so it is what gets undone
+    EndEdit(field);
+
+    if (undo.empty() || field.Width()!=width || field.Height()!=height)
+    {
+        return HeightRect();
+    }
+
+    redo.push_back(undo.back());
+    undo.pop_back();
+
+    return Apply(field,redo.back(),false);
+};
+
+HeightRect HeightHistory::Redo(HeightField16 &field)
+{
+    EndEdit(field);
+
+    if (redo.empty() || field.Width()!=width || field.Height()!=height)
+    {
+        return HeightRect();
+    }
+
+    undo.push_back(redo.back());
+    redo.pop_back();
+
+    return Apply(field,undo.back(),true);
+};
+
+//******************************************//
+//             Memory Budget                //
+//******************************************//
+/*
+Sum the distinct tile buffers still held. Current
+tile buffers no step refers to any more are let go
+here, the next edit of such a tile copies it again.
+*/
+void HeightHistory::Recount()
+{
+    for (size_t t=0; t<current.size(); ++t)
+    {
+        if (current[t] && current[t].use_count()==1)
+        {
+            current[t].reset();
+        }
+    }
+
+    std::unordered_set<const void*> seen;
+    used=0;
+
+    for (size_t s=0; s<undo.size()+redo.size(); ++s)
+    {
+        const Edit &edit = s<undo.size() ? undo[s] : redo[s-undo.size()];
+        for (size_t k=0; k<edit.size(); ++k)
+        {
+            if (seen.insert(edit[k].before.get()).second)
+            {
+                used += edit[k].before->size()*sizeof(uint16_t);
+            }
+            if (seen.insert(edit[k].after.get()).second)
+            {
+                used += edit[k].after->size()*sizeof(uint16_t);
+            }
+        }
+    }
+};
+
+/*
+Merge two neighbouring steps into one. Tiles in
+both keep the older "before" and the newer "after",
+the state between the two is released.
+*/
+HeightHistory::Edit HeightHistory::Fold(const Edit &older,const Edit &newer)
+{
+    Edit merged;
+    merged.reserve(older.size()+newer.size());
+
+    size_t a=0, b=0;
+    while (a<older.size() || b<newer.size())
+    {
+        if (b==newer.size() || (a<older.size() && older[a].tile<newer[b].tile))
+        {
+            merged.push_back(older[a++]);
+        } else if (a==older.size() || newer[b].tile<older[a].tile) {
+            merged.push_back(newer[b++]);
+        } else {
+            TileEdit t = older[a++];
+            t.after = newer[b++].after;
+            merged.push_back(t);
+        }
+    }
+
+    return merged;
+};
+
+void HeightHistory::Enforce()
+{
+    Recount();
+
+    while (undo.size()>1 && ((int)undo.size()>maxSteps || used>budget))
+    {
+        // Folding only frees memory when the two oldest steps share tiles
+        bool shared=false;
+        for (size_t a=0, b=0; a<undo[0].size() && b<undo[1].size() && !shared;)
+        {
+            if (undo[0][a].tile==undo[1][b].tile)
+            {
+                shared=true;
+            } else if (undo[0][a].tile<undo[1][b].tile) {
+                ++a;
+            } else {
+                ++b;
+            }
+        }
+
+        if (shared || (int)undo.size()>maxSteps)
+        {
+            Edit merged = Fold(undo[0],undo[1]);
+            undo.pop_front();
+            undo[0].swap(merged);
+        } else {
+            undo.pop_front();
+        }
+
+        Recount();
+    }
+};
+
+//******************************************//
+//            Snapshot the Field            //
+//******************************************//
+/*
+Tiles without a current buffer are copied and the
+copy becomes current, so the next snapshot shares
+it. Tiles an open edit has touched may change until
+it ends, their copies are not kept.
+*/
+void HeightHistory::Snapshot(const HeightField16 &field,std::vector<TileData> &tiles)
+{
+    if (field.Width()!=width || field.Height()!=height)
+    {
+        Reset(field.Width(),field.Height());
+    }
+
+    const int n = tilesX*tilesY;
+    tiles.assign(n,TileData());
+
+    #pragma omp parallel for schedule(dynamic,16)
+    for (int t=0; t<n; ++t)
+    {
+        if (openIndex[t]>=0)
+        {
+            tiles[t]=CopyTile(field,t);
+            continue;
+        }
+
+        if (!current[t])
+        {
+            current[t]=CopyTile(field,t);
+        }
+        tiles[t]=current[t];
+    }
+};
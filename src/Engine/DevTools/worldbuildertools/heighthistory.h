@@ -0,0 +1,134 @@
+#ifndef HEIGHTHISTORY_C
+#define HEIGHTHISTORY_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Tools/heightfield.hpp"
+#include <memory>
+#include <deque>
+
+//******************************************//
+//           Height History Class           //
+//******************************************//
+/*
+    Undo/redo history of a HeightField16 built on
+    copy-on-write tiles. The field is split into
+    tileSize x tileSize tiles (smaller at the far
+    edges). An edit records, for every tile it
+    touched only, the tile contents before and
+    after it. Tile contents are immutable and
+    reference counted: the "after" of one edit is
+    the very same buffer as the "before" of the
+    next edit of that tile, and tiles no edit
+    touched are not stored at all.
+
+    Usage while sculpting:
+
+        Touch(field,rect)   before writing heights
+                            inside rect, opens an
+                            edit if none is open
+        EndEdit(field)      when the stroke is done
+
+    Undo()/Redo() write the stored tiles back and
+    return the rect they covered, so the cost is
+    proportional to the edited area.
+
+    Snapshot() hands out the tiles of the whole
+    field as the same immutable buffers, so a
+    snapshot of a field that was saved before only
+    copies the tiles edited since.
+
+    When the history holds more than the memory
+    budget (or more than maxSteps edits) the two
+    oldest edits are folded into one, dropping
+    the state in between. When folding frees
+    nothing the oldest edit is dropped instead.
+    The newest edit is always kept.
+*/
+class HeightHistory
+{
+public:
+    typedef std::shared_ptr< const std::vector<uint16_t> > TileData;
+
+private:
+    struct TileEdit
+    {
+        int tile; // ty*tilesX+tx
+        TileData before;
+        TileData after;
+    };
+
+    // Tile edits of one undo step, sorted by tile
+    typedef std::vector<TileEdit> Edit;
+
+    int tileSize;
+    int width,height; // Field size the history was reset for
+    int tilesX,tilesY;
+
+    std::deque<Edit> undo; // Oldest first
+    std::vector<Edit> redo; // Next redo last
+
+    Edit open; // Edit being recorded
+    std::vector<int> openIndex; // Tile to index in open, -1 if untouched
+
+    // Buffer matching the field contents of each tile, shared with the history (null if unknown)
+    std::vector<TileData> current;
+
+    size_t budget; // Bytes of tile data allowed
+    int maxSteps; // Undo steps allowed
+    size_t used; // Bytes of distinct tile data held
+
+    HeightRect TileRect(int tile) const;
+    TileData CopyTile(const HeightField16 &field,int tile) const;
+    void WriteTile(HeightField16 &field,int tile,const TileData &data) const;
+
+    // Write one side of an edit into the field
+    HeightRect Apply(HeightField16 &field,const Edit &edit,bool after);
+
+    void Recount();
+    void Enforce();
+    static Edit Fold(const Edit &older,const Edit &newer);
+
+public:
+    HeightHistory();
+    ~HeightHistory() {};
+
+    // Drop everything and track a field of w x h
+    void Reset(int w,int h);
+
+    // Bytes of tile data the history may hold
+    void SetBudget(size_t bytes) {budget=bytes; Enforce();};
+    // Most undo steps kept
+    void SetMaxSteps(int steps) {maxSteps=std::max(steps,1); Enforce();};
+    // Edge of the snapshot tiles, resets the history
+    void SetTileSize(int size) {tileSize=std::max(size,8); Reset(width,height);};
+
+    // Snapshot the tiles of rect that the open edit has not seen yet
+    void Touch(const HeightField16 &field,const HeightRect &rect);
+
+    // Close the open edit and push it as an undo step
+    void EndEdit(const HeightField16 &field);
+
+    /*
+    Tiles of the whole field, row by row, tile
+    (ty,tx) at tiles[ty*GetTilesX()+tx]. Tiles of an
+    open edit are copied as they are now.
+    */
+    void Snapshot(const HeightField16 &field,std::vector<TileData> &tiles);
+
+    int GetTileSize() const {return tileSize;};
+    int GetTilesX() const {return tilesX;};
+
+    bool IsEditing() const {return !open.empty();};
+    bool CanUndo() const {return !undo.empty();};
+    bool CanRedo() const {return !redo.empty();};
+
+    // Step back or forward, returns the rect of heights written
+    HeightRect Undo(HeightField16 &field);
+    HeightRect Redo(HeightField16 &field);
+
+    int GetUndoSteps() const {return (int)undo.size();};
+    int GetRedoSteps() const {return (int)redo.size();};
+    size_t GetMemory() const {return used;};
+};
+
+#endif
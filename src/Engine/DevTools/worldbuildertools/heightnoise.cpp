@@ -0,0 +1,245 @@
+#include "heightnoise.h"
+#include <algorithm>
+#include <math.h>
+
+void HeightNoise::Scratch::Resize(int n)
+{
+    if ((int)val.size()>=n)
+    {
+        return;
+    }
+
+    x.resize(n); y.resize(n);
+    wx.resize(n); wy.resize(n);
+    val.resize(n); tmp.resize(n);
+};
+
+void HeightNoise::Setup(const Settings &settings,uint32_t seed)
+{
+    this->settings=settings;
+    this->settings.wavelength=std::max(settings.wavelength,1.0f);
+    this->settings.octaves=std::max(settings.octaves,1);
+    this->seed=seed;
+};
+
+//******************************************//
+//          Lattice Gradient Noise          //
+//******************************************//
+// 32 bit integer hash of a lattice corner
+static inline uint32_t HashCorner(int32_t ix,int32_t iy,uint32_t seed)
+{
+    uint32_t h = (uint32_t)ix*0x8DA6B343u ^ (uint32_t)iy*0xD8163841u ^ seed;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+};
+
+// Dot of the corner gradient (two 16 bit halves of h, each -1..1) with the offset
+static inline float CornerDot(uint32_t h,float dx,float dy)
+{
+    float gx = (float)(h & 0xFFFFu)*(1.0f/32768.0f)-1.0f;
+    float gy = (float)(h >> 16)*(1.0f/32768.0f)-1.0f;
+    return gx*dx+gy*dy;
+};
+
+void HeightNoise::Gradient(const double *x,const double *y,int n,uint32_t seed,float *out)
+{
+    #pragma omp simd
+    for (int k=0; k<n; ++k)
+    {
+        double fx=floor(x[k]);
+        double fy=floor(y[k]);
+        int32_t ix=(int32_t)fx;
+        int32_t iy=(int32_t)fy;
+        float tx=(float)(x[k]-fx);
+        float ty=(float)(y[k]-fy);
+
+        float n00=CornerDot(HashCorner(ix,iy,seed),tx,ty);
+        float n10=CornerDot(HashCorner(ix+1,iy,seed),tx-1.0f,ty);
+        float n01=CornerDot(HashCorner(ix,iy+1,seed),tx,ty-1.0f);
+        float n11=CornerDot(HashCorner(ix+1,iy+1,seed),tx-1.0f,ty-1.0f);
+
+        // Quintic fade
+        float u=tx*tx*tx*(tx*(tx*6.0f-15.0f)+10.0f);
+        float v=ty*ty*ty*(ty*(ty*6.0f-15.0f)+10.0f);
+
+        float a=n00+u*(n10-n00);
+        float b=n01+u*(n11-n01);
+        out[k]=a+v*(b-a);
+    }
+};
+
+//******************************************//
+//              Fractal Sums                //
+//******************************************//
+void HeightNoise::Fractal(const double *x,const double *y,int n,bool ridged,uint32_t seed,float *out,Scratch &sc) const
+{
+    double *lx=&sc.wx[0];
+    double *ly=&sc.wy[0];
+    float *t=&sc.tmp[0];
+
+    for (int k=0; k<n; ++k)
+    {
+        out[k]=0.0f;
+    }
+
+    // One octave stays within about -0.7..0.7 and the sum of
+    // octaves within -0.4..0.4, these bring both out to -1..1
+    const float ridgeScale=2.5f;
+    const float sumScale = ridged ? 1.0f : 2.5f;
+
+    double freq=1.0/settings.wavelength;
+    float amp=1.0f;
+    float ampSum=0.0f;
+
+    for (int o=0; o<settings.octaves; ++o)
+    {
+        #pragma omp simd
+        for (int k=0; k<n; ++k)
+        {
+            lx[k]=x[k]*freq;
+            ly[k]=y[k]*freq;
+        }
+
+        // Every octave has its own lattice
+        Gradient(lx,ly,n,seed+(uint32_t)o*0x9E3779B9u,t);
+
+        if (ridged)
+        {
+            #pragma omp simd
+            for (int k=0; k<n; ++k)
+            {
+                float r=1.0f-std::min(ridgeScale*fabsf(t[k]),1.0f);
+                out[k]+=amp*(2.0f*r*r-1.0f);
+            }
+        } else {
+            #pragma omp simd
+            for (int k=0; k<n; ++k)
+            {
+                out[k]+=amp*t[k];
+            }
+        }
+
+        ampSum+=amp;
+        amp*=settings.gain;
+        freq*=settings.lacunarity;
+    }
+
+    const float norm=sumScale/ampSum;
+    for (int k=0; k<n; ++k)
+    {
+        out[k]*=norm;
+    }
+};
+
+void HeightNoise::Row(long long gy,long long gx0,int n,int step,float *out,Scratch &sc) const
+{
+    sc.Resize(n);
+    double *x=&sc.x[0];
+    double *y=&sc.y[0];
+
+    for (int k=0; k<n; ++k)
+    {
+        x[k]=(double)(gx0+(long long)k*step);
+        y[k]=(double)gy;
+    }
+
+    if (settings.type!=NOISE_WARP)
+    {
+        Fractal(x,y,n,settings.type==NOISE_RIDGED,seed,out,sc);
+        return;
+    }
+
+    //************************
+    //    Domain Warping
+    //************************
+    // Two fBm fields, offset so they are unrelated, give the displacement
+    const double wl=settings.wavelength;
+    const double shift=settings.warp*wl;
+    float *qx=out;
+    float *qy=&sc.val[0];
+
+    for (int k=0; k<n; ++k)
+    {
+        x[k]+=5.2*wl;
+        y[k]+=1.3*wl;
+    }
+    Fractal(x,y,n,false,seed^0xA511E9B3u,qx,sc);
+
+    for (int k=0; k<n; ++k)
+    {
+        x[k]+=(1.7-5.2)*wl;
+        y[k]+=(9.2-1.3)*wl;
+    }
+    Fractal(x,y,n,false,seed^0x63D83595u,qy,sc);
+
+    for (int k=0; k<n; ++k)
+    {
+        x[k]=(double)(gx0+(long long)k*step)+shift*qx[k];
+        y[k]=(double)gy+shift*qy[k];
+    }
+    Fractal(x,y,n,false,seed,out,sc);
+};
+
+//******************************************//
+//            Fill Height Fields            //
+//******************************************//
+/*
+Rows [i0,i1) of field, field row i being world row
+gy0+i*step. All fills go through here, so a vert
+gets the same height whichever way it is built.
+*/
+void HeightNoise::FillRows(HeightField16 &field,int i0,int i1,long long gx0,long long gy0,int step) const
+{
+    const int w=field.Width();
+
+    Scratch sc;
+    std::vector<float> vals(w);
+
+    const float base=settings.base;
+    const float drop=settings.drop;
+    const float rise=settings.rise;
+    const float top=settings.maxHeight;
+
+    for (int i=i0; i<i1; ++i)
+    {
+        Row(gy0+(long long)i*step,gx0,w,step,&vals[0],sc);
+
+        uint16_t *row=field.Row(i);
+        for (int j=0; j<w; ++j)
+        {
+            float v=vals[j];
+            float hgt=base+v*(v<0.0f ? drop : rise);
+            row[j]=(uint16_t)std::round(std::min(std::max(hgt,0.0f),top));
+        }
+    }
+};
+
+void HeightNoise::FillTile(HeightField16 &tile,long long gx0,long long gy0) const
+{
+    FillRows(tile,0,tile.Height(),gx0,gy0,1);
+};
+
+void HeightNoise::Fill(HeightField16 &field,long long gx0,long long gy0,int step) const
+{
+    FillBand(field,0,field.Height(),gx0,gy0,step);
+};
+
+void HeightNoise::FillBand(HeightField16 &field,int i0,int i1,long long gx0,long long gy0,int step) const
+{
+    i0=std::max(i0,0);
+    i1=std::min(i1,field.Height());
+    step=std::max(step,1);
+
+    // Bands of rows, each one evaluated like a tile of its own
+    const int band=16;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int b=i0; b<i1; b+=band)
+    {
+        FillRows(field,b,std::min(b+band,i1),gx0,gy0,step);
+    }
+};
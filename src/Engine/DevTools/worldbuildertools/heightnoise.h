@@ -0,0 +1,124 @@
+#ifndef HEIGHTNOISE_C
+#define HEIGHTNOISE_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Tools/heightfield.hpp"
+#include <stdint.h>
+
+//******************************************//
+//             Height Noise Class           //
+//******************************************//
+/*
+    Fractal gradient noise height generator. The
+    height of world vert (gx,gy) is a pure function
+    of the seed, the settings and (gx,gy): lattice
+    gradients come from an integer hash of the cell
+    corner, not from a table. So any rect of the
+    world can be built on its own, in any order or
+    on any thread, and neighbouring rects meet with
+    no seam. The world has no size of its own.
+
+    Types:
+        NOISE_FBM       sum of octaves of gradient
+                        noise, rolling hills
+        NOISE_RIDGED    octaves of (1-|noise|)^2,
+                        sharp ridges and valleys
+        NOISE_WARP      fBm sampled at a position
+                        displaced by two more fBm
+                        fields (domain warping),
+                        folded, eroded looking
+
+    A row is evaluated as arrays, one octave at a
+    time, so the inner loops are plain float math
+    with no lookups and vectorize.
+
+    Noise values (about -1..1) map to heights as
+    base+value*rise above 0 and base+value*drop
+    below it, clamped to [0,maxHeight].
+*/
+class HeightNoise
+{
+public:
+    enum Type
+    {
+        NOISE_FBM=0,
+        NOISE_RIDGED=1,
+        NOISE_WARP=2
+    };
+
+    struct Settings
+    {
+        Type type;
+        float wavelength; // Verts across the largest features
+        int octaves;
+        float lacunarity; // Frequency step between octaves
+        float gain; // Amplitude step between octaves
+        float warp; // Displacement of NOISE_WARP in wavelengths
+
+        float base; // Height of noise value 0
+        float drop; // Height below base at value -1
+        float rise; // Height above base at value 1
+        float maxHeight;
+
+        Settings()
+        {
+            type=NOISE_FBM;
+            wavelength=512.0f;
+            octaves=8;
+            lacunarity=2.0f;
+            gain=0.5f;
+            warp=0.5f;
+            base=500.0f;
+            drop=300.0f;
+            rise=300.0f;
+            maxHeight=1000.0f;
+        };
+    };
+
+private:
+    Settings settings;
+    uint32_t seed;
+
+    // Working arrays of one row
+    struct Scratch
+    {
+        std::vector<double> x,y,wx,wy;
+        std::vector<float> val,tmp;
+        void Resize(int n);
+    };
+
+    // Gradient noise at lattice coordinates (x,y)
+    static void Gradient(const double *x,const double *y,int n,uint32_t seed,float *out);
+
+    // Octave sum at world coordinates (x,y), about -1..1
+    void Fractal(const double *x,const double *y,int n,bool ridged,uint32_t seed,float *out,Scratch &sc) const;
+
+    // Noise values of n verts of world row gy, every step-th from column gx0
+    void Row(long long gy,long long gx0,int n,int step,float *out,Scratch &sc) const;
+
+    // Heights of field rows [i0,i1), field vert (i,j) being world vert (gx0+j*step,gy0+i*step)
+    void FillRows(HeightField16 &field,int i0,int i1,long long gx0,long long gy0,int step) const;
+
+public:
+    HeightNoise() : seed(1) {};
+    ~HeightNoise() {};
+
+    void Setup(const Settings &settings,uint32_t seed);
+    const Settings& GetSettings() const {return settings;};
+
+    /*
+    Fill field with the world rect of its size whose
+    first vert is world vert (gx0,gy0). Rows are built
+    in parallel. With step>1 every step-th world vert
+    is taken, a coarse copy of the same rect x step.
+    */
+    void Fill(HeightField16 &field,long long gx0=0,long long gy0=0,int step=1) const;
+
+    // Same for field rows [i0,i1) only, so long fills can report and stop between bands
+    void FillBand(HeightField16 &field,int i0,int i1,long long gx0=0,long long gy0=0,int step=1) const;
+
+    // Same for one tile, built on the calling thread only
+    void FillTile(HeightField16 &tile,long long gx0,long long gy0) const;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include "heightnormals.h"
+#include <omp.h>
+#include <math.h>
+
+//******************************************//
+//          Interior Row Gradients          //
+//******************************************//
+/*
+Fill nx,ny,nz[j] for columns [ja,jb) of a row that
+has a row above (a) and below (b). sx and sz scale
+the raw height differences into slopes.
+*/
+static inline void CentralRow(const uint16_t *a,const uint16_t *m,const uint16_t *b,
+                              int ja,int jb,float sx,float sz,float *nx,float *ny,float *nz)
+{
+    #pragma omp simd
+    for (int j=ja; j<jb; ++j)
+    {
+        float gx = sx*(float)((int)m[j+1]-(int)m[j-1]);
+        float gz = sz*(float)((int)b[j]-(int)a[j]);
+
+        float inv = 1.0f/sqrtf(gx*gx+gz*gz+1.0f);
+        nx[j] = -gx*inv;
+        ny[j] = inv;
+        nz[j] = -gz*inv;
+    }
+};
+
+static inline void SobelRow(const uint16_t *a,const uint16_t *m,const uint16_t *b,
+                            int ja,int jb,float sx,float sz,float *nx,float *ny,float *nz)
+{
+    #pragma omp simd
+    for (int j=ja; j<jb; ++j)
+    {
+        int dx = ((int)a[j+1]-(int)a[j-1]) + 2*((int)m[j+1]-(int)m[j-1]) + ((int)b[j+1]-(int)b[j-1]);
+        int dz = ((int)b[j-1]-(int)a[j-1]) + 2*((int)b[j]-(int)a[j]) + ((int)b[j+1]-(int)a[j+1]);
+
+        float gx = sx*(float)dx;
+        float gz = sz*(float)dz;
+
+        float inv = 1.0f/sqrtf(gx*gx+gz*gz+1.0f);
+        nx[j] = -gx*inv;
+        ny[j] = inv;
+        nz[j] = -gz*inv;
+    }
+};
+
+//******************************************//
+//              Border Normal               //
+//******************************************//
+/*
+Neighbours outside the field are clamped to the
+edge, and the difference is divided by the real
+distance so edges get a one-sided slope.
+*/
+glm::vec3 HeightNormals::BorderNormal(const HeightField16 &field,int i,int j) const
+{
+    const int h = field.Height();
+    const int w = field.Width();
+
+    int im1 = std::max(i-1,0);
+    int ip1 = std::min(i+1,h-1);
+    int jm1 = std::max(j-1,0);
+    int jp1 = std::min(j+1,w-1);
+
+    float dx = 0.0f;
+    float dz = 0.0f;
+
+    if (quality==NORMALS_SOBEL)
+    {
+        dx = ( (float)field(im1,jp1) - (float)field(im1,jm1)
+             + 2.0f*((float)field(i,jp1) - (float)field(i,jm1))
+             + (float)field(ip1,jp1) - (float)field(ip1,jm1) )/4.0f;
+        dz = ( (float)field(ip1,jm1) - (float)field(im1,jm1)
+             + 2.0f*((float)field(ip1,j) - (float)field(im1,j))
+             + (float)field(ip1,jp1) - (float)field(im1,jp1) )/4.0f;
+    } else {
+        dx = (float)field(i,jp1) - (float)field(i,jm1);
+        dz = (float)field(ip1,j) - (float)field(im1,j);
+    }
+
+    float gx = (jp1>jm1) ? heightMult*dx/(spacing*(jp1-jm1)) : 0.0f;
+    float gz = (ip1>im1) ? heightMult*dz/(spacing*(ip1-im1)) : 0.0f;
+
+    return glm::normalize(glm::vec3(-gx,1.0f,-gz));
+};
+
+//******************************************//
+//             Compute Normals              //
+//******************************************//
+void HeightNormals::Compute(const HeightField16 &field,Vertex *verts,int vstride,int vi0,int vj0,int i0,int i1,int j0,int j1) const
+{
+    const int h = field.Height();
+    const int w = field.Width();
+
+    i0 = std::max(i0,0);
+    j0 = std::max(j0,0);
+    i1 = std::min(i1,h);
+    j1 = std::min(j1,w);
+
+    if (i0>=i1 || j0>=j1)
+    {
+        return;
+    }
+
+    // Slope per unit of height difference
+    float sx,sz;
+    if (quality==NORMALS_SOBEL)
+    {
+        sx = heightMult/(8.0f*spacing);
+        sz = heightMult/(8.0f*spacing);
+    } else {
+        sx = heightMult/(2.0f*spacing);
+        sz = heightMult/(2.0f*spacing);
+    }
+
+    // Interior columns of the requested range
+    const int ja = std::max(j0,1);
+    const int jb = std::min(j1,w-1);
+
+    // Small (brush sized) regions are not worth the thread startup
+    const bool parallel = (long long int)(i1-i0)*(j1-j0) > 16384;
+
+    #pragma omp parallel if(parallel)
+    {
+        std::vector<float> nx(w),ny(w),nz(w);
+
+        #pragma omp for schedule(static)
+        for (int i=i0; i<i1; ++i)
+        {
+            // vRow[j-vj0] is grid vert (i,j)
+            Vertex *vRow = verts + (size_t)(i-vi0)*vstride;
+
+            if (i==0 || i==h-1)
+            {
+                for (int j=j0; j<j1; ++j)
+                {
+                    vRow[j-vj0].normal = BorderNormal(field,i,j);
+                }
+                continue;
+            }
+
+            if (ja<jb)
+            {
+                if (quality==NORMALS_SOBEL)
+                {
+                    SobelRow(field.Row(i-1),field.Row(i),field.Row(i+1),ja,jb,sx,sz,&nx[0],&ny[0],&nz[0]);
+                } else {
+                    CentralRow(field.Row(i-1),field.Row(i),field.Row(i+1),ja,jb,sx,sz,&nx[0],&ny[0],&nz[0]);
+                }
+
+                for (int j=ja; j<jb; ++j)
+                {
+                    vRow[j-vj0].normal = glm::vec3(nx[j],ny[j],nz[j]);
+                }
+            }
+
+            if (j0==0)
+            {
+                vRow[0-vj0].normal = BorderNormal(field,i,0);
+            }
+
+            if (j1==w)
+            {
+                vRow[w-1-vj0].normal = BorderNormal(field,i,w-1);
+            }
+        }
+    }
+};
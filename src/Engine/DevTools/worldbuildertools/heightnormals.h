@@ -0,0 +1,81 @@
+#ifndef HEIGHTNORMALS_C
+#define HEIGHTNORMALS_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../../Headers/headersogl.h"
+#include "../../Handlers/ModelHandler/base_classes.h"
+#include "../../Tools/heightfield.hpp"
+
+//******************************************//
+//           Height Normals Class           //
+//******************************************//
+/*
+    Computes vertex normals straight from a
+    HeightField16. On a regular grid the normal
+    at (i,j) is normalize(-dy/dx, 1, -dy/dz), so
+    only the two height gradients are needed.
+
+    Quality modes:
+        NORMALS_CENTRAL  4 neighbour central differences
+        NORMALS_SOBEL    8 neighbour Sobel differences,
+                         smoother on noisy terrain
+
+    Interior rows run through a vectorized loop
+    that writes into per-row SoA scratch arrays,
+    borders are done separately with one-sided
+    (clamped) differences.
+*/
+class HeightNormals
+{
+public:
+    enum Quality
+    {
+        NORMALS_CENTRAL=0,
+        NORMALS_SOBEL=1
+    };
+
+private:
+    Quality quality;
+    float spacing; // Distance between verts
+    float heightMult; // Height multiplier
+
+    glm::vec3 BorderNormal(const HeightField16 &field,int i,int j) const;
+
+public:
+    HeightNormals() : quality(NORMALS_SOBEL), spacing(1.0f), heightMult(1.0f) {};
+
+    void SetQuality(Quality quality) {this->quality=quality;};
+    Quality GetQuality() const {return quality;};
+
+    // Grid spacing and height multiplier used to build the verts
+    void SetScale(float spacing,float heightMult)
+    {
+        this->spacing=spacing;
+        this->heightMult=heightMult;
+    };
+
+    //*****************************
+    //     Compute the Normals
+    //*****************************
+    /*
+    Writes the normals of rows [i0,i1) and columns
+    [j0,j1) into a row-major block of verts holding
+    grid vert (vi0,vj0) at verts[0], with vstride
+    verts per row. The block must cover the rect.
+    */
+    void Compute(const HeightField16 &field,Vertex *verts,int vstride,int vi0,int vj0,int i0,int i1,int j0,int j1) const;
+
+    // Verts laid out like the field, field.Width() verts per row
+    void Compute(const HeightField16 &field,Vertex *verts,int i0,int i1,int j0,int j1) const
+    {
+        Compute(field,verts,field.Width(),0,0,i0,i1,j0,j1);
+    };
+
+    // Whole field
+    void Compute(const HeightField16 &field,Vertex *verts) const
+    {
+        Compute(field,verts,0,field.Height(),0,field.Width());
+    };
+};
+
+#endif
@@ -0,0 +1,363 @@
+#include "heightpicker.h"
+#include <omp.h>
+#include <math.h>
+
+//******************************************//
+//              Build Level 0               //
+//******************************************//
+/*
+Min/max of the four corner heights of the cells in
+rows [i0,i1) and columns [j0,j1).
+*/
+void HeightPicker::BuildLevel0(const HeightField16 &field,int i0,int i1,int j0,int j1)
+{
+    Level &L = levels[0];
+
+    #pragma omp parallel for if((i1-i0)*(j1-j0)>16384)
+    for (int i=i0; i<i1; ++i)
+    {
+        const uint16_t *r0 = field.Row(i);
+        const uint16_t *r1 = field.Row(i+1);
+        uint16_t *lo = &L.low[(size_t)i*L.width];
+        uint16_t *hi = &L.high[(size_t)i*L.width];
+
+        for (int j=j0; j<j1; ++j)
+        {
+            uint16_t a = std::min(r0[j],r0[j+1]);
+            uint16_t b = std::min(r1[j],r1[j+1]);
+            uint16_t c = std::max(r0[j],r0[j+1]);
+            uint16_t d = std::max(r1[j],r1[j+1]);
+            lo[j] = std::min(a,b);
+            hi[j] = std::max(c,d);
+        }
+    }
+};
+
+//******************************************//
+//             Build Level k>0              //
+//******************************************//
+/*
+Merge the (up to) 2x2 children of the nodes in rows
+[i0,i1) and columns [j0,j1) of level k.
+*/
+void HeightPicker::BuildLevel(int k,int i0,int i1,int j0,int j1)
+{
+    Level &L = levels[k];
+    const Level &C = levels[k-1];
+
+    #pragma omp parallel for if((i1-i0)*(j1-j0)>16384)
+    for (int i=i0; i<i1; ++i)
+    {
+        int ci0 = 2*i;
+        int ci1 = std::min(2*i+2,C.height);
+
+        for (int j=j0; j<j1; ++j)
+        {
+            int cj0 = 2*j;
+            int cj1 = std::min(2*j+2,C.width);
+
+            uint16_t lo = 0xFFFF;
+            uint16_t hi = 0;
+            for (int ci=ci0; ci<ci1; ++ci)
+            {
+                for (int cj=cj0; cj<cj1; ++cj)
+                {
+                    lo = std::min(lo,C.low[(size_t)ci*C.width+cj]);
+                    hi = std::max(hi,C.high[(size_t)ci*C.width+cj]);
+                }
+            }
+
+            L.low[(size_t)i*L.width+j] = lo;
+            L.high[(size_t)i*L.width+j] = hi;
+        }
+    }
+};
+
+//******************************************//
+//              Build Pyramid               //
+//******************************************//
+void HeightPicker::Build(const HeightField16 &field)
+{
+    levels.clear();
+
+    fieldWidth = field.Width();
+    fieldHeight = field.Height();
+
+    if (fieldWidth<2 || fieldHeight<2)
+    {
+        return;
+    }
+
+    // Allocate the levels, halving until a single node is left
+    int lw = fieldWidth-1;
+    int lh = fieldHeight-1;
+    while (true)
+    {
+        Level L;
+        L.width = lw;
+        L.height = lh;
+        L.low.resize((size_t)lw*lh);
+        L.high.resize((size_t)lw*lh);
+        levels.push_back(L);
+
+        if (lw==1 && lh==1)
+        {
+            break;
+        }
+
+        lw = (lw+1)/2;
+        lh = (lh+1)/2;
+    }
+
+    BuildLevel0(field,0,levels[0].height,0,levels[0].width);
+    for (int k=1; k<(int)levels.size(); ++k)
+    {
+        BuildLevel(k,0,levels[k].height,0,levels[k].width);
+    }
+};
+
+//******************************************//
+//             Update Pyramid               //
+//******************************************//
+/*
+A vert touches the cells up and left of it, so the
+cell rect is the vert rect grown by one to the top
+and left. Each level above covers half of the rect
+below it.
+*/
+void HeightPicker::Update(const HeightField16 &field,const HeightRect &r)
+{
+    if (levels.empty() || field.Width()!=fieldWidth || field.Height()!=fieldHeight)
+    {
+        Build(field);
+        return;
+    }
+
+    HeightRect c = HeightRect(r.i0-1,r.i1,r.j0-1,r.j1).Clipped(levels[0].height,levels[0].width);
+    if (c.Empty())
+    {
+        return;
+    }
+
+    BuildLevel0(field,c.i0,c.i1,c.j0,c.j1);
+
+    for (int k=1; k<(int)levels.size(); ++k)
+    {
+        c = HeightRect(c.i0/2,(c.i1-1)/2+1,c.j0/2,(c.j1-1)/2+1);
+        BuildLevel(k,c.i0,c.i1,c.j0,c.j1);
+    }
+};
+
+//******************************************//
+//           Ray Box Intersection           //
+//******************************************//
+/*
+Slab test, returns the entry distance in tnear
+(clamped to 0 when the origin is inside).
+*/
+static inline bool RayBox(const glm::vec3 &o,const glm::vec3 &inv,const glm::vec3 &bmin,const glm::vec3 &bmax,float &tnear)
+{
+    float t0 = 0.0f;
+    float t1 = 1.0e30f;
+
+    for (int a=0; a<3; ++a)
+    {
+        float tA = (bmin[a]-o[a])*inv[a];
+        float tB = (bmax[a]-o[a])*inv[a];
+        if (tA>tB)
+        {
+            std::swap(tA,tB);
+        }
+
+        t0 = tA>t0 ? tA : t0;
+        t1 = tB<t1 ? tB : t1;
+
+        if (t0>t1)
+        {
+            return false;
+        }
+    }
+
+    tnear=t0;
+    return true;
+};
+
+//******************************************//
+//        Ray Triangle Intersection         //
+//******************************************//
+/*
+Moller-Trumbore, two sided. Returns the ray distance
+in t.
+*/
+static inline bool RayTriangle(const glm::vec3 &o,const glm::vec3 &d,const glm::vec3 &v0,const glm::vec3 &v1,const glm::vec3 &v2,float &t)
+{
+    glm::vec3 e1 = v1-v0;
+    glm::vec3 e2 = v2-v0;
+    glm::vec3 p = glm::cross(d,e2);
+    float det = glm::dot(e1,p);
+
+    if (fabs(det)<1.0e-12f)
+    {
+        return false;
+    }
+
+    float invDet = 1.0f/det;
+    glm::vec3 s = o-v0;
+    float u = glm::dot(s,p)*invDet;
+    if (u<0.0f || u>1.0f)
+    {
+        return false;
+    }
+
+    glm::vec3 q = glm::cross(s,e1);
+    float v = glm::dot(d,q)*invDet;
+    if (v<0.0f || u+v>1.0f)
+    {
+        return false;
+    }
+
+    t = glm::dot(e2,q)*invDet;
+    return t>=0.0f;
+};
+
+//******************************************//
+//                Pick Ray                  //
+//******************************************//
+/*
+The ray is moved into grid space (x=column, y=height,
+z=row) where node boxes are simply index ranges and
+height ranges. This is an affine map, so the ray
+parameter t is the same in both spaces.
+*/
+PickResult HeightPicker::Pick(const HeightField16 &field,glm::vec3 origin,glm::vec3 dir) const
+{
+    PickResult result;
+
+    if (levels.empty() || field.Width()!=fieldWidth || field.Height()!=fieldHeight)
+    {
+        return result;
+    }
+
+    float shift = spacing*(fieldWidth-1)/2.0f;
+    float hm = (heightMult!=0.0f) ? heightMult : 1.0e-6f;
+
+    glm::vec3 o((origin.x+shift)/spacing,origin.y/hm+midpoint,(origin.z+shift)/spacing);
+    glm::vec3 d(dir.x/spacing,dir.y/hm,dir.z/spacing);
+    glm::vec3 inv(1.0f/d.x,1.0f/d.y,1.0f/d.z);
+
+    struct Node
+    {
+        int k,i,j;
+        float tnear;
+    };
+
+    std::vector<Node> stack;
+    stack.reserve(4*levels.size()+4);
+
+    // Start at the root
+    {
+        const int top = (int)levels.size()-1;
+        const Level &L = levels[top];
+        glm::vec3 bmin(0.0f,(float)L.low[0],0.0f);
+        glm::vec3 bmax((float)(fieldWidth-1),(float)L.high[0],(float)(fieldHeight-1));
+
+        float tn;
+        if (RayBox(o,inv,bmin,bmax,tn))
+        {
+            Node n = {top,0,0,tn};
+            stack.push_back(n);
+        }
+    }
+
+    float best = 1.0e30f;
+
+    while (!stack.empty())
+    {
+        Node n = stack.back();
+        stack.pop_back();
+
+        if (n.tnear>=best)
+        {
+            continue;
+        }
+
+        // Leaf: exact triangle tests
+        if (n.k==0)
+        {
+            int i=n.i;
+            int j=n.j;
+            glm::vec3 v00((float)j,  (float)field(i,j),  (float)i);
+            glm::vec3 v01((float)j+1,(float)field(i,j+1),(float)i);
+            glm::vec3 v10((float)j,  (float)field(i+1,j),(float)i+1);
+            glm::vec3 v11((float)j+1,(float)field(i+1,j+1),(float)i+1);
+
+            float t;
+            if (RayTriangle(o,d,v00,v10,v01,t) && t<best)
+            {
+                best=t;
+                result.i=i;
+                result.j=j;
+                result.tri=0;
+            }
+            if (RayTriangle(o,d,v01,v10,v11,t) && t<best)
+            {
+                best=t;
+                result.i=i;
+                result.j=j;
+                result.tri=1;
+            }
+            continue;
+        }
+
+        // Children, pushed far to near so the nearest is visited first
+        const Level &C = levels[n.k-1];
+        const int size = 1<<(n.k-1); // Cells per child edge
+
+        Node child[4];
+        int nchild=0;
+
+        for (int ci=2*n.i; ci<std::min(2*n.i+2,C.height); ++ci)
+        {
+            for (int cj=2*n.j; cj<std::min(2*n.j+2,C.width); ++cj)
+            {
+                size_t idx = (size_t)ci*C.width+cj;
+                glm::vec3 bmin((float)(cj*size),(float)C.low[idx],(float)(ci*size));
+                glm::vec3 bmax((float)std::min((cj+1)*size,fieldWidth-1),(float)C.high[idx],(float)std::min((ci+1)*size,fieldHeight-1));
+
+                float tn;
+                if (RayBox(o,inv,bmin,bmax,tn) && tn<best)
+                {
+                    Node c = {n.k-1,ci,cj,tn};
+                    child[nchild++] = c;
+                }
+            }
+        }
+
+        // Sort by distance (at most 4, insertion sort), farthest first
+        for (int a=1; a<nchild; ++a)
+        {
+            Node key = child[a];
+            int b=a-1;
+            while (b>=0 && child[b].tnear<key.tnear)
+            {
+                child[b+1]=child[b];
+                --b;
+            }
+            child[b+1]=key;
+        }
+
+        for (int a=0; a<nchild; ++a)
+        {
+            stack.push_back(child[a]);
+        }
+    }
+
+    if (result.tri>=0)
+    {
+        result.hit=true;
+        result.t=best;
+        result.position=origin+best*dir;
+    }
+
+    return result;
+};
@@ -0,0 +1,101 @@
+#ifndef HEIGHTPICKER_C
+#define HEIGHTPICKER_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../../Headers/headersogl.h"
+#include "../../Tools/heightfield.hpp"
+
+//******************************************//
+//            Pick Result Struct            //
+//******************************************//
+/*
+    Result of a ray pick. The hit triangle is
+    triangle tri (0 or 1) of the grid cell whose
+    top left vert is (i,j), split the same way the
+    terrain meshes are indexed:
+
+        tri 0: (i,j) (i+1,j) (i,j+1)
+        tri 1: (i,j+1) (i+1,j) (i+1,j+1)
+*/
+struct PickResult
+{
+    bool hit;
+    float t; // Ray parameter of the hit
+    glm::vec3 position; // World position of the hit
+    int i,j; // Grid cell
+    int tri; // Triangle of the cell
+
+    PickResult() : hit(false), t(0.0f), position(0.0f), i(-1), j(-1), tri(-1) {};
+};
+
+//******************************************//
+//           Height Picker Class            //
+//******************************************//
+/*
+    Min/max mip pyramid over the grid cells of a
+    HeightField16, used to intersect rays with the
+    terrain. Level 0 holds the lowest and highest
+    corner height of every cell, each level above
+    merges 2x2 nodes of the one below.
+
+    A pick walks the pyramid front to back along
+    the ray, only descending into nodes whose
+    bounding box the ray passes through, and does
+    exact triangle tests at level 0 only.
+
+    After sculpting, Update() rebuilds just the
+    nodes above a dirty rect of verts.
+*/
+class HeightPicker
+{
+    struct Level
+    {
+        int width; // Nodes per row
+        int height; // Rows of nodes
+        std::vector<uint16_t> low;
+        std::vector<uint16_t> high;
+    };
+
+    std::vector<Level> levels;
+
+    int fieldWidth;
+    int fieldHeight;
+
+    // Grid to world mapping (same as the terrain verts)
+    float spacing;
+    float heightMult;
+    float midpoint;
+
+    void BuildLevel0(const HeightField16 &field,int i0,int i1,int j0,int j1);
+    void BuildLevel(int k,int i0,int i1,int j0,int j1);
+
+public:
+    HeightPicker() : fieldWidth(0), fieldHeight(0), spacing(1.0f), heightMult(1.0f), midpoint(0.0f) {};
+
+    /*
+    World position of vert (i,j) is
+        x = j*spacing - shift
+        y = heightMult*(height - midpoint)
+        z = i*spacing - shift
+    with shift = spacing*(width-1)/2
+    */
+    void SetMapping(float spacing,float heightMult,float midpoint)
+    {
+        this->spacing=spacing;
+        this->heightMult=heightMult;
+        this->midpoint=midpoint;
+    };
+
+    // Build the whole pyramid
+    void Build(const HeightField16 &field);
+
+    // Rebuild the nodes covering a rect of changed verts
+    void Update(const HeightField16 &field,const HeightRect &r);
+
+    // Intersect a world space ray with the terrain
+    PickResult Pick(const HeightField16 &field,glm::vec3 origin,glm::vec3 dir) const;
+
+    bool Empty() const {return levels.empty();};
+};
+
+#endif
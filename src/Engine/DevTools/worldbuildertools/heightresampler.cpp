@@ -0,0 +1,125 @@
+#include "heightresampler.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+//******************************************//
+//              Filter Taps                 //
+//******************************************//
+void HeightResampler::BuildTaps(int from,int to,Taps &taps)
+{
+    const double scale = to>1 ? (double)(from-1)/(to-1) : 0.0;
+    const double radius = std::max(scale,1.0);
+
+    taps.first.resize(to);
+    taps.count.resize(to);
+    taps.offset.resize(to);
+    taps.weights.clear();
+    taps.widest=1;
+
+    for (int o=0; o<to; ++o)
+    {
+        const double center=o*scale;
+        const int k0=std::max((int)floor(center-radius)+1,0);
+        const int k1=std::min((int)ceil(center+radius)-1,from-1);
+
+        taps.first[o]=k0;
+        taps.count[o]=k1-k0+1;
+        taps.offset[o]=(int)taps.weights.size();
+        taps.widest=std::max(taps.widest,k1-k0+1);
+
+        double sum=0.0;
+        for (int k=k0; k<=k1; ++k)
+        {
+            sum+=1.0-fabs(k-center)/radius;
+        }
+        for (int k=k0; k<=k1; ++k)
+        {
+            taps.weights.push_back((float)((1.0-fabs(k-center)/radius)/sum));
+        }
+    }
+};
+
+//******************************************//
+//            Resample the Rows             //
+//******************************************//
+bool HeightResampler::Resample(int srcWidth,int srcHeight,const RowReader &next,HeightField16 &field,uint16_t &low,uint16_t &high)
+{
+    const int w=field.Width();
+    const int h=field.Height();
+    if (srcWidth<2 || srcHeight<2 || w<2 || h<2)
+    {
+        return false;
+    }
+
+    Taps across,down;
+    BuildTaps(srcWidth,w,across);
+    BuildTaps(srcHeight,h,down);
+
+    // Source rows filtered across, the last ring rows read
+    const int ring=down.widest;
+    std::vector<float> rows((size_t)ring*w);
+    std::vector<uint16_t> src(srcWidth);
+
+    uint16_t lo=std::numeric_limits<uint16_t>::max();
+    uint16_t hi=0;
+    int read=0;
+
+    for (int o=0; o<h; ++o)
+    {
+        //*************************
+        //   Source Rows, Across
+        //*************************
+        while (read<down.first[o]+down.count[o])
+        {
+            if (!next(&src[0]))
+            {
+                return false;
+            }
+
+            float *dst=&rows[(size_t)(read%ring)*w];
+
+            #pragma omp parallel for schedule(static)
+            for (int j=0; j<w; ++j)
+            {
+                const float *wt=&across.weights[across.offset[j]];
+                const uint16_t *s=&src[across.first[j]];
+                float sum=0.0f;
+                for (int k=0; k<across.count[j]; ++k)
+                {
+                    sum+=wt[k]*s[k];
+                }
+                dst[j]=sum;
+            }
+
+            ++read;
+        }
+
+        //*************************
+        //   Output Row, Down
+        //*************************
+        const float *wt=&down.weights[down.offset[o]];
+        const int k0=down.first[o];
+        const int n=down.count[o];
+        uint16_t *out=field.Row(o);
+
+        #pragma omp parallel for schedule(static) reduction(min:lo) reduction(max:hi)
+        for (int j=0; j<w; ++j)
+        {
+            float sum=0.0f;
+            for (int k=0; k<n; ++k)
+            {
+                sum+=wt[k]*rows[(size_t)((k0+k)%ring)*w+j];
+            }
+
+            const uint16_t v=(uint16_t)std::min(std::max(sum+0.5f,0.0f),65535.0f);
+            out[j]=v;
+            lo=std::min(lo,v);
+            hi=std::max(hi,v);
+        }
+    }
+
+    low=lo;
+    high=hi;
+    return true;
+};
@@ -0,0 +1,55 @@
+#ifndef HEIGHTRESAMPLER_C
+#define HEIGHTRESAMPLER_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Tools/heightfield.hpp"
+#include <functional>
+
+//******************************************//
+//          Height Resampler Class          //
+//******************************************//
+/*
+    Resamples a stream of height rows to the size
+    of a HeightField16, reading every source row
+    once and in order, so the source never has to
+    be in memory.
+
+    Corners map onto corners (vert grids, like the
+    2^n+1 terrains). Each output height is a tent
+    filter over the source: bilinear when
+    enlarging, and as wide as the step between
+    output verts when shrinking, so large DEMs are
+    averaged down rather than point sampled.
+
+    Each source row is filtered across as it comes
+    in and kept in a small ring of rows, and every
+    output row is filtered down from the ring as
+    soon as its last source row arrived. Both run
+    in parallel over the columns. The lowest and
+    highest output heights are found on the way.
+*/
+class HeightResampler
+{
+public:
+    // Fill the next source row, false if there is none
+    typedef std::function<bool(uint16_t *row)> RowReader;
+
+private:
+    // Source samples and weights of every output vert along one axis
+    struct Taps
+    {
+        std::vector<int> first;
+        std::vector<int> count;
+        std::vector<int> offset; // Into weights
+        std::vector<float> weights;
+        int widest;
+    };
+
+    static void BuildTaps(int from,int to,Taps &taps);
+
+public:
+    // Resample srcWidth x srcHeight rows from next into field (allocated to the output size)
+    static bool Resample(int srcWidth,int srcHeight,const RowReader &next,HeightField16 &field,uint16_t &low,uint16_t &high);
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "heightsmoother.h"
+#include "../../Tools/console.h"
+#include <omp.h>
+
+//******************************************//
+//              3x3 Kernels                 //
+//******************************************//
+/*
+Each kernel computes the new value of column j from
+the rows above (u), at (m) and below (d) the element.
+jm and jp are the left and right neighbour columns,
+already wrapped by the caller. The functions are
+branch free so the interior loops vectorize.
+*/
+struct BoxKernel
+{
+    static inline int Value(const uint16_t *u,const uint16_t *m,const uint16_t *d,int jm,int j,int jp)
+    {
+        int SUM = u[jm] + u[j] + u[jp]
+                + m[jm]        + m[jp]
+                + d[jm] + d[j] + d[jp];
+        return SUM/8;
+    };
+};
+
+struct GaussianKernel
+{
+    static inline int Value(const uint16_t *u,const uint16_t *m,const uint16_t *d,int jm,int j,int jp)
+    {
+        int SUM =    u[jm] + 2*u[j] +   u[jp]
+                + 2*m[jm] + 4*m[j] + 2*m[jp]
+                +    d[jm] + 2*d[j] +   d[jp];
+        return (SUM+8)/16;
+    };
+};
+
+struct MedianKernel
+{
+    static inline void Sort2(int &a,int &b)
+    {
+        int lo = a < b ? a : b;
+        int hi = a < b ? b : a;
+        a=lo;
+        b=hi;
+    };
+
+    // Median of 9 with a fixed 19 compare exchange network
+    static inline int Value(const uint16_t *u,const uint16_t *m,const uint16_t *d,int jm,int j,int jp)
+    {
+        int p0=u[jm], p1=u[j], p2=u[jp];
+        int p3=m[jm], p4=m[j], p5=m[jp];
+        int p6=d[jm], p7=d[j], p8=d[jp];
+
+        Sort2(p1,p2); Sort2(p4,p5); Sort2(p7,p8);
+        Sort2(p0,p1); Sort2(p3,p4); Sort2(p6,p7);
+        Sort2(p1,p2); Sort2(p4,p5); Sort2(p7,p8);
+        Sort2(p0,p3); Sort2(p5,p8); Sort2(p4,p7);
+        Sort2(p3,p6); Sort2(p1,p4); Sort2(p2,p5);
+        Sort2(p4,p7); Sort2(p4,p2); Sort2(p6,p4);
+        Sort2(p4,p2);
+
+        return p4;
+    };
+};
+
+//******************************************//
+//            Single Row Pass               //
+//******************************************//
+/*
+Smooth one row. Interior columns run through a simd
+loop, the two edge columns wrap around separately.
+*/
+template<class K>
+static inline void SmoothRow(const uint16_t *u,const uint16_t *m,const uint16_t *d,uint16_t *out,int w)
+{
+    if (w<3)
+    {
+        for (int j=0; j<w; ++j)
+        {
+            int jm = (j==0) ? w-1 : j-1;
+            int jp = (j==w-1) ? 0 : j+1;
+            out[j] = (uint16_t)K::Value(u,m,d,jm,j,jp);
+        }
+        return;
+    }
+
+    #pragma omp simd
+    for (int j=1; j<w-1; ++j)
+    {
+        out[j] = (uint16_t)K::Value(u,m,d,j-1,j,j+1);
+    }
+
+    //Periodic Conditions
+    out[0]   = (uint16_t)K::Value(u,m,d,w-1,0,1);
+    out[w-1] = (uint16_t)K::Value(u,m,d,w-2,w-1,0);
+};
+
+template<class K>
+static void SmoothField(const HeightField16 &src,HeightField16 &dst,int rowBlock)
+{
+    const int h = src.Height();
+    const int w = src.Width();
+    const int nBlocks = (h+rowBlock-1)/rowBlock;
+
+    #pragma omp parallel for schedule(static)
+    for (int b=0; b<nBlocks; ++b)
+    {
+        int iend = std::min(h,(b+1)*rowBlock);
+        for (int i=b*rowBlock; i<iend; ++i)
+        {
+            //Periodic Conditions
+            int im1 = (i==0) ? h-1 : i-1;
+            int ip1 = (i==h-1) ? 0 : i+1;
+
+            SmoothRow<K>(src.Row(im1),src.Row(i),src.Row(ip1),dst.Row(i),w);
+        }
+    }
+};
+
+//******************************************//
+//             Smoothing Pass               //
+//******************************************//
+void HeightSmoother::Pass(const HeightField16 &src,HeightField16 &dst,Kernel kernel)
+{
+    switch (kernel)
+    {
+        case SMOOTH_GAUSSIAN:
+            SmoothField<GaussianKernel>(src,dst,rowBlock);
+            break;
+        case SMOOTH_MEDIAN:
+            SmoothField<MedianKernel>(src,dst,rowBlock);
+            break;
+        case SMOOTH_BOX:
+        default:
+            SmoothField<BoxKernel>(src,dst,rowBlock);
+            break;
+    }
+};
+
+//******************************************//
+//           Smooth Height Field            //
+//******************************************//
+/*
+The scratch buffer is kept between calls and only
+reallocated when the field size changes. After each
+pass the buffers are swapped so field always holds
+the latest result.
+*/
+void HeightSmoother::Smooth(HeightField16 &field,Kernel kernel,int passes)
+{
+    if (passes<=0 || field.Empty())
+    {
+        return;
+    }
+
+    if (scratch.Width()!=field.Width() || scratch.Height()!=field.Height())
+    {
+        if (!scratch.Allocate(field.Width(),field.Height()))
+        {
+            Console::cPrint("Failed to allocate smoothing buffer!");
+            return;
+        }
+    }
+
+    for (int l=0; l<passes; ++l)
+    {
+        Pass(field,scratch,kernel);
+        field.Swap(scratch);
+    }
+};
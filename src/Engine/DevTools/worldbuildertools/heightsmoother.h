@@ -0,0 +1,64 @@
+#ifndef HEIGHTSMOOTHER_C
+#define HEIGHTSMOOTHER_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Tools/heightfield.hpp"
+
+//******************************************//
+//           Height Smoother Class          //
+//******************************************//
+/*
+    Runs repeated 3x3 smoothing passes over a
+    HeightField16. Two buffers are used: the field
+    being smoothed and a scratch buffer owned by
+    this class. Each pass reads one and writes the
+    other, then the two are swapped, so no copy
+    or allocation happens between passes.
+
+    Neighbours wrap around the edges (periodic).
+    Rows wrap by choosing the row pointers, so
+    every row runs through the same vectorized
+    interior loop; only the first and last
+    column are handled separately.
+
+    Kernels:
+        SMOOTH_BOX      mean of the 8 neighbours
+        SMOOTH_GAUSSIAN 1-2-1 weighted 3x3 mean
+        SMOOTH_MEDIAN   median of the 3x3 block
+*/
+class HeightSmoother
+{
+public:
+    enum Kernel
+    {
+        SMOOTH_BOX=0,
+        SMOOTH_GAUSSIAN=1,
+        SMOOTH_MEDIAN=2
+    };
+
+private:
+    HeightField16 scratch; // Second ping-pong buffer
+
+    // Rows per block handed to a thread
+    static const int rowBlock=32;
+
+    void Pass(const HeightField16 &src,HeightField16 &dst,Kernel kernel);
+
+public:
+    HeightSmoother() {};
+    ~HeightSmoother() {};
+
+    //*****************************
+    //   Smooth a Height Field
+    //*****************************
+    /*
+    Run passes smoothing passes of the given kernel
+    over field. The result is left in field.
+    */
+    void Smooth(HeightField16 &field,Kernel kernel,int passes);
+
+    // Release the scratch buffer
+    void Cleanup() {scratch.Free();};
+};
+
+#endif
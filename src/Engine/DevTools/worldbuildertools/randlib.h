@@ -2,79 +2,184 @@
 #define RANDOMGEN_C
 
 #include "../../../Headers/headerscpp.h"
-#include "../../../Headers/headersogl.h"
+#include <stdint.h>
 #include <time.h>
-#include <random>
 
-//Included Shader Program
-//#include "../EasyBMP_1.06/EasyBMP.h"
+//******************************************//
+//        Counter Based Random Class        //
+//******************************************//
+/*
+    Stateless random number generator in the
+    style of SplitMix64. Every value is a pure
+    function of (seed, stream, counter):
 
-class RandomInteger
+        stream  = which stage/level is drawing
+        counter = which cell/element is drawing
+
+    Because nothing is carried between calls,
+    any thread can draw any value in any order
+    and the result is identical to a serial run.
+    Regenerating a terrain only requires the
+    seed it was built with.
+*/
+class CounterRandom
 {
-        std::default_random_engine generator;
-        std::vector<int> array;
-        int index;
+    uint64_t seed;
+    uint64_t key;
 
-        public:
-        RandomInteger(){};
-        RandomInteger(int w,int i){Setup(w,i);};
+public:
+    CounterRandom() {SetSeed(0);};
+    CounterRandom(uint64_t seed) {SetSeed(seed);};
+
+    //****************
+    //  Seed Handling
+    //****************
+    void SetSeed(uint64_t seed)
+    {
+        this->seed=seed;
+        this->key=Mix(seed+0x9E3779B97F4A7C15ull);
+    };
+
+    uint64_t GetSeed() const {return seed;};
+
+    // Returns a seed drawn from the clock, for when the user gave none
+    static uint32_t ClockSeed()
+    {
+        uint64_t t = ((uint64_t)time(NULL) << 20) ^ (uint64_t)clock();
+        uint32_t s = (uint32_t)(Mix(t) >> 32);
+        return s==0 ? 1 : s;
+    };
+
+    //*****************************
+    //  SplitMix64 Finalizer (Mix)
+    //*****************************
+    static inline uint64_t Mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    };
 
-        void Setup(int w,int i)
+    //*********************
+    //  Single Value Draws
+    //*********************
+    // Raw 32 bit value
+    inline uint32_t Uint32(uint32_t stream,uint64_t counter) const
+    {
+        uint64_t x = (key ^ ((uint64_t)stream*0xD1B54A32D192ED03ull)) + counter*0x9E3779B97F4A7C15ull;
+        return (uint32_t)(Mix(x) >> 32);
+    };
+
+    // Integer in the closed range [low,high]
+    inline int Int(uint32_t stream,uint64_t counter,int low,int high) const
+    {
+        uint64_t range = (uint64_t)((int64_t)high-(int64_t)low+1);
+        return low + (int)(((uint64_t)Uint32(stream,counter)*range) >> 32);
+    };
+
+    // Real in the half open range [low,high)
+    inline float Real(uint32_t stream,uint64_t counter,float low,float high) const
+    {
+        return low + (Uint32(stream,counter) >> 8)*(1.0f/16777216.0f)*(high-low);
+    };
+
+    //*************************
+    //   Bulk (Span) Draws
+    //*************************
+    /*
+    Fill out[0..count) with the values for counters
+    first..first+count-1. The loops carry no state
+    between iterations so the compiler vectorizes them.
+    */
+    void FillUint32(uint32_t stream,uint64_t first,int count,uint32_t *out) const
+    {
+        const uint64_t base = (key ^ ((uint64_t)stream*0xD1B54A32D192ED03ull)) + first*0x9E3779B97F4A7C15ull;
+
+        #pragma omp simd
+        for (int k=0; k<count; ++k)
         {
-                time_t Time;
-                time(&Time);
-                int seedOffset=(int)Time;
+            out[k] = (uint32_t)(Mix(base + (uint64_t)k*0x9E3779B97F4A7C15ull) >> 32);
+        }
+    };
+
+    void FillInts(uint32_t stream,uint64_t first,int count,int low,int high,int *out) const
+    {
+        const uint64_t base = (key ^ ((uint64_t)stream*0xD1B54A32D192ED03ull)) + first*0x9E3779B97F4A7C15ull;
+        const uint64_t range = (uint64_t)((int64_t)high-(int64_t)low+1);
 
-                array.resize(w);
+        #pragma omp simd
+        for (int k=0; k<count; ++k)
+        {
+            uint64_t r = Mix(base + (uint64_t)k*0x9E3779B97F4A7C15ull) >> 32;
+            out[k] = low + (int)((r*range) >> 32);
+        }
+    };
 
-                int t = (int)glfwGetTime()+i;
-                std::seed_seq seed = {seedOffset,t,i+100};
-                seed.generate(array.begin(),array.end());//Seed the generator
+    void FillReals(uint32_t stream,uint64_t first,int count,float low,float high,float *out) const
+    {
+        const uint64_t base = (key ^ ((uint64_t)stream*0xD1B54A32D192ED03ull)) + first*0x9E3779B97F4A7C15ull;
+        const float scale = (1.0f/16777216.0f)*(high-low);
+
+        #pragma omp simd
+        for (int k=0; k<count; ++k)
+        {
+            uint64_t r = Mix(base + (uint64_t)k*0x9E3779B97F4A7C15ull) >> 40;
+            out[k] = low + (float)r*scale;
+        }
+    };
+};
+
+//******************************************//
+//          Sequential Random Classes       //
+//******************************************//
+/*
+    Convenience wrappers that walk the counter of a
+    single CounterRandom stream. Seeding is explicit,
+    the same seed always produces the same sequence.
+*/
+class RandomInteger
+{
+        CounterRandom generator;
+        uint32_t stream;
+        uint64_t index;
+
+        public:
+        RandomInteger() : stream(0), index(0) {};
+        RandomInteger(uint64_t seed,uint32_t stream=0) {Setup(seed,stream);};
+
+        void Setup(uint64_t seed,uint32_t stream=0)
+        {
+                generator.SetSeed(seed);
+                this->stream=stream;
                 index = 0;
         };
 
         int GenRandInt(int low,int high)
         {
-                generator.seed(array[index]);//Seed the generator
-                std::uniform_int_distribution<int> distribution(low,high);//Setup the distribution
-                int RN = (int)distribution(generator);//Denerate the random number
-                //std::cout << "RandomNumber: " << RN << std::endl;
-                ++index;//Increase seed offset
-                return RN;
+                return generator.Int(stream,index++,low,high);
         };
 };
 
 class RandomRealVal
 {
-        std::default_random_engine generator;
-        std::vector<int> array;
-        int index;
+        CounterRandom generator;
+        uint32_t stream;
+        uint64_t index;
 
         public:
-        RandomRealVal(){};
+        RandomRealVal() : stream(0), index(0) {};
+        RandomRealVal(uint64_t seed,uint32_t stream=0) {Setup(seed,stream);};
 
-        void Setup(int w,int i)
+        void Setup(uint64_t seed,uint32_t stream=0)
         {
-                time_t Time;
-                time(&Time);
-                int seedOffset=(int)Time;
-
-                array.resize(w);
-
-                int t = (int)glfwGetTime()+i;
-                std::seed_seq seed = {seedOffset,t,i+100};
-                seed.generate(array.begin(),array.end());//Seed the generator
+                generator.SetSeed(seed);
+                this->stream=stream;
                 index = 0;
         };
 
-        int GenRandReal(int high,int low)
+        float GenRandReal(float low,float high)
         {
-                generator.seed(array[index]);//Seed the generator
-                std::uniform_real_distribution<float> distribution(low,high);//Setup the distribution
-                float RN = (float)distribution(generator);//Denerate the random number
-                //std::cout << "RandomNumber: " << RN << std::endl;
-                ++index;//Increase seed offset
-                return RN;
+                return generator.Real(stream,index++,low,high);
         };
 };
 
@@ -0,0 +1,90 @@
+#ifndef SCULPTBRUSH_C
+#define SCULPTBRUSH_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../../Headers/headersogl.h"
+#include <math.h>
+
+//******************************************//
+//            Brush Sample Struct           //
+//******************************************//
+/*
+    One application of a sculpt brush, queued
+    when the user clicks and applied with the
+    rest of the frame's samples.
+
+    func: 0=lower, 1=raise, 2=level
+*/
+struct BrushSample
+{
+    glm::vec3 point; // World position of the brush center
+    int func; // Brush function
+    float eff; // Falloff exponent
+
+    BrushSample() : point(0.0f), func(0), eff(1.0f) {};
+    BrushSample(glm::vec3 point,int func,float eff) : point(point), func(func), eff(eff) {};
+};
+
+//******************************************//
+//         Brush Falloff Table Class        //
+//******************************************//
+/*
+    Tabulates the radial brush falloff
+
+        f(R) = strength/(pow(R/4,eff)+1)   for R<radius
+        f(R) = 0                           otherwise
+
+    so a brush application only needs a table
+    lookup (with linear interpolation) per vert
+    instead of a pow. The table is rebuilt only
+    when the brush parameters change.
+*/
+class BrushFalloff
+{
+    std::vector<float> table;
+    float radius;
+    float eff;
+    float strength;
+    float scale; // Table entries per unit distance
+
+public:
+    BrushFalloff() : radius(-1.0f), eff(-1.0f), strength(-1.0f), scale(0.0f) {};
+
+    // Number of table entries over [0,radius]
+    static const int NTABLE=1024;
+
+    // Rebuild the table if any parameter changed
+    void Setup(float radius,float eff,float strength)
+    {
+        if (radius==this->radius && eff==this->eff && strength==this->strength)
+        {
+            return;
+        }
+
+        this->radius=radius;
+        this->eff=eff;
+        this->strength=strength;
+        this->scale=NTABLE/radius;
+
+        // One extra entry so interpolation at R=radius stays in range
+        table.resize(NTABLE+2);
+        for (int k=0; k<NTABLE+2; ++k)
+        {
+            float R = k/scale;
+            table[k] = strength/(pow(R/4.0,eff)+1.0);
+        }
+    };
+
+    float Radius() const {return radius;};
+
+    // Falloff at distance R (R<radius)
+    inline float operator()(float R) const
+    {
+        float x = R*scale;
+        int k = (int)x;
+        float t = x-k;
+        return table[k] + t*(table[k+1]-table[k]);
+    };
+};
+
+#endif
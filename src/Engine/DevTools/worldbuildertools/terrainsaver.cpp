@@ -0,0 +1,105 @@
+#include "terrainsaver.h"
+#include "../../Tools/console.h"
+#include <omp.h>
+
+//******************************************//
+//             Queue a Save                 //
+//******************************************//
+void TerrainSaver::Save(Snapshot &snap)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    // A waiting save is replaced, it would be written over anyway
+    std::swap(pending,snap);
+    hasPending=true;
+    if (running)
+    {
+        return;
+    }
+
+    // The last worker is done, only its thread is left to join
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+
+    running=true;
+    worker=std::thread(&TerrainSaver::Run,this);
+};
+
+bool TerrainSaver::IsBusy()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return running;
+};
+
+void TerrainSaver::Wait()
+{
+    std::thread done;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::swap(done,worker);
+    }
+
+    if (done.joinable())
+    {
+        done.join();
+    }
+};
+
+//******************************************//
+//              Worker Thread               //
+//******************************************//
+void TerrainSaver::Run()
+{
+    while (true)
+    {
+        Snapshot snap;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!hasPending)
+            {
+                running=false;
+                return;
+            }
+            std::swap(snap,pending);
+            hasPending=false;
+        }
+
+        double ts=omp_get_wtime();
+        if (Write(snap))
+        {
+            Console::cPrint(tools::appendStrings("Saved ",snap.filename," in ",omp_get_wtime()-ts,"s"));
+        }
+        else
+        {
+            Console::cPrint(tools::appendStrings("Failed to save ",snap.filename));
+        }
+    }
+};
+
+// Rows of a band gathered from the tiles
+bool TerrainSaver::Write(const Snapshot &snap)
+{
+    if ((int)snap.tiles.size()!=snap.tilesX*((snap.height+snap.tileSize-1)/snap.tileSize))
+    {
+        return false;
+    }
+
+    return TerrainLoader::WritePacked(snap.filename,snap.header,snap.width,snap.height,
+        [&snap](int i0,int n,uint16_t *dst)
+    {
+        for (int i=i0; i<i0+n; ++i, dst+=snap.width)
+        {
+            const int ty = i/snap.tileSize;
+            const int ti = i-ty*snap.tileSize;
+
+            for (int tx=0; tx<snap.tilesX; ++tx)
+            {
+                const int j0 = tx*snap.tileSize;
+                const int cols = std::min(snap.tileSize,snap.width-j0);
+                memcpy(dst+j0,&(*snap.tiles[ty*snap.tilesX+tx])[(size_t)ti*cols],cols*sizeof(uint16_t));
+            }
+        }
+    });
+};
@@ -0,0 +1,69 @@
+#ifndef TERRAINSAVER_C
+#define TERRAINSAVER_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Loaders/terrainloader.h"
+#include "heighthistory.h"
+#include <thread>
+#include <mutex>
+
+//******************************************//
+//          Terrain Saver Class             //
+//******************************************//
+/*
+    Writes terrains on a worker thread so the
+    editor keeps drawing and sculpting while a
+    save runs.
+
+    A save is handed a Snapshot: the file header
+    (materials, textures, mesh layout) and the
+    height tiles from HeightHistory::Snapshot().
+    The tiles are immutable and shared, so taking
+    one costs only the tiles edited since the last
+    one, and edits after it never reach the file.
+
+    The worker packs the heights (see WritePacked)
+    band by band from the tiles. A save asked for
+    while one is running waits for it, and only the
+    newest of the waiting saves is written.
+*/
+class TerrainSaver
+{
+public:
+    struct Snapshot
+    {
+        std::string filename;
+        TerrainFileHeader header;
+        int width,height;
+        int tileSize,tilesX;
+        std::vector<HeightHistory::TileData> tiles;
+
+        Snapshot() : width(0), height(0), tileSize(0), tilesX(0) {};
+    };
+
+private:
+    std::thread worker;
+    std::mutex lock;
+
+    Snapshot pending;
+    bool hasPending;
+    bool running;
+
+    void Run();
+    static bool Write(const Snapshot &snap);
+
+public:
+    TerrainSaver() : hasPending(false), running(false) {};
+    ~TerrainSaver() {Wait();};
+
+    // Save snap on the worker, taking its contents
+    void Save(Snapshot &snap);
+
+    // A save is running or waiting
+    bool IsBusy();
+
+    // Finish every save asked for
+    void Wait();
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "terrainculler.h"
+#include <math.h>
+#include <algorithm>
+
+//******************************************//
+//              Resize Arrays               //
+//******************************************//
+void TerrainCuller::Resize(int Nmesh)
+{
+    cx.assign(Nmesh,0.0f);
+    cy.assign(Nmesh,0.0f);
+    cz.assign(Nmesh,0.0f);
+    ex.assign(Nmesh,0.0f);
+    ey.assign(Nmesh,0.0f);
+    ez.assign(Nmesh,0.0f);
+    outside.assign(Nmesh,0);
+    sorted.reserve(Nmesh);
+
+    visible=Nmesh;
+    culled=0;
+};
+
+//******************************************//
+//           Set Mesh Bounding Box          //
+//******************************************//
+void TerrainCuller::SetBounds(int mesh,const std::vector<Vertex> &verts)
+{
+    if (verts.empty() || mesh<0 || mesh>=(int)cx.size())
+    {
+        return;
+    }
+
+    glm::vec3 lo(verts[0].position);
+    glm::vec3 hi(verts[0].position);
+    for (size_t k=1; k<verts.size(); ++k)
+    {
+        lo = glm::min(lo,verts[k].position);
+        hi = glm::max(hi,verts[k].position);
+    }
+
+    glm::vec3 c = 0.5f*(lo+hi);
+    glm::vec3 e = 0.5f*(hi-lo);
+    cx[mesh]=c.x; cy[mesh]=c.y; cz[mesh]=c.z;
+    ex[mesh]=e.x; ey[mesh]=e.y; ez[mesh]=e.z;
+};
+
+//******************************************//
+//          Grow Mesh Bounding Box          //
+//******************************************//
+/*
+The box only ever grows, so lowering the terrain
+leaves it a little loose until the next full setup,
+which is still correct for culling.
+*/
+void TerrainCuller::GrowBounds(int mesh,const Vertex *verts,int count)
+{
+    if (count<=0 || mesh<0 || mesh>=(int)cx.size())
+    {
+        return;
+    }
+
+    glm::vec3 lo(cx[mesh]-ex[mesh],cy[mesh]-ey[mesh],cz[mesh]-ez[mesh]);
+    glm::vec3 hi(cx[mesh]+ex[mesh],cy[mesh]+ey[mesh],cz[mesh]+ez[mesh]);
+    for (int k=0; k<count; ++k)
+    {
+        lo = glm::min(lo,verts[k].position);
+        hi = glm::max(hi,verts[k].position);
+    }
+
+    glm::vec3 c = 0.5f*(lo+hi);
+    glm::vec3 e = 0.5f*(hi-lo);
+    cx[mesh]=c.x; cy[mesh]=c.y; cz[mesh]=c.z;
+    ex[mesh]=e.x; ey[mesh]=e.y; ez[mesh]=e.z;
+};
+
+//******************************************//
+//              Cull Meshes                 //
+//******************************************//
+/*
+The six planes are the sums and differences of the
+fourth row of PV with its first three rows. A box
+is outside when its center lies further behind a
+plane than the box's projected radius onto the
+plane normal.
+*/
+void TerrainCuller::Cull(const glm::mat4 &PV,glm::vec3 eye,std::vector<int> &order)
+{
+    const int Nmesh = (int)cx.size();
+
+    order.clear();
+    if (Nmesh==0)
+    {
+        visible=culled=0;
+        return;
+    }
+
+    glm::vec4 row[4];
+    for (int r=0; r<4; ++r)
+    {
+        row[r] = glm::vec4(PV[0][r],PV[1][r],PV[2][r],PV[3][r]);
+    }
+
+    glm::vec4 planes[6] = {
+        row[3]+row[0], row[3]-row[0], // Left, right
+        row[3]+row[1], row[3]-row[1], // Bottom, top
+        row[3]+row[2], row[3]-row[2]  // Near, far
+    };
+
+    std::fill(outside.begin(),outside.end(),0);
+
+    const float *pcx=&cx[0], *pcy=&cy[0], *pcz=&cz[0];
+    const float *pex=&ex[0], *pey=&ey[0], *pez=&ez[0];
+    unsigned char *pout=&outside[0];
+
+    for (int p=0; p<6; ++p)
+    {
+        const float len = glm::length(glm::vec3(planes[p]));
+        const float nx = planes[p].x/len;
+        const float ny = planes[p].y/len;
+        const float nz = planes[p].z/len;
+        const float d = planes[p].w/len;
+        const float ax = fabs(nx), ay = fabs(ny), az = fabs(nz);
+
+        #pragma omp simd
+        for (int m=0; m<Nmesh; ++m)
+        {
+            float dist = nx*pcx[m]+ny*pcy[m]+nz*pcz[m]+d;
+            float rad = ax*pex[m]+ay*pey[m]+az*pez[m];
+            pout[m] |= (unsigned char)(dist<-rad);
+        }
+    }
+
+    // Sort the survivors front to back
+    sorted.clear();
+    for (int m=0; m<Nmesh; ++m)
+    {
+        if (!outside[m])
+        {
+            float dx=cx[m]-eye.x;
+            float dy=cy[m]-eye.y;
+            float dz=cz[m]-eye.z;
+            sorted.push_back(std::make_pair(dx*dx+dy*dy+dz*dz,m));
+        }
+    }
+    std::sort(sorted.begin(),sorted.end());
+
+    order.resize(sorted.size());
+    for (size_t k=0; k<sorted.size(); ++k)
+    {
+        order[k] = sorted[k].second;
+    }
+
+    visible = (int)sorted.size();
+    culled = Nmesh-visible;
+};
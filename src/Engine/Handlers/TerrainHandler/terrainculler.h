@@ -0,0 +1,55 @@
+#ifndef TERRAINCULLER_C
+#define TERRAINCULLER_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../../Headers/headersogl.h"
+#include "../ModelHandler/base_classes.h"
+
+//******************************************//
+//          Terrain Culler Class            //
+//******************************************//
+/*
+    View frustum culling of the terrain meshes.
+
+    Every mesh has an axis aligned bounding box
+    (including its lowest and highest vert),
+    stored as separate center and half extent
+    arrays so the plane tests run over all meshes
+    at once with simd. The meshes that survive are
+    returned sorted front to back, so the depth
+    test rejects as much of the hidden terrain as
+    possible.
+*/
+class TerrainCuller
+{
+    // Bounding boxes, center and half extent
+    std::vector<float> cx,cy,cz;
+    std::vector<float> ex,ey,ez;
+
+    // Scratch space of the cull
+    std::vector<unsigned char> outside;
+    std::vector< std::pair<float,int> > sorted;
+
+    int visible;
+    int culled;
+
+public:
+    TerrainCuller() : visible(0), culled(0) {};
+
+    // Set the number of meshes
+    void Resize(int Nmesh);
+
+    // Bounding box of a mesh from its verts
+    void SetBounds(int mesh,const std::vector<Vertex> &verts);
+
+    // Grow the box of a mesh to include some verts (after sculpting)
+    void GrowBounds(int mesh,const Vertex *verts,int count);
+
+    // Fill order with the meshes inside the frustum of PV, nearest to eye first
+    void Cull(const glm::mat4 &PV,glm::vec3 eye,std::vector<int> &order);
+
+    int GetVisible() const {return visible;};
+    int GetCulled() const {return culled;};
+};
+
+#endif
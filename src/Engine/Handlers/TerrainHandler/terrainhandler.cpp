@@ -1,4 +1,5 @@
 #include "terrainhandler.h"
+#include "terraintilestreamer.h"
 /*
     This class requires the terrain.* shader in the
     bin/Shaders folder to work properly
@@ -9,8 +10,46 @@ TerrainHandler::TerrainHandler()
     GPUDataSet=false;
     GPUTexSet=false;
     GPUShdrSet=false;
+
+    Nsub=0;
+    Elen=0;
+
+    stripIdxs=true;
+
+    lodEnabled=true;
+    lodActive=false;
+    drawnTris=0;
+
+    uniforms.modelMat=-1;
+    uniforms.ambient=-1;
+    uniforms.diffuse=-1;
+    uniforms.specular=-1;
+    uniforms.shininess=-1;
+    uniforms.relativeHeight=-1;
+    uniforms.hmEnabled=-1;
+    uniforms.hmSobel=-1;
+    uniforms.hmEdge=-1;
+    uniforms.hmSubdiv=-1;
+    uniforms.hmSpacing=-1;
+    uniforms.hmHeightMult=-1;
+    uniforms.hmMidpoint=-1;
+
+    exportError=0.5f;
+    heightScale=1.0f;
+
+    heightField=NULL;
+    heightMapping.spacing=1.0f;
+    heightMapping.heightMult=1.0f;
+    heightMapping.midpoint=0.0f;
+    heightMapping.sobel=true;
+    heightMapEnabled=false;
+    heightMapActive=false;
+    heightTex=0;
 }
 
+// Sampler uniform of each landscape texture
+static const char *TextureSamplers[4] = {"textures.lowlandMap","textures.mediumlandMap","textures.highlandMap","textures.cliffMap"};
+
 //*********************************************
 //       Sets up the Shader and Textures
 //*********************************************
@@ -22,10 +61,10 @@ void TerrainHandler::SetTextures()
         //std::cout << "Setting Textures on GPU...\n";
 
         // Setup Textures
-        texture[0].Setup(tools::appendStrings("landscape/",TextureFiles[0]),"textures.lowlandMap");
-        texture[1].Setup(tools::appendStrings("landscape/",TextureFiles[1]),"textures.mediumlandMap");
-        texture[2].Setup(tools::appendStrings("landscape/",TextureFiles[2]),"textures.highlandMap");
-        texture[3].Setup(tools::appendStrings("landscape/",TextureFiles[3]),"textures.cliffMap");
+        for (int i=0; i<4; ++i)
+        {
+            texture[i].Setup(tools::appendStrings("landscape/",TextureFiles[i]),TextureSamplers[i]);
+        }
 
         // Load Textures to CPU and GPU
         for (auto&& tex : texture)
@@ -54,6 +93,30 @@ void TerrainHandler::SetShader()
         Console::cPrint("Setting Shader on GPU...");
         shader.ShaderSet(ShaderFiles);
         GPUShdrSet=true;
+
+        // Resolve the uniforms once, the samplers never change unit
+        GLuint Prog = shader.Program;
+        uniforms.modelMat = glGetUniformLocation(Prog, "modelMat");
+        uniforms.ambient = glGetUniformLocation(Prog, "light.ambient");
+        uniforms.diffuse = glGetUniformLocation(Prog, "light.diffuse");
+        uniforms.specular = glGetUniformLocation(Prog, "light.specular");
+        uniforms.shininess = glGetUniformLocation(Prog, "light.shininess");
+        uniforms.relativeHeight = glGetUniformLocation(Prog, "textures.relativeHeight");
+        uniforms.hmEnabled = glGetUniformLocation(Prog, "heightMap.enabled");
+        uniforms.hmSobel = glGetUniformLocation(Prog, "heightMap.sobel");
+        uniforms.hmEdge = glGetUniformLocation(Prog, "heightMap.edge");
+        uniforms.hmSubdiv = glGetUniformLocation(Prog, "heightMap.subdiv");
+        uniforms.hmSpacing = glGetUniformLocation(Prog, "heightMap.spacing");
+        uniforms.hmHeightMult = glGetUniformLocation(Prog, "heightMap.heightMult");
+        uniforms.hmMidpoint = glGetUniformLocation(Prog, "heightMap.midpoint");
+
+        shader.Use();
+        for (int i=0; i<4; ++i)
+        {
+            glUniform1i(glGetUniformLocation(Prog, TextureSamplers[i]), i);
+        }
+        glUniform1i(glGetUniformLocation(Prog, "heightMap.heights"), 4);
+        glUseProgram(0);
     }
     else
     {
@@ -109,18 +172,12 @@ Set Materials on GPU
 */
 void TerrainHandler::setMaterialUniform ()
 {
-    GLuint Prog = shader.Program;
-    GLint AmbientLoc = glGetUniformLocation(Prog, "light.ambient");
-    GLint DiffuseLoc = glGetUniformLocation(Prog, "light.diffuse");
-    GLint SpecularLoc = glGetUniformLocation(Prog, "light.specular");
-    GLint ShineLoc = glGetUniformLocation(Prog, "light.shininess");
-
     //cout << "Ambient [" << materials.Ka.x << "," << materials.Ka.y << "," << materials.Ka.z << "]\n";
 
-    glUniform3f(AmbientLoc, materials.Ka.x, materials.Ka.y, materials.Ka.z);
-    glUniform3f(DiffuseLoc, materials.Kd.x, materials.Kd.y, materials.Kd.z);
-    glUniform3f(SpecularLoc, materials.Ks.x, materials.Ks.y, materials.Ks.z);
-    glUniform1f(ShineLoc, materials.shine);
+    glUniform3f(uniforms.ambient, materials.Ka.x, materials.Ka.y, materials.Ka.z);
+    glUniform3f(uniforms.diffuse, materials.Kd.x, materials.Kd.y, materials.Kd.z);
+    glUniform3f(uniforms.specular, materials.Ks.x, materials.Ks.y, materials.Ks.z);
+    glUniform1f(uniforms.shininess, materials.shine);
 };
 
 //*********************************************
@@ -131,9 +188,7 @@ Set Relative Height Data on GPU.
 */
 void TerrainHandler::SetRelativeHeightUniform()
 {
-    GLuint Prog = shader.Program;
-    GLint RelHeightLoc = glGetUniformLocation(Prog, "textures.relativeHeight");
-    glUniform4f(RelHeightLoc,relativeHeight.x,relativeHeight.y,relativeHeight.z,relativeHeight.w);
+    glUniform4f(uniforms.relativeHeight,relativeHeight.x,relativeHeight.y,relativeHeight.z,relativeHeight.w);
 };
 
 //*********************************************
@@ -147,12 +202,175 @@ void TerrainHandler::setupMeshes()
 {
     Console::cPrint("Setting Up Terrain Mesh");
     //std::cout << "Setting Up Terrain Mesh" << std::endl;
-    // Create buffers/arrays
+    if (meshVerts.empty())
+    {
+        return;
+    }
+
+    // One index buffer for all meshes
+    GLuint maxIdx = (GLuint)meshVerts[0].size()-1;
+
+    lodActive=false;
+    if (lodEnabled)
+    {
+        lod.Setup(Elen,Nsub);
+        lodActive=!lod.Empty();
+    }
+
+    if (lodActive)
+    {
+        lod.ComputeErrors(meshVerts);
+        idxBuffer.GenBuffer(lod.AccessIdxs(),maxIdx,GL_TRIANGLES);
+        Console::cPrint(tools::appendStrings(" Terrain LOD Levels: ",lod.GetNumLevels()));
+    }
+    else if (stripIdxs)
+    {
+        std::vector<GLuint> strip;
+        BuildStripIndices(Elen,strip);
+        idxBuffer.GenBuffer(strip,maxIdx,GL_TRIANGLE_STRIP);
+    }
+    else
+    {
+        idxBuffer.GenBuffer(idxs,maxIdx,GL_TRIANGLES);
+    }
+
+    // Bounding boxes for culling
+    culler.Resize((int)meshVerts.size());
+    #pragma omp parallel for
     for (int i=0; i<int(meshVerts.size()); ++i)
     {
-        ogltools::BufferHandler tmpBuff;
-        tmpBuff.GenBuffers(meshVerts[i],idxs[i]);
-        buffers.push_back(tmpBuff);
+        culler.SetBounds(i,meshVerts[i]);
+    }
+
+    // Create buffers/arrays, only the index buffer when drawing from the height texture
+    heightMapActive = heightMapEnabled && SetupHeightMap();
+    if (heightMapActive)
+    {
+        buffer.GenBuffers(idxBuffer);
+    }
+    else
+    {
+        buffer.GenBuffers(meshVerts,idxBuffer);
+    }
+};
+
+//*********************************************
+//           Setup the Height Map
+//*********************************************
+/*
+Uploads heightField as a single channel 16 bit
+texture. Returns false (and the vertex buffers are
+used) if there is no field or it is too large for
+a texture.
+*/
+bool TerrainHandler::SetupHeightMap()
+{
+    if (heightField==NULL || heightField->Width()<2 || heightField->Height()<2)
+    {
+        return false;
+    }
+
+    // The shader rebuilds verts assuming the generator's mesh layout
+    int size = (Elen-1)*Nsub+1;
+    if (heightField->Width()!=size || heightField->Height()!=size)
+    {
+        return false;
+    }
+
+    GLint maxSize=0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE,&maxSize);
+    if (heightField->Width()>maxSize || heightField->Height()>maxSize)
+    {
+        Console::cPrint("Terrain too large for a height texture, using vertex buffers.");
+        return false;
+    }
+
+    glGenTextures(1,&heightTex);
+    glBindTexture(GL_TEXTURE_2D,heightTex);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT,2);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,heightField->Stride());
+    glTexImage2D(GL_TEXTURE_2D,0,GL_R16,heightField->Width(),heightField->Height(),0,GL_RED,GL_UNSIGNED_SHORT,heightField->Data());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+
+    glBindTexture(GL_TEXTURE_2D,0);
+
+    Console::cPrint(" Terrain drawn from a height texture");
+    return true;
+};
+
+//*********************************************
+//            Set the Height Map
+//*********************************************
+void TerrainHandler::SetHeightMap(const HeightField16 *field,float spacing,float heightMult,float midpoint,bool sobel)
+{
+    heightField=field;
+    heightMapping.spacing=spacing;
+    heightMapping.heightMult=heightMult;
+    heightMapping.midpoint=midpoint;
+    heightMapping.sobel=sobel;
+};
+
+//*********************************************
+//      Update Part of the Height Map
+//*********************************************
+/*
+Copies the heights of rect r into the height
+texture. The normals of the verts around the rect
+are rebuilt by the shader on the next draw.
+*/
+void TerrainHandler::UpdateHeightMapOnGPU(const HeightRect &r)
+{
+    if (!GPUDataSet || !heightMapActive || heightField==NULL)
+    {
+        return;
+    }
+
+    HeightRect c = r.Clipped(heightField->Height(),heightField->Width());
+    if (c.Empty())
+    {
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D,heightTex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,2);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,heightField->Stride());
+    glTexSubImage2D(GL_TEXTURE_2D,0,c.j0,c.i0,c.Cols(),c.Rows(),GL_RED,GL_UNSIGNED_SHORT,heightField->Row(c.i0)+c.j0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+    glBindTexture(GL_TEXTURE_2D,0);
+};
+
+//*********************************************
+//          Build Strip Indices
+//*********************************************
+/*
+One strip per row of quads, separated by the restart
+index. The strip alternates between the upper and
+lower vert of each column, which gives the same
+triangles with the same winding as the triangle list:
+
+    (i,j) (i+1,j) (i,j+1)
+    (i,j+1) (i+1,j) (i+1,j+1)
+*/
+void TerrainHandler::BuildStripIndices(int N,std::vector<GLuint> &strip)
+{
+    strip.resize((size_t)(N-1)*(2*N+1));
+
+    size_t it=0;
+    for (int i=0; i<(N-1); ++i)
+    {
+        for (int j=0; j<N; ++j)
+        {
+            strip[it++] = j+(i)*N;
+            strip[it++] = j+(i+1)*N;
+        }
+        strip[it++] = 0xFFFFFFFF;
     }
 };
 
@@ -163,11 +381,14 @@ void TerrainHandler::SetTerrainOnGPU()
 {
     if (GPUDataSet)
     {
-        while (!buffers.empty())
+        buffer.ClearBuffers();
+        idxBuffer.ClearBuffer();
+        if (heightTex)
         {
-            buffers.back().ClearBuffers();
-            buffers.pop_back();
+            glDeleteTextures(1,&heightTex);
+            heightTex=0;
         }
+        heightMapActive=false;
 
         setupMeshes();
     }
@@ -179,6 +400,30 @@ void TerrainHandler::SetTerrainOnGPU()
     GPUDataSet=true;
 };
 
+//*********************************************
+//       Update Part of a Mesh on the GPU
+//*********************************************
+/*
+Copies the verts [first,first+count) of meshVerts[mesh]
+into its part of the terrain VBO, no buffers are
+recreated. Does nothing if the terrain is not on
+the GPU yet.
+*/
+void TerrainHandler::UpdateMeshOnGPU(int mesh,int first,int count)
+{
+    if (!GPUDataSet || mesh<0 || mesh>=(int)meshVerts.size() || count<=0)
+    {
+        return;
+    }
+
+    if (!heightMapActive)
+    {
+        buffer.UpdateVerts(&meshVerts[mesh][first],(size_t)mesh*meshVerts[0].size()+first,count);
+    }
+    culler.GrowBounds(mesh,&meshVerts[mesh][first],count);
+    lod.SetDirty(mesh);
+};
+
 //*********************************************
 //              Setup Tex Files
 //*********************************************
@@ -234,26 +479,66 @@ void TerrainHandler::DrawCall()
 {
     if (GPUDataSet)
     {
-        Draw();
+        drawOrder.resize(meshVerts.size());
+        for (int i=0; i<(int)meshVerts.size(); ++i)
+        {
+            drawOrder[i]=i;
+        }
+
+        Draw(false);
+    }
+};
+
+/*
+Culls the meshes outside the camera frustum, draws the
+rest front to back and picks the detail level of every
+mesh from the camera position. A world size at unit
+distance covers sheight*PM[1][1]/2 pixels.
+*/
+void TerrainHandler::DrawCall(RTSCamera &camera)
+{
+    if (GPUDataSet)
+    {
+        culler.Cull(camera.PM*camera.VM,camera.cameraPos,drawOrder);
+
+        if (lodActive)
+        {
+            lod.Select(meshVerts,camera.cameraPos,0.5f*camera.sheight*camera.PM[1][1]);
+        }
+        Draw(true);
     }
 };
 
 //*********************************************
-//         Draws the Mesh (Singular)
+//         Draw a Streamed Tile World
 //*********************************************
 /*
-Draw the mesh to the color buffer.
+The streamer holds its own verts and buffers, only
+the shader, textures and materials come from here.
 */
-void TerrainHandler::Draw()
+void TerrainHandler::DrawCall(TerrainTileStreamer &streamer,RTSCamera &camera)
+{
+    if (streamer.IsActive())
+    {
+        UseDrawState(false);
+        streamer.Draw(camera);
+        drawnTris=streamer.GetDrawnTriangles();
+    }
+};
+
+//*********************************************
+//            Bind the Draw State
+//*********************************************
+void TerrainHandler::UseDrawState(bool heightMap)
 {
     // Use Shader
     shader.Use();
 
     // Bind Textures
-    texture[0].useTexture(shader,0);
-    texture[1].useTexture(shader,1);
-    texture[2].useTexture(shader,2);
-    texture[3].useTexture(shader,3);
+    for (int i=0; i<4; ++i)
+    {
+        texture[i].bindTexture(i);
+    }
 
     // Set Materials
     setMaterialUniform();
@@ -261,18 +546,76 @@ void TerrainHandler::Draw()
     // Set Relative Height
     SetRelativeHeightUniform();
 
-    // Create buffers/arrays
-    for (int i=0; i<(int)buffers.size(); ++i)
+    // Set Position, the verts are already in world space
+    glm::mat4 model2;
+    glUniformMatrix4fv(uniforms.modelMat, 1, GL_FALSE, glm::value_ptr(model2));
+
+    // Height map data
+    glUniform1i(uniforms.hmEnabled, heightMap ? 1 : 0);
+    if (heightMap)
+    {
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, heightTex);
+        glUniform1i(uniforms.hmSobel, heightMapping.sobel ? 1 : 0);
+        glUniform1i(uniforms.hmEdge, Elen);
+        glUniform1i(uniforms.hmSubdiv, Nsub);
+        glUniform1f(uniforms.hmSpacing, heightMapping.spacing);
+        glUniform1f(uniforms.hmHeightMult, heightMapping.heightMult);
+        glUniform1f(uniforms.hmMidpoint, heightMapping.midpoint);
+    }
+};
+
+//*********************************************
+//         Draws the Mesh (Singular)
+//*********************************************
+/*
+Draw the mesh to the color buffer.
+*/
+void TerrainHandler::Draw(bool useLOD)
+{
+    UseDrawState(heightMapActive);
+
+    // Gather the index runs of every visible mesh
+    drawCounts.clear();
+    drawOffsets.clear();
+    drawBase.clear();
+    drawnTris=0;
+
+    const size_t isize = (idxBuffer.type==GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    const GLint meshSize = meshVerts.empty() ? 0 : (GLint)meshVerts[0].size();
+
+    for (int k=0; k<(int)drawOrder.size(); ++k)
     {
-        // Set Position
-        GLuint modelLoc = glGetUniformLocation(shader.Program, "modelMat");
+        const int i = drawOrder[k];
 
-        glm::mat4 model2;
-        model2=glm::translate(model2,glm::vec3(0.0f,0.0f,0.0f));
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model2));
+        if (lodActive)
+        {
+            LODRange r[5];
+            int nr = useLOD ? lod.GetRanges(i,r) : lod.GetFullRanges(r);
+
+            for (int q=0; q<nr; ++q)
+            {
+                drawCounts.push_back(r[q].count);
+                drawOffsets.push_back((const GLvoid*)(r[q].first*isize));
+                drawBase.push_back(i*meshSize);
+                drawnTris += r[q].count/3;
+            }
+        }
+        else
+        {
+            drawCounts.push_back(idxBuffer.idxSize);
+            drawOffsets.push_back((const GLvoid*)0);
+            drawBase.push_back(i*meshSize);
+            drawnTris += 2*(long int)(Elen-1)*(Elen-1);
+        }
+    }
 
-        // Draw mesh
-        buffers[i].DrawVerts();
+    // Draw meshes
+    if (!drawCounts.empty())
+    {
+        idxBuffer.BeginDraw();
+        buffer.DrawRanges(&drawCounts[0],&drawOffsets[0],&drawBase[0],(int)drawCounts.size());
+        idxBuffer.EndDraw();
     }
 };
 
@@ -283,11 +626,14 @@ void TerrainHandler::Cleanup()
 {
     if (GPUDataSet)
     {
-        while (!buffers.empty())
+        buffer.ClearBuffers();
+        idxBuffer.ClearBuffer();
+        if (heightTex)
         {
-            buffers.back().ClearBuffers();
-            buffers.pop_back();
+            glDeleteTextures(1,&heightTex);
+            heightTex=0;
         }
+        heightMapActive=false;
 
         GPUDataSet=false;
     }
@@ -301,12 +647,19 @@ void TerrainHandler::Cleanup()
 //**************************
 long int TerrainHandler::GetGPUMemoryReqs()
 {
-    int rtnval=0;
+    long int rtnval=0;
 
     if (GPUDataSet)
     {
-        rtnval += sizeof(Vertex) * this->meshVerts.back().size() * this->buffers.size();
-        rtnval += sizeof(GLuint) * this->idxs.back().size() * this->buffers.size();
+        if (heightMapActive)
+        {
+            rtnval += sizeof(uint16_t) * (long int)heightField->Width() * heightField->Height();
+        }
+        else
+        {
+            rtnval += sizeof(Vertex) * this->meshVerts.back().size() * this->meshVerts.size();
+        }
+        rtnval += idxBuffer.MemSize();
         rtnval /= (1024*1024);
     }
 
@@ -319,13 +672,13 @@ long int TerrainHandler::GetGPUMemoryReqs()
 //**************************
 //     Number of Verts
 //**************************
-int TerrainHandler::GetNumberVerts()
+long int TerrainHandler::GetNumberVerts()
 {
-    int rtnval=0;
+    long int rtnval=0;
 
     if (GPUDataSet)
     {
-        rtnval = this->meshVerts.back().size() * this->buffers.size();
+        rtnval = (long int)this->meshVerts.back().size() * this->meshVerts.size();
     }
 
     return rtnval;
@@ -391,65 +744,220 @@ int TerrainHandler::GetMeshVertIDatPos(double x, double z,glm::ivec3 &vt)
 //**************************
 //    Export the Terrain
 //**************************
-void TerrainHandler::ExportTerrain(std::string filename)
+/*
+Writes the binary .ter format (see TerrainLoader):
+the heights once, plus the verts of every mesh so
+the file loads without rebuilding them, or their
+adaptive meshes.
+*/
+void TerrainHandler::ExportTerrain(std::string filename,bool adaptive)
 {
+    if (heightField==NULL || meshVerts.empty())
+    {
+        Console::cPrint("No terrain to export!");
+        return;
+    }
+
     std::stringstream ss;
     ss << "../Data/Terrain/" << filename << ".ter";
 
-    std::ofstream savefile;
-    savefile.open(ss.str().c_str());
+    TerrainFileHeader header=FileHeader();
+
+    double ts=glfwGetTime();
+
+    std::vector< std::vector<Vertex> > adaptVerts;
+    std::vector< std::vector<GLuint> > adaptTris;
+    if (adaptive && !BuildAdaptiveMeshes(adaptVerts,adaptTris))
+    {
+        Console::cPrint("Adaptive export needs a square 2^n+1 terrain!");
+        return;
+    }
+
+    bool written = adaptive ? TerrainLoader::Write(ss.str(),header,*heightField,&adaptVerts,&adaptTris)
+                            : TerrainLoader::Write(ss.str(),header,*heightField,&meshVerts);
+    if (written)
+    {
+        Console::cPrint(tools::appendStrings("Exported ",ss.str()," in ",glfwGetTime()-ts,"s"));
+    }
+    else
+    {
+        Console::cPrint(tools::appendStrings("Failed to export ",ss.str()));
+    }
+};
+
+//**************************
+//    Terrain File Header
+//**************************
+TerrainFileHeader TerrainHandler::FileHeader()
+{
+    TerrainFileHeader header;
+    header.Nsub=Nsub;
+    header.Elen=Elen;
+    header.spacing=heightMapping.spacing;
+    header.heightMult=heightMapping.heightMult;
+    header.midpoint=heightMapping.midpoint;
+    header.heightScale=heightScale;
+
+    for (int i=0; i<4; ++i)
+    {
+        header.relativeHeight[i]=relativeHeight[i];
+        strncpy(header.textures[i],TextureFiles[i].c_str(),sizeof(header.textures[i])-1);
+    }
+    strncpy(header.shader,ShaderFiles.c_str(),sizeof(header.shader)-1);
 
-    savefile << "L1Tex=" << TextureFiles[0] << std::endl;
-    savefile << "L2Tex=" << TextureFiles[1] << std::endl;
-    savefile << "L3Tex=" << TextureFiles[2] << std::endl;
-    savefile << "L4Tex=" << TextureFiles[3] << std::endl;
+    for (int i=0; i<3; ++i)
+    {
+        header.Ka[i]=materials.Ka[i];
+        header.Kd[i]=materials.Kd[i];
+        header.Ks[i]=materials.Ks[i];
+    }
+    header.shine=materials.shine;
 
-    savefile << "Shdr=" << ShaderFiles << std::endl;
+    return header;
+};
 
-    savefile << "mKa=" << materials.Ka.x << "," << materials.Ka.y << "," << materials.Ka.z << std::endl;
-    savefile << "mKd=" << materials.Kd.x << "," << materials.Kd.y << "," << materials.Kd.z << std::endl;
-    savefile << "mKs=" << materials.Ks.x << "," << materials.Ks.y << "," << materials.Ks.z << std::endl;
-    savefile << "mSh=" << materials.shine << std::endl;
+//**************************
+//  Adaptive Export Meshes
+//**************************
+/*
+One error hierarchy over the whole terrain, then
+every chunk is meshed on its own in parallel. The
+hierarchy makes the chunk borders match. A chunk
+keeps only the verts its triangles use, taken from
+its full grid so normals and texture coordinates
+carry over.
+*/
+bool TerrainHandler::BuildAdaptiveMeshes(std::vector< std::vector<Vertex> > &verts,std::vector< std::vector<GLuint> > &tris)
+{
+    const int Nmesh=Nsub*Nsub;
+    if ((int)meshVerts.size()!=Nmesh)
+    {
+        return false;
+    }
 
-    savefile << "rHx=" << relativeHeight.x << std::endl;
-    savefile << "rHy=" << relativeHeight.y << std::endl;
-    savefile << "rHz=" << relativeHeight.z << std::endl;
-    savefile << "rHw=" << relativeHeight.w << std::endl;
+    TerrainRTIN rtin;
+    if (!rtin.Build(*heightField))
+    {
+        return false;
+    }
 
-    // Save Indicies
-    int Nmesh=meshVerts.size();
-    int Nvert=meshVerts[0].size();
-    int Nidxs=idxs[0].size();
+    // World units into height field units
+    const float maxError = heightMapping.heightMult>0.0f ? exportError/heightMapping.heightMult : 0.0f;
+    const size_t NN=(size_t)Elen*Elen;
 
-    savefile << "Nmesh=" << Nmesh << std::endl;
-    savefile << "Nidx=" << Nvert << std::endl;
+    verts.assign(Nmesh,std::vector<Vertex>());
+    tris.assign(Nmesh,std::vector<GLuint>());
+    long long int nTris=0;
 
-    savefile << "$BEGIN_IDXS" << std::endl;
-    for (int i=0;i<Nmesh;++i)
+    #pragma omp parallel for schedule(dynamic) reduction(+:nTris)
+    for (int c=0; c<Nmesh; ++c)
     {
-        savefile << "$MESH_" << i << std::endl;
-        for (int j=0;j<Nidxs;)
+        if (meshVerts[c].size()!=NN)
         {
-            savefile << " " << idxs[i][j] << " " <<idxs[i][j+1] << " " << idxs[i][j+2] << std::endl;
-            j+=3;
+            continue;
         }
+
+        std::vector<GLuint> grid;
+        rtin.Extract((Elen-1)*(c/Nsub),(Elen-1)*(c%Nsub),Elen,maxError,grid);
+
+        // Grid verts in order of first use
+        std::vector<GLuint> remap(NN,0xFFFFFFFF);
+        tris[c].resize(grid.size());
+        for (size_t k=0; k<grid.size(); ++k)
+        {
+            GLuint &id=remap[grid[k]];
+            if (id==0xFFFFFFFF)
+            {
+                id=(GLuint)verts[c].size();
+                verts[c].push_back(meshVerts[c][grid[k]]);
+            }
+            tris[c][k]=id;
+        }
+
+        nTris+=grid.size()/3;
+    }
+
+    const double fullTris=2.0*(Elen-1)*(Elen-1)*Nmesh;
+    Console::cPrint(tools::appendStrings("Adaptive mesh: ",nTris," triangles, ",100.0*nTris/fullTris,"% of the full grid"));
+    return true;
+};
+
+//**************************
+//  Load an Exported Terrain
+//**************************
+/*
+Restores the textures, shader, materials, texture
+heights and height scale of a mapped .ter file, and
+copies its mesh verts when the file has them in the
+current mesh layout. Returns true if the verts were
+taken.
+
+Textures or a shader already on the GPU are loaded
+again when the file names others. A reloaded shader
+has to be registered with the camera and lights
+again by the caller.
+*/
+bool TerrainHandler::LoadTerrainFile(const TerrainLoader &file)
+{
+    const TerrainFileHeader &header = file.Header();
+
+    std::string tex[4];
+    for (int i=0; i<4; ++i)
+    {
+        tex[i]=std::string(header.textures[i],strnlen(header.textures[i],sizeof(header.textures[i])));
+    }
+    const std::string shd(header.shader,strnlen(header.shader,sizeof(header.shader)));
+
+    bool texChanged=false;
+    for (int i=0; i<4; ++i)
+    {
+        texChanged = texChanged || tex[i]!=TextureFiles[i];
+    }
+    const bool shdChanged = shd!=ShaderFiles;
+
+    SetTexFiles(tex[0],tex[1],tex[2],tex[3]);
+    SetShaderFile(shd);
+
+    if (texChanged && GPUTexSet)
+    {
+        UnsetTextures();
+        SetTextures();
     }
-    savefile << "$END_IDXS" << std::endl;
+    if (shdChanged && GPUShdrSet)
+    {
+        UnsetShader();
+        SetShader();
+    }
+
+    SetupMaterials(glm::vec3(header.Ka[0],header.Ka[1],header.Ka[2]),
+                   glm::vec3(header.Kd[0],header.Kd[1],header.Kd[2]),
+                   glm::vec3(header.Ks[0],header.Ks[1],header.Ks[2]),header.shine);
 
-    savefile << "Nvert=" << Nvert << std::endl;
+    relativeHeight=glm::vec4(header.relativeHeight[0],header.relativeHeight[1],header.relativeHeight[2],header.relativeHeight[3]);
+    heightScale = header.heightScale>0.0f ? header.heightScale : 1.0f;
 
-    savefile << "$BEGIN_VERTS" << std::endl;
-    for (int i=0;i<Nmesh;++i)
+    if (!file.HasVerts() || header.Nsub!=Nsub || header.Elen!=Elen || file.NumChunks()!=(int)meshVerts.size())
     {
-        savefile << "$MESH_" << i << std::endl;
-        for (int j=0;j<Nvert;++j)
+        return false;
+    }
+
+    const size_t NN = (size_t)Elen*Elen;
+
+    // Every chunk needs its full grid, otherwise the verts are rebuilt
+    for (int c=0; c<file.NumChunks(); ++c)
+    {
+        if (file.ChunkVerts(c)==NULL || file.Chunk(c).vertCount!=NN)
         {
-            savefile << " " << meshVerts[i][j].position.x << " " << meshVerts[i][j].position.y << " " << meshVerts[i][j].position.z << std::endl;
-            savefile << " " << meshVerts[i][j].normal.x << " " << meshVerts[i][j].normal.y << " " << meshVerts[i][j].normal.z << std::endl;
-            savefile << " " << meshVerts[i][j].texture.x << " " << meshVerts[i][j].texture.y << std::endl;
+            return false;
         }
     }
-    savefile << "$END_VERTS" << std::endl;
 
-    savefile.close();
+    #pragma omp parallel for schedule(dynamic)
+    for (int c=0; c<file.NumChunks(); ++c)
+    {
+        const Vertex *src = file.ChunkVerts(c);
+        meshVerts[c].assign(src,src+NN);
+    }
+
+    return true;
 };
@@ -10,6 +10,14 @@
 #include "../../Tools/ogltools.hpp"
 #include "../../Tools/glmtools.hpp"
 #include "../../Tools/micro_timer.h"
+#include "../../Tools/rtscamera.h"
+#include "../../Tools/heightfield.hpp"
+#include "terrainlod.h"
+#include "terrainculler.h"
+#include "terrainrtin.h"
+#include "../../Loaders/terrainloader.h"
+
+class TerrainTileStreamer;
 
 class TerrainHandler
 {
@@ -19,10 +27,50 @@ class TerrainHandler
 
     /* These vectors hold the mesh data for the terrain */
     std::vector< std::vector<Vertex> > meshVerts;
-    std::vector< std::vector<GLuint> > idxs;
 
-    /*  A vector of render data buffers  */
-    std::vector< ogltools::BufferHandler > buffers;
+    /* Triangle list indices, every mesh has the same layout so one list is shared by all */
+    std::vector<GLuint> idxs;
+
+    /* Render data buffer, all meshes back to back in one VBO */
+    ogltools::BufferHandler buffer;
+
+    /* Shared index buffer bound by every mesh VAO */
+    ogltools::IndexBufferHandler idxBuffer;
+    bool stripIdxs; // Draw with triangle strips and primitive restart
+
+    /* Level of detail selection, its index lists replace the above when enabled */
+    TerrainLOD lod;
+    bool lodEnabled;
+    bool lodActive; // The index buffer on the GPU holds the LOD lists
+    long int drawnTris; // Triangles drawn last frame
+
+    /* Frustum culling, drawOrder holds the meshes to draw this frame */
+    TerrainCuller culler;
+    std::vector<int> drawOrder;
+
+    /* Height map rendering, verts are rebuilt in the shader from an R16 texture */
+    const HeightField16 *heightField;
+    struct HeightMapping
+    {
+        float spacing;
+        float heightMult;
+        float midpoint;
+        bool sobel;
+    } heightMapping;
+    bool heightMapEnabled;
+    bool heightMapActive; // The GPU holds the height texture instead of verts
+    GLuint heightTex;
+
+    /* Vertical error bound of adaptive exports, in world units */
+    float exportError;
+
+    /* Height samples per editor height unit, kept in .ter files */
+    float heightScale;
+
+    /* Multi draw arguments, reused between frames */
+    std::vector<GLsizei> drawCounts;
+    std::vector<const GLvoid*> drawOffsets;
+    std::vector<GLint> drawBase;
 
     /* Variables for determining if data is set on the GPU */
     bool GPUDataSet;
@@ -38,6 +86,24 @@ class TerrainHandler
     /* Shader Handler */
     Shader shader;
 
+    /* Uniform locations, resolved when the shader is set */
+    struct Uniforms
+    {
+        GLint modelMat;
+        GLint ambient;
+        GLint diffuse;
+        GLint specular;
+        GLint shininess;
+        GLint relativeHeight;
+        GLint hmEnabled;
+        GLint hmSobel;
+        GLint hmEdge;
+        GLint hmSubdiv;
+        GLint hmSpacing;
+        GLint hmHeightMult;
+        GLint hmMidpoint;
+    } uniforms;
+
     /* Materials Data Storage */
     Material materials;
 
@@ -55,7 +121,13 @@ class TerrainHandler
     Internal Class Functionality
     ---------------------------*/
     //Main Draw
-    void Draw();
+    void Draw(bool useLOD);
+    // Bind the shader, textures and uniforms shared by every draw
+    void UseDrawState(bool heightMap);
+    // Create the height texture from heightField
+    bool SetupHeightMap();
+    // Adaptive meshes of all chunks for ExportTerrain
+    bool BuildAdaptiveMeshes(std::vector< std::vector<Vertex> > &verts,std::vector< std::vector<GLuint> > &tris);
 
     //**********
     //   Timer
@@ -73,8 +145,8 @@ public:
     ---------------------------*/
         // Index Access Provider
     std::vector< std::vector<Vertex> >& AccessMeshVerts() {return meshVerts;}
-    // Index Access Provider
-    std::vector< std::vector<GLuint> >& AccessIdxs() {return idxs;}
+    // Index Access Provider (shared by all meshes)
+    std::vector<GLuint>& AccessIdxs() {return idxs;}
     // Positions Access Provider
     std::vector< glm::vec2 >& AccessPositions() {return positions;}
     // Shader Access Provider
@@ -105,27 +177,73 @@ public:
     void SetupMaterials(glm::vec3 Ka,glm::vec3 Kd,glm::vec3 Ks,float shininess);
     // Set the mesh subdivision information
     void SetupMeshSubInfo(int Nsub,int Elen,float Vdist);
+    // Number of meshes along one edge of the terrain
+    int GetMeshSubDiv() {return Nsub;};
+    // Number of verts along one edge of a mesh
+    int GetMeshEdge() {return Elen;};
+    // Use triangle strips with primitive restart (takes effect on the next SetTerrainOnGPU)
+    void SetIndexStrips(bool strips) {stripIdxs=strips;};
+    // Use distance based level of detail (takes effect on the next SetTerrainOnGPU)
+    void SetLODEnabled(bool enabled) {lodEnabled=enabled;};
+    bool GetLODEnabled() {return lodEnabled;};
+    // LOD bias, each +1 allows twice the screen space error
+    void SetLODBias(float bias) {lod.SetBias(bias);};
+    float GetLODBias() {return lod.GetBias();};
+    // Draw from a height texture instead of vertex buffers (takes effect on the next SetTerrainOnGPU)
+    void SetHeightMapEnabled(bool enabled) {heightMapEnabled=enabled;};
+    bool GetHeightMapEnabled() {return heightMapEnabled;};
+    /*
+    Height data and its mapping to world space, see
+    TerrainGeneration::UpdateVerticies. The field must
+    outlive the terrain on the GPU.
+    */
+    void SetHeightMap(const HeightField16 *field,float spacing,float heightMult,float midpoint,bool sobel);
+    // Triangles drawn in the last frame
+    long int GetDrawnTriangles() {return drawnTris;};
+    // Meshes drawn and culled in the last frame
+    int GetVisibleMeshes() {return culler.GetVisible();};
+    int GetCulledMeshes() {return culler.GetCulled();};
 
     /*---------------------------
           Class Functionality
     ---------------------------*/
     // Export the terrain
     /*
-    The exported file is used by the game
-    engine and cannot be reloaded into the
-    editor. If you want to re-edit terrian
-    later use the save function from
-    the TerrainGeneration class.
+    Writes ../Data/Terrain/filename.ter in the
+    binary format of TerrainLoader. The file is
+    used by the game engine and can be loaded
+    back into the editor with
+    TerrainGeneration::LoadTerrain.
+
+    adaptive writes every chunk as an adaptive mesh
+    (TerrainRTIN) within the export error instead
+    of its full grid.
     */
-    void ExportTerrain(std::string filename);
-    // Draw call with load check
+    void ExportTerrain(std::string filename,bool adaptive=false);
+    // Vertical error bound of adaptive exports, in world units
+    void SetExportError(float error) {exportError=std::max(error,0.0f);};
+    float GetExportError() {return exportError;};
+    // Height samples per editor height unit (see TerrainGeneration::ImportHeightmap)
+    void SetHeightScale(float scale) {heightScale=scale;};
+    float GetHeightScale() {return heightScale;};
+    // .ter header of the mesh layout, look and height mapping (filled in by the writers)
+    TerrainFileHeader FileHeader();
+    // Restore the look and mesh verts of a mapped .ter file
+    bool LoadTerrainFile(const TerrainLoader &file);
+    // Draw call with load check, at full detail
     void DrawCall();
+    // Draw call with the level of detail chosen for the camera
+    void DrawCall(RTSCamera &camera);
+    // Draw the tiles of a streamed world with this terrain's shader and materials
+    void DrawCall(TerrainTileStreamer &streamer,RTSCamera &camera);
+    // Strip indices of an N x N vert mesh, strips separated by 0xFFFFFFFF
+    static void BuildStripIndices(int N,std::vector<GLuint> &strip);
     // Cleanup the class
     void Cleanup();
     // Get Memory Use
     long int GetGPUMemoryReqs();
     // Return the number of verts in all meshes
-    int GetNumberVerts();
+    long int GetNumberVerts();
     // Return mesh of x,z coordinates
     int GetMeshVertIDatPos(double x, double z,glm::ivec3 &vt);
 
@@ -136,6 +254,10 @@ public:
     void SetTerrainOnGPU();
     // Sets up the meshes on the GPU
     void setupMeshes();
+    // Push verts [first,first+count) of a mesh into its existing buffer
+    void UpdateMeshOnGPU(int mesh,int first,int count);
+    // Push a rect of changed heights into the height texture
+    void UpdateHeightMapOnGPU(const HeightRect &r);
     // Fully load landscape textures to the CPU and GPU
     void SetTextures();
     // Unset the Textures on the GPU
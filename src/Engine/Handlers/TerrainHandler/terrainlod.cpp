@@ -0,0 +1,388 @@
+#include "terrainlod.h"
+#include <omp.h>
+#include <math.h>
+
+//******************************************//
+//              Setup the Levels            //
+//******************************************//
+/*
+Levels go from full detail (L=0) down to the level
+with two cells per mesh edge. The mesh edge (N-1)
+is a power of two for any terrain the generator can
+build.
+*/
+void TerrainLOD::Setup(int N,int Nsub)
+{
+    this->Nsub=Nsub;
+
+    // The index lists only depend on the mesh edge
+    if (N!=this->N)
+    {
+        this->N=N;
+
+        idxs.clear();
+        ranges.clear();
+        Nlevels=0;
+
+        int c = N-1;
+        while (c>=2 && (c%(1<<Nlevels))==0 && (c>>Nlevels)>=2)
+        {
+            ++Nlevels;
+        }
+
+        ranges.resize(Nlevels);
+        for (int L=0; L<Nlevels; ++L)
+        {
+            BuildLevel(L);
+        }
+    }
+
+    int Nmesh = Nsub*Nsub;
+    error.assign(Nmesh,std::vector<float>(Nlevels,0.0f));
+    bmin.assign(Nmesh,glm::vec3(0.0f));
+    bmax.assign(Nmesh,glm::vec3(0.0f));
+    dirty.assign(Nmesh,true);
+    level.assign(Nmesh,0);
+};
+
+//******************************************//
+//            Add a Triangle                //
+//******************************************//
+/*
+Appends a triangle, flipped if needed so it winds the
+same way as the full terrain mesh does.
+*/
+void TerrainLOD::AddTriangle(GLuint a,GLuint b,GLuint c)
+{
+    float ai=a/N, aj=a%N;
+    float bi=b/N, bj=b%N;
+    float ci=c/N, cj=c%N;
+
+    // Triangle (i,j) (i+1,j) (i,j+1) has a negative cross in (j,i)
+    float cross = (bj-aj)*(ci-ai)-(bi-ai)*(cj-aj);
+    if (cross>0.0f)
+    {
+        std::swap(b,c);
+    }
+
+    idxs.push_back(a);
+    idxs.push_back(b);
+    idxs.push_back(c);
+};
+
+//******************************************//
+//            Build a Single Level          //
+//******************************************//
+void TerrainLOD::BuildLevel(int L)
+{
+    const int s = 1<<L;
+    const int c = (N-1)/s; // Cells per edge
+
+    std::vector<LODRange> &R = ranges[L];
+    R.resize(9);
+
+    // Interior, every cell not touching the mesh edge
+    R[0].first = idxs.size();
+    for (int I=1; I<c-1; ++I)
+    {
+        for (int J=1; J<c-1; ++J)
+        {
+            GLuint idx1 = J*s+(I*s)*N;
+            GLuint idx2 = idx1+s;
+            GLuint idx3 = J*s+(I*s+s)*N;
+            GLuint idx4 = idx3+s;
+
+            AddTriangle(idx1,idx3,idx2);
+            AddTriangle(idx2,idx3,idx4);
+        }
+    }
+    R[0].count = (GLsizei)(idxs.size()-R[0].first);
+
+    // Border bands
+    for (int side=0; side<4; ++side)
+    {
+        R[1+2*side].first = idxs.size();
+        AddBand(L,side,s);
+        R[1+2*side].count = (GLsizei)(idxs.size()-R[1+2*side].first);
+
+        if (L+1<Nlevels)
+        {
+            R[2+2*side].first = idxs.size();
+            AddBand(L,side,2*s);
+            R[2+2*side].count = (GLsizei)(idxs.size()-R[2+2*side].first);
+        }
+        else
+        {
+            // Nothing coarser can border this level
+            R[2+2*side] = R[1+2*side];
+        }
+    }
+};
+
+//******************************************//
+//           Build a Border Band            //
+//******************************************//
+/*
+The band between the mesh edge and the first inner
+row of verts, a trapezoid. The outer row steps by
+edgeStep (s, or 2s to match a coarser neighbour),
+the inner row by s and is shortened by s at each
+end. The two rows are zipped into triangles by
+always advancing the row whose next segment starts
+first.
+*/
+void TerrainLOD::AddBand(int L,int side,int edgeStep)
+{
+    const int s = 1<<L;
+
+    // Vert index at distance p along the edge and depth d into the mesh
+    struct Map
+    {
+        int N, side;
+        GLuint operator()(int p,int d) const
+        {
+            switch (side)
+            {
+                case SIDE_TOP: return p+d*N;
+                case SIDE_BOTTOM: return p+(N-1-d)*N;
+                case SIDE_LEFT: return d+p*N;
+                default: return (N-1-d)+p*N;
+            }
+        };
+    } map = {N,side};
+
+    std::vector<int> outer;
+    for (int p=0; p<=N-1; p+=edgeStep)
+    {
+        outer.push_back(p);
+    }
+
+    std::vector<int> inner;
+    for (int p=s; p<=N-1-s; p+=s)
+    {
+        inner.push_back(p);
+    }
+
+    int a=0;
+    int b=0;
+    const int lastO = (int)outer.size()-1;
+    const int lastI = (int)inner.size()-1;
+
+    while (a<lastO || b<lastI)
+    {
+        bool advanceOuter;
+        if (a==lastO)
+        {
+            advanceOuter=false;
+        }
+        else if (b==lastI)
+        {
+            advanceOuter=true;
+        }
+        else
+        {
+            advanceOuter = (outer[a]+outer[a+1]) <= (inner[b]+inner[b+1]);
+        }
+
+        if (advanceOuter)
+        {
+            AddTriangle(map(outer[a],0),map(outer[a+1],0),map(inner[b],s));
+            ++a;
+        }
+        else
+        {
+            AddTriangle(map(outer[a],0),map(inner[b+1],s),map(inner[b],s));
+            ++b;
+        }
+    }
+};
+
+//******************************************//
+//          Compute Height Errors           //
+//******************************************//
+/*
+The error of level L is the error of level L-1 plus
+the largest height difference between the verts of
+level L-1 and the surface of level L. This bounds the
+error against full detail without visiting every
+vert for every level.
+*/
+void TerrainLOD::ComputeErrors(int mesh,const std::vector<Vertex> &verts)
+{
+    if (Nlevels==0 || (int)verts.size()<N*N)
+    {
+        return;
+    }
+
+    glm::vec3 lo(verts[0].position);
+    glm::vec3 hi(verts[0].position);
+    for (size_t k=1; k<verts.size(); ++k)
+    {
+        lo = glm::min(lo,verts[k].position);
+        hi = glm::max(hi,verts[k].position);
+    }
+    bmin[mesh]=lo;
+    bmax[mesh]=hi;
+
+    std::vector<float> &E = error[mesh];
+    E[0] = 0.0f;
+
+    for (int L=1; L<Nlevels; ++L)
+    {
+        const int s = 1<<L;
+        const int h = s/2;
+        const int c = (N-1)/s;
+        float maxdev = 0.0f;
+
+        for (int i=0; i<N; i+=h)
+        {
+            int I = std::min(i/s,c-1);
+            float v = (i-I*s)/(float)s;
+
+            for (int j=(i%s==0 ? h : 0); j<N; j+=((i%s==0) ? s : h))
+            {
+                int J = std::min(j/s,c-1);
+                float u = (j-J*s)/(float)s;
+
+                float h00 = verts[J*s+(I*s)*N].position.y;
+                float h01 = verts[J*s+s+(I*s)*N].position.y;
+                float h10 = verts[J*s+(I*s+s)*N].position.y;
+                float h11 = verts[J*s+s+(I*s+s)*N].position.y;
+
+                // Same diagonal as the mesh triangles
+                float y;
+                if (u+v<=1.0f)
+                {
+                    y = h00+u*(h01-h00)+v*(h10-h00);
+                }
+                else
+                {
+                    y = h11+(1.0f-u)*(h10-h11)+(1.0f-v)*(h01-h11);
+                }
+
+                maxdev = std::max(maxdev,(float)fabs(verts[j+i*N].position.y-y));
+            }
+        }
+
+        E[L] = E[L-1]+maxdev;
+    }
+
+    dirty[mesh]=false;
+};
+
+void TerrainLOD::ComputeErrors(const std::vector< std::vector<Vertex> > &meshVerts)
+{
+    #pragma omp parallel for schedule(dynamic)
+    for (int m=0; m<(int)meshVerts.size(); ++m)
+    {
+        if (m<(int)error.size())
+        {
+            ComputeErrors(m,meshVerts[m]);
+        }
+    }
+};
+
+//******************************************//
+//            Select Mesh Levels            //
+//******************************************//
+void TerrainLOD::Select(const std::vector< std::vector<Vertex> > &meshVerts,glm::vec3 eye,float pixelScale)
+{
+    if (Nlevels==0)
+    {
+        return;
+    }
+
+    const int Nmesh = (int)level.size();
+    const float tol = pixelError*pow(2.0f,bias);
+
+    for (int m=0; m<Nmesh; ++m)
+    {
+        if (dirty[m] && m<(int)meshVerts.size())
+        {
+            ComputeErrors(m,meshVerts[m]);
+        }
+
+        // Distance from the eye to the mesh bounds
+        glm::vec3 d = glm::max(glm::max(bmin[m]-eye,eye-bmax[m]),glm::vec3(0.0f));
+        float dist = std::max(glm::length(d),1.0e-3f);
+
+        int L=0;
+        while (L+1<Nlevels && error[m][L+1]*pixelScale/dist<=tol)
+        {
+            ++L;
+        }
+        level[m]=L;
+    }
+
+    // Neighbours may differ by at most one level
+    bool changed=true;
+    while (changed)
+    {
+        changed=false;
+        for (int m=0; m<Nsub; ++m)
+        {
+            for (int n=0; n<Nsub; ++n)
+            {
+                int &L = level[n+m*Nsub];
+                int lmin = L;
+                if (m>0) lmin = std::min(lmin,level[n+(m-1)*Nsub]+1);
+                if (m<Nsub-1) lmin = std::min(lmin,level[n+(m+1)*Nsub]+1);
+                if (n>0) lmin = std::min(lmin,level[(n-1)+m*Nsub]+1);
+                if (n<Nsub-1) lmin = std::min(lmin,level[(n+1)+m*Nsub]+1);
+
+                if (lmin<L)
+                {
+                    L=lmin;
+                    changed=true;
+                }
+            }
+        }
+    }
+};
+
+//******************************************//
+//             Get Draw Ranges              //
+//******************************************//
+int TerrainLOD::GetRanges(int mesh,LODRange *out) const
+{
+    const int L = level[mesh];
+    const int m = mesh/Nsub;
+    const int n = mesh%Nsub;
+
+    const int nb[4] = {
+        m>0 ? mesh-Nsub : -1,
+        m<Nsub-1 ? mesh+Nsub : -1,
+        n>0 ? mesh-1 : -1,
+        n<Nsub-1 ? mesh+1 : -1
+    };
+
+    int count=0;
+    if (ranges[L][0].count>0)
+    {
+        out[count++] = ranges[L][0];
+    }
+
+    for (int side=0; side<4; ++side)
+    {
+        bool stitch = nb[side]>=0 && level[nb[side]]>L;
+        out[count++] = ranges[L][stitch ? 2+2*side : 1+2*side];
+    }
+
+    return count;
+};
+
+int TerrainLOD::GetFullRanges(LODRange *out) const
+{
+    int count=0;
+    if (ranges[0][0].count>0)
+    {
+        out[count++] = ranges[0][0];
+    }
+
+    for (int side=0; side<4; ++side)
+    {
+        out[count++] = ranges[0][1+2*side];
+    }
+
+    return count;
+};
@@ -0,0 +1,112 @@
+#ifndef TERRAINLOD_C
+#define TERRAINLOD_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../../Headers/headersogl.h"
+#include "../ModelHandler/base_classes.h"
+
+//******************************************//
+//          Terrain LOD Range Struct        //
+//******************************************//
+/*
+    A run of indices in the shared LOD index list
+*/
+struct LODRange
+{
+    size_t first; // First index
+    GLsizei count; // Number of indices
+
+    LODRange() : first(0), count(0) {};
+};
+
+//******************************************//
+//           Terrain LOD Class              //
+//******************************************//
+/*
+    Geomipmapping for the terrain meshes. Every
+    mesh has the same N x N vert layout, so the
+    index lists of all detail levels are built
+    once and shared:
+
+    Level L skips every 2^L verts. Each level is
+    split into an interior block and four border
+    bands (top, bottom, left, right). Every band
+    exists twice, once matching its own level and
+    once stitched to a neighbour one level coarser,
+    so adjacent meshes never leave cracks.
+
+    The level of each mesh is the coarsest one
+    whose height error, projected to the screen,
+    stays below the pixel tolerance. The LOD bias
+    scales that tolerance by pow(2,bias), so +1
+    allows twice the error. Neighbouring meshes
+    are then limited to differ by one level.
+*/
+class TerrainLOD
+{
+    int N; // Verts per mesh edge
+    int Nsub; // Meshes per terrain edge
+    int Nlevels;
+
+    // Shared index list of all levels
+    std::vector<GLuint> idxs;
+
+    // Per level: 0 interior, 1+2*side normal band, 2+2*side stitched band
+    std::vector< std::vector<LODRange> > ranges;
+
+    // Per mesh data
+    std::vector< std::vector<float> > error; // Height error of each level
+    std::vector<glm::vec3> bmin; // Bounding boxes
+    std::vector<glm::vec3> bmax;
+    std::vector<char> dirty; // Needs its errors recomputed
+    std::vector<int> level; // Selected level
+
+    float pixelError; // Tolerance in pixels
+    float bias;
+
+    void BuildLevel(int L);
+    void AddBand(int L,int side,int edgeStep);
+    void AddTriangle(GLuint a,GLuint b,GLuint c);
+
+public:
+    TerrainLOD() : N(0), Nsub(0), Nlevels(0), pixelError(2.0f), bias(0.0f) {};
+
+    enum Sides
+    {
+        SIDE_TOP=0, // Row 0, meshes m-1
+        SIDE_BOTTOM=1, // Row N-1, meshes m+1
+        SIDE_LEFT=2, // Column 0, meshes n-1
+        SIDE_RIGHT=3 // Column N-1, meshes n+1
+    };
+
+    // Build the shared index lists for meshes with N verts per edge
+    void Setup(int N,int Nsub);
+
+    // Recompute the height error and bounds of one or all meshes
+    void ComputeErrors(int mesh,const std::vector<Vertex> &verts);
+    void ComputeErrors(const std::vector< std::vector<Vertex> > &meshVerts);
+
+    // Mark a mesh whose verts changed
+    void SetDirty(int mesh) {if (mesh>=0 && mesh<(int)dirty.size()) dirty[mesh]=true;};
+
+    // Choose the level of every mesh. pixelScale converts a world
+    // size at unit distance into pixels (viewport height/(2*tan(fovy/2)))
+    void Select(const std::vector< std::vector<Vertex> > &meshVerts,glm::vec3 eye,float pixelScale);
+
+    // The (up to 5) index runs that draw a mesh at its selected level
+    int GetRanges(int mesh,LODRange *out) const;
+
+    // Draw ranges of a mesh at full detail
+    int GetFullRanges(LODRange *out) const;
+
+    std::vector<GLuint>& AccessIdxs() {return idxs;};
+    bool Empty() const {return Nlevels==0;};
+    int GetNumLevels() const {return Nlevels;};
+    int GetLevel(int mesh) const {return level[mesh];};
+
+    void SetBias(float bias) {this->bias=bias;};
+    float GetBias() const {return bias;};
+    void SetPixelError(float pixelError) {this->pixelError=pixelError;};
+};
+
+#endif
@@ -0,0 +1,244 @@
+#include "terrainrtin.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+//******************************************//
+//           Hierarchy Helpers              //
+//******************************************//
+void TerrainRTIN::Diagonal(int ci,int cj,int s,int &di,int &dj) const
+{
+    // The two top triangles split along the main diagonal
+    if (2*s>=N-1)
+    {
+        di=1;
+        dj=1;
+        return;
+    }
+
+    // Toward the center of the 4s square around it
+    const int pi=(ci/(4*s))*4*s+2*s;
+    const int pj=(cj/(4*s))*4*s+2*s;
+    di = pi>ci ? 1 : -1;
+    dj = pj>cj ? 1 : -1;
+};
+
+/*
+Twice the largest height error of the triangle's
+plane over the verts it covers, rounded up. Edges
+are axis aligned or diagonal, so every row span
+ends on a vert.
+*/
+static int TriangleError2(const HeightField16 &heights,int ai,int aj,int bi,int bj,int ci,int cj)
+{
+    const float ha=heights(ai,aj);
+    const float hb=heights(bi,bj);
+    const float hc=heights(ci,cj);
+
+    const float det=(float)((bi-ai)*(cj-aj)-(ci-ai)*(bj-aj));
+    const float gi=((hb-ha)*(cj-aj)-(hc-ha)*(bj-aj))/det;
+    const float gj=((bi-ai)*(hc-ha)-(ci-ai)*(hb-ha))/det;
+
+    const int pi[3] = {ai,bi,ci};
+    const int pj[3] = {aj,bj,cj};
+
+    float worst=0.0f;
+    for (int i=std::min(ai,std::min(bi,ci)); i<=std::max(ai,std::max(bi,ci)); ++i)
+    {
+        // Columns where the edges cross this row
+        int j0=std::numeric_limits<int>::max();
+        int j1=std::numeric_limits<int>::min();
+        for (int e=0; e<3; ++e)
+        {
+            const int p=e;
+            const int q=(e+1)%3;
+            if (i<std::min(pi[p],pi[q]) || i>std::max(pi[p],pi[q]))
+            {
+                continue;
+            }
+
+            if (pi[p]==pi[q])
+            {
+                j0=std::min(j0,std::min(pj[p],pj[q]));
+                j1=std::max(j1,std::max(pj[p],pj[q]));
+            }
+            else
+            {
+                const int j=pj[p]+(pj[q]-pj[p])*(i-pi[p])/(pi[q]-pi[p]);
+                j0=std::min(j0,j);
+                j1=std::max(j1,j);
+            }
+        }
+
+        const uint16_t *row=heights.Row(i);
+        const float base=ha+gi*(i-ai);
+        for (int j=j0; j<=j1; ++j)
+        {
+            worst=std::max(worst,fabsf(base+gj*(j-aj)-row[j]));
+        }
+    }
+
+    return std::min((int)ceilf(2.0f*worst),65535);
+};
+
+//******************************************//
+//            Build the Errors              //
+//******************************************//
+/*
+The error of a vert is the exact error of the (one
+or two) triangles it splits, not just its own
+distance from the hypotenuse, so a triangle that
+is kept is within the bound over all the verts it
+covers. Each level costs two passes over the field.
+
+Levels go from the finest (s=1) up. On each level
+the edge midpoints only read the centers of level
+s/2 and the centers only the edge midpoints of
+level s, so every vert of a pass is independent.
+*/
+bool TerrainRTIN::Build(const HeightField16 &heights)
+{
+    const int n=heights.Width();
+    if (n!=heights.Height() || n<3 || ((n-1)&(n-2))!=0)
+    {
+        Clear();
+        return false;
+    }
+
+    N=n;
+    errors.assign((size_t)N*N,0);
+
+    for (int s=1; s<N-1; s*=2)
+    {
+        const int h=s/2;
+
+        //*************************
+        //      Edge Midpoints
+        //*************************
+        #pragma omp parallel for schedule(dynamic)
+        for (int i=0; i<N; i+=s)
+        {
+            // Rows on the 2s grid hold edges along j, the others edges along i
+            const bool alongJ = (i%(2*s))==0;
+
+            for (int j = alongJ ? s : 0; j<N; j+=2*s)
+            {
+                // Triangles with the edge as hypotenuse and the right angle s away on either side
+                int e=0;
+                for (int side=-1; side<=1; side+=2)
+                {
+                    if (alongJ && i+side*s>=0 && i+side*s<N)
+                    {
+                        e=std::max(e,TriangleError2(heights,i,j-s,i,j+s,i+side*s,j));
+                    }
+                    if (!alongJ && j+side*s>=0 && j+side*s<N)
+                    {
+                        e=std::max(e,TriangleError2(heights,i-s,j,i+s,j,i,j+side*s));
+                    }
+                }
+
+                // The s/2 centers around it
+                if (h>0)
+                {
+                    for (int a=-1; a<=1; a+=2)
+                    {
+                        for (int b=-1; b<=1; b+=2)
+                        {
+                            const int ci=i+a*h;
+                            const int cj=j+b*h;
+                            if (ci>=0 && ci<N && cj>=0 && cj<N)
+                            {
+                                e=std::max(e,(int)errors[(size_t)ci*N+cj]);
+                            }
+                        }
+                    }
+                }
+
+                errors[(size_t)i*N+j]=(uint16_t)e;
+            }
+        }
+
+        //*************************
+        //      Square Centers
+        //*************************
+        #pragma omp parallel for schedule(dynamic)
+        for (int i=s; i<N; i+=2*s)
+        {
+            for (int j=s; j<N; j+=2*s)
+            {
+                int di,dj;
+                Diagonal(i,j,s,di,dj);
+
+                // The two halves of the square
+                const int ai=i-di*s, aj=j-dj*s;
+                const int bi=i+di*s, bj=j+dj*s;
+                int e=std::max(TriangleError2(heights,ai,aj,bi,bj,ai,bj),
+                               TriangleError2(heights,ai,aj,bi,bj,bi,aj));
+
+                // Its 4 edge midpoints
+                e=std::max(e,(int)errors[(size_t)(i-s)*N+j]);
+                e=std::max(e,(int)errors[(size_t)(i+s)*N+j]);
+                e=std::max(e,(int)errors[(size_t)i*N+j-s]);
+                e=std::max(e,(int)errors[(size_t)i*N+j+s]);
+
+                errors[(size_t)i*N+j]=(uint16_t)e;
+            }
+        }
+    }
+
+    return true;
+};
+
+//******************************************//
+//            Extract a Chunk               //
+//******************************************//
+void TerrainRTIN::Refine(int ai,int aj,int bi,int bj,int ci,int cj,float limit,int i0,int j0,int stride,std::vector<GLuint> &tris) const
+{
+    // A hypotenuse one cell diagonal long has no midpoint vert
+    if (((ai+bi)&1)==0 && ((aj+bj)&1)==0)
+    {
+        const int mi=(ai+bi)/2;
+        const int mj=(aj+bj)/2;
+
+        if (errors[(size_t)mi*N+mj]>limit)
+        {
+            Refine(ai,aj,ci,cj,mi,mj,limit,i0,j0,stride,tris);
+            Refine(ci,cj,bi,bj,mi,mj,limit,i0,j0,stride,tris);
+            return;
+        }
+    }
+
+    // Same winding as the full terrain meshes (x=j, z=i)
+    if ((bj-aj)*(ci-ai)-(bi-ai)*(cj-aj)>0)
+    {
+        std::swap(bi,ci);
+        std::swap(bj,cj);
+    }
+
+    tris.push_back((GLuint)((ai-i0)*stride+(aj-j0)));
+    tris.push_back((GLuint)((bi-i0)*stride+(bj-j0)));
+    tris.push_back((GLuint)((ci-i0)*stride+(cj-j0)));
+};
+
+void TerrainRTIN::Extract(int i0,int j0,int edge,float maxError,std::vector<GLuint> &tris) const
+{
+    tris.clear();
+
+    const int s=(edge-1)/2;
+    if (N==0 || s<1 || ((edge-1)&(edge-2))!=0 || i0<0 || j0<0 || i0+edge>N || j0+edge>N)
+    {
+        return;
+    }
+
+    // Errors are stored doubled
+    const float limit=2.0f*std::max(maxError,0.0f);
+
+    const int ci=i0+s;
+    const int cj=j0+s;
+    int di,dj;
+    Diagonal(ci,cj,s,di,dj);
+
+    // The chunk's two triangles meet on its diagonal
+    Refine(ci-di*s,cj-dj*s,ci+di*s,cj+dj*s,ci-di*s,cj+dj*s,limit,i0,j0,edge,tris);
+    Refine(ci+di*s,cj+dj*s,ci-di*s,cj-dj*s,ci+di*s,cj-dj*s,limit,i0,j0,edge,tris);
+};
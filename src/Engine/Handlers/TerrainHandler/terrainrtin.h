@@ -0,0 +1,78 @@
+#ifndef TERRAINRTIN_C
+#define TERRAINRTIN_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../../Headers/headersogl.h"
+#include "../../Tools/heightfield.hpp"
+
+//******************************************//
+//           Terrain RTIN Class             //
+//******************************************//
+/*
+    Right triangulated irregular network of a
+    (2^k+1) x (2^k+1) height field, for meshes that
+    keep the height error below a bound with as few
+    triangles as possible.
+
+    The field is split into two right triangles
+    along its diagonal, and every triangle splits
+    at the midpoint of its hypotenuse into two
+    more, down to the grid cells. Every vert is the
+    hypotenuse midpoint of one or two triangles:
+
+        square centers  of a 2s square, on its
+                        diagonal. The diagonal lies
+                        on the diagonal of the 4s
+                        square around it that runs
+                        through that square's center
+        edge midpoints  of a 2s long grid edge
+
+    Build() stores for every vert the height error
+    of the triangles it splits, raised to the
+    errors of all verts below it in the hierarchy
+    (the 4 edge midpoints of a center, the 4 s/2
+    centers around an edge midpoint). A triangle is
+    split when the error of its midpoint is above
+    the bound, and the two triangles sharing a
+    hypotenuse share the midpoint, so the mesh has
+    no T-junctions anywhere.
+
+    Chunks of 2^m+1 verts line up with the
+    hierarchy, each is two of its triangles, so
+    Extract() meshes chunks on their own (and in
+    parallel) while their borders still match.
+*/
+class TerrainRTIN
+{
+    int N; // Verts per field edge
+
+    // Twice the height error of every vert (saturated), propagated up the hierarchy
+    std::vector<uint16_t> errors;
+
+    // Diagonal direction of the 2s square centered at (ci,cj)
+    void Diagonal(int ci,int cj,int s,int &di,int &dj) const;
+
+    // Triangle with hypotenuse a-b and right angle at c, split or emitted
+    void Refine(int ai,int aj,int bi,int bj,int ci,int cj,float limit,int i0,int j0,int stride,std::vector<GLuint> &tris) const;
+
+public:
+    TerrainRTIN() : N(0) {};
+
+    // Compute the vert errors, false if the field is not (2^k+1) square
+    bool Build(const HeightField16 &heights);
+
+    /*
+    Triangles of the chunk with corner vert (i0,j0)
+    and edge verts along each side, as a triangle
+    list of chunk verts (i-i0)*edge+(j-j0). The
+    height error stays at or below maxError (in
+    height field units). Triangles wind like the
+    full terrain meshes.
+    */
+    void Extract(int i0,int j0,int edge,float maxError,std::vector<GLuint> &tris) const;
+
+    void Clear() {N=0; errors.clear();};
+    bool Empty() const {return N==0;};
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "terraintilestore.h"
+#include <algorithm>
+
+//******************************************//
+//              Tile Slot Layout            //
+//******************************************//
+size_t TerrainTileStore::TileBytes() const
+{
+    size_t E = (size_t)TileEdge();
+    return E*E*sizeof(uint16_t);
+};
+
+std::streamoff TerrainTileStore::TileOffset(int tx,int ty) const
+{
+    return (std::streamoff)TILESTORE_DATA_OFFSET
+         + ((std::streamoff)ty*header.tilesX+tx)*(std::streamoff)TileBytes();
+};
+
+//******************************************//
+//             Create a New Store           //
+//******************************************//
+bool TerrainTileStore::Create(const std::string &filename,const TileStoreHeader &header)
+{
+    Close();
+
+    if (header.tileSize<1 || header.apron<0 || header.tilesX<1 || header.tilesY<1)
+    {
+        return false;
+    }
+
+    file.open(filename.c_str(),std::ios::in|std::ios::out|std::ios::binary|std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    this->filename=filename;
+    this->header=header;
+    this->header.magic=TILESTORE_MAGIC;
+    this->header.version=TILESTORE_VERSION;
+
+    return Flush();
+};
+
+//******************************************//
+//          Open an Existing Store          //
+//******************************************//
+bool TerrainTileStore::Open(const std::string &filename)
+{
+    Close();
+
+    file.open(filename.c_str(),std::ios::in|std::ios::out|std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    TileStoreHeader h;
+    file.read((char*)&h,sizeof(TileStoreHeader));
+    if (!file || h.magic!=TILESTORE_MAGIC || h.version!=TILESTORE_VERSION
+        || h.tileSize<1 || h.apron<0 || h.tilesX<1 || h.tilesY<1)
+    {
+        Close();
+        return false;
+    }
+
+    this->filename=filename;
+    this->header=h;
+    return true;
+};
+
+//******************************************//
+//             Write the Header             //
+//******************************************//
+/*
+The header is padded out to TILESTORE_DATA_OFFSET
+so the tiles start on a page boundary.
+*/
+bool TerrainTileStore::Flush()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    std::vector<char> page(TILESTORE_DATA_OFFSET,0);
+    memcpy(&page[0],&header,sizeof(TileStoreHeader));
+
+    file.clear();
+    file.seekp(0);
+    file.write(&page[0],page.size());
+    file.flush();
+    return !file.fail();
+};
+
+void TerrainTileStore::Close()
+{
+    if (file.is_open())
+    {
+        file.close();
+    }
+    file.clear();
+    filename.clear();
+};
+
+//******************************************//
+//                Read a Tile               //
+//******************************************//
+bool TerrainTileStore::ReadTile(int tx,int ty,HeightField16 &tile)
+{
+    if (tx<0 || ty<0 || tx>=header.tilesX || ty>=header.tilesY)
+    {
+        return false;
+    }
+
+    const int E = TileEdge();
+    if (tile.Width()!=E || tile.Height()!=E)
+    {
+        if (!tile.Allocate(E,E))
+        {
+            return false;
+        }
+    }
+
+    // One read for the whole slot, then spread the rows to the field stride
+    std::vector<uint16_t> slot((size_t)E*E);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        file.clear();
+        file.seekg(TileOffset(tx,ty));
+        file.read((char*)&slot[0],TileBytes());
+        if (file.gcount()!=(std::streamsize)TileBytes())
+        {
+            file.clear();
+            return false;
+        }
+    }
+
+    for (int i=0; i<E; ++i)
+    {
+        memcpy(tile.Row(i),&slot[(size_t)i*E],E*sizeof(uint16_t));
+    }
+
+    return true;
+};
+
+//******************************************//
+//               Write a Tile               //
+//******************************************//
+bool TerrainTileStore::WriteTile(int tx,int ty,const HeightField16 &tile)
+{
+    const int E = TileEdge();
+    if (tx<0 || ty<0 || tx>=header.tilesX || ty>=header.tilesY || tile.Width()!=E || tile.Height()!=E)
+    {
+        return false;
+    }
+
+    std::vector<uint16_t> slot((size_t)E*E);
+    for (int i=0; i<E; ++i)
+    {
+        memcpy(&slot[(size_t)i*E],tile.Row(i),E*sizeof(uint16_t));
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    file.clear();
+    file.seekp(TileOffset(tx,ty));
+    file.write((const char*)&slot[0],TileBytes());
+    return !file.fail();
+};
+
+//******************************************//
+//        Apron at the World Border         //
+//******************************************//
+void TerrainTileStore::RepeatApron(const TileStoreHeader &header,int tx,int ty,HeightField16 &tile)
+{
+    const int E = tile.Width();
+    const int a = header.apron;
+
+    for (int r=0; r<tile.Height(); ++r)
+    {
+        uint16_t *row=tile.Row(r);
+        if (tx==0)                {for (int k=0; k<a; ++k) row[k]=row[a];}
+        if (tx==header.tilesX-1)  {for (int k=0; k<a; ++k) row[E-1-k]=row[E-1-a];}
+    }
+    for (int k=0; k<a; ++k)
+    {
+        if (ty==0)                {memcpy(tile.Row(k),tile.Row(a),E*sizeof(uint16_t));}
+        if (ty==header.tilesY-1)  {memcpy(tile.Row(tile.Height()-1-k),tile.Row(tile.Height()-1-a),E*sizeof(uint16_t));}
+    }
+};
+
+//******************************************//
+//      Write a Height Field as Tiles       //
+//******************************************//
+bool TerrainTileStore::WriteField(const std::string &filename,const HeightField16 &field,int tileSize,float spacing,float heightMult,float midpoint)
+{
+    const int w = field.Width();
+    const int h = field.Height();
+
+    if (tileSize<1 || w<2 || h<2 || (w-1)%tileSize!=0 || (h-1)%tileSize!=0)
+    {
+        return false;
+    }
+
+    TileStoreHeader hdr;
+    hdr.tileSize=tileSize;
+    hdr.apron=1;
+    hdr.tilesX=(w-1)/tileSize;
+    hdr.tilesY=(h-1)/tileSize;
+    hdr.spacing=spacing;
+    hdr.heightMult=heightMult;
+    hdr.midpoint=midpoint;
+    field.MinMax(hdr.minHeight,hdr.maxHeight);
+
+    if (!Create(filename,hdr))
+    {
+        return false;
+    }
+
+    const int E = TileEdge();
+    const int a = header.apron;
+
+    HeightField16 tile(E,E);
+    for (int ty=0; ty<header.tilesY; ++ty)
+    {
+        for (int tx=0; tx<header.tilesX; ++tx)
+        {
+            for (int r=0; r<E; ++r)
+            {
+                int gi = std::min(std::max(ty*tileSize-a+r,0),h-1);
+                const uint16_t *src = field.Row(gi);
+                uint16_t *dst = tile.Row(r);
+
+                for (int c=0; c<E; ++c)
+                {
+                    int gj = std::min(std::max(tx*tileSize-a+c,0),w-1);
+                    dst[c] = src[gj];
+                }
+            }
+
+            if (!WriteTile(tx,ty,tile))
+            {
+                return false;
+            }
+        }
+    }
+
+    return Flush();
+};
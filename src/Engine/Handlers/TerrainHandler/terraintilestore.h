@@ -0,0 +1,119 @@
+#ifndef TERRAINTILESTORE_C
+#define TERRAINTILESTORE_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../Tools/heightfield.hpp"
+#include <stdint.h>
+#include <mutex>
+
+//******************************************//
+//        Terrain Tile Store Header         //
+//******************************************//
+/*
+    Fixed size header at the start of a tile store
+    file, the tiles follow at TILESTORE_DATA_OFFSET.
+*/
+#define TILESTORE_MAGIC 0x4C49544A // "JTIL"
+#define TILESTORE_VERSION 1
+#define TILESTORE_DATA_OFFSET 4096
+
+struct TileStoreHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t tileSize; // Cells per tile edge (tile verts = tileSize+1)
+    int32_t apron; // Extra verts stored around every tile
+    int32_t tilesX; // Tiles along x (columns)
+    int32_t tilesY; // Tiles along z (rows)
+    float spacing; // Distance between verts
+    float heightMult; // Height multiplier
+    float midpoint; // Height shift applied to the verts
+    uint16_t minHeight; // Lowest and highest height in the world
+    uint16_t maxHeight;
+
+    TileStoreHeader() : magic(TILESTORE_MAGIC), version(TILESTORE_VERSION), tileSize(0), apron(1), tilesX(0), tilesY(0),
+                        spacing(1.0f), heightMult(1.0f), midpoint(0.0f), minHeight(0), maxHeight(0) {};
+};
+
+//******************************************//
+//         Terrain Tile Store Class         //
+//******************************************//
+/*
+    A paged terrain world on disk. The world is a
+    grid of tilesX x tilesY tiles, tile (tx,ty)
+    holding the world verts
+
+        rows    [ty*T-apron, ty*T+T+1+apron)
+        columns [tx*T-apron, tx*T+T+1+apron)
+
+    as 16 bit heights (T=tileSize). Neighbouring
+    tiles share their edge verts, so the world is
+    tilesX*T+1 verts wide. The apron lets a tile
+    compute its edge normals on its own, at the
+    world edge it repeats the last vert.
+
+    Every tile has a fixed size slot in the file,
+    so a tile is found with one 64 bit seek and
+    tiles can be written in any order. Reads and
+    writes may come from different threads.
+*/
+class TerrainTileStore
+{
+    std::fstream file;
+    std::string filename;
+    TileStoreHeader header;
+    std::mutex lock;
+
+    // Bytes of one tile slot
+    size_t TileBytes() const;
+
+    // File offset of a tile slot
+    std::streamoff TileOffset(int tx,int ty) const;
+
+public:
+    TerrainTileStore() {};
+    ~TerrainTileStore() {Close();};
+
+    // Create a new (empty) store, an existing file is overwritten
+    bool Create(const std::string &filename,const TileStoreHeader &header);
+
+    // Open an existing store
+    bool Open(const std::string &filename);
+
+    // Write the header back (min/max heights may have changed)
+    bool Flush();
+
+    void Close();
+
+    bool IsOpen() const {return file.is_open();};
+    const TileStoreHeader& GetHeader() const {return header;};
+
+    // Height range written by the next Flush()
+    void SetHeightRange(uint16_t low,uint16_t high) {header.minHeight=low; header.maxHeight=high;};
+    const std::string& GetFileName() const {return filename;};
+
+    // Verts per tile edge, apron included
+    int TileEdge() const {return header.tileSize+1+2*header.apron;};
+
+    // World size in verts
+    int WorldWidth() const {return header.tilesX*header.tileSize+1;};
+    int WorldHeight() const {return header.tilesY*header.tileSize+1;};
+
+    // Read a tile (apron included) into tile, which is (re)allocated as needed
+    bool ReadTile(int tx,int ty,HeightField16 &tile);
+
+    // Write a tile of TileEdge() x TileEdge() heights
+    bool WriteTile(int tx,int ty,const HeightField16 &tile);
+
+    // Repeat the edge verts into the apron of tile (tx,ty) where it lies on the world border
+    static void RepeatApron(const TileStoreHeader &header,int tx,int ty,HeightField16 &tile);
+
+    /*
+    Write a whole in memory height field as a store
+    with tiles of tileSize cells. (field.Width()-1)
+    must be a multiple of tileSize.
+    */
+    bool WriteField(const std::string &filename,const HeightField16 &field,int tileSize,float spacing,float heightMult,float midpoint);
+};
+
+#endif
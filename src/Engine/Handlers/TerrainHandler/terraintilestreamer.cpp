@@ -0,0 +1,550 @@
+#include "terraintilestreamer.h"
+#include "terrainhandler.h"
+#include "../../Tools/console.h"
+#include <omp.h>
+#include <algorithm>
+
+TerrainTileStreamer::TerrainTileStreamer()
+{
+    N=0;
+    fromNoise=false;
+    shiftX=0.0f;
+    shiftZ=0.0f;
+
+    stop=false;
+    maxReady=8;
+
+    frame=0;
+    memoryCap=256*1024*1024;
+    radius=6;
+    prefetchFrames=30;
+    uploadsPerFrame=4;
+
+    lastPos=glm::vec3(0.0f);
+    hasLastPos=false;
+
+    GPUSet=false;
+    drawnTris=0;
+    drawnTiles=0;
+}
+
+//******************************************//
+//               Open a Store               //
+//******************************************//
+bool TerrainTileStreamer::Open(const std::string &filename)
+{
+    Close();
+
+    if (!store.Open(filename))
+    {
+        Console::cPrint(tools::appendStrings("Could not open tile store: ",filename));
+        return false;
+    }
+
+    header = store.GetHeader();
+    SetupWorld();
+    return true;
+};
+
+bool TerrainTileStreamer::OpenNoise(const HeightNoise &noise,const TileStoreHeader &header)
+{
+    Close();
+
+    if (header.tileSize<1 || header.apron<0 || header.tilesX<1 || header.tilesY<1)
+    {
+        return false;
+    }
+
+    this->noise = noise;
+    this->header = header;
+    fromNoise = true;
+    SetupWorld();
+    return true;
+};
+
+void TerrainTileStreamer::SetupWorld()
+{
+    const int worldW = header.tilesX*header.tileSize+1;
+    const int worldH = header.tilesY*header.tileSize+1;
+
+    N = header.tileSize+1;
+    shiftX = header.spacing*(worldW-1)/2.0f;
+    shiftZ = header.spacing*(worldH-1)/2.0f;
+    normals.SetScale(header.spacing,header.heightMult);
+
+    Console::cPrint(tools::appendStrings(fromNoise ? "Noise World: " : "Tile Store: ",worldW,"x",worldH," verts"));
+    Console::cPrint(tools::appendStrings(" Tiles: ",header.tilesX,"x",header.tilesY," of ",header.tileSize," cells"));
+};
+
+//******************************************//
+//       Setup the GPU and the Worker       //
+//******************************************//
+/*
+The ring radius is reduced until the ring fits in
+the slots the memory cap allows, otherwise tiles
+the camera needs would evict each other.
+*/
+bool TerrainTileStreamer::Start()
+{
+    if ((!store.IsOpen() && !fromNoise) || GPUSet)
+    {
+        return false;
+    }
+
+    const size_t tileBytes = (size_t)N*N*sizeof(Vertex);
+    long long slots = (long long)std::max(memoryCap/tileBytes,(size_t)1);
+    slots = std::min(slots,(long long)header.tilesX*header.tilesY);
+
+    int ring=0;
+    while (radius>1)
+    {
+        ring=0;
+        for (int dy=-radius; dy<=radius; ++dy)
+        {
+            for (int dx=-radius; dx<=radius; ++dx)
+            {
+                ring += (dx*dx+dy*dy <= (radius+0.5f)*(radius+0.5f)) ? 1 : 0;
+            }
+        }
+
+        if (ring<=slots)
+        {
+            break;
+        }
+        --radius;
+    }
+
+    Console::cPrint(tools::appendStrings(" Tile Slots: ",slots," (",(slots*tileBytes)/(1024*1024),"MB), Ring Radius: ",radius));
+
+    // One strip layout shared by every tile
+    std::vector<GLuint> strip;
+    TerrainHandler::BuildStripIndices(N,strip);
+    idxBuffer.GenBuffer(strip,(GLuint)(N*N-1),GL_TRIANGLE_STRIP);
+    buffer.GenBuffers((size_t)slots*N*N,idxBuffer);
+
+    culler.Resize((int)slots);
+    slotKey.assign(slots,-1);
+    slotUsed.assign(slots,0);
+    resident.clear();
+    frame=0;
+    hasLastPos=false;
+
+    stop=false;
+    worker=std::thread(&TerrainTileStreamer::WorkerLoop,this);
+
+    GPUSet=true;
+    return true;
+};
+
+//******************************************//
+//          Stop and Free Everything        //
+//******************************************//
+void TerrainTileStreamer::Close()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop=true;
+        requests.clear();
+    }
+    wake.notify_all();
+
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+
+    ready.clear();
+    loading.clear();
+
+    if (GPUSet)
+    {
+        buffer.ClearBuffers();
+        idxBuffer.ClearBuffer();
+        GPUSet=false;
+    }
+
+    slotKey.clear();
+    slotUsed.clear();
+    resident.clear();
+    drawnTris=0;
+    drawnTiles=0;
+
+    store.Close();
+    fromNoise=false;
+};
+
+//******************************************//
+//              Worker Thread               //
+//******************************************//
+/*
+Takes the nearest request, reads and builds it.
+Waits while the ready list is full, so at most
+maxReady built tiles are held outside the GPU.
+*/
+void TerrainTileStreamer::WorkerLoop()
+{
+    // Tiles are small, keep the normals pass on this thread
+    omp_set_num_threads(1);
+
+    HeightField16 scratch;
+
+    while (true)
+    {
+        TileKey key;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard,[this]{return stop || (!requests.empty() && (int)ready.size()<maxReady);});
+
+            if (stop)
+            {
+                break;
+            }
+
+            key = requests.back().key;
+            requests.pop_back();
+            loading.insert(key);
+        }
+
+        ReadyTile tile;
+        tile.key = key;
+        BuildTile(key,scratch,tile.verts);
+
+        std::lock_guard<std::mutex> guard(lock);
+        ready.push_back(std::move(tile));
+    }
+};
+
+//******************************************//
+//             Build a Tile's Verts         //
+//******************************************//
+/*
+Same vert layout as TerrainGeneration::UpdateVerticies,
+in world grid coordinates. A tile that was never
+written to the store is built flat. Noise tiles are
+filled exactly as TerrainGeneration::SaveNoiseWorld
+writes them.
+*/
+bool TerrainTileStreamer::BuildTile(TileKey key,HeightField16 &scratch,std::vector<Vertex> &verts)
+{
+    const int tx = (int)(key%header.tilesX);
+    const int ty = (int)(key/header.tilesX);
+    const int T = header.tileSize;
+    const int a = header.apron;
+
+    const int E = T+1+2*a;
+
+    bool found;
+    if (fromNoise)
+    {
+        found = (scratch.Width()==E && scratch.Height()==E) || scratch.Allocate(E,E);
+        if (found)
+        {
+            noise.FillTile(scratch,(long long)tx*T-a,(long long)ty*T-a);
+            TerrainTileStore::RepeatApron(header,tx,ty,scratch);
+        }
+    }
+    else
+    {
+        found = store.ReadTile(tx,ty,scratch);
+    }
+
+    if (!found)
+    {
+        if (scratch.Width()!=E || scratch.Height()!=E)
+        {
+            scratch.Allocate(E,E);
+        }
+        scratch.Fill((uint16_t)std::min(std::max(header.midpoint,0.0f),65535.0f));
+    }
+
+    verts.resize((size_t)N*N);
+
+    const float sp = header.spacing;
+    const float hMult = header.heightMult;
+    const float midpoint = header.midpoint;
+
+    for (int i=0; i<N; ++i)
+    {
+        const uint16_t *hRow = scratch.Row(i+a)+a;
+        Vertex *vRow = &verts[(size_t)i*N];
+        const int gi = ty*T+i;
+
+        for (int j=0; j<N; ++j)
+        {
+            const int gj = tx*T+j;
+
+            vRow[j].position.x = gj*sp-shiftX;
+            vRow[j].position.y = hMult*((float)hRow[j]-midpoint);
+            vRow[j].position.z = gi*sp-shiftZ;
+
+            vRow[j].texture.x = (float)gj;
+            vRow[j].texture.y = (float)gi;
+        }
+    }
+
+    // The apron gives the edge verts their outer neighbours
+    normals.Compute(scratch,&verts[0],N,a,a,a,a+N,a,a+N);
+
+    return found;
+};
+
+//******************************************//
+//            Add a Wanted Tile             //
+//******************************************//
+void TerrainTileStreamer::AddWanted(int tx,int ty,float priority,std::map<TileKey,float> &wanted)
+{
+    if (tx<0 || ty<0 || tx>=header.tilesX || ty>=header.tilesY)
+    {
+        return;
+    }
+
+    TileKey key = (TileKey)ty*header.tilesX+tx;
+    std::map<TileKey,float>::iterator it = wanted.find(key);
+    if (it==wanted.end())
+    {
+        wanted[key]=priority;
+    }
+    else
+    {
+        it->second = std::min(it->second,priority);
+    }
+};
+
+//******************************************//
+//           Find a Slot for a Tile         //
+//******************************************//
+int TerrainTileStreamer::FindSlot()
+{
+    int best=-1;
+    for (int s=0; s<(int)slotKey.size(); ++s)
+    {
+        if (slotKey[s]<0)
+        {
+            return s;
+        }
+
+        if (slotUsed[s]<frame && (best<0 || slotUsed[s]<slotUsed[best]))
+        {
+            best=s;
+        }
+    }
+    return best;
+};
+
+//******************************************//
+//          Update the Resident Tiles       //
+//******************************************//
+void TerrainTileStreamer::Update(glm::vec3 pos)
+{
+    if (!GPUSet)
+    {
+        return;
+    }
+
+    ++frame;
+
+    //********************
+    //   Wanted Tiles
+    //********************
+    const float tileWorld = header.tileSize*header.spacing;
+    const float R = radius+0.5f;
+
+    glm::vec3 vel = hasLastPos ? pos-lastPos : glm::vec3(0.0f);
+    lastPos = pos;
+    hasLastPos = true;
+
+    // Camera and look ahead point in tile units
+    const float cx = (pos.x+shiftX)/tileWorld;
+    const float cz = (pos.z+shiftZ)/tileWorld;
+    float ax = (pos.x+vel.x*prefetchFrames+shiftX)/tileWorld;
+    float az = (pos.z+vel.z*prefetchFrames+shiftZ)/tileWorld;
+
+    float ad = sqrt((ax-cx)*(ax-cx)+(az-cz)*(az-cz));
+    if (ad>radius)
+    {
+        ax = cx+(ax-cx)*radius/ad;
+        az = cz+(az-cz)*radius/ad;
+        ad = (float)radius;
+    }
+
+    std::map<TileKey,float> wanted;
+    for (int ty=(int)floor(cz-R); ty<=(int)floor(cz+R); ++ty)
+    {
+        for (int tx=(int)floor(cx-R); tx<=(int)floor(cx+R); ++tx)
+        {
+            float dx = tx+0.5f-cx;
+            float dz = ty+0.5f-cz;
+            float d = sqrt(dx*dx+dz*dz);
+            if (d<=R)
+            {
+                AddWanted(tx,ty,d,wanted);
+            }
+        }
+    }
+
+    // Ahead of the camera, loaded after the ring itself
+    if (ad>=0.5f)
+    {
+        for (int ty=(int)floor(az-R); ty<=(int)floor(az+R); ++ty)
+        {
+            for (int tx=(int)floor(ax-R); tx<=(int)floor(ax+R); ++tx)
+            {
+                float dx = tx+0.5f-ax;
+                float dz = ty+0.5f-az;
+                if (dx*dx+dz*dz<=R*R)
+                {
+                    float ex = tx+0.5f-cx;
+                    float ez = ty+0.5f-cz;
+                    AddWanted(tx,ty,R+sqrt(ex*ex+ez*ez),wanted);
+                }
+            }
+        }
+    }
+
+    //********************
+    //  Upload Built Tiles
+    //********************
+    std::vector<ReadyTile> done;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        int n = std::min((int)ready.size(),uploadsPerFrame);
+        for (int k=0; k<n; ++k)
+        {
+            done.push_back(std::move(ready[k]));
+        }
+        ready.erase(ready.begin(),ready.begin()+n);
+    }
+
+    const size_t NN = (size_t)N*N;
+    for (size_t k=0; k<done.size(); ++k)
+    {
+        std::map<TileKey,float>::iterator w = wanted.find(done[k].key);
+        if (w==wanted.end() || resident.count(done[k].key))
+        {
+            continue;
+        }
+
+        int s = FindSlot();
+        if (s<0)
+        {
+            continue;
+        }
+
+        if (slotKey[s]>=0)
+        {
+            resident.erase(slotKey[s]);
+        }
+
+        buffer.UpdateVerts(&done[k].verts[0],(size_t)s*NN,NN);
+        culler.SetBounds(s,done[k].verts);
+
+        slotKey[s] = done[k].key;
+        slotUsed[s] = (w->second<=R) ? frame : frame-1;
+        resident[done[k].key] = s;
+    }
+
+    //********************
+    //  Rebuild the Queue
+    //********************
+    std::vector<TileRequest> queue;
+    for (std::map<TileKey,float>::iterator w=wanted.begin(); w!=wanted.end(); ++w)
+    {
+        std::map<TileKey,int>::iterator r = resident.find(w->first);
+        if (r!=resident.end())
+        {
+            // Prefetched tiles are kept over older ones but may still be evicted
+            if (w->second<=R)
+            {
+                slotUsed[r->second] = frame;
+            }
+            else
+            {
+                slotUsed[r->second] = std::max(slotUsed[r->second],frame-1);
+            }
+            continue;
+        }
+
+        TileRequest req;
+        req.key = w->first;
+        req.priority = w->second;
+        queue.push_back(req);
+    }
+
+    std::sort(queue.begin(),queue.end(),[](const TileRequest &a,const TileRequest &b){return a.priority>b.priority;});
+
+    // No point loading more than the slots can hold
+    if (queue.size()>slotKey.size())
+    {
+        queue.erase(queue.begin(),queue.end()-slotKey.size());
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t k=0; k<done.size(); ++k)
+        {
+            loading.erase(done[k].key);
+        }
+
+        requests.clear();
+        for (size_t k=0; k<queue.size(); ++k)
+        {
+            if (!loading.count(queue[k].key))
+            {
+                requests.push_back(queue[k]);
+            }
+        }
+    }
+    wake.notify_one();
+};
+
+//******************************************//
+//           Number of Pending Tiles        //
+//******************************************//
+int TerrainTileStreamer::GetPendingTiles()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return (int)(requests.size()+loading.size());
+};
+
+//******************************************//
+//          Draw the Resident Tiles         //
+//******************************************//
+void TerrainTileStreamer::Draw(RTSCamera &camera)
+{
+    drawnTris=0;
+    drawnTiles=0;
+
+    if (!GPUSet)
+    {
+        return;
+    }
+
+    culler.Cull(camera.PM*camera.VM,camera.cameraPos,drawOrder);
+
+    drawCounts.clear();
+    drawOffsets.clear();
+    drawBase.clear();
+
+    const GLint NN = N*N;
+    for (size_t k=0; k<drawOrder.size(); ++k)
+    {
+        const int s = drawOrder[k];
+        if (slotKey[s]<0)
+        {
+            continue;
+        }
+
+        drawCounts.push_back(idxBuffer.idxSize);
+        drawOffsets.push_back((const GLvoid*)0);
+        drawBase.push_back(s*NN);
+        drawnTris += 2*(long int)(N-1)*(N-1);
+        ++drawnTiles;
+    }
+
+    if (!drawCounts.empty())
+    {
+        idxBuffer.BeginDraw();
+        buffer.DrawRanges(&drawCounts[0],&drawOffsets[0],&drawBase[0],(int)drawCounts.size());
+        idxBuffer.EndDraw();
+    }
+};
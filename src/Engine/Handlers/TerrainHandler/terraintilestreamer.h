@@ -0,0 +1,172 @@
+#ifndef TERRAINTILESTREAMER_C
+#define TERRAINTILESTREAMER_C
+
+#include "../../../Headers/headerscpp.h"
+#include "../../../Headers/headersogl.h"
+#include "../ModelHandler/base_classes.h"
+#include "../../Tools/ogltools.hpp"
+#include "../../Tools/rtscamera.h"
+#include "../../Tools/heightfield.hpp"
+#include "../../DevTools/worldbuildertools/heightnormals.h"
+#include "../../DevTools/worldbuildertools/heightnoise.h"
+#include "terraintilestore.h"
+#include "terrainculler.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <map>
+#include <set>
+
+//******************************************//
+//        Terrain Tile Streamer Class       //
+//******************************************//
+/*
+    Streams the tiles of a TerrainTileStore in a
+    ring around the camera, so worlds far larger
+    than memory can be viewed at a constant cost.
+
+    Update() (main thread, once a frame) works out
+    the tiles within the ring radius of the camera
+    and of the point the camera is heading for
+    (its motion over the last frame, extrapolated
+    prefetchFrames ahead), and queues the missing
+    ones nearest first. The queue is rebuilt every
+    frame, so tiles the camera has left behind are
+    dropped before they are loaded.
+
+    A worker thread reads each tile from disk and
+    builds its verts (positions and normals) into
+    a ready list. Update() uploads a few ready
+    tiles a frame into slots of one VBO. The number
+    of slots follows from the memory cap, when all
+    are in use the least recently wanted tile is
+    evicted. Tiles are drawn at full detail with
+    one shared index buffer, culled and front to
+    back like the editor terrain.
+
+    A world opened with OpenNoise() has no store,
+    the worker builds each tile from the noise.
+*/
+class TerrainTileStreamer
+{
+    // Tile key, ty*tilesX+tx
+    typedef long long TileKey;
+
+    struct TileRequest
+    {
+        TileKey key;
+        float priority; // Lower loads first
+    };
+
+    struct ReadyTile
+    {
+        TileKey key;
+        std::vector<Vertex> verts;
+    };
+
+    TerrainTileStore store;
+    TileStoreHeader header; // Copy of the store header
+    HeightNoise noise;
+    bool fromNoise; // Tiles come from noise, not from store
+    int N; // Verts per tile edge
+    float shiftX,shiftZ; // World offset that centers the terrain at the origin
+
+    HeightNormals normals;
+
+    //*************************
+    //   Worker Thread State
+    //*************************
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::atomic<bool> stop;
+
+    std::vector<TileRequest> requests; // Sorted, nearest last
+    std::set<TileKey> loading; // Taken by the worker or waiting in ready
+    std::vector<ReadyTile> ready;
+    int maxReady; // Built tiles allowed to wait for upload
+
+    void SetupWorld();
+
+    void WorkerLoop();
+    bool BuildTile(TileKey key,HeightField16 &scratch,std::vector<Vertex> &verts);
+
+    //*************************
+    //   Resident Tile Slots
+    //*************************
+    std::vector<TileKey> slotKey; // -1 for a free slot
+    std::vector<long long> slotUsed; // Frame the tile was last wanted
+    std::map<TileKey,int> resident; // Tile to slot
+    long long frame;
+
+    size_t memoryCap; // Bytes of vertex data allowed on the GPU
+    int radius; // Ring radius in tiles
+    int prefetchFrames;
+    int uploadsPerFrame;
+
+    glm::vec3 lastPos;
+    bool hasLastPos;
+
+    // Free slot, else the least recently wanted one (-1 if all are wanted now)
+    int FindSlot();
+
+    //*************************
+    //      GPU Resources
+    //*************************
+    ogltools::BufferHandler buffer;
+    ogltools::IndexBufferHandler idxBuffer;
+    bool GPUSet;
+
+    TerrainCuller culler;
+    std::vector<int> drawOrder;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const GLvoid*> drawOffsets;
+    std::vector<GLint> drawBase;
+    long int drawnTris;
+    int drawnTiles;
+
+    void AddWanted(int tx,int ty,float priority,std::map<TileKey,float> &wanted);
+
+public:
+    TerrainTileStreamer();
+    ~TerrainTileStreamer() {Close();};
+
+    // Open a store, the tiles are not loaded until Start()
+    bool Open(const std::string &filename);
+
+    // Stream a world of header's layout built from noise (see TerrainGeneration::SetupNoiseWorld)
+    bool OpenNoise(const HeightNoise &noise,const TileStoreHeader &header);
+
+    // Create the slot buffers on the GPU and start the worker
+    bool Start();
+
+    // Stop the worker and free everything
+    void Close();
+
+    bool IsActive() const {return GPUSet;};
+
+    // Memory cap of the resident tiles in bytes, takes effect on the next Start()
+    void SetMemoryCap(size_t bytes) {memoryCap=bytes;};
+    // Ring radius in tiles, limited to what the memory cap allows
+    void SetRadius(int tiles) {radius=std::max(tiles,1);};
+    // Frames of camera motion to look ahead when prefetching
+    void SetPrefetchFrames(int frames) {prefetchFrames=std::max(frames,0);};
+    void SetNormalQuality(HeightNormals::Quality quality) {normals.SetQuality(quality);};
+
+    // Queue tiles around the camera pole position and upload finished ones
+    void Update(glm::vec3 pos);
+
+    // Cull and draw the resident tiles with the bound shader
+    void Draw(RTSCamera &camera);
+
+    const TileStoreHeader& GetHeader() const {return header;};
+    int GetResidentTiles() const {return (int)resident.size();};
+    int GetSlots() const {return (int)slotKey.size();};
+    int GetPendingTiles();
+    size_t GetGPUMemory() const {return slotKey.size()*(size_t)N*N*sizeof(Vertex)+idxBuffer.MemSize();};
+    long int GetDrawnTriangles() const {return drawnTris;};
+    int GetVisibleTiles() const {return drawnTiles;};
+};
+
+#endif
@@ -0,0 +1,508 @@
+#include "heightmapfile.h"
+#include <algorithm>
+#include <math.h>
+
+static const uint8_t pngSignature[8] = {137,80,78,71,13,10,26,10};
+
+static uint32_t ReadBE32(const uint8_t *p)
+{
+    return ((uint32_t)p[0]<<24)|((uint32_t)p[1]<<16)|((uint32_t)p[2]<<8)|(uint32_t)p[3];
+};
+
+static void PutBE32(uint8_t *p,uint32_t v)
+{
+    p[0]=(uint8_t)(v>>24);
+    p[1]=(uint8_t)(v>>16);
+    p[2]=(uint8_t)(v>>8);
+    p[3]=(uint8_t)v;
+};
+
+HeightmapFile::HeightmapFile()
+{
+    format=HEIGHTMAP_NONE;
+    width=0;
+    height=0;
+    bitDepth=16;
+    row=0;
+    idatLeft=0;
+}
+
+HeightmapFile::Format HeightmapFile::FormatOf(const std::string &filename)
+{
+    size_t dot=filename.find_last_of('.');
+    if (dot==std::string::npos)
+    {
+        return HEIGHTMAP_NONE;
+    }
+
+    std::string ext=filename.substr(dot+1);
+    std::transform(ext.begin(),ext.end(),ext.begin(),::tolower);
+
+    if (ext=="png")
+    {
+        return HEIGHTMAP_PNG;
+    }
+    if (ext=="raw" || ext=="r16")
+    {
+        return HEIGHTMAP_RAW;
+    }
+    return HEIGHTMAP_NONE;
+};
+
+//******************************************//
+//              Open a File                 //
+//******************************************//
+bool HeightmapFile::Open(const std::string &filename,int rawWidth,int rawHeight)
+{
+    Close();
+
+    Format type=FormatOf(filename);
+    file.open(filename.c_str(),std::ios::in|std::ios::binary);
+    if (type==HEIGHTMAP_NONE || !file.is_open())
+    {
+        Close();
+        return false;
+    }
+
+    bool valid=false;
+    if (type==HEIGHTMAP_RAW)
+    {
+        file.seekg(0,std::ios::end);
+        const uint64_t bytes=(uint64_t)file.tellg();
+        file.seekg(0,std::ios::beg);
+
+        if (rawWidth<=0 || rawHeight<=0)
+        {
+            rawWidth=(int)(sqrt((double)(bytes/2))+0.5);
+            rawHeight=rawWidth;
+        }
+
+        width=rawWidth;
+        height=rawHeight;
+        bitDepth=16;
+        valid = width>1 && height>1 && (uint64_t)width*height*2<=bytes;
+        line.resize((size_t)width*2);
+    }
+    else
+    {
+        valid=OpenPNG();
+    }
+
+    if (!valid)
+    {
+        Close();
+        return false;
+    }
+
+    format=type;
+    row=0;
+    return true;
+};
+
+/*
+Reads the chunks up to the first IDAT. The image
+data is pulled from there on by the InflateStream.
+*/
+bool HeightmapFile::OpenPNG()
+{
+    uint8_t head[13];
+    file.read((char*)head,8);
+    if (!file || memcmp(head,pngSignature,8)!=0)
+    {
+        return false;
+    }
+
+    bool header=false;
+    while (file)
+    {
+        file.read((char*)head,8);
+        if (!file)
+        {
+            return false;
+        }
+
+        const uint32_t len=ReadBE32(head);
+        const std::string type((const char*)head+4,4);
+
+        if (type=="IHDR" && len==13)
+        {
+            file.read((char*)head,13);
+            file.seekg(4,std::ios::cur);
+
+            width=(int)ReadBE32(head);
+            height=(int)ReadBE32(head+4);
+            bitDepth=head[8];
+
+            // Greyscale, 8 or 16 bits, not interlaced
+            header = width>1 && height>1 && (bitDepth==8 || bitDepth==16)
+                  && head[9]==0 && head[10]==0 && head[11]==0 && head[12]==0;
+            if (!header)
+            {
+                return false;
+            }
+        }
+        else if (type=="IDAT")
+        {
+            if (!header)
+            {
+                return false;
+            }
+
+            const size_t stride=(size_t)width*bitDepth/8;
+            line.assign(stride+1,0);
+            prior.assign(stride,0);
+
+            idatLeft=len;
+            return inflate.Start([this](uint8_t *dst,size_t n) {return ReadIDAT(dst,n);});
+        }
+        else if (type=="IEND")
+        {
+            return false;
+        }
+        else
+        {
+            file.seekg((std::streamoff)len+4,std::ios::cur);
+        }
+    }
+
+    return false;
+};
+
+// Image data of consecutive IDAT chunks, 0 after the last
+size_t HeightmapFile::ReadIDAT(uint8_t *dst,size_t n)
+{
+    while (idatLeft==0)
+    {
+        uint8_t head[8];
+        file.seekg(4,std::ios::cur);
+        file.read((char*)head,8);
+        if (!file || memcmp(head+4,"IDAT",4)!=0)
+        {
+            return 0;
+        }
+        idatLeft=ReadBE32(head);
+    }
+
+    file.read((char*)dst,std::min((size_t)idatLeft,n));
+    const size_t got=(size_t)file.gcount();
+    idatLeft-=(uint32_t)got;
+    return got;
+};
+
+void HeightmapFile::Close()
+{
+    if (file.is_open())
+    {
+        file.close();
+    }
+    file.clear();
+
+    format=HEIGHTMAP_NONE;
+    width=0;
+    height=0;
+    row=0;
+    idatLeft=0;
+    line.clear();
+    prior.clear();
+};
+
+//******************************************//
+//               Read a Row                 //
+//******************************************//
+static inline uint8_t Paeth(int a,int b,int c)
+{
+    const int p=a+b-c;
+    const int pa=abs(p-a);
+    const int pb=abs(p-b);
+    const int pc=abs(p-c);
+    if (pa<=pb && pa<=pc)
+    {
+        return (uint8_t)a;
+    }
+    return (uint8_t)(pb<=pc ? b : c);
+};
+
+bool HeightmapFile::ReadRow(uint16_t *dst)
+{
+    if (!IsOpen() || row>=height)
+    {
+        return false;
+    }
+
+    if (format==HEIGHTMAP_RAW)
+    {
+        file.read((char*)&line[0],line.size());
+        if (!file)
+        {
+            return false;
+        }
+
+        for (int j=0; j<width; ++j)
+        {
+            dst[j]=(uint16_t)(line[2*j]|(line[2*j+1]<<8));
+        }
+        ++row;
+        return true;
+    }
+
+    //*************************
+    //   Unfilter a PNG Row
+    //*************************
+    if (!inflate.Read(&line[0],line.size()))
+    {
+        return false;
+    }
+
+    const int bpp=bitDepth/8;
+    const int stride=(int)prior.size();
+    uint8_t *x=&line[1];
+    const uint8_t *p=&prior[0];
+
+    switch (line[0])
+    {
+    case 0:
+        break;
+    case 1:
+        for (int k=bpp; k<stride; ++k)
+        {
+            x[k]=(uint8_t)(x[k]+x[k-bpp]);
+        }
+        break;
+    case 2:
+        for (int k=0; k<stride; ++k)
+        {
+            x[k]=(uint8_t)(x[k]+p[k]);
+        }
+        break;
+    case 3:
+        for (int k=0; k<stride; ++k)
+        {
+            const int a = k>=bpp ? x[k-bpp] : 0;
+            x[k]=(uint8_t)(x[k]+((a+p[k])>>1));
+        }
+        break;
+    case 4:
+        for (int k=0; k<stride; ++k)
+        {
+            const int a = k>=bpp ? x[k-bpp] : 0;
+            const int c = k>=bpp ? p[k-bpp] : 0;
+            x[k]=(uint8_t)(x[k]+Paeth(a,p[k],c));
+        }
+        break;
+    default:
+        return false;
+    }
+
+    // Samples are big endian, 8 bit ones are scaled to 16 bits
+    if (bpp==2)
+    {
+        for (int j=0; j<width; ++j)
+        {
+            dst[j]=(uint16_t)((x[2*j]<<8)|x[2*j+1]);
+        }
+    }
+    else
+    {
+        for (int j=0; j<width; ++j)
+        {
+            dst[j]=(uint16_t)(x[j]*257);
+        }
+    }
+
+    memcpy(&prior[0],x,stride);
+    ++row;
+    return true;
+};
+
+//******************************************//
+//              PNG Checksums               //
+//******************************************//
+static const uint32_t* CrcTable()
+{
+    struct Table
+    {
+        uint32_t crc[256];
+        Table()
+        {
+            for (uint32_t n=0; n<256; ++n)
+            {
+                uint32_t c=n;
+                for (int k=0; k<8; ++k)
+                {
+                    c = (c&1) ? 0xEDB88320u^(c>>1) : c>>1;
+                }
+                crc[n]=c;
+            }
+        };
+    };
+    static const Table table;
+    return table.crc;
+};
+
+static void WriteChunk(std::ofstream &file,const char *type,const uint8_t *data,uint32_t len)
+{
+    const uint32_t *table=CrcTable();
+    uint32_t crc=0xFFFFFFFFu;
+    for (int k=0; k<4; ++k)
+    {
+        crc=table[(crc^(uint8_t)type[k])&255]^(crc>>8);
+    }
+    for (uint32_t k=0; k<len; ++k)
+    {
+        crc=table[(crc^data[k])&255]^(crc>>8);
+    }
+
+    uint8_t word[4];
+    PutBE32(word,len);
+    file.write((const char*)word,4);
+    file.write(type,4);
+    file.write((const char*)data,len);
+    PutBE32(word,crc^0xFFFFFFFFu);
+    file.write((const char*)word,4);
+};
+
+// Running adler32 of the zlib stream
+static void Adler(uint32_t &adler,const uint8_t *data,size_t n)
+{
+    uint32_t s1=adler&0xFFFF;
+    uint32_t s2=adler>>16;
+    while (n>0)
+    {
+        // Largest run the sums cannot overflow in
+        const size_t run=std::min(n,(size_t)5552);
+        for (size_t k=0; k<run; ++k)
+        {
+            s1+=data[k];
+            s2+=s1;
+        }
+        s1%=65521;
+        s2%=65521;
+        data+=run;
+        n-=run;
+    }
+    adler=(s2<<16)|s1;
+};
+
+//******************************************//
+//              Write a File                //
+//******************************************//
+bool HeightmapFile::Write(const std::string &filename,int width,int height,const RowSource &rows)
+{
+    const Format type=FormatOf(filename);
+    if (type==HEIGHTMAP_NONE || width<1 || height<1)
+    {
+        return false;
+    }
+
+    std::ofstream file(filename.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    if (type==HEIGHTMAP_RAW)
+    {
+        std::vector<uint8_t> bytes((size_t)width*2);
+        for (int i=0; i<height && file.good(); ++i)
+        {
+            const uint16_t *src=rows(i);
+            for (int j=0; j<width; ++j)
+            {
+                bytes[2*j]=(uint8_t)src[j];
+                bytes[2*j+1]=(uint8_t)(src[j]>>8);
+            }
+            file.write((const char*)&bytes[0],bytes.size());
+        }
+
+        file.close();
+        return !file.fail();
+    }
+
+    //*************************
+    //     PNG Header
+    //*************************
+    file.write((const char*)pngSignature,8);
+
+    uint8_t ihdr[13];
+    PutBE32(ihdr,(uint32_t)width);
+    PutBE32(ihdr+4,(uint32_t)height);
+    ihdr[8]=16; // Bit depth
+    ihdr[9]=0; // Greyscale
+    ihdr[10]=0;
+    ihdr[11]=0;
+    ihdr[12]=0;
+    WriteChunk(file,"IHDR",ihdr,13);
+
+    //*************************
+    //   Stored Deflate Blocks
+    //*************************
+    /*
+    Every block of up to 65535 bytes of filter byte
+    plus big endian samples goes out as one IDAT
+    chunk, the zlib header in front of the first.
+    */
+    const uint64_t total=(uint64_t)height*(1+2*(uint64_t)width);
+    uint64_t fed=0;
+    uint32_t adler=1;
+    bool first=true;
+
+    std::vector<uint8_t> block;
+    block.reserve(65535+7);
+    std::vector<uint8_t> line(1+2*(size_t)width);
+
+    for (int i=0; i<height && file.good(); ++i)
+    {
+        const uint16_t *src=rows(i);
+        line[0]=0; // No filter
+        for (int j=0; j<width; ++j)
+        {
+            line[1+2*j]=(uint8_t)(src[j]>>8);
+            line[2+2*j]=(uint8_t)src[j];
+        }
+        Adler(adler,&line[0],line.size());
+
+        size_t k=0;
+        while (k<line.size())
+        {
+            if (block.empty())
+            {
+                if (first)
+                {
+                    block.push_back(0x78);
+                    block.push_back(0x01);
+                }
+                block.resize(block.size()+5); // Block header, set when full
+            }
+
+            const size_t head = first ? 2 : 0;
+            const size_t room = 65535-(block.size()-head-5);
+            const size_t take = std::min(room,line.size()-k);
+            block.insert(block.end(),line.begin()+k,line.begin()+k+take);
+            k+=take;
+            fed+=take;
+
+            const size_t len=block.size()-head-5;
+            if (len==65535 || fed==total)
+            {
+                uint8_t *bh=&block[head];
+                bh[0] = fed==total ? 1 : 0;
+                bh[1]=(uint8_t)len;
+                bh[2]=(uint8_t)(len>>8);
+                bh[3]=(uint8_t)~len;
+                bh[4]=(uint8_t)(~len>>8);
+
+                WriteChunk(file,"IDAT",&block[0],(uint32_t)block.size());
+                block.clear();
+                first=false;
+            }
+        }
+    }
+
+    uint8_t tail[4];
+    PutBE32(tail,adler);
+    WriteChunk(file,"IDAT",tail,4);
+    WriteChunk(file,"IEND",NULL,0);
+
+    file.close();
+    return !file.fail();
+};
@@ -0,0 +1,81 @@
+#ifndef HEIGHTMAPFILE_C
+#define HEIGHTMAPFILE_C
+
+#include "../../Headers/headerscpp.h"
+#include "inflatestream.h"
+#include <stdint.h>
+#include <functional>
+
+//******************************************//
+//          Heightmap File Class            //
+//******************************************//
+/*
+    Streams heightmap images in and out row by
+    row, so DEMs far larger than memory can be
+    read and written. The format comes from the
+    file name:
+
+        .png    greyscale, 8 or 16 bits, not
+                interlaced. Rows come out of an
+                InflateStream as they are read
+        .raw    16 bit little endian samples,
+                width x height (a square is
+                assumed from the file size when
+                no size is given)
+
+    8 bit samples are scaled to the 16 bit range.
+
+    PNGs are written as stored (uncompressed)
+    deflate blocks, readable by every PNG reader.
+*/
+class HeightmapFile
+{
+public:
+    enum Format
+    {
+        HEIGHTMAP_NONE=0,
+        HEIGHTMAP_RAW=1,
+        HEIGHTMAP_PNG=2
+    };
+
+    // Pointer to row i of the heights, asked for in order
+    typedef std::function<const uint16_t*(int i)> RowSource;
+
+private:
+    std::ifstream file;
+    Format format;
+    int width,height;
+    int bitDepth;
+    int row; // Next row to read
+
+    // PNG rows before unfiltering, filter byte first
+    std::vector<uint8_t> line,prior;
+    uint32_t idatLeft; // Bytes left in the current IDAT chunk
+    InflateStream inflate;
+
+    bool OpenPNG();
+    size_t ReadIDAT(uint8_t *dst,size_t n);
+
+public:
+    HeightmapFile();
+    ~HeightmapFile() {Close();};
+
+    // Format of a file name, by its extension
+    static Format FormatOf(const std::string &filename);
+
+    // Open for reading, rawWidth/rawHeight give the size of .raw files (0 for a square)
+    bool Open(const std::string &filename,int rawWidth=0,int rawHeight=0);
+    void Close();
+
+    bool IsOpen() const {return format!=HEIGHTMAP_NONE;};
+    int Width() const {return width;};
+    int Height() const {return height;};
+
+    // Read the next row of width heights, false at the end or on broken data
+    bool ReadRow(uint16_t *dst);
+
+    // Write a width x height heightmap, rows asked for top to bottom
+    static bool Write(const std::string &filename,int width,int height,const RowSource &rows);
+};
+
+#endif
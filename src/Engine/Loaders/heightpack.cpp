@@ -0,0 +1,235 @@
+#include "heightpack.h"
+
+//******************************************//
+//          Prediction and Coding           //
+//******************************************//
+// Median edge detector, a left, b above, c above left
+static inline int Predict(int a,int b,int c)
+{
+    if (c>=std::max(a,b))
+    {
+        return std::min(a,b);
+    }
+    if (c<=std::min(a,b))
+    {
+        return std::max(a,b);
+    }
+    return a+b-c;
+};
+
+// Rice parameter from the running sum and count of the coded values
+static inline int RiceK(uint32_t sum,uint32_t count)
+{
+    int k=0;
+    while ((count<<k)<sum && k<15)
+    {
+        ++k;
+    }
+    return k;
+};
+
+static inline void Adapt(uint32_t &sum,uint32_t &count,uint32_t z)
+{
+    sum+=z;
+    if (++count==64)
+    {
+        sum>>=1;
+        count>>=1;
+    }
+};
+
+// Unary quotients of this length or longer are escaped
+static const int ESCAPE=24;
+
+//******************************************//
+//               Bit Streams                //
+//******************************************//
+class BitWriter
+{
+    std::vector<uint8_t> &out;
+    uint64_t acc;
+    int bits;
+
+public:
+    BitWriter(std::vector<uint8_t> &out) : out(out), acc(0), bits(0) {};
+
+    // Up to 32 bits, low bits of value
+    void Put(uint32_t value,int n)
+    {
+        acc |= (uint64_t)(value & (n<32 ? (1u<<n)-1u : 0xFFFFFFFFu)) << bits;
+        bits += n;
+        while (bits>=8)
+        {
+            out.push_back((uint8_t)acc);
+            acc >>= 8;
+            bits -= 8;
+        }
+    };
+
+    void Flush()
+    {
+        if (bits>0)
+        {
+            out.push_back((uint8_t)acc);
+        }
+        acc=0;
+        bits=0;
+    };
+};
+
+/*
+Reads zeros past the end of the data rather than
+checking every read, Overrun() tells afterwards.
+*/
+class BitReader
+{
+    const uint8_t *data;
+    size_t bytes;
+    size_t pos;
+    uint64_t acc;
+    int bits;
+
+    // At least 57 bits in acc
+    void Refill()
+    {
+        while (bits<=56)
+        {
+            acc |= (uint64_t)(pos<bytes ? data[pos] : 0) << bits;
+            ++pos;
+            bits += 8;
+        }
+    };
+
+public:
+    BitReader(const uint8_t *data,size_t bytes) : data(data), bytes(bytes), pos(0), acc(0), bits(0) {};
+
+    // Up to 32 bits
+    uint32_t Get(int n)
+    {
+        if (bits<n)
+        {
+            Refill();
+        }
+        const uint32_t value = (uint32_t)(acc & ((1ull<<n)-1ull));
+        acc >>= n;
+        bits -= n;
+        return value;
+    };
+
+    // Count of ones before the next zero, which is read too. Stops at limit (up to 57) ones
+    uint32_t Unary(uint32_t limit)
+    {
+        Refill();
+        uint32_t q=0;
+        while (q<limit && (acc&1))
+        {
+            acc >>= 1;
+            ++q;
+        }
+        bits -= q;
+        if (q<limit)
+        {
+            acc >>= 1;
+            --bits;
+        }
+        return q;
+    };
+
+    // More bits were read than the data holds
+    bool Overrun() const {return (uint64_t)pos*8>(uint64_t)bytes*8+bits;};
+};
+
+//******************************************//
+//                Pack Rows                 //
+//******************************************//
+void HeightPack::Pack(const uint16_t *rows,int w,int n,std::vector<uint8_t> &out)
+{
+    BitWriter bw(out);
+    uint32_t sum=16;
+    uint32_t count=1;
+
+    for (int i=0; i<n; ++i)
+    {
+        const uint16_t *row=rows+(size_t)i*w;
+        const uint16_t *up = i>0 ? row-w : NULL;
+
+        for (int j=0; j<w; ++j)
+        {
+            int pred;
+            if (up==NULL)
+            {
+                pred = j>0 ? row[j-1] : 0;
+            }
+            else
+            {
+                pred = j>0 ? Predict(row[j-1],up[j],up[j-1]) : up[j];
+            }
+
+            // Wrapped to 16 bits and zigzagged, so small either way
+            const int16_t d=(int16_t)(uint16_t)(row[j]-pred);
+            const uint32_t z=(uint32_t)(uint16_t)((d<<1)^(d>>15));
+
+            const int k=RiceK(sum,count);
+            const uint32_t q=z>>k;
+            if (q<(uint32_t)ESCAPE)
+            {
+                bw.Put((1u<<q)-1u,q+1); // q ones and a zero
+                bw.Put(z,k);
+            }
+            else
+            {
+                bw.Put((1u<<ESCAPE)-1u,ESCAPE);
+                bw.Put(z,16);
+            }
+
+            Adapt(sum,count,z);
+        }
+    }
+
+    bw.Flush();
+};
+
+//******************************************//
+//               Unpack Rows                //
+//******************************************//
+bool HeightPack::Unpack(const uint8_t *data,size_t bytes,int w,int n,uint16_t *dst,size_t stride)
+{
+    BitReader br(data,bytes);
+    uint32_t sum=16;
+    uint32_t count=1;
+
+    for (int i=0; i<n; ++i)
+    {
+        uint16_t *row=dst+(size_t)i*stride;
+        const uint16_t *up = i>0 ? row-stride : NULL;
+
+        for (int j=0; j<w; ++j)
+        {
+            int pred;
+            if (up==NULL)
+            {
+                pred = j>0 ? row[j-1] : 0;
+            }
+            else
+            {
+                pred = j>0 ? Predict(row[j-1],up[j],up[j-1]) : up[j];
+            }
+
+            const int k=RiceK(sum,count);
+            const uint32_t q=br.Unary(ESCAPE);
+            const uint32_t z = q<(uint32_t)ESCAPE ? (q<<k)|br.Get(k) : br.Get(16);
+
+            const int16_t d=(int16_t)(uint16_t)((z>>1)^(0u-(z&1u)));
+            row[j]=(uint16_t)(pred+d);
+
+            Adapt(sum,count,z);
+        }
+
+        if (br.Overrun())
+        {
+            return false;
+        }
+    }
+
+    return true;
+};
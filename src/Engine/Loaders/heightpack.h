@@ -0,0 +1,36 @@
+#ifndef HEIGHTPACK_C
+#define HEIGHTPACK_C
+
+#include "../../Headers/headerscpp.h"
+#include <stdint.h>
+
+//******************************************//
+//             Height Pack Class            //
+//******************************************//
+/*
+    Lossless compression of bands of 16 bit height
+    rows, for saved terrains.
+
+    Every height is predicted from its left, upper
+    and upper left neighbours (the median edge
+    detector of LOCO-I), and the difference is
+    written as an adaptive Rice code whose
+    parameter follows the mean of the recent
+    differences. Smooth terrain mostly costs a few
+    bits a height. Differences too large for the
+    code are escaped and written raw.
+
+    Bands are coded on their own, so they can be
+    packed and unpacked in any order or in parallel.
+*/
+class HeightPack
+{
+public:
+    // Append the code of n rows of w heights (row k at rows+k*w) to out
+    static void Pack(const uint16_t *rows,int w,int n,std::vector<uint8_t> &out);
+
+    // Decode n rows of w heights into dst (row k at dst+k*stride), false if data is short
+    static bool Unpack(const uint8_t *data,size_t bytes,int w,int n,uint16_t *dst,size_t stride);
+};
+
+#endif
@@ -0,0 +1,432 @@
+#include "inflatestream.h"
+
+//******************************************//
+//             Deflate Tables               //
+//******************************************//
+static const uint16_t lengthBase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const uint8_t lengthExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const uint16_t distBase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+                                      1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const uint8_t distExtra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+// Order the code length code lengths are stored in
+static const uint8_t lengthOrder[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+
+InflateStream::InflateStream()
+{
+    input.resize(65536);
+    window.resize(WINDOW);
+    inPos=0;
+    inEnd=0;
+    padBytes=0;
+    acc=0;
+    bits=0;
+    outPos=0;
+    state=STATE_ERROR;
+    last=false;
+    stored=0;
+    matchLen=0;
+    matchDist=0;
+}
+
+//******************************************//
+//               Bit Input                  //
+//******************************************//
+/*
+Keeps at least 57 bits in acc. Once the source is
+dry zero bytes are fed, padBytes tells how many so
+reading past the end shows up afterwards.
+*/
+void InflateStream::Refill()
+{
+    while (bits<=56)
+    {
+        if (inPos==inEnd && padBytes==0)
+        {
+            inPos=0;
+            inEnd=source ? source(&input[0],input.size()) : 0;
+        }
+
+        uint8_t b=0;
+        if (inPos<inEnd)
+        {
+            b=input[inPos++];
+        }
+        else
+        {
+            ++padBytes;
+        }
+
+        acc |= (uint64_t)b << bits;
+        bits += 8;
+    }
+};
+
+uint32_t InflateStream::Get(int n)
+{
+    if (bits<n)
+    {
+        Refill();
+    }
+    const uint32_t value = (uint32_t)(acc & ((1ull<<n)-1ull));
+    acc >>= n;
+    bits -= n;
+    return value;
+};
+
+//******************************************//
+//             Huffman Codes                //
+//******************************************//
+// Canonical code of n code lengths, false if over subscribed
+bool InflateStream::Build(Huffman &h,const uint8_t *lengths,int n)
+{
+    memset(h.count,0,sizeof(h.count));
+    for (int s=0; s<n; ++s)
+    {
+        h.count[lengths[s]]++;
+    }
+    h.count[0]=0;
+
+    int left=1;
+    for (int len=1; len<16; ++len)
+    {
+        left <<= 1;
+        left -= h.count[len];
+        if (left<0)
+        {
+            return false;
+        }
+    }
+
+    // Symbols sorted by length, then value
+    uint16_t offs[16];
+    offs[1]=0;
+    for (int len=1; len<15; ++len)
+    {
+        offs[len+1]=offs[len]+h.count[len];
+    }
+    for (int s=0; s<n; ++s)
+    {
+        if (lengths[s]!=0)
+        {
+            h.symbol[offs[lengths[s]]++]=(uint16_t)s;
+        }
+    }
+
+    // Codes are read least significant bit first, so the table is indexed by reversed codes
+    memset(h.fast,0,sizeof(h.fast));
+    int code=0;
+    int k=0;
+    for (int len=1; len<=FAST_BITS; ++len)
+    {
+        for (int c=0; c<h.count[len]; ++c, ++k, ++code)
+        {
+            int rev=0;
+            for (int b=0; b<len; ++b)
+            {
+                rev |= ((code>>b)&1)<<(len-1-b);
+            }
+            for (int f=rev; f<(1<<FAST_BITS); f+=1<<len)
+            {
+                h.fast[f]=(uint16_t)((h.symbol[k]<<4)|len);
+            }
+        }
+        code <<= 1;
+    }
+
+    return true;
+};
+
+// Next symbol, -1 for a code not in h
+int InflateStream::Decode(const Huffman &h)
+{
+    if (bits<15)
+    {
+        Refill();
+    }
+
+    const uint16_t entry = h.fast[acc & ((1u<<FAST_BITS)-1u)];
+    if (entry!=0)
+    {
+        acc >>= (entry&15);
+        bits -= (entry&15);
+        return entry>>4;
+    }
+
+    // Longer codes, one bit at a time
+    int code=0;
+    int first=0;
+    int index=0;
+    for (int len=1; len<16; ++len)
+    {
+        code |= (int)(acc&1);
+        acc >>= 1;
+        --bits;
+
+        const int count=h.count[len];
+        if (code<first+count)
+        {
+            return h.symbol[index+(code-first)];
+        }
+        index += count;
+        first = (first+count)<<1;
+        code <<= 1;
+    }
+
+    return -1;
+};
+
+//******************************************//
+//              Block Headers               //
+//******************************************//
+bool InflateStream::DynamicTables()
+{
+    const int nlit = Get(5)+257;
+    const int ndist = Get(5)+1;
+    const int ncode = Get(4)+4;
+    if (nlit>286 || ndist>30)
+    {
+        return false;
+    }
+
+    uint8_t lengths[320];
+    memset(lengths,0,sizeof(lengths));
+    for (int k=0; k<ncode; ++k)
+    {
+        lengths[lengthOrder[k]]=(uint8_t)Get(3);
+    }
+
+    Huffman codes;
+    if (!Build(codes,lengths,19))
+    {
+        return false;
+    }
+
+    // Literal/length and distance code lengths, run length coded together
+    memset(lengths,0,sizeof(lengths));
+    int k=0;
+    while (k<nlit+ndist)
+    {
+        int sym=Decode(codes);
+        if (sym<0)
+        {
+            return false;
+        }
+
+        if (sym<16)
+        {
+            lengths[k++]=(uint8_t)sym;
+            continue;
+        }
+
+        uint8_t len=0;
+        int repeat;
+        if (sym==16)
+        {
+            if (k==0)
+            {
+                return false;
+            }
+            len=lengths[k-1];
+            repeat=3+Get(2);
+        }
+        else if (sym==17)
+        {
+            repeat=3+Get(3);
+        }
+        else
+        {
+            repeat=11+Get(7);
+        }
+
+        if (k+repeat>nlit+ndist)
+        {
+            return false;
+        }
+        while (repeat--)
+        {
+            lengths[k++]=len;
+        }
+    }
+
+    // A block needs its end code
+    return lengths[256]!=0 && Build(lit,lengths,nlit) && Build(dist,lengths+nlit,ndist);
+};
+
+bool InflateStream::BlockHeader()
+{
+    last = Get(1)!=0;
+    const int type = Get(2);
+
+    if (type==0)
+    {
+        // Stored, from the next byte boundary
+        const int drop=bits&7;
+        acc >>= drop;
+        bits -= drop;
+
+        const uint32_t len=Get(16);
+        const uint32_t nlen=Get(16);
+        if (len!=(~nlen & 0xFFFF))
+        {
+            return false;
+        }
+
+        stored=len;
+        state=STATE_STORED;
+        return true;
+    }
+
+    if (type==1)
+    {
+        uint8_t lengths[320];
+        for (int s=0; s<288; ++s)
+        {
+            lengths[s] = s<144 ? 8 : (s<256 ? 9 : (s<280 ? 7 : 8));
+        }
+        for (int s=0; s<30; ++s)
+        {
+            lengths[288+s]=5;
+        }
+
+        Build(lit,lengths,288);
+        Build(dist,lengths+288,30);
+        state=STATE_HUFFMAN;
+        return true;
+    }
+
+    if (type==2 && DynamicTables())
+    {
+        state=STATE_HUFFMAN;
+        return true;
+    }
+
+    return false;
+};
+
+//******************************************//
+//              Start a Stream              //
+//******************************************//
+bool InflateStream::Start(Source source)
+{
+    this->source=source;
+    inPos=0;
+    inEnd=0;
+    padBytes=0;
+    acc=0;
+    bits=0;
+    outPos=0;
+    last=false;
+    stored=0;
+    matchLen=0;
+    matchDist=0;
+
+    // zlib header: deflate, check bits, no preset dictionary
+    const uint32_t cmf=Get(8);
+    const uint32_t flg=Get(8);
+    const bool valid = (cmf&15)==8 && (cmf>>4)<=7 && (cmf*256+flg)%31==0 && (flg&32)==0;
+
+    state = valid ? STATE_HEADER : STATE_ERROR;
+    return valid;
+};
+
+//******************************************//
+//              Read Output                 //
+//******************************************//
+bool InflateStream::Read(uint8_t *dst,size_t n)
+{
+    size_t done=0;
+
+    while (done<n)
+    {
+        //*************************
+        //  Rest of a Window Copy
+        //*************************
+        if (matchLen>0)
+        {
+            const int take=(int)std::min((size_t)matchLen,n-done);
+            for (int k=0; k<take; ++k)
+            {
+                const uint8_t b=window[(outPos-matchDist)&(WINDOW-1)];
+                window[outPos&(WINDOW-1)]=b;
+                ++outPos;
+                dst[done++]=b;
+            }
+            matchLen-=take;
+            continue;
+        }
+
+        if (state==STATE_HEADER)
+        {
+            if (last)
+            {
+                state=STATE_DONE;
+            }
+            else if (!BlockHeader())
+            {
+                state=STATE_ERROR;
+            }
+        }
+        else if (state==STATE_STORED)
+        {
+            if (stored==0)
+            {
+                state=STATE_HEADER;
+                continue;
+            }
+
+            const uint8_t b=(uint8_t)Get(8);
+            window[outPos&(WINDOW-1)]=b;
+            ++outPos;
+            dst[done++]=b;
+            --stored;
+        }
+        else if (state==STATE_HUFFMAN)
+        {
+            const int sym=Decode(lit);
+            if (sym<0 || sym>285)
+            {
+                state=STATE_ERROR;
+            }
+            else if (sym<256)
+            {
+                window[outPos&(WINDOW-1)]=(uint8_t)sym;
+                ++outPos;
+                dst[done++]=(uint8_t)sym;
+            }
+            else if (sym==256)
+            {
+                state=STATE_HEADER;
+            }
+            else
+            {
+                const int ls=sym-257;
+                matchLen=lengthBase[ls]+(int)Get(lengthExtra[ls]);
+
+                const int ds=Decode(dist);
+                if (ds<0 || ds>29)
+                {
+                    state=STATE_ERROR;
+                    matchLen=0;
+                    continue;
+                }
+                matchDist=distBase[ds]+(int)Get(distExtra[ds]);
+
+                // Nothing was put out that far back
+                if ((size_t)matchDist>outPos)
+                {
+                    state=STATE_ERROR;
+                    matchLen=0;
+                }
+            }
+        }
+
+        if (state==STATE_DONE || state==STATE_ERROR || padBytes*8>(size_t)bits)
+        {
+            state=STATE_ERROR;
+            return false;
+        }
+    }
+
+    return padBytes*8<=(size_t)bits;
+};
@@ -0,0 +1,89 @@
+#ifndef INFLATESTREAM_C
+#define INFLATESTREAM_C
+
+#include "../../Headers/headerscpp.h"
+#include <stdint.h>
+#include <functional>
+
+//******************************************//
+//          Inflate Stream Class            //
+//******************************************//
+/*
+    Decoder of zlib (deflate) streams that hands
+    out the output a piece at a time, so a large
+    compressed image is read row by row without
+    ever being held whole. The compressed bytes are
+    pulled from a Source as they are needed, only
+    the 32K window of past output is kept.
+
+    Huffman codes up to FAST_BITS long decode with
+    one table lookup, longer ones bit by bit. The
+    adler32 check at the end of the stream is not
+    verified.
+*/
+class InflateStream
+{
+public:
+    // Copy up to n compressed bytes into dst, returns how many (0 at the end)
+    typedef std::function<size_t(uint8_t *dst,size_t n)> Source;
+
+private:
+    enum
+    {
+        FAST_BITS=10,
+        WINDOW=32768
+    };
+
+    enum State
+    {
+        STATE_HEADER=0, // Next block header
+        STATE_STORED=1,
+        STATE_HUFFMAN=2,
+        STATE_DONE=3, // Past the last block
+        STATE_ERROR=4
+    };
+
+    struct Huffman
+    {
+        uint16_t fast[1<<FAST_BITS]; // symbol<<4|length of codes up to FAST_BITS, 0 if longer
+        uint16_t count[16]; // Codes of each length
+        uint16_t symbol[320]; // Symbols by code
+    };
+
+    Source source;
+    std::vector<uint8_t> input;
+    size_t inPos,inEnd;
+    size_t padBytes; // Zero bytes fed after the source ran dry
+
+    uint64_t acc;
+    int bits;
+
+    std::vector<uint8_t> window;
+    size_t outPos; // Bytes put out so far
+
+    State state;
+    bool last; // In the final block
+    uint32_t stored; // Bytes left of a stored block
+    int matchLen,matchDist; // Rest of a copy from the window
+
+    Huffman lit,dist;
+
+    void Refill();
+    uint32_t Get(int n);
+    bool Build(Huffman &h,const uint8_t *lengths,int n);
+    int Decode(const Huffman &h);
+    bool BlockHeader();
+    bool DynamicTables();
+
+public:
+    InflateStream();
+    ~InflateStream() {};
+
+    // Start decoding a zlib stream from source, false if its header is not deflate
+    bool Start(Source source);
+
+    // Fill dst with the next n bytes of output, false if the stream ended early or is broken
+    bool Read(uint8_t *dst,size_t n);
+};
+
+#endif
@@ -0,0 +1,552 @@
+#include "terrainloader.h"
+#include "heightpack.h"
+#include <algorithm>
+#include <limits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+TerrainLoader::TerrainLoader()
+{
+    base=NULL;
+    size=0;
+#ifdef _WIN32
+    fileHandle=NULL;
+    mapHandle=NULL;
+#else
+    fd=-1;
+#endif
+    header=NULL;
+    chunks=NULL;
+    bands=NULL;
+}
+
+//******************************************//
+//              Map a File                  //
+//******************************************//
+bool TerrainLoader::Open(const std::string &filename)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if (file==INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    fileHandle=file;
+
+    LARGE_INTEGER fsize;
+    GetFileSizeEx(file,&fsize);
+    size=(size_t)fsize.QuadPart;
+
+    mapHandle=CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+    if (mapHandle!=NULL)
+    {
+        base=(const unsigned char*)MapViewOfFile((HANDLE)mapHandle,FILE_MAP_READ,0,0,0);
+    }
+#else
+    fd = open(filename.c_str(),O_RDONLY);
+    if (fd<0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd,&st)==0 && st.st_size>0)
+    {
+        size=(size_t)st.st_size;
+        void *ptr = mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+        base = (ptr==MAP_FAILED) ? NULL : (const unsigned char*)ptr;
+    }
+#endif
+
+    if (base==NULL || size<sizeof(TerrainFileHeader))
+    {
+        Close();
+        return false;
+    }
+
+    //********************
+    // Validate the Layout
+    //********************
+    header=(const TerrainFileHeader*)base;
+    bool valid = header->magic==TERRAINFILE_MAGIC && header->version==TERRAINFILE_VERSION
+              && header->width>1 && header->height>1 && header->chunkCount>=0
+              && header->chunkTableOffset+(uint64_t)header->chunkCount*sizeof(TerrainFileChunk)<=size;
+
+    if (valid && IsPacked())
+    {
+        // Bands in file order, all inside the file
+        const uint64_t nb = (header->height+TERRAINFILE_BAND-1)/TERRAINFILE_BAND;
+        valid = header->heightOffset+(nb+1)*sizeof(uint64_t)<=size;
+        if (valid)
+        {
+            bands=(const uint64_t*)(base+header->heightOffset);
+            valid = bands[0]>=header->heightOffset+(nb+1)*sizeof(uint64_t) && bands[nb]<=size;
+            for (uint64_t b=0; b<nb && valid; ++b)
+            {
+                valid = bands[b]<=bands[b+1];
+            }
+        }
+    }
+    else if (valid)
+    {
+        valid = header->heightOffset+(uint64_t)header->width*header->height*sizeof(uint16_t)<=size;
+    }
+
+    if (valid && (HasVerts() || IsAdaptive()) && header->vertexSize!=sizeof(Vertex))
+    {
+        valid=false;
+    }
+
+    if (valid)
+    {
+        chunks=(const TerrainFileChunk*)(base+header->chunkTableOffset);
+        for (int c=0; c<header->chunkCount && valid; ++c)
+        {
+            valid = chunks[c].vertOffset+chunks[c].vertCount*sizeof(Vertex)<=size
+                 && chunks[c].idxOffset+chunks[c].idxCount*sizeof(uint32_t)<=size;
+        }
+    }
+
+    if (!valid)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+};
+
+//******************************************//
+//              Unmap the File              //
+//******************************************//
+void TerrainLoader::Close()
+{
+#ifdef _WIN32
+    if (base!=NULL)
+    {
+        UnmapViewOfFile(base);
+    }
+    if (mapHandle!=NULL)
+    {
+        CloseHandle((HANDLE)mapHandle);
+    }
+    if (fileHandle!=NULL)
+    {
+        CloseHandle((HANDLE)fileHandle);
+    }
+    fileHandle=NULL;
+    mapHandle=NULL;
+#else
+    if (base!=NULL)
+    {
+        munmap((void*)base,size);
+    }
+    if (fd>=0)
+    {
+        close(fd);
+    }
+    fd=-1;
+#endif
+
+    base=NULL;
+    size=0;
+    header=NULL;
+    chunks=NULL;
+    bands=NULL;
+};
+
+//******************************************//
+//         Copy the Heights to a Field      //
+//******************************************//
+bool TerrainLoader::CopyHeights(HeightField16 &field) const
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+
+    const int w = header->width;
+    const int h = header->height;
+    if (field.Width()!=w || field.Height()!=h)
+    {
+        if (!field.Allocate(w,h))
+        {
+            return false;
+        }
+    }
+
+    if (IsPacked())
+    {
+        // Bands unpack on their own
+        const int nb = (h+TERRAINFILE_BAND-1)/TERRAINFILE_BAND;
+        bool ok=true;
+
+        #pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+        for (int b=0; b<nb; ++b)
+        {
+            const int i0 = b*TERRAINFILE_BAND;
+            ok = HeightPack::Unpack(base+bands[b],(size_t)(bands[b+1]-bands[b]),w,std::min(TERRAINFILE_BAND,h-i0),
+                                    field.Row(i0),field.Stride()) && ok;
+        }
+
+        return ok;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i=0; i<h; ++i)
+    {
+        memcpy(field.Row(i),HeightRow(i),w*sizeof(uint16_t));
+    }
+
+    return true;
+};
+
+//******************************************//
+//              Write a File                //
+//******************************************//
+// Zero fill the file up to the next page boundary
+static void PadToPage(std::ofstream &file)
+{
+    static const char zeros[TERRAINFILE_PAGE] = {0};
+
+    uint64_t pos = (uint64_t)file.tellp();
+    uint64_t pad = (TERRAINFILE_PAGE-pos%TERRAINFILE_PAGE)%TERRAINFILE_PAGE;
+    file.write(zeros,pad);
+};
+
+/*
+Files are written next to the target and moved over
+it once complete, so a failed or interrupted write
+never leaves a broken terrain behind.
+*/
+static std::string TempName(const std::string &filename)
+{
+    return filename+".tmp";
+};
+
+// Move the finished temporary file over filename, or drop it if writing failed
+static bool ReplaceFile(const std::string &filename,bool written)
+{
+    const std::string tmp=TempName(filename);
+    if (written)
+    {
+#ifdef _WIN32
+        written = MoveFileExA(tmp.c_str(),filename.c_str(),MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+        written = rename(tmp.c_str(),filename.c_str())==0;
+#endif
+    }
+
+    if (!written)
+    {
+        remove(tmp.c_str());
+    }
+    return written;
+};
+
+static uint64_t PageRound(uint64_t bytes)
+{
+    return ((bytes+TERRAINFILE_PAGE-1)/TERRAINFILE_PAGE)*TERRAINFILE_PAGE;
+};
+
+// Grid rect and bounding box of chunk c, heights in [lo,hi]
+static void SetupChunk(const TerrainFileHeader &header,int c,uint16_t lo,uint16_t hi,TerrainFileChunk &ch)
+{
+    const int N = header.Elen;
+    const float shift = header.spacing*(header.width-1)/2.0f;
+
+    ch.i0=(N-1)*(c/header.Nsub);
+    ch.j0=(N-1)*(c%header.Nsub);
+    ch.rows=N;
+    ch.cols=N;
+
+    ch.bmin[0]=ch.j0*header.spacing-shift;
+    ch.bmin[1]=header.heightMult*(lo-header.midpoint);
+    ch.bmin[2]=ch.i0*header.spacing-shift;
+    ch.bmax[0]=(ch.j0+N-1)*header.spacing-shift;
+    ch.bmax[1]=header.heightMult*(hi-header.midpoint);
+    ch.bmax[2]=(ch.i0+N-1)*header.spacing-shift;
+
+    ch.vertOffset=0;
+    ch.vertCount=0;
+    ch.idxOffset=0;
+    ch.idxCount=0;
+};
+
+bool TerrainLoader::Write(const std::string &filename,TerrainFileHeader header,const HeightField16 &heights,
+                          const std::vector< std::vector<Vertex> > *meshVerts,
+                          const std::vector< std::vector<GLuint> > *meshIdxs)
+{
+    const int w = heights.Width();
+    const int h = heights.Height();
+    const int Nsub = header.Nsub;
+    const int N = header.Elen;
+
+    if (w<2 || h<2 || Nsub<1 || N<2 || (N-1)*Nsub+1!=w || (N-1)*Nsub+1!=h)
+    {
+        return false;
+    }
+
+    const bool verts = meshVerts!=NULL && (int)meshVerts->size()==Nsub*Nsub;
+    const bool adaptive = verts && meshIdxs!=NULL && (int)meshIdxs->size()==Nsub*Nsub;
+
+    //********************
+    //  Section Offsets
+    //********************
+    header.magic=TERRAINFILE_MAGIC;
+    header.version=TERRAINFILE_VERSION;
+    header.vertexSize=sizeof(Vertex);
+    header.flags = adaptive ? TERRAINFILE_ADAPTIVE : (verts ? TERRAINFILE_VERTS : 0);
+    header.width=w;
+    header.height=h;
+    header.chunkCount=Nsub*Nsub;
+    header.chunkTableOffset=TERRAINFILE_PAGE;
+    header.heightOffset=header.chunkTableOffset+PageRound((uint64_t)header.chunkCount*sizeof(TerrainFileChunk));
+
+    const uint64_t blobBytes = PageRound((uint64_t)N*N*sizeof(Vertex));
+    uint64_t next = header.heightOffset+PageRound((uint64_t)w*h*sizeof(uint16_t));
+
+    //********************
+    //    Chunk Table
+    //********************
+    std::vector<TerrainFileChunk> table(header.chunkCount);
+
+    #pragma omp parallel for
+    for (int c=0; c<header.chunkCount; ++c)
+    {
+        const int i0 = (N-1)*(c/Nsub);
+        const int j0 = (N-1)*(c%Nsub);
+
+        uint16_t lo=std::numeric_limits<uint16_t>::max();
+        uint16_t hi=0;
+        for (int i=i0; i<i0+N; ++i)
+        {
+            const uint16_t *row = heights.Row(i);
+            for (int j=j0; j<j0+N; ++j)
+            {
+                lo = std::min(lo,row[j]);
+                hi = std::max(hi,row[j]);
+            }
+        }
+
+        TerrainFileChunk &ch = table[c];
+        SetupChunk(header,c,lo,hi,ch);
+        ch.vertOffset = (verts && !adaptive) ? next+(uint64_t)c*blobBytes : 0;
+        ch.vertCount = (verts && !adaptive) ? (uint64_t)N*N : 0;
+    }
+
+    if (adaptive)
+    {
+        // Blob sizes differ per chunk, all verts come before all indices
+        for (int c=0; c<header.chunkCount; ++c)
+        {
+            table[c].vertOffset=next;
+            table[c].vertCount=(*meshVerts)[c].size();
+            next+=PageRound(table[c].vertCount*sizeof(Vertex));
+        }
+        for (int c=0; c<header.chunkCount; ++c)
+        {
+            table[c].idxOffset=next;
+            table[c].idxCount=(*meshIdxs)[c].size();
+            next+=PageRound(table[c].idxCount*sizeof(uint32_t));
+        }
+    }
+    else if (verts)
+    {
+        next += (uint64_t)header.chunkCount*blobBytes;
+    }
+    header.fileSize=next;
+
+    //********************
+    //   Write Sections
+    //********************
+    std::ofstream file(TempName(filename).c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    file.write((const char*)&header,sizeof(TerrainFileHeader));
+    PadToPage(file);
+
+    file.write((const char*)&table[0],table.size()*sizeof(TerrainFileChunk));
+    PadToPage(file);
+
+    for (int i=0; i<h; ++i)
+    {
+        file.write((const char*)heights.Row(i),w*sizeof(uint16_t));
+    }
+    PadToPage(file);
+
+    if (adaptive)
+    {
+        for (int c=0; c<header.chunkCount; ++c)
+        {
+            const std::vector<Vertex> &mv = (*meshVerts)[c];
+            if (!mv.empty())
+            {
+                file.write((const char*)&mv[0],mv.size()*sizeof(Vertex));
+            }
+            PadToPage(file);
+        }
+
+        for (int c=0; c<header.chunkCount; ++c)
+        {
+            const std::vector<GLuint> &mi = (*meshIdxs)[c];
+            if (!mi.empty())
+            {
+                file.write((const char*)&mi[0],mi.size()*sizeof(GLuint));
+            }
+            PadToPage(file);
+        }
+    }
+    else if (verts)
+    {
+        for (int c=0; c<header.chunkCount; ++c)
+        {
+            const std::vector<Vertex> &mv = (*meshVerts)[c];
+            std::vector<Vertex> blank;
+            const Vertex *src = &mv[0];
+
+            // A mesh of the wrong size is written flat rather than breaking the layout
+            if ((int)mv.size()!=N*N)
+            {
+                blank.resize((size_t)N*N);
+                src = &blank[0];
+            }
+
+            file.write((const char*)src,(size_t)N*N*sizeof(Vertex));
+            PadToPage(file);
+        }
+    }
+
+    file.close();
+    return ReplaceFile(filename,!file.fail());
+};
+
+//******************************************//
+//          Write Packed Heights            //
+//******************************************//
+/*
+The header, chunk table and band table are written
+as placeholders first, then the bands are asked
+for, packed and written one after the other. The
+chunk bounds and band offsets are only known at
+the end, so their placeholders are written over.
+*/
+bool TerrainLoader::WritePacked(const std::string &filename,TerrainFileHeader header,int width,int height,const RowSource &rows)
+{
+    const int Nsub = header.Nsub;
+    const int N = header.Elen;
+
+    if (width<2 || height<2 || Nsub<1 || N<2 || (N-1)*Nsub+1!=width || (N-1)*Nsub+1!=height)
+    {
+        return false;
+    }
+
+    const int nb = (height+TERRAINFILE_BAND-1)/TERRAINFILE_BAND;
+
+    //********************
+    //  Section Offsets
+    //********************
+    header.magic=TERRAINFILE_MAGIC;
+    header.version=TERRAINFILE_VERSION;
+    header.vertexSize=sizeof(Vertex);
+    header.flags=TERRAINFILE_PACKED;
+    header.width=width;
+    header.height=height;
+    header.chunkCount=Nsub*Nsub;
+    header.chunkTableOffset=TERRAINFILE_PAGE;
+    header.heightOffset=header.chunkTableOffset+PageRound((uint64_t)header.chunkCount*sizeof(TerrainFileChunk));
+
+    std::vector<TerrainFileChunk> table(header.chunkCount);
+    std::vector<uint64_t> offsets(nb+1,0);
+
+    std::ofstream file(TempName(filename).c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    file.write((const char*)&header,sizeof(TerrainFileHeader));
+    PadToPage(file);
+    file.write((const char*)&table[0],table.size()*sizeof(TerrainFileChunk));
+    PadToPage(file);
+    file.write((const char*)&offsets[0],offsets.size()*sizeof(uint64_t));
+
+    //********************
+    //    Height Bands
+    //********************
+    std::vector<uint16_t> lo(header.chunkCount,std::numeric_limits<uint16_t>::max());
+    std::vector<uint16_t> hi(header.chunkCount,0);
+    std::vector<uint16_t> band((size_t)TERRAINFILE_BAND*width);
+    std::vector<uint8_t> packed;
+
+    for (int b=0; b<nb && file.good(); ++b)
+    {
+        const int i0 = b*TERRAINFILE_BAND;
+        const int n = std::min(TERRAINFILE_BAND,height-i0);
+        rows(i0,n,&band[0]);
+
+        // Chunk bounds, border rows belong to the chunks on both sides
+        for (int k=0; k<n; ++k)
+        {
+            const int i = i0+k;
+            const uint16_t *row = &band[(size_t)k*width];
+            const int m1 = std::min(i/(N-1),Nsub-1);
+            const int m0 = (i%(N-1)==0 && i>0) ? i/(N-1)-1 : m1;
+
+            for (int c=0; c<Nsub; ++c)
+            {
+                uint16_t rlo=std::numeric_limits<uint16_t>::max();
+                uint16_t rhi=0;
+                for (int j=(N-1)*c; j<(N-1)*c+N; ++j)
+                {
+                    rlo = std::min(rlo,row[j]);
+                    rhi = std::max(rhi,row[j]);
+                }
+
+                for (int m=m0; m<=m1; ++m)
+                {
+                    lo[m*Nsub+c] = std::min(lo[m*Nsub+c],rlo);
+                    hi[m*Nsub+c] = std::max(hi[m*Nsub+c],rhi);
+                }
+            }
+        }
+
+        packed.clear();
+        HeightPack::Pack(&band[0],width,n,packed);
+
+        offsets[b]=(uint64_t)file.tellp();
+        file.write((const char*)&packed[0],packed.size());
+    }
+
+    offsets[nb]=(uint64_t)file.tellp();
+    header.fileSize=offsets[nb];
+
+    for (int c=0; c<header.chunkCount; ++c)
+    {
+        SetupChunk(header,c,lo[c],hi[c],table[c]);
+    }
+
+    //********************
+    //  Final Placeholders
+    //********************
+    file.seekp(0);
+    file.write((const char*)&header,sizeof(TerrainFileHeader));
+    file.seekp(header.chunkTableOffset);
+    file.write((const char*)&table[0],table.size()*sizeof(TerrainFileChunk));
+    file.seekp(header.heightOffset);
+    file.write((const char*)&offsets[0],offsets.size()*sizeof(uint64_t));
+
+    file.close();
+    return ReplaceFile(filename,!file.fail());
+};
@@ -0,0 +1,206 @@
+#ifndef TERRAINLOADER_C
+#define TERRAINLOADER_C
+
+#include "../../Headers/headerscpp.h"
+#include "../../Headers/headersogl.h"
+#include "../Handlers/ModelHandler/base_classes.h"
+#include "../Tools/heightfield.hpp"
+#include <stdint.h>
+#include <functional>
+
+//******************************************//
+//           Terrain File Layout            //
+//******************************************//
+/*
+    Binary .ter file, little endian:
+
+        page 0      TerrainFileHeader
+        page 1..    chunk table (TerrainFileChunk x chunkCount)
+        next page   heights, width x height uint16 rows,
+                    or with TERRAINFILE_PACKED the band table
+                    followed by the packed bands
+        next pages  vertex blobs, one per chunk, each
+                    page aligned (only with TERRAINFILE_VERTS
+                    or TERRAINFILE_ADAPTIVE)
+        next pages  index blobs, one per chunk, each page
+                    aligned (only with TERRAINFILE_ADAPTIVE)
+
+    TERRAINFILE_PACKED heights come in bands of
+    TERRAINFILE_BAND rows, each packed on its own
+    (HeightPack). The band table holds the
+    bands+1 file offsets where each band starts,
+    the last one the end of the heights.
+
+    TERRAINFILE_VERTS chunks hold the full grid of
+    Elen x Elen verts. TERRAINFILE_ADAPTIVE chunks hold
+    only the verts of an adaptive mesh (TerrainRTIN)
+    plus its triangle list of chunk vert indices.
+
+    Every section starts on a TERRAINFILE_PAGE boundary,
+    so a mapped file hands out the heights and the vertex
+    blobs as plain pointers, ready for memcpy or
+    glBufferSubData. Nothing is parsed on load
+    except packed heights.
+*/
+#define TERRAINFILE_MAGIC 0x5245544A // "JTER"
+#define TERRAINFILE_VERSION 3
+#define TERRAINFILE_PAGE 4096
+#define TERRAINFILE_BAND 64 // Rows per packed height band
+
+enum TerrainFileFlags
+{
+    TERRAINFILE_VERTS=1, // Full grid vertex blobs follow the heights
+    TERRAINFILE_ADAPTIVE=2, // Adaptive mesh vertex and index blobs follow the heights
+    TERRAINFILE_PACKED=4 // Heights are packed bands
+};
+
+struct TerrainFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vertexSize; // sizeof(Vertex) the blobs were written with
+
+    int32_t width; // Heights per row
+    int32_t height; // Rows
+    int32_t Nsub; // Chunks per terrain edge
+    int32_t Elen; // Verts per chunk edge
+
+    float spacing; // Distance between verts
+    float heightMult; // Height multiplier
+    float midpoint; // Height shift applied to the verts
+    float relativeHeight[4]; // Texture switching heights
+
+    float Ka[3]; // Material
+    float Kd[3];
+    float Ks[3];
+    float shine;
+
+    char textures[4][64]; // Landscape texture files
+    char shader[64]; // Shader name
+
+    uint64_t chunkTableOffset;
+    uint64_t heightOffset;
+    uint64_t fileSize;
+    int32_t chunkCount;
+    float heightScale; // Height samples per editor height unit (0 in older files, read as 1)
+
+    TerrainFileHeader()
+    {
+        memset(this,0,sizeof(TerrainFileHeader));
+        magic=TERRAINFILE_MAGIC;
+        version=TERRAINFILE_VERSION;
+        vertexSize=sizeof(Vertex);
+    };
+};
+
+struct TerrainFileChunk
+{
+    int32_t i0,j0; // First grid row and column
+    int32_t rows,cols; // Verts
+    float bmin[3]; // Bounding box of the verts
+    float bmax[3];
+    uint64_t vertOffset; // 0 without vertex blobs
+    uint64_t vertCount;
+    uint64_t idxOffset; // 0 without index blobs
+    uint64_t idxCount; // uint32 indices, 3 per triangle
+};
+
+//******************************************//
+//          Terrain Loader Class            //
+//******************************************//
+/*
+    Maps a .ter file read only. The header, chunk
+    table, height rows and vertex blobs are read
+    straight from the mapping, which stays valid
+    until Close().
+
+    Write() produces the file. Every section is
+    written with one call per row or chunk.
+    WritePacked() streams packed heights only, for
+    saves that run beside the editor. Both write
+    <filename>.tmp and move it over the file once
+    it is complete.
+*/
+class TerrainLoader
+{
+    const unsigned char *base;
+    size_t size;
+
+#ifdef _WIN32
+    void *fileHandle;
+    void *mapHandle;
+#else
+    int fd;
+#endif
+
+    const TerrainFileHeader *header;
+    const TerrainFileChunk *chunks;
+    const uint64_t *bands; // Band table of packed heights
+
+public:
+    TerrainLoader();
+    ~TerrainLoader() {Close();};
+
+    // Map and validate a file
+    bool Open(const std::string &filename);
+    void Close();
+
+    bool IsOpen() const {return base!=NULL;};
+    const TerrainFileHeader& Header() const {return *header;};
+
+    bool HasVerts() const {return (header->flags & TERRAINFILE_VERTS)!=0;};
+    bool IsAdaptive() const {return (header->flags & TERRAINFILE_ADAPTIVE)!=0;};
+    bool IsPacked() const {return (header->flags & TERRAINFILE_PACKED)!=0;};
+    int NumChunks() const {return header->chunkCount;};
+    const TerrainFileChunk& Chunk(int c) const {return chunks[c];};
+
+    // Row i of the heights (not of packed heights, see CopyHeights)
+    const uint16_t* HeightRow(int i) const
+    {
+        return (const uint16_t*)(base+header->heightOffset)+(size_t)i*header->width;
+    };
+
+    // Verts of chunk c (NULL without vertex blobs)
+    const Vertex* ChunkVerts(int c) const
+    {
+        return chunks[c].vertOffset ? (const Vertex*)(base+chunks[c].vertOffset) : NULL;
+    };
+
+    // Triangle list of chunk c (NULL without index blobs)
+    const uint32_t* ChunkIdxs(int c) const
+    {
+        return chunks[c].idxOffset ? (const uint32_t*)(base+chunks[c].idxOffset) : NULL;
+    };
+
+    // Copy (or unpack) the heights into a field, (re)allocated to the file size
+    bool CopyHeights(HeightField16 &field) const;
+
+    /*
+    Write a terrain. Chunk (m,n) of the Nsub x Nsub chunks
+    covers rows [(Elen-1)m,(Elen-1)m+Elen) and columns
+    [(Elen-1)n,(Elen-1)n+Elen) and is meshVerts[n+m*Nsub].
+    Pass meshVerts=NULL to write the heights only.
+
+    With meshIdxs the chunks are adaptive meshes:
+    meshVerts[c] holds any number of verts and
+    meshIdxs[c] the triangles over them.
+    */
+    static bool Write(const std::string &filename,TerrainFileHeader header,const HeightField16 &heights,
+                      const std::vector< std::vector<Vertex> > *meshVerts,
+                      const std::vector< std::vector<GLuint> > *meshIdxs=NULL);
+
+    // Fills rows [i0,i0+n) of the heights into dst, row k at dst+k*width
+    typedef std::function<void(int i0,int n,uint16_t *dst)> RowSource;
+
+    /*
+    Write a terrain of packed heights only, in the
+    chunk layout of header. The rows are asked for
+    band by band, so the heights never have to be
+    in one piece, and the chunk bounds are found on
+    the way.
+    */
+    static bool WritePacked(const std::string &filename,TerrainFileHeader header,int width,int height,const RowSource &rows);
+};
+
+#endif
@@ -114,3 +114,9 @@ void Texture::useTexture (Shader &shader, GLint texIdx)
     glBindTexture(GL_TEXTURE_2D, this->TextureID);
     glUniform1i(glGetUniformLocation(shader.Program, uniform.c_str()), texIdx);
 };
+
+void Texture::bindTexture (GLint texIdx)
+{
+    glActiveTexture(GL_TEXTURE0 + texIdx);
+    glBindTexture(GL_TEXTURE_2D, this->TextureID);
+};
@@ -57,6 +57,9 @@ class Texture
 
     void useTexture (Shader &shader, GLint texIdx);
 
+    // Bind to a texture unit, the sampler uniform must already point at it
+    void bindTexture (GLint texIdx);
+
     void ProduceMemoryUsage();
 
     double MemSize();
@@ -19,6 +19,7 @@ void SaveToolbox::Init(std::string buttontext,float posx, float posy,Properties
 
     lh=0.13f;
     lw=0.2f;
+    hint="";
 
     // Setup the frame
     frame.Init(0.2f,0.13f,0.01f,*props);
@@ -52,6 +53,11 @@ void SaveToolbox::DrawToolBox()
     text.RenderTextCentered("Insert Filename: ",1,x-0.07,1,y+0.03,1.0f,glm::vec3(1.0f));
     insertbox.DrawInsBox();
 
+    if (!hint.empty())
+    {
+        text.RenderTextLeftJustified(hint,x-0.19,y-0.11,0.7f,glm::vec3(0.8f));
+    }
+
     buttons.DrawButtons();
 };
 
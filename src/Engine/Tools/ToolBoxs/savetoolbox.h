@@ -24,6 +24,7 @@ class SaveToolbox
     float swidth,sheight;
     float x,y;
     float lh,lw;
+    std::string hint; // Small print under the file name
 
     double dt;//For press timing
 
@@ -56,6 +57,9 @@ public:
 
     // Get Filename
     std::string GetFileName();
+
+    // Line of help drawn under the file name ("" for none)
+    void SetHint(std::string hint) {this->hint=hint;};
 };
 
 
@@ -17,44 +17,50 @@ void TerrainCreationToolbox::Init(float posx, float posy,Properties *props,ISoun
     this->x=posx;
     this->y=posy;
 
-    lh=0.21f;
+    lh=0.24f;
     lw=0.3f;
 
     // Setup the frame
-    frame.Init(0.3f,0.21f,0.01f,*props);
+    frame.Init(0.3f,0.24f,0.01f,*props);
     frame.SetColors(glm::vec4(0.6f,0.6f,0.6f,0.5f),glm::vec4(0.2f,0.2f,0.2f,1.0f));
 
     // Setup the insertion boxes
-    insertbox[0].Init(x+0.05,y+0.15,0.04f,"solid",*props,audioengine,0);
+    insertbox[0].Init(x+0.05,y+0.21,0.04f,"solid",*props,audioengine,0);
     std::stringstream ss1;
     ss1 << log2(atoi(tcdata.terrainSize.c_str())-1);
     insertbox[0].SetData(ss1.str());
 
-    insertbox[1].Init(x+0.05,y+0.09,0.04f,"solid",*props,audioengine,0);
+    insertbox[1].Init(x+0.05,y+0.15,0.04f,"solid",*props,audioengine,0);
     std::stringstream ss2;
     ss2 << tcdata.heightVariation[0];
     insertbox[1].SetData(ss2.str());
 
-    insertbox[2].Init(x+0.05,y+0.03,0.04f,"solid",*props,audioengine,0);
+    insertbox[2].Init(x+0.05,y+0.09,0.04f,"solid",*props,audioengine,0);
     std::stringstream ss3;
     ss3 << tcdata.heightVariation[1];
     insertbox[2].SetData(ss3.str());
 
-    insertbox[3].Init(x+0.05,y-0.03,0.04f,"solid",*props,audioengine,0);
+    insertbox[3].Init(x+0.05,y+0.03,0.04f,"solid",*props,audioengine,0);
     std::stringstream ss4;
     ss4 << tcdata.heightVariation[2];
     insertbox[3].SetData(ss4.str());
 
-    insertbox[4].Init(x+0.05,y-0.09,0.04f,"solid",*props,audioengine,0);
+    insertbox[4].Init(x+0.05,y-0.03,0.04f,"solid",*props,audioengine,0);
     std::stringstream ss5;
     ss5 << tcdata.NSmooth;
     insertbox[4].SetData(ss5.str());
 
-    insertbox[5].Init(x+0.05,y-0.15,0.04f,"solid",*props,audioengine,0);
+    insertbox[5].Init(x+0.05,y-0.09,0.04f,"solid",*props,audioengine,0);
     std::stringstream ss6;
     ss6 << tcdata.SubDivision;
     insertbox[5].SetData(ss6.str());
 
+    insertbox[6].Init(x+0.05,y-0.15,0.04f,"solid",*props,audioengine,0);
+    insertbox[6].SetData(tcdata.seed);
+
+    insertbox[7].Init(x+0.05,y-0.21,0.04f,"solid",*props,audioengine,0);
+    insertbox[7].SetData(tcdata.generator);
+
     // Setup the screen writer class
     text.Setup("../Fonts/FreeSans.ttf",props->WinWidth,props->WinHeight,props->FontSize);
 
@@ -78,18 +84,23 @@ void TerrainCreationToolbox::DrawToolBox()
 
     std::stringstream ss;
     ss << "Terrain Size (" << pow(2,insertbox[0].FetchDataInteger())+1 << "):";
-    text.RenderTextLeftJustified(ss.str(),x-0.27,y+0.15,1.0f,glm::vec3(1.0f));
+    text.RenderTextLeftJustified(ss.str(),x-0.27,y+0.21,1.0f,glm::vec3(1.0f));
     insertbox[0].DrawInsBox();
-    text.RenderTextLeftJustified("Initial Heights (0-1000): ",x-0.27,y+0.09,1.0f,glm::vec3(1.0f));
+    text.RenderTextLeftJustified("Initial Heights (0-1000): ",x-0.27,y+0.15,1.0f,glm::vec3(1.0f));
     insertbox[1].DrawInsBox();
-    text.RenderTextLeftJustified("Initial Drop (0-1000): ",x-0.27,y+0.03,1.0f,glm::vec3(1.0f));
+    text.RenderTextLeftJustified("Initial Drop (0-1000): ",x-0.27,y+0.09,1.0f,glm::vec3(1.0f));
     insertbox[2].DrawInsBox();
-    text.RenderTextLeftJustified("Initial Rise (0-1000): ",x-0.27,y-0.03,1.0f,glm::vec3(1.0f));
+    text.RenderTextLeftJustified("Initial Rise (0-1000): ",x-0.27,y+0.03,1.0f,glm::vec3(1.0f));
     insertbox[3].DrawInsBox();
-    text.RenderTextLeftJustified("Smooth Cycles: ",x-0.27,y-0.09,1.0f,glm::vec3(1.0f));
+    text.RenderTextLeftJustified("Smooth Cycles: ",x-0.27,y-0.03,1.0f,glm::vec3(1.0f));
     insertbox[4].DrawInsBox();
-    text.RenderTextLeftJustified("Terrain SubDivision: ",x-0.27,y-0.15,1.0f,glm::vec3(1.0f));
+    text.RenderTextLeftJustified("Terrain SubDivision: ",x-0.27,y-0.09,1.0f,glm::vec3(1.0f));
     insertbox[5].DrawInsBox();
+    text.RenderTextLeftJustified("Seed (0=Random): ",x-0.27,y-0.15,1.0f,glm::vec3(1.0f));
+    insertbox[6].DrawInsBox();
+    // 0=midpoint displacement, 1=fBm, 2=ridged, 3=domain warped noise
+    text.RenderTextLeftJustified("Generator (0-3): ",x-0.27,y-0.21,1.0f,glm::vec3(1.0f));
+    insertbox[7].DrawInsBox();
 
     buttons.DrawButtons();
 };
@@ -109,6 +120,8 @@ void TerrainCreationToolbox::Cleanup()
     insertbox[3].Cleanup();
     insertbox[4].Cleanup();
     insertbox[5].Cleanup();
+    insertbox[6].Cleanup();
+    insertbox[7].Cleanup();
     text.Cleanup();
     buttons.Cleanup();
 };
@@ -132,6 +145,8 @@ int TerrainCreationToolbox::UpdateEvents(InputStruct &input)
     insertbox[3].UpdateEvents(input);
     insertbox[4].UpdateEvents(input);
     insertbox[5].UpdateEvents(input);
+    insertbox[6].UpdateEvents(input);
+    insertbox[7].UpdateEvents(input);
 
     int bpress = buttons.UpdateButtonEvents(input);
 
@@ -216,6 +231,8 @@ TerrainCreationData TerrainCreationToolbox::FetchTerrainCreationData()
     tcdata.heightVariation[2]=insertbox[3].FetchDataString();
     tcdata.NSmooth=insertbox[4].FetchDataString();
     tcdata.SubDivision=insertbox[5].FetchDataString();
+    tcdata.seed=insertbox[6].FetchDataString();
+    tcdata.generator=insertbox[7].FetchDataString();
 
     return tcdata;
 };
@@ -23,12 +23,14 @@ struct TerrainCreationData
     std::string NSmooth;
     std::string SubDivision;
     std::string heightVariation[3];
+    std::string seed;
+    std::string generator;
 
     TerrainCreationData() {};
 
-    TerrainCreationData(int terrainSize,int NSmooth,int SubDivision,glm::ivec3 heightVariation)
+    TerrainCreationData(int terrainSize,int NSmooth,int SubDivision,glm::ivec3 heightVariation,unsigned int seed,int generator)
     {
-        std::stringstream ss[6];
+        std::stringstream ss[8];
 
         ss[0] << terrainSize;
         this->terrainSize=ss[0].str();
@@ -47,6 +49,12 @@ struct TerrainCreationData
 
         ss[5] << SubDivision;
         this->SubDivision=ss[5].str();
+
+        ss[6] << seed;
+        this->seed=ss[6].str();
+
+        ss[7] << generator;
+        this->generator=ss[7].str();
     };
 
     //Class Assignment
@@ -58,10 +66,12 @@ struct TerrainCreationData
         this->heightVariation[0] = instance.heightVariation[0];
         this->heightVariation[1] = instance.heightVariation[1];
         this->heightVariation[2] = instance.heightVariation[2];
+        this->seed = instance.seed;
+        this->generator = instance.generator;
         return *this;
     };
 
-    void ReturnData(int &terrainSize,int &NSmooth,int &SubDivision,glm::ivec3 &heightVariation)
+    void ReturnData(int &terrainSize,int &NSmooth,int &SubDivision,glm::ivec3 &heightVariation,unsigned int &seed,int &generator)
     {
         terrainSize=atoi(this->terrainSize.c_str());
         NSmooth=atoi(this->NSmooth.c_str());
@@ -69,6 +79,8 @@ struct TerrainCreationData
         heightVariation.x=atoi(this->heightVariation[0].c_str());
         heightVariation.y=atoi(this->heightVariation[1].c_str());
         heightVariation.z=atoi(this->heightVariation[2].c_str());
+        seed=(unsigned int)strtoul(this->seed.c_str(),NULL,10);
+        generator=atoi(this->generator.c_str());
     };
 };
 
@@ -93,7 +105,7 @@ class TerrainCreationToolbox
     ScreenWriter text;
 
     // Testing!
-    InsertionBox insertbox[6];
+    InsertionBox insertbox[8];
     MenuButtons buttons;
 
     // Check if mouse is over button
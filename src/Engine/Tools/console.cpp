@@ -4,6 +4,7 @@
 // Declare global static variables -- Console Class
 std::vector<std::string> Console::cbuffer;
 bool Console::consoleActive;
+std::mutex Console::cbufferLock;
 
 // ----------------------
 // Initialize the Console
@@ -39,16 +40,22 @@ void Console::Draw ()
 {
     if (consoleActive)
     {
-        int N = cbuffer.size();
-        for(int i=0; i<N; ++i)
+        // Copy the lines drawn, a background job may print meanwhile
+        std::vector<std::string> lines;
         {
-            ctext.RenderTextLeftJustified(cbuffer[N-1-i],-0.95f,-0.95f+i*0.04,1.0f,glm::vec3(1.0f));
-            if (i>=20)
+            std::lock_guard<std::mutex> guard(cbufferLock);
+            int N = cbuffer.size();
+            for(int i=0; i<N && i<=20; ++i)
             {
-                break;
+                lines.push_back(cbuffer[N-1-i]);
             }
         }
 
+        for(int i=0; i<(int)lines.size(); ++i)
+        {
+            ctext.RenderTextLeftJustified(lines[i],-0.95f,-0.95f+i*0.04,1.0f,glm::vec3(1.0f));
+        }
+
         SetMemoryUsage();
 
         std::stringstream ss;
@@ -69,6 +76,8 @@ class.
 */
 void Console::SetMemoryUsage ()
 {
+    std::lock_guard<std::mutex> guard(cbufferLock);
+
     long long int bytes = 0;
     for (auto&& s : cbuffer)
         bytes += s.capacity();
@@ -95,6 +104,8 @@ void Console::Clear()
 
     // Cleanup
     ctext.Cleanup();
+
+    std::lock_guard<std::mutex> guard(cbufferLock);
     cbuffer.clear();
 };
 
@@ -134,9 +145,12 @@ void Console::DumpConsole(bool errchk)
     cDump << (now->tm_min) << ":";
     cDump << (now->tm_sec) << "\n";
 
-    for (auto&& line : cbuffer)
     {
-        cDump << line << std::endl;
+        std::lock_guard<std::mutex> guard(cbufferLock);
+        for (auto&& line : cbuffer)
+        {
+            cDump << line << std::endl;
+        }
     }
 
     if (errchk)
@@ -152,6 +166,7 @@ void Console::DumpConsole(bool errchk)
 //Prints a line the the console buffer
 void Console::cPrint(std::string line)
 {
+    std::lock_guard<std::mutex> guard(cbufferLock);
     cbuffer.push_back("> ");
     cbuffer.back().append(line);
     cbuffer.back().shrink_to_fit();
@@ -160,6 +175,7 @@ void Console::cPrint(std::string line)
 //Prints a line the the console buffer with blank before
 void Console::cPrint(bool spacef,std::string line)
 {
+    std::lock_guard<std::mutex> guard(cbufferLock);
     cbuffer.push_back(" ");
     cbuffer.back().shrink_to_fit();
     cbuffer.push_back("> ");
@@ -170,6 +186,7 @@ void Console::cPrint(bool spacef,std::string line)
 //Prints a line the the console buffer with blank after
 void Console::cPrint(std::string line,bool spaceb)
 {
+    std::lock_guard<std::mutex> guard(cbufferLock);
     cbuffer.push_back("> ");
     cbuffer.back().append(line);
     cbuffer.back().shrink_to_fit();
@@ -180,6 +197,7 @@ void Console::cPrint(std::string line,bool spaceb)
 //Prints a line the the console buffer with blank before and after
 void Console::cPrint(bool spacef,std::string line,bool spaceb)
 {
+    std::lock_guard<std::mutex> guard(cbufferLock);
     cbuffer.push_back(" ");
     cbuffer.push_back("> ");
     cbuffer.back().append(line);
@@ -8,6 +8,7 @@
 #include "../Loaders/properties.h"
 
 #include <iostream>
+#include <mutex>
 
 //_____________________________________________________________//
 //      **************************************************     //
@@ -23,6 +24,7 @@ class Console
     //------------------
     static std::vector<std::string> cbuffer; // Console buffer
     static bool consoleActive;
+    static std::mutex cbufferLock; // Background jobs print too
 
     //------------------
     //  Class Variables
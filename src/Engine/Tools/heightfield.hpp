@@ -0,0 +1,346 @@
+#ifndef HEIGHTFIELD_HPP
+#define HEIGHTFIELD_HPP
+
+#include "../../Headers/headerscpp.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+//******************************************//
+//             Height Tile View             //
+//******************************************//
+/*
+    Non-owning view into a rectangular block of
+    a HeightField. The view keeps the stride of
+    the field it was taken from, so rows are
+    still contiguous and aligned the same way
+    as in the parent buffer.
+*/
+template<typename T>
+struct HeightTile
+{
+    T *data; // First element of the tile
+    int width; // Number of columns
+    int height; // Number of rows
+    int stride; // Elements between the start of two rows
+
+    HeightTile() : data(NULL), width(0), height(0), stride(0) {};
+    HeightTile(T *data,int width,int height,int stride) : data(data), width(width), height(height), stride(stride) {};
+
+    // Row access
+    T* Row(int i) const {return data + (size_t)i*stride;};
+
+    // Element access (i=row, j=column)
+    T& operator()(int i,int j) const {return data[(size_t)i*stride + j];};
+};
+
+//******************************************//
+//            Height Region (Rect)          //
+//******************************************//
+/*
+    Half open rectangle of rows [i0,i1) and columns
+    [j0,j1). Used to track which part of a field
+    was changed (dirty region) since the last update.
+*/
+struct HeightRect
+{
+    int i0,i1;
+    int j0,j1;
+
+    HeightRect() {Clear();};
+    HeightRect(int i0,int i1,int j0,int j1) : i0(i0), i1(i1), j0(j0), j1(j1) {};
+
+    // Reset to the empty rect
+    void Clear()
+    {
+        i0=j0=std::numeric_limits<int>::max();
+        i1=j1=std::numeric_limits<int>::min();
+    };
+
+    bool Empty() const {return i0>=i1 || j0>=j1;};
+    int Rows() const {return Empty() ? 0 : i1-i0;};
+    int Cols() const {return Empty() ? 0 : j1-j0;};
+
+    // Grow to contain the element (i,j)
+    void Add(int i,int j)
+    {
+        i0=std::min(i0,i);
+        i1=std::max(i1,i+1);
+        j0=std::min(j0,j);
+        j1=std::max(j1,j+1);
+    };
+
+    // Grow to contain another rect
+    void Add(const HeightRect &r)
+    {
+        if (!r.Empty())
+        {
+            i0=std::min(i0,r.i0);
+            i1=std::max(i1,r.i1);
+            j0=std::min(j0,r.j0);
+            j1=std::max(j1,r.j1);
+        }
+    };
+
+    // Pad by n elements on every side (halo)
+    HeightRect Padded(int n) const
+    {
+        return Empty() ? *this : HeightRect(i0-n,i1+n,j0-n,j1+n);
+    };
+
+    // Clip to a height x width field
+    HeightRect Clipped(int height,int width) const
+    {
+        HeightRect r(std::max(i0,0),std::min(i1,height),std::max(j0,0),std::min(j1,width));
+        if (r.Empty())
+        {
+            r.Clear();
+        }
+        return r;
+    };
+
+    // Overlap of two rects (empty if they do not touch)
+    HeightRect Intersect(const HeightRect &r) const
+    {
+        HeightRect o(std::max(i0,r.i0),std::min(i1,r.i1),std::max(j0,r.j0),std::min(j1,r.j1));
+        if (o.Empty())
+        {
+            o.Clear();
+        }
+        return o;
+    };
+};
+
+//******************************************//
+//            Height Field Class            //
+//******************************************//
+/*
+    The HeightField class stores a two dimensional
+    grid of heights in a single row-major buffer.
+    Every row starts on a HEIGHTFIELD_ALIGN byte
+    boundary, the distance between rows is given
+    by Stride() (in elements, not bytes).
+
+    Elements are accessed as (i,j) where i is
+    the row (z direction) and j is the column
+    (x direction), the same ordering that the
+    old vector<vector<int>> storage used.
+*/
+#define HEIGHTFIELD_ALIGN 64
+
+template<typename T>
+class HeightField
+{
+    T *data;
+    int width;
+    int height;
+    int stride;
+
+    //*****************************
+    // Aligned Allocation Helpers
+    //*****************************
+    static T* AlignedAlloc(size_t bytes)
+    {
+        void *ptr=NULL;
+#ifdef _WIN32
+        ptr=_aligned_malloc(bytes,HEIGHTFIELD_ALIGN);
+#else
+        if (posix_memalign(&ptr,HEIGHTFIELD_ALIGN,bytes)!=0)
+        {
+            ptr=NULL;
+        }
+#endif
+        return static_cast<T*>(ptr);
+    };
+
+    static void AlignedFree(T *ptr)
+    {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    };
+
+public:
+    typedef T ValueType;
+
+    /*---------------------------
+         Public Constructors
+    ---------------------------*/
+    HeightField() : data(NULL), width(0), height(0), stride(0) {};
+
+    HeightField(int width,int height) : HeightField()
+    {
+        Allocate(width,height);
+    };
+
+    HeightField(const HeightField &instance) : HeightField()
+    {
+        *this=instance;
+    };
+
+    ~HeightField()
+    {
+        Free();
+    };
+
+    //Class Assignment (deep copy)
+    HeightField& operator=(const HeightField &instance)
+    {
+        if (this!=&instance)
+        {
+            if (width!=instance.width || height!=instance.height)
+            {
+                Allocate(instance.width,instance.height);
+            }
+
+            if (data!=NULL)
+            {
+                memcpy(data,instance.data,MemSize());
+            }
+        }
+        return *this;
+    };
+
+    /*---------------------------
+        Storage Functionality
+    ---------------------------*/
+    // Allocate a width x height field, contents are undefined
+    bool Allocate(int width,int height)
+    {
+        Free();
+
+        int elemAlign = HEIGHTFIELD_ALIGN/sizeof(T);
+        if (elemAlign<1)
+        {
+            elemAlign=1;
+        }
+
+        this->stride = ((width+elemAlign-1)/elemAlign)*elemAlign;
+        this->width = width;
+        this->height = height;
+
+        size_t bytes = (size_t)this->stride*(size_t)height*sizeof(T);
+        if (bytes>0)
+        {
+            data=AlignedAlloc(bytes);
+        }
+
+        if (data==NULL)
+        {
+            this->width=0;
+            this->height=0;
+            this->stride=0;
+            return false;
+        }
+
+        return true;
+    };
+
+    // Release the buffer
+    void Free()
+    {
+        if (data!=NULL)
+        {
+            AlignedFree(data);
+        }
+
+        data=NULL;
+        width=0;
+        height=0;
+        stride=0;
+    };
+
+    // Swap buffers with another field (used for ping-pong passes)
+    void Swap(HeightField &other)
+    {
+        std::swap(data,other.data);
+        std::swap(width,other.width);
+        std::swap(height,other.height);
+        std::swap(stride,other.stride);
+    };
+
+    // Set every element (padding included) to val
+    void Fill(T val)
+    {
+        size_t N = (size_t)stride*(size_t)height;
+        std::fill(data,data+N,val);
+    };
+
+    /*---------------------------
+      Data Accessing Functions
+    ---------------------------*/
+    int Width() const {return width;};
+    int Height() const {return height;};
+    int Stride() const {return stride;};
+    bool Empty() const {return data==NULL;};
+
+    // Bytes held by the buffer (padding included)
+    size_t MemSize() const {return (size_t)stride*(size_t)height*sizeof(T);};
+
+    T* Data() {return data;};
+    const T* Data() const {return data;};
+
+    T* Row(int i) {return data + (size_t)i*stride;};
+    const T* Row(int i) const {return data + (size_t)i*stride;};
+
+    T& operator()(int i,int j) {return data[(size_t)i*stride + j];};
+    const T& operator()(int i,int j) const {return data[(size_t)i*stride + j];};
+
+    // View of the rows [i0,i0+h) and columns [j0,j0+w)
+    HeightTile<T> Tile(int i0,int j0,int h,int w)
+    {
+        return HeightTile<T>(Row(i0)+j0,w,h,stride);
+    };
+
+    HeightTile<const T> Tile(int i0,int j0,int h,int w) const
+    {
+        return HeightTile<const T>(Row(i0)+j0,w,h,stride);
+    };
+
+    // View of the whole field
+    HeightTile<T> Full() {return Tile(0,0,height,width);};
+    HeightTile<const T> Full() const {return Tile(0,0,height,width);};
+
+    //*****************************
+    //  Parallel Min/Max Reduction
+    //*****************************
+    /*
+    Returns the lowest and highest element of the
+    field. Padding elements are not considered.
+    */
+    void MinMax(T &low,T &high) const
+    {
+        T lo = std::numeric_limits<T>::max();
+        T hi = std::numeric_limits<T>::lowest();
+
+        const int h = height;
+        const int w = width;
+
+        #pragma omp parallel for reduction(min:lo) reduction(max:hi)
+        for (int i=0; i<h; ++i)
+        {
+            const T *row = Row(i);
+            for (int j=0; j<w; ++j)
+            {
+                lo = row[j] < lo ? row[j] : lo;
+                hi = row[j] > hi ? row[j] : hi;
+            }
+        }
+
+        low=lo;
+        high=hi;
+    };
+};
+
+// Storage types used by the terrain tools
+typedef HeightField<uint16_t> HeightField16;
+typedef HeightField<float> HeightField32;
+
+#endif
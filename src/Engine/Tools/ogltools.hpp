@@ -10,14 +10,109 @@
 namespace ogltools
 {
 
+//*********************************************
+//          Shared Index Buffer Handler
+//*********************************************
+/*
+One element buffer that any number of VAOs can
+bind, used when several meshes have the same
+index layout. The indices are stored as 16-bit
+when every index (and the restart index) fits,
+otherwise as 32-bit. With mode GL_TRIANGLE_STRIP
+the list is expected to separate strips with the
+primitive restart index 'restart'.
+*/
+struct IndexBufferHandler
+{
+    GLuint EBO;
+    GLenum mode; // GL_TRIANGLES or GL_TRIANGLE_STRIP
+    GLenum type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLuint restart; // Primitive restart index (strips only)
+    int idxSize;
+
+    IndexBufferHandler () : EBO(0), mode(GL_TRIANGLES), type(GL_UNSIGNED_INT), restart(0xFFFFFFFF), idxSize(0) {};
+
+    /*
+    maxIdx is the largest index in idxs that is not
+    a restart index. Restart indices in idxs should
+    be 0xFFFFFFFF, they are narrowed with the rest.
+    */
+    void GenBuffer(const std::vector<GLuint> &idxs,GLuint maxIdx,GLenum mode)
+    {
+        this->mode=mode;
+        idxSize=(int)idxs.size();
+
+        glGenBuffers(1, &this->EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+
+        if (maxIdx<0xFFFF)
+        {
+            std::vector<GLushort> compact(idxs.size());
+            for (size_t i=0; i<idxs.size(); ++i)
+            {
+                compact[i]=(GLushort)idxs[i];
+            }
+
+            type=GL_UNSIGNED_SHORT;
+            restart=0xFFFF;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, compact.size() * sizeof(GLushort), &compact[0], GL_STATIC_DRAW);
+        }
+        else
+        {
+            type=GL_UNSIGNED_INT;
+            restart=0xFFFFFFFF;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, idxs.size() * sizeof(GLuint), &idxs[0], GL_STATIC_DRAW);
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    };
+
+    // Bytes used on the GPU
+    size_t MemSize() const
+    {
+        return (size_t)idxSize * (type==GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+    };
+
+    // Turn primitive restart on for strips, call before drawing
+    void BeginDraw() const
+    {
+        if (mode==GL_TRIANGLE_STRIP)
+        {
+            glEnable(GL_PRIMITIVE_RESTART);
+            glPrimitiveRestartIndex(restart);
+        }
+    };
+
+    void EndDraw() const
+    {
+        if (mode==GL_TRIANGLE_STRIP)
+        {
+            glDisable(GL_PRIMITIVE_RESTART);
+        }
+    };
+
+    void ClearBuffer()
+    {
+        if (EBO)
+        {
+            glDeleteBuffers(1, &EBO);
+        }
+        EBO=0;
+        idxSize=0;
+    };
+};
+
 struct BufferHandler
 {
     GLuint VAO;
     GLuint VBO;
     GLuint EBO;
     int idxSize;
+    GLenum idxMode;
+    GLenum idxType;
+    bool sharedEBO; // EBO belongs to an IndexBufferHandler
 
-    BufferHandler () {};
+    BufferHandler () : VAO(0), VBO(0), EBO(0), idxSize(0), idxMode(GL_TRIANGLES), idxType(GL_UNSIGNED_INT), sharedEBO(false) {};
 
     //Class Assignment
     BufferHandler& operator=(const BufferHandler& instance)
@@ -26,12 +121,18 @@ struct BufferHandler
         this->VBO = instance.VBO;
         this->EBO = instance.EBO;
         this->idxSize=instance.idxSize;
+        this->idxMode=instance.idxMode;
+        this->idxType=instance.idxType;
+        this->sharedEBO=instance.sharedEBO;
         return *this;
     }
 
     void GenBuffers(std::vector<Vertex> &verts,std::vector<GLuint> &idxs)
     {
         idxSize=(int)idxs.size();
+        idxMode=GL_TRIANGLES;
+        idxType=GL_UNSIGNED_INT;
+        sharedEBO=false;
 
         glGenVertexArrays(1, &this->VAO);
         glGenBuffers(1, &this->VBO);
@@ -48,6 +149,88 @@ struct BufferHandler
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, idxs.size() * sizeof(GLuint), &idxs[0], GL_DYNAMIC_DRAW);
 
+        SetAttribPointers();
+
+        glBindVertexArray(0);
+    };
+
+    // Several meshes of one layout back to back in one VBO, drawn by base vertex
+    void GenBuffers(const std::vector< std::vector<Vertex> > &meshes,const IndexBufferHandler &shared)
+    {
+        idxSize=shared.idxSize;
+        idxMode=shared.mode;
+        idxType=shared.type;
+        sharedEBO=true;
+        EBO=shared.EBO;
+
+        size_t total=0;
+        for (size_t m=0; m<meshes.size(); ++m)
+        {
+            total+=meshes[m].size();
+        }
+
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBufferData(GL_ARRAY_BUFFER, total * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+
+        size_t first=0;
+        for (size_t m=0; m<meshes.size(); ++m)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), meshes[m].size() * sizeof(Vertex), &meshes[m][0]);
+            first+=meshes[m].size();
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+
+        SetAttribPointers();
+
+        glBindVertexArray(0);
+    };
+
+    // Room for nverts verts filled later with UpdateVerts, drawn by base vertex
+    void GenBuffers(size_t nverts,const IndexBufferHandler &shared)
+    {
+        idxSize=shared.idxSize;
+        idxMode=shared.mode;
+        idxType=shared.type;
+        sharedEBO=true;
+        EBO=shared.EBO;
+
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBufferData(GL_ARRAY_BUFFER, nverts * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+
+        SetAttribPointers();
+
+        glBindVertexArray(0);
+    };
+
+    // A VAO with only the shared index buffer, for shaders that build verts from gl_VertexID
+    void GenBuffers(const IndexBufferHandler &shared)
+    {
+        idxSize=shared.idxSize;
+        idxMode=shared.mode;
+        idxType=shared.type;
+        sharedEBO=true;
+        EBO=shared.EBO;
+        VBO=0;
+
+        glGenVertexArrays(1, &this->VAO);
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        glBindVertexArray(0);
+    };
+
+    void SetAttribPointers()
+    {
         // Set the vertex attribute pointers
         // Vertex Positions
         glEnableVertexAttribArray(0);
@@ -58,7 +241,21 @@ struct BufferHandler
         // Vertex Normals
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+    };
 
+    // Overwrite count verts starting at vertex first of the VBO
+    void UpdateVerts(const Vertex *verts,size_t first,size_t count)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), count * sizeof(Vertex), verts);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    };
+
+    // Draw several runs of the index buffer in one call (offsets in bytes), each run offset by its own base vertex
+    void DrawRanges(const GLsizei *counts,const GLvoid* const *offsets,const GLint *basevertex,int nranges)
+    {
+        glBindVertexArray(this->VAO);
+        glMultiDrawElementsBaseVertex(idxMode, counts, idxType, offsets, nranges, basevertex);
         glBindVertexArray(0);
     };
 
@@ -66,7 +263,7 @@ struct BufferHandler
     {
         // Draw mesh
         glBindVertexArray(this->VAO);
-        glDrawElements(GL_TRIANGLES, idxSize, GL_UNSIGNED_INT, 0);
+        glDrawElements(idxMode, idxSize, idxType, 0);
         glBindVertexArray(0);
     };
 
@@ -74,8 +271,14 @@ struct BufferHandler
     {
         idxSize=0;
         glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(1, &VBO);
-        glDeleteBuffers(1, &EBO);
+        if (VBO)
+        {
+            glDeleteBuffers(1, &VBO);
+        }
+        if (!sharedEBO)
+        {
+            glDeleteBuffers(1, &EBO);
+        }
     };
 };
 
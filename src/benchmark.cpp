@@ -0,0 +1,14 @@
+#include "Benchmark/terrainbenchmark.h"
+
+// Entry point of the headless terrain benchmark (Benchmark target)
+int main(int argc, char *argv[])
+{
+    TerrainBenchmark bench;
+
+    if (!bench.Init(argc,argv)) {
+        std::cerr << "Usage: TerrainBenchmark [-s sizes] [-t threads] [-r reps] [-n smooth] [-e iterations] [-o file.csv]" << std::endl;
+        return 1;
+    }
+
+    return bench.Run();
+}